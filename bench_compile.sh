@@ -0,0 +1,106 @@
+#!/bin/bash
+# Compile time scaling benchmark: generate workloads with bobgen at increasing sizes, compile each with bob --stats and
+#  append per-phase times and peak memory to a csv. Growth well above the size ratio points at an algorithmic regression.
+#  Growth is reported for bob's own time (every phase but link, which is mostly clang) and for each phase.
+#
+# Usage: ./bench_compile.sh [workload ...]
+#  BOB, BOBGEN    compiler and generator to use (default build/bob and build/bobgen)
+#  BOB_FLAGS      extra flags for bob (default -O0, llvm's optimizer would dominate the time)
+#  SIZES          workload sizes to run (default "250 500 1000 2000")
+#  CSV            output file (default bench_compile.csv), rows are appended
+
+BASE_DIR=`pwd`
+BOB=${BOB:-$BASE_DIR/build/bob}
+BOBGEN=${BOBGEN:-$BASE_DIR/build/bobgen}
+BOB_FLAGS=${BOB_FLAGS:--O0}
+SIZES=${SIZES:-"250 500 1000 2000"}
+CSV=${CSV:-$BASE_DIR/bench_compile.csv}
+WORKLOADS=${@:-"procs expr promote structs overloads poly imports"}
+
+# Phase names as bob --stats prints them, each gets a name_ms column. Keep in sync with PchzFromPhase.
+
+PHASES="parse,type check,fold,generate,optimize,emit objects,link"
+HEADER="workload,size,`echo "$PHASES" | sed 's/ /_/g; s/,/_ms,/g'`_ms,compile_ms,peak_kb"
+
+WORK_DIR=`mktemp -d`
+trap "rm -rf $WORK_DIR" EXIT
+
+if [ ! -f "$CSV" ]; then
+	echo "$HEADER" > "$CSV"
+elif [ "`head -n 1 "$CSV"`" != "$HEADER" ]; then
+	echo "$CSV has different columns than this version of the script, use another CSV"
+	exit 1
+fi
+
+for WORKLOAD in $WORKLOADS; do
+	PREV_SIZE=""
+	PREV_ROW=""
+	for SIZE in $SIZES; do
+		FILE="$WORKLOAD$SIZE"
+		if ! "$BOBGEN" $WORKLOAD $SIZE "$WORK_DIR/$FILE.bob"; then
+			exit 1
+		fi
+
+		# Run from the work dir so imports resolve and outputs land there
+
+		pushd "$WORK_DIR" > /dev/null
+		"$BOB" --stats $BOB_FLAGS $FILE.bob > $FILE.txt 2>&1
+		RESULT=$?
+		popd > /dev/null
+
+		if [ $RESULT != 0 ]; then
+			echo "$WORKLOAD $SIZE failed to compile:"
+			head -n 10 "$WORK_DIR/$FILE.txt"
+			continue
+		fi
+
+		# Phase lines look like "    type check    12.34 ms (5.6%)". Columns are matched by name, so a phase bob
+		#  prints that isn't in PHASES is an error instead of shifting the columns after it.
+
+		ROW=`awk -v phases="$PHASES" '
+			BEGIN { cPhase = split(phases, aPhase, ",") }
+			/^  Phase times:/ { inPhase = 1; next }
+			inPhase && match($0, / +[0-9.]+ ms/) { mpPhaseMs[substr($0, 5, RSTART - 5)] = substr($0, RSTART, RLENGTH - 3) + 0; next }
+			{ inPhase = 0 }
+			/^  Peak memory:/ { peak = $3 }
+			END {
+				for (phase in mpPhaseMs)
+				{
+					fKnown = 0
+					for (i = 1; i <= cPhase; ++i) if (aPhase[i] == phase) fKnown = 1
+					if (!fKnown) { print "Unknown phase \"" phase "\", add it to PHASES" > "/dev/stderr"; exit 1 }
+				}
+
+				compile = 0
+				for (i = 1; i <= cPhase; ++i)
+				{
+					row = row mpPhaseMs[aPhase[i]] + 0 ","
+					if (aPhase[i] != "link") compile += mpPhaseMs[aPhase[i]]
+				}
+				print row compile "," peak
+			}' "$WORK_DIR/$FILE.txt"` || exit 1
+		echo "$WORKLOAD,$SIZE,$ROW" >> "$CSV"
+
+		COMPILE_MS=`echo "$ROW" | awk -F, '{ print $(NF - 1) }'`
+		if [ -n "$PREV_ROW" ]; then
+			GROWTH=`awk -v phases="$PHASES" -v row="$ROW" -v prevRow="$PREV_ROW" -v size=$SIZE -v prevSize=$PREV_SIZE '
+				BEGIN {
+					cPhase = split(phases, aPhase, ",")
+					cCol = split(row, aMs, ",")
+					split(prevRow, aMsPrev, ",")
+					printf "%.2fx time for %.2fx size;", aMs[cCol - 1] / aMsPrev[cCol - 1], size / prevSize
+					for (i = 1; i <= cPhase; ++i)
+					{
+						if (aMsPrev[i] > 0) printf " %s %.2fx", aPhase[i], aMs[i] / aMsPrev[i]
+					}
+				}'`
+			echo "$WORKLOAD $SIZE: $COMPILE_MS ms excluding link ($GROWTH)"
+		else
+			echo "$WORKLOAD $SIZE: $COMPILE_MS ms excluding link"
+		fi
+		PREV_SIZE=$SIZE
+		PREV_ROW=$ROW
+	done
+done
+
+echo "Results appended to $CSV"
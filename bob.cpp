@@ -26,6 +26,15 @@
 #include <errno.h>
 #include <unistd.h>
 #include <execinfo.h>
+#include <sys/stat.h>
+#include <sys/time.h>
+#include <dirent.h>
+#include <time.h>
+#include <sys/resource.h>
+
+#include <thread>
+#include <mutex>
+#include <chrono>
 
 #if 0
 #include <ffi.h>
@@ -40,7 +49,10 @@
 
 #include "llvm-c/Core.h"
 #include "llvm-c/Analysis.h"
-#include "llvm-c/BitWriter.h"
+#include "llvm-c/DebugInfo.h"
+#include "llvm-c/Target.h"
+#include "llvm-c/TargetMachine.h"
+#include "llvm-c/Transforms/PassBuilder.h"
 
 // Compilation phases:
 // Parse to AST, no types
@@ -50,9 +62,10 @@
 //  2. Iterate over list performing type checking, if we find a declaration that is unresolved, push current progress
 //		onto the stack and switch to it.
 //  3. Continue type checking popping off the progress stack until we're done.
-// Generate: global variables then procedures.
+// Generate: procedures (optionally split across threads), global variables as they are referenced.
 //  Running modify procs during type checking will require generating and executing code during type checking.
 //  How to keep fast?
+// Optimize each module with llvm's pipeline and emit it as an object file, then link those with clang.
 
 #if __INTELLISENSE__
 #undef va_start(arg, va)
@@ -222,7 +235,13 @@ void ShowHelp()
 		"bob --run-unit-tests\n"
 		"\n"
 		"Options:\n"
-		"  --print-ast,-p          Print scheme representation of syntax tree\n");
+		"  --print-ast,-p          Print scheme representation of syntax tree\n"
+		"  --stats                 Print compiler statistics (phase times, counts, cache hit rates etc.)\n"
+		"  --trace FILE            Write phase, module and procedure timings to FILE (chrome://tracing format)\n"
+		"  -O0, -O1, -O2, -O3      Optimization level for generated code (default -O2)\n"
+		"  --jobs,-j N             Generate code on N threads, writing one object file per thread\n"
+		"  --cache DIR             Reuse objects for unchanged procedures from DIR, storing new ones there. Entries\n"
+		"                          unused for 30 days are deleted. Only inline procedures inline across entries.\n");
 }
 
 // BB (adrianb) Load file in pages?
@@ -396,17 +415,6 @@ const char * PchzFromKeyword(KEYWORD keyword)
 	return s_mpKeywordPchz[keyword];
 }
 
-KEYWORD KeywordFromPchz(const char * pChz)
-{
-	for (int keyword = KEYWORD_Invalid + 1; keyword < KEYWORD_Max; ++keyword)
-	{
-		if (strcmp(PchzFromKeyword(KEYWORD(keyword)), pChz) == 0)
-			return KEYWORD(keyword);
-	}
-
-	return KEYWORD_Invalid;
-}
-
 template <class T>
 T Max(const T & t0, const T & t1)
 {
@@ -436,11 +444,10 @@ void LogErrVa(const SErrorInfo & errinfo, const char * pChzErr, const char * pCh
 	}
 
 	vfprintf(stderr, pChzFormat, va);
+	fprintf(stderr, "\n");
 
 	if (errinfo.pChzLine)
 	{
-		fprintf(stderr, "\n");
-
 		char aChzLine[1024];
 		char aChzHighlight[DIM(aChzLine)];
 		{
@@ -486,9 +493,6 @@ void LogErrVa(const SErrorInfo & errinfo, const char * pChzErr, const char * pCh
 	}
 
 	fflush(stderr);
-	ExitErr();
-
-	va_end(va);
 }
 
 void ShowErr(const SErrorInfo & errinfo, const char * pChzFormat, ...)
@@ -679,6 +683,18 @@ inline typename TAry::TElement & Tail(TAry * pAry, int i = 0)
 	return pAry->a[pAry->c - i - 1];
 }
 
+template <class TAry, class T>
+bool FContains(const TAry & ary, const T & t)
+{
+	for (int i = 0; i < ary.c; ++i)
+	{
+		if (ary.a[i] == t)
+			return true;
+	}
+
+	return false;
+}
+
 template <class TAry, class T>
 inline int IFromP(const TAry * pAry, const T * p)
 {
@@ -776,6 +792,14 @@ inline T * PtAlloc(SPagedAlloc * pPagealloc, int cT = 1)
 }
 
 
+// NOTE (adrianb) Needs to be declared before the templates below, argument dependent lookup doesn't find it for
+//  char pointers.
+
+inline bool FIsKeyEqual(const char * pChz0, const char * pChz1)
+{
+	return pChz0 == pChz1 || strcmp(pChz0, pChz1) == 0;
+}
+
 template <class T>
 struct SSetNode
 {
@@ -833,7 +857,7 @@ void EnsureCount(SSet<T> * pSet, int c)
 	SSetNode<T> * aNode = pSet->aNode;
 
 	pSet->c = 0;
-	pSet->cMax = cMax + 256;
+	pSet->cMax = Max(cMax * 2, 256); // Double so rehashing stays linear in the number of adds
 	pSet->aNode = static_cast<SSetNode<T> *>(calloc(pSet->cMax, sizeof(SSetNode<T>)));
 
 	for (int iNode = 0; iNode < cMax; ++iNode)
@@ -941,7 +965,7 @@ void EnsureCount(SHash<K, E> * pHash, int c)
 	SHashNode<K,E> * aNode = pHash->aNode;
 
 	pHash->c = 0;
-	pHash->cMax = cMax + 256;
+	pHash->cMax = Max(cMax * 2, 256); // Double so rehashing stays linear in the number of adds
 	pHash->aNode = static_cast<SHashNode<K, E> *>(calloc(pHash->cMax, sizeof(SHashNode<K, E>)));
 
 	for (int iNode = 0; iNode < cMax; ++iNode)
@@ -1009,103 +1033,296 @@ inline bool FIsIdent(char ch)
 	return ch == '#' || ch == '_' || FIsDigit(ch) || FIsLetter(ch);
 }
 
-struct SOperator
+// Operators are resolved to an OP once in the lexer, later phases switch on it or index per-phase tables
+//  (see SOperatorTable) instead of comparing strings.
+
+enum OPLEVEL
 {
-	const char * pChzOpChar;
-	const char * pChzOpSpaceSeparated;
+	OPLEVEL_Arrow,
+	OPLEVEL_Assign,
+	OPLEVEL_Range,			// Ranges bind looser than everything but assignment so 0..c-1 works
+	OPLEVEL_Or,
+	OPLEVEL_And,
+	OPLEVEL_Compare,
+	OPLEVEL_Add,
+	OPLEVEL_Multiply,		// Shifts multiply/divide by powers of two, they bind like * 
+	OPLEVEL_Polymorphic,
+	OPLEVEL_Dot,			// Dot is highest priority and handled specially
+
+	OPLEVEL_Max,
+	OPLEVEL_Nil = -1,
 };
 
-// BB (adrianb) && is higher than != yuck. Requires strcmp everywhere, yuck.
-//  Switch to single constant enums?
+enum OP
+{
+	OP_Arrow,
+
+	OP_Assign,
+	OP_DefineAssign,
+	OP_AddAssign,
+	OP_SubAssign,
+	OP_MulAssign,
+	OP_DivAssign,
+	OP_RemAssign,
+	OP_BitAndAssign,
+	OP_BitOrAssign,
+	OP_BitXorAssign,
+	OP_ShiftLeftAssign,
+	OP_ShiftRightAssign,
+
+	OP_Range,
+	OP_Define,
+	OP_DefineConstant,
+	OP_At,
+	OP_Question,
+
+	OP_Or,
+	OP_Xor,
+	OP_And,
+
+	OP_Equal,
+	OP_NotEqual,
+	OP_Less,
+	OP_Greater,
+	OP_LessEqual,
+	OP_GreaterEqual,
+	OP_Not,
+	OP_In,
+	OP_NotIn,
+	OP_Is,
+	OP_IsNot,
+	OP_NotWord,
+	OP_Of,
+
+	OP_Add,
+	OP_Sub,				// Prefix is negate
+	OP_BitOr,
+	OP_BitXor,
+	OP_BitNot,
+	OP_Increment,
+	OP_Decrement,
+	OP_Uninitialized,
+
+	OP_Mul,				// Prefix is address of
+	OP_Div,
+	OP_Rem,
+	OP_BitAnd,
+	OP_ShiftLeft,		// Prefix is dereference
+	OP_ShiftRight,
+
+	OP_Polymorphic,
+	OP_Dot,
+
+	OP_Max,
+	OP_Nil = -1,
+};
 
-const SOperator g_aOperator[] =
+struct SOperatorInfo
 {
-	{}, // Arrow-like operators
-	{}, // Assignment-like operators
-	{"@:?", nullptr},
-	{"", "or xor"},
-	{"", "and"},
-	{"=<>!", "in notin is isnot not of"},
-	{"&", nullptr},
-	{"+-|~", nullptr},
-	{"*/%", nullptr},
-	{"$^", nullptr}
+	const char * pChz;
+	OPLEVEL oplevel;
 };
 
-const char * g_pChzOperatorAll = "@:?=<>!.&+-|~*/%$^";
+// BB (adrianb) && is higher than != yuck.
+
+const SOperatorInfo & OpinfoFromOp(OP op)
+{
+	static const SOperatorInfo s_mpOpOpinfo[] =
+	{
+		{ "->", OPLEVEL_Arrow },
+
+		{ "=", OPLEVEL_Assign },
+		{ ":=", OPLEVEL_Assign },
+		{ "+=", OPLEVEL_Assign },
+		{ "-=", OPLEVEL_Assign },
+		{ "*=", OPLEVEL_Assign },
+		{ "/=", OPLEVEL_Assign },
+		{ "%=", OPLEVEL_Assign },
+		{ "&=", OPLEVEL_Assign },
+		{ "|=", OPLEVEL_Assign },
+		{ "^=", OPLEVEL_Assign },
+		{ "<<=", OPLEVEL_Assign },
+		{ ">>=", OPLEVEL_Assign },
+
+		{ "..", OPLEVEL_Range },
+		{ ":", OPLEVEL_Range },
+		{ "::", OPLEVEL_Range },
+		{ "@", OPLEVEL_Range },
+		{ "?", OPLEVEL_Range },
+
+		{ "or", OPLEVEL_Or },
+		{ "xor", OPLEVEL_Or },
+		{ "and", OPLEVEL_And },
+
+		{ "==", OPLEVEL_Compare },
+		{ "!=", OPLEVEL_Compare },
+		{ "<", OPLEVEL_Compare },
+		{ ">", OPLEVEL_Compare },
+		{ "<=", OPLEVEL_Compare },
+		{ ">=", OPLEVEL_Compare },
+		{ "!", OPLEVEL_Compare },
+		{ "in", OPLEVEL_Compare },
+		{ "notin", OPLEVEL_Compare },
+		{ "is", OPLEVEL_Compare },
+		{ "isnot", OPLEVEL_Compare },
+		{ "not", OPLEVEL_Compare },
+		{ "of", OPLEVEL_Compare },
+
+		{ "+", OPLEVEL_Add },
+		{ "-", OPLEVEL_Add },
+		{ "|", OPLEVEL_Add },
+		{ "^", OPLEVEL_Add },
+		{ "~", OPLEVEL_Add },
+		{ "++", OPLEVEL_Add },
+		{ "--", OPLEVEL_Add },
+		{ "---", OPLEVEL_Add },
+
+		{ "*", OPLEVEL_Multiply },
+		{ "/", OPLEVEL_Multiply },
+		{ "%", OPLEVEL_Multiply },
+		{ "&", OPLEVEL_Multiply },
+		{ "<<", OPLEVEL_Multiply },
+		{ ">>", OPLEVEL_Multiply },
+
+		{ "$", OPLEVEL_Polymorphic },
+		{ ".", OPLEVEL_Dot },
+	};
+	CASSERT(DIM(s_mpOpOpinfo) == OP_Max);
+	ASSERT(op >= 0 && op < OP_Max);
+
+	return s_mpOpOpinfo[op];
+}
+
+inline const char * PchzFromOp(OP op)
+{
+	return OpinfoFromOp(op).pChz;
+}
 
-const char * PchzOperatorClean(const char * pChz)
+inline OPLEVEL OplevelFromOp(OP op)
 {
-	// Convert into the world version so we can get correct precedence.
+	return OpinfoFromOp(op).oplevel;
+}
+
+OP OpFromPchz(const char * pChz)
+{
+	// && and || are spelled and/or everywhere after the lexer
 
 	if (strcmp(pChz, "&&") == 0)
-		return "and";
+		return OP_And;
 	if (strcmp(pChz, "||") == 0)
-		return "or";
+		return OP_Or;
 
-	return pChz;
+	for (int op = 0; op < OP_Max; ++op)
+	{
+		const char * pChzOp = PchzFromOp(OP(op));
+		if (pChzOp[0] == pChz[0] && strcmp(pChzOp, pChz) == 0)
+			return OP(op);
+	}
+
+	return OP_Nil;
 }
 
-int NOperatorLevel(const char * pChzOp)
+struct SReservedWord
 {
-	int cChOp = int(strlen(pChzOp));
+	const char * pChz;		// Null for an empty slot
+	int cCh;
+	TOKK tokk;				// TOKK_Keyword, TOKK_Literal (true/false) or TOKK_Operator (and, or, in, ...)
+	int n;					// KEYWORD, bool or OP depending on tokk
+};
 
-	// Check for arrow-like
+static const int s_cReservedWordSlot = 128;
+static const int s_cChReservedWordMax = 16;
 
-	if (cChOp > 1 && pChzOp[cChOp - 1] == '>')
-	{
-		return 0;
-	}
+inline int IReservedWordSlot(const char * pCh, int cCh)
+{
+	// Perfect hash over every reserved word, found by brute force search over the multipliers. Checked when the
+	//  table is built, so a new keyword that collides will assert and the multipliers need another search.
+
+	return (u8(pCh[0]) + 2 * u8(pCh[1]) + 2 * u8(pCh[cCh - 1]) + 19 * cCh) & (s_cReservedWordSlot - 1);
+}
 
-	// Check for assignment-like operators
+struct SReservedWordTable
+{
+	SReservedWord aResword[s_cReservedWordSlot];
 
-	const char * pChzNonAssign = "<>!=~?";
-	if (pChzOp[cChOp - 1] == '=' && strchr(pChzNonAssign, pChzOp[0]) == nullptr)
+	SReservedWordTable()
 	{
-		return 1;
-	}
+		for (SReservedWord & resword : aResword)
+			resword = { nullptr, 0, TOKK_Invalid, 0 };
 
-	// Dot is highest priority and handled specially
+		for (int keyword = KEYWORD_Invalid + 1; keyword < KEYWORD_Max; ++keyword)
+		{
+			Add(PchzFromKeyword(KEYWORD(keyword)), TOKK_Keyword, keyword);
+		}
 
-	if (pChzOp[0] == '.')
-	{
-		return DIM(g_aOperator);
+		Add("false", TOKK_Literal, false);
+		Add("true", TOKK_Literal, true);
+
+		for (int op = 0; op < OP_Max; ++op)
+		{
+			const char * pChzOp = PchzFromOp(OP(op));
+			if (FIsLetter(pChzOp[0]))
+				Add(pChzOp, TOKK_Operator, op);
+		}
 	}
 
-	for (int iOperator = 0; iOperator < DIM(g_aOperator); ++iOperator)
+	void Add(const char * pChz, TOKK tokk, int n)
 	{
-		const SOperator & operatorTest = g_aOperator[iOperator];
+		int cCh = int(strlen(pChz));
+		ASSERT(cCh >= 2 && cCh <= s_cChReservedWordMax);
 
-		// First letter defines an operator
+		SReservedWord & resword = aResword[IReservedWordSlot(pChz, cCh)];
+		ASSERTCHZ(resword.pChz == nullptr, "Reserved word %s collides with %s, search for new hash multipliers", 
+			pChz, resword.pChz);
 
-		if (operatorTest.pChzOpChar && strchr(operatorTest.pChzOpChar, pChzOp[0]) != nullptr)
-		{
-			return iOperator;
-		}
+		resword = { pChz, cCh, tokk, n };
+	}
+};
+
+const SReservedWord * PreswordLookup(const char * pCh, int cCh)
+{
+	// Classifies an identifier in place in the source, before it's copied anywhere
 
-		// Or a list of all operators
+	static const SReservedWordTable s_reswordtable;
 
-		if (operatorTest.pChzOpSpaceSeparated)
-		{
-			const char * pChzWords = operatorTest.pChzOpSpaceSeparated;
-			while (*pChzWords)
-			{
-				ASSERT(FIsIdent(*pChzWords));
-				const char * pChzDelim = strchr(pChzWords, ' ');
-				int cChWord = int((pChzDelim) ? pChzDelim - pChzWords : strlen(pChzWords));
+	if (cCh < 2 || cCh > s_cChReservedWordMax)
+		return nullptr;
 
-				if (strncmp(pChzOp, pChzWords, cChWord) == 0 && pChzOp[cChWord] == '\0')
-					return iOperator;
+	const SReservedWord & resword = s_reswordtable.aResword[IReservedWordSlot(pCh, cCh)];
+	if (resword.cCh != cCh || memcmp(resword.pChz, pCh, cCh) != 0)
+		return nullptr;
 
-				pChzWords += cChWord;
-				while (*pChzWords == ' ')
-					pChzWords++;
-			}
+	return &resword;
+}
+
+template <class T>
+struct SOperatorTable
+{
+	// Direct lookup from an operator to its entry in one of the per-phase tables (s_aBopi et al), null when the 
+	//  phase has no entry for it.
+
+	const T * mpOpPt[OP_Max];
+
+	template <size_t C>
+	SOperatorTable(const T (&aT)[C])
+	{
+		for (auto & pT : mpOpPt)
+			pT = nullptr;
+
+		for (const T & t : aT)
+		{
+			ASSERT(t.op >= 0 && t.op < OP_Max && mpOpPt[t.op] == nullptr);
+			mpOpPt[t.op] = &t;
 		}
 	}
 
-	return -1;
-}
+	const T * PtLookup(OP op) const
+	{
+		return (op >= 0 && op < OP_Max) ? mpOpPt[op] : nullptr;
+	}
+};
+
+const char * g_pChzOperatorAll = "@:?=<>!.&+-|~*/%$^";
 
 inline bool FIsOperator(char ch)
 {
@@ -1153,6 +1370,7 @@ const char * PchzFromLitk(LITK litk)
 struct SLiteral // tag = lit
 {
 	LITK litk;
+	bool fUnsigned;		// LITK_Int whose n holds a u64 above the s64 range, e.g. 1 << 63
 	union
 	{
 		const char * pChz;
@@ -1180,11 +1398,7 @@ struct SToken
 
 		KEYWORD keyword;
 
-		struct
-		{
-			const char * pChz;
-			int nLevel;
-		} op;
+		OP op;
 	};
 
 	bool fBeginLine;
@@ -1239,12 +1453,20 @@ enum SYMTBLK
 
 struct SAstProcedure;
 struct SAstDeclareSingle;
+struct SAstCall;
+struct SOverloadSet;
 struct SStorage;
 struct STypeStruct;
 struct SResolveDecl;
 struct SProcedure;
 struct SGlobal;
 
+struct SBuiltinRef
+{
+	SAstProcedure * pAstprocFrom;	// Procedure the reference is in, null outside procedures
+	SAstProcedure * pAstprocTo;		// Builtin module procedure referenced
+};
+
 struct SPolyArg
 {
 	const char * pChz;
@@ -1258,10 +1480,25 @@ struct SSpecializedProc
 	SResolveDecl * pResdecl;	// Declaration for type checking
 };
 
+struct SPolyArgKey // tag = polykey
+{
+	// Inferred types of one specialization, points into SSpecializedProc::aryParg (or the array being matched)
+
+	const SPolyArg * aParg;
+	int cParg;
+};
+
 struct SPolymorphicProc // tag = polyproc
 {
 	SAstDeclareSingle * pAstdeclProcOrig;
 	SArray<SSpecializedProc> arySpecproc;
+	SHash<SPolyArgKey, SResolveDecl *> hashPolykeyPresdecl; // Specializations by inferred types
+};
+
+struct SPolyCallKey // tag = polycall
+{
+	const SAstCall * pAstcall;
+	const SAstDeclareSingle * pAstdeclPoly;
 };
 
 struct SSymbolTable
@@ -1270,12 +1507,69 @@ struct SSymbolTable
 	SSymbolTable * pSymtParent;
 	SArray<SResolveDecl *> arypResdecl; // Declarations, may be finished or unfinished if out of order
 	int ipResdeclUsing;
+	int nUsingEpochResolved;			// SWorkspace::nUsingEpoch when we and our parents last had all using resolved
 	
 	SArray<SPolymorphicProc> aryPolyproc; // Polymorphic procedures
+	SHash<const char *, SOverloadSet *> hashPchzPovset; // Declarations and polymorphic procedures by name
 
 	SAstProcedure * pAstproc; // Function for procedure symbol tables
 };
 
+// Compile phases timed for --stats and --trace
+
+enum PHASE
+{
+	PHASE_Parse,
+	PHASE_TypeCheck,
+	PHASE_Fold,
+	PHASE_Generate,
+	PHASE_Optimize,
+	PHASE_EmitObject,
+	PHASE_Link,
+
+	PHASE_Max,
+	PHASE_Nil = -1,
+};
+
+const char * PchzFromPhase(PHASE phase)
+{
+	static const char * s_mpPhasePchz[] =
+	{
+		"parse",
+		"type check",
+		"fold",
+		"generate",
+		"optimize",
+		"emit objects",
+		"link",
+	};
+	CASSERT(DIM(s_mpPhasePchz) == PHASE_Max);
+	ASSERT(phase >= 0 && phase < PHASE_Max);
+	return s_mpPhasePchz[phase];
+}
+
+inline u64 NsNow()
+{
+	return std::chrono::duration_cast<std::chrono::nanoseconds>(
+				std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+struct STraceSpan // tag = trspan
+{
+	const char * pChzCat;
+	const char * pChzName;			// Must outlive the trace, e.g. interned or static strings
+	u64 nsStart;
+	u64 nsDuration;
+	int iThread;
+};
+
+struct STrace // tag = trace
+{
+	std::mutex mutex;				// Code generation adds spans from several threads
+	u64 nsStart;					// Span times are written relative to this
+	SArray<STraceSpan> aryTrspan;
+};
+
 struct SWorkspace
 {
 	SPagedAlloc pagealloc;
@@ -1283,8 +1577,6 @@ struct SWorkspace
 	SArray<SModule> aryModule;
 	int iModuleParse;
 
-	int cOperator;
-
 	// Tokenizing
 
 	const char * pChzCurrent;
@@ -1295,10 +1587,12 @@ struct SWorkspace
 	SArray<SToken> aryTokNext;
 	bool fInToken;
 	int cPeek;
+	int cToken;						// Stats for all tokens lexed
 
 	// Parsing
 
 	SArray<SAst *> arypAstAll;
+	int cPushContext;				// For unique names of saved contexts
 
 	// Type checking data
 
@@ -1324,8 +1618,67 @@ struct SWorkspace
 	SArray<STypeStruct *> arypTypestruct; // All structs
 	SHash<STypeId, SSymbolTable *> hashTidPsymtStruct; // Symbol tables for out of order struct type checking
 	SHash<SAst *, SResolveDecl *> hashPastPresdeclResolved;
+	SHash<SPolyCallKey, SResolveDecl *> hashPolycallPresdecl; // Specialization matched by a call, kept across suspends
+	SArray<SBuiltinRef> aryBuiltinref;	// References to builtin module procedures (see PruneBuiltinProcedures)
+	int cPolyLookup;				// Stats for polymorphic specialization lookups
+	int cPolyHit;					//  ...
+	int cPolyCallMemoHit;			//  ...
+	int cOverloadLookup;			// Stats for overload set match cache
+	int cOverloadHit;				//  ...
+
+	int nUsingEpoch;				// Bumped for each using declaration added to any symbol table
+	int cUsingResolve;				// Stats for using resolution (see FTryResolveUsing)
+	int cUsingResolveSkip;			//  ...
+	int cUsingScopeVisit;			//  ...
+	int cSymbolLookup;				// Stats for declarations looked up by name (see PresdeclLookup)
+	int cTypeCheckSuspend;			// Stats for declarations suspended waiting on another (see TypeCheckAll)
+
+	// Constant evaluation
+
+	SHash<SAstDeclareSingle *, void *> hashPastdeclPvConst; // Evaluated initializer bytes per declaration
+	int cEvalConstHit;				// Stats for constant evaluation cache
+	int cEvalConstMiss;				//  ...
+	int cFoldConst;					// Stats for constant folding (see FoldConstants)
+	int cFoldBranch;				//  ...
+
+	// Code generation
+
+	bool fAssignedLinkNames;
+	int nOptLevel;					// -O level, 0 skips llvm's optimization pipeline
+	int cCodegenCacheHit;			// Stats for procedure object cache (see GenerateCached)
+	int cCodegenCacheMiss;			//  ...
+	s64 cLlvmInstruction;			// Stats for instructions in generated modules
+
+	// Profiling
+
+	u64 mpPhaseNs[PHASE_Max];		// Time spent in each phase (see EndPhase)
+	STrace * pTrace;				// Spans for --trace, null when not tracing
+
+	// Guards data that is filled in lazily during code generation (type sizes, unique types, constant cache) so
+	//  procedures can be generated on several threads. Per workspace so separate compiles don't wait on each other,
+	//  allocated since workspaces are cleared with memset.
+
+	std::recursive_mutex * pMutex;
 };
 
+void AddTraceSpan(SWorkspace * pWork, const char * pChzCat, const char * pChzName, u64 nsStart, int iThread = 0)
+{
+	STrace * pTrace = pWork->pTrace;
+	if (!pTrace)
+		return;
+
+	u64 nsEnd = NsNow();
+
+	std::lock_guard<std::mutex> lock(pTrace->mutex);
+	Append(&pTrace->aryTrspan, STraceSpan{pChzCat, pChzName, nsStart, nsEnd - nsStart, iThread});
+}
+
+void EndPhase(SWorkspace * pWork, PHASE phase, u64 nsStart)
+{
+	pWork->mpPhaseNs[phase] += NsNow() - nsStart;
+	AddTraceSpan(pWork, "phase", PchzFromPhase(phase), nsStart);
+}
+
 struct SStringWithLength
 {
 	const char * pCh;
@@ -1369,6 +1722,82 @@ const char * PchzCopy(SWorkspace * pWork, const char * pCh, s64 cCh)
 	return pChz;
 }
 
+// Declarations programs get with #import "Context" (see AddModuleFile). Allocation (new, delete, dynamic arrays)
+//  then goes through context.allocator, see PlvalGenerateAllocate. Procs are called with a null pV to allocate
+//  and a zero cBNew to free. Programs that don't import it allocate from the C heap and are free to use the names.
+
+static const char s_pChzModuleContext[] = "Context";
+
+static const char s_pChzBuiltinModule[] =
+	"Allocator :: struct {\n"
+	"    proc : (pData : * void, pV : * void, cBOld : u64, cBNew : u64) -> * void // Null for the C heap\n"
+	"    pData : * void\n"
+	"}\n"
+	"\n"
+	"Context :: struct {\n"
+	"    allocator : Allocator\n"
+	"}\n"
+	"\n"
+	"context : Context // Thread local, swap with push_context\n"
+	"\n"
+	"// Bump allocator, frees are ignored and memory is reclaimed all at once by arena_reset.\n"
+	"\n"
+	"Arena :: struct {\n"
+	"    aB : [..] u8\n"
+	"    cBUsed : s64\n"
+	"}\n"
+	"\n"
+	"arena_init :: (pArena : * Arena, cB : s64) {\n"
+	"    array_reserve(*pArena.aB, cB)\n"
+	"    pArena.cBUsed = 0\n"
+	"}\n"
+	"\n"
+	"arena_reset :: (pArena : * Arena) {\n"
+	"    pArena.cBUsed = 0\n"
+	"}\n"
+	"\n"
+	"arena_free :: (pArena : * Arena) {\n"
+	"    array_free(*pArena.aB)\n"
+	"    pArena.cBUsed = 0\n"
+	"}\n"
+	"\n"
+	"arena_allocator_proc :: (pData : * void, pV : * void, cBOld : u64, cBNew : u64) -> * void {\n"
+	"    if cBNew == 0 {\n"
+	"        return null\n"
+	"    }\n"
+	"    if cBNew < cBOld + 1 {\n"
+	"        return pV\n"
+	"    }\n"
+	"\n"
+	"    // Returns null when full, arenas don't grow\n"
+	"\n"
+	"    pArena := cast(* Arena) pData\n"
+	"    cB := cast(s64) ((cBNew + 15) / 16 * 16)\n"
+	"    if pArena.cBUsed + cB > pArena.aB.cMax {\n"
+	"        return null\n"
+	"    }\n"
+	"\n"
+	"    pB := pArena.aB.a + pArena.cBUsed\n"
+	"    pArena.cBUsed += cB\n"
+	"\n"
+	"    pBOld := cast(* u8) pV\n"
+	"    cBCopy := cast(s64) cBOld\n"
+	"    iB : s64 = 0\n"
+	"    while iB < cBCopy {\n"
+	"        pB[iB] = pBOld[iB]\n"
+	"        ++iB\n"
+	"    }\n"
+	"\n"
+	"    return pB\n"
+	"}\n"
+	"\n"
+	"arena_allocator :: (pArena : * Arena) -> Allocator {\n"
+	"    allocator : Allocator\n"
+	"    allocator.proc = arena_allocator_proc\n"
+	"    allocator.pData = pArena\n"
+	"    return allocator\n"
+	"}\n";
+
 // BB (adrianb) pWork is just for the paged alloc.  Just malloc instead?
 
 void AddModuleFile(SWorkspace * pWork, const char * pChzFile)
@@ -1376,6 +1805,23 @@ void AddModuleFile(SWorkspace * pWork, const char * pChzFile)
 	// BB (adrianb) Deal with full paths with working directory?
 	// BB (adrianb) Just use _split_path and _make_path?
 
+	// The builtin module isn't a file, importing it more than once is fine
+
+	if (strcmp(pChzFile, s_pChzModuleContext) == 0)
+	{
+		for (const SModule & module : pWork->aryModule)
+		{
+			if (module.fBuiltIn)
+				return;
+		}
+
+		SModule * pModule = PtAppendNew(&pWork->aryModule);
+		pModule->pChzFile = s_pChzModuleContext;
+		pModule->pChzContents = s_pChzBuiltinModule;
+		pModule->fBuiltIn = true;
+		return;
+	}
+
 	char aChzFile[256];
 	{
 		int cCh = strlen(pChzFile);
@@ -1431,9 +1877,9 @@ inline bool FIsDone(const SWorkspace * pWork)
 	return Ch(pWork) == '\0';
 }
 
-inline bool FIsOperator(const SToken & tok, const char * pChz)
+inline bool FIsOperator(const SToken & tok, OP op)
 {
-	return tok.tokk == TOKK_Operator && strcmp(tok.op.pChz, pChz) == 0;
+	return tok.tokk == TOKK_Operator && tok.op == op;
 }
 
 inline void FillInErrInfo(SWorkspace * pWork, SErrorInfo * pErrinfo)
@@ -1450,6 +1896,7 @@ inline SToken * PtokStart(TOKK tokk, SWorkspace * pWork)
 
 	SToken * pTok = PtAppendNew(&pWork->aryTokNext);
 	pTok->tokk = tokk;
+	++pWork->cToken;
 	pTok->fBeginLine = pWork->fBeginLine;
 	pTok->cSpace = pWork->cSpace;
 	FillInErrInfo(pWork, &pTok->errinfo);
@@ -1565,9 +2012,9 @@ s64 NDigitBase16(char c)
 	if (c >= '0' && c <= '9')
 		return c - '0';
 	if (c >= 'A' && c <= 'F')
-		return c - 'A';
+		return c - 'A' + 10;
 	if (c >= 'a' && c <= 'f')
-		return c - 'a';
+		return c - 'a' + 10;
 
 	return -1;
 }
@@ -1643,6 +2090,7 @@ void TokenizeInt(SWorkspace * pWork)
 
 	pTok->lit.litk = LITK_Int;
 	pTok->lit.n = n;
+	pTok->lit.fUnsigned = n < 0; // Only wraps when above the s64 range
 
 	// BB (adrianb) Provide a way to specific explicit size?
 
@@ -1803,33 +2251,31 @@ void ParseToken(SWorkspace * pWork)
 		{
 		}
 
-		// BB (adrianb) Reuse strings in original source?
+		int cCh = int(pWork->pChzCurrent - pChzStart);
+		const SReservedWord * pResword = PreswordLookup(pChzStart, cCh);
 
-		const char * pChzIdent = PchzCopy(pWork, pChzStart, pWork->pChzCurrent - pChzStart);
-
-		const char * pChzOperator = PchzOperatorClean(pChzIdent);
-		int nOpLevel = NOperatorLevel(pChzOperator);
+		if (!pResword)
+		{
+			// BB (adrianb) Reuse strings in original source?
 
-		if (KEYWORD keyword = KeywordFromPchz(pChzIdent))
+			pTok->ident.pChz = PchzCopy(pWork, pChzStart, cCh);
+		}
+		else if (pResword->tokk == TOKK_Keyword)
 		{
 			pTok->tokk = TOKK_Keyword;
-			pTok->keyword = keyword;
+			pTok->keyword = KEYWORD(pResword->n);
 		}
-		else if (strcmp(pChzIdent, "false") == 0 || strcmp(pChzIdent, "true") == 0)
+		else if (pResword->tokk == TOKK_Literal)
 		{
 			pTok->tokk = TOKK_Literal;
-			pTok->lit.n = (strcmp(pChzIdent, "true") == 0);
+			pTok->lit.n = pResword->n;
 			pTok->lit.litk = LITK_Bool;
 		}
-		else if (nOpLevel >= 0)
-		{
-			pTok->tokk = TOKK_Operator;
-			pTok->op.pChz = pChzOperator;
-			pTok->op.nLevel = nOpLevel;
-		}
 		else
 		{
-			pTok->ident.pChz = pChzIdent;
+			ASSERT(pResword->tokk == TOKK_Operator);
+			pTok->tokk = TOKK_Operator;
+			pTok->op = OP(pResword->n);
 		}
 
 		EndToken(pTok, pWork);
@@ -1933,10 +2379,20 @@ void ParseToken(SWorkspace * pWork)
 		{
 		}
 
-		const char * pChzOp = PchzCopy(pWork, pChzStart, pWork->pChzCurrent - pChzStart);
-		pTok->op.pChz = PchzOperatorClean(pChzOp);
-		pTok->op.nLevel = NOperatorLevel(pTok->op.pChz);
-		ASSERT(pTok->op.nLevel >= 0);
+		char aChOp[16];
+		int cChOp = int(pWork->pChzCurrent - pChzStart);
+		if (cChOp >= DIM(aChOp))
+			ShowErr(pTok->errinfo, "Unknown operator %.*s", cChOp, pChzStart);
+
+		memcpy(aChOp, pChzStart, cChOp);
+		aChOp[cChOp] = '\0';
+
+		pTok->op = OpFromPchz(aChOp);
+		if (pTok->op == OP_Nil)
+		{
+			EndToken(pTok, pWork);
+			ShowErr(pTok->errinfo, "Unknown operator %s", aChOp);
+		}
 
 		EndToken(pTok, pWork);
 	}
@@ -2082,13 +2538,13 @@ void ConsumeExpectedLiteral(SWorkspace * pWork, LITK litk, SToken * pTok = nullp
 		*pTok = tok;
 }
 
-bool FTryConsumeOperator(SWorkspace * pWork, const char * pChzOp, SToken * pTok = nullptr)
+bool FTryConsumeOperator(SWorkspace * pWork, OP op, SToken * pTok = nullptr)
 {
 	SToken tok = TokPeek(pWork);
 	if (pTok)
 		*pTok = tok;
 
-	if (tok.tokk == TOKK_Operator && strcmp(tok.op.pChz, pChzOp) == 0)
+	if (FIsOperator(tok, op))
 	{
 		ConsumeToken(pWork);
 		return true;
@@ -2097,12 +2553,12 @@ bool FTryConsumeOperator(SWorkspace * pWork, const char * pChzOp, SToken * pTok
 	return false;
 }
 
-void ConsumeExpectedOperator(SWorkspace * pWork, const char * pChzOp)
+void ConsumeExpectedOperator(SWorkspace * pWork, OP op)
 {
 	SToken tok;
-	if (!FTryConsumeOperator(pWork, pChzOp, &tok))
+	if (!FTryConsumeOperator(pWork, op, &tok))
 	{
-		ShowErr(tok.errinfo, "Expected operator %s", pChzOp);
+		ShowErr(tok.errinfo, "Expected operator %s", PchzFromOp(op));
 	}
 }
 
@@ -2292,7 +2748,7 @@ struct SAstOperator : public SAst
 {
 	static const ASTK s_astk = ASTK_Operator;
 	
-	const char * pChzOp;
+	OP op;
 	SAst * pAstLeft; // If nullptr, we're a prefix operator
 	SAst * pAstRight;
 };
@@ -2320,10 +2776,12 @@ struct SAstFor : public SAst
 	
 	bool fTakesPointer;
 	SAst * pAstIter;
-	SAst * pAstIterRight; // i : expr
+	SAst * pAstIterRight; // i : expr, or the start of i : expr..expr
+	SAst * pAstRangeEnd; // Inclusive end of a range, null when iterating an array
 	SAst * pAstLoop;
 
-	// BB (adrianb) Add declaration for iteration variable? 
+	SAstDeclareSingle * pAstdeclIt; // Named by pAstIter or "it"
+	SAstDeclareSingle * pAstdeclItIndex; // "it_index"
 };
 
 struct SAstLoopControl : public SAst
@@ -2400,8 +2858,8 @@ struct SAstDefer : public SAst
 struct SAstInline : public SAst
 {
 	static const ASTK s_astk = ASTK_Inline;
-	SAst * pAstExpr; // BB (adrianb) Only ever a procedure call?
-	// BB (adrianb) Support noinline.
+	SAst * pAstExpr; // Procedure call
+	bool fNoInline; // noinline instead of inline
 };
 
 struct SAstPushContext : public SAst
@@ -2419,21 +2877,17 @@ struct SAstDeclareSingle : public SAst
 	SAst * pAstValue;	// Optional initial value
 	bool fUsing;
 	bool fIsConstant;
+	bool fIsModified;	// Assigned or addressed after being declared (see MarkModified)
+	bool fIsAddressed;	// Address taken, so it can change through pointers (see MarkModified)
 };
 
 struct SAstDeclareMulti : public SAst
 {
 	static const ASTK s_astk = ASTK_DeclareMulti;
 
-	struct SName
-	{
-		const char * pChzName;
-		SErrorInfo errinfo;
-	};
-
-	SArray<SName> aryName;
+	SArray<SAstDeclareSingle *> arypAstdecl; // One per name, typed by what's unpacked into them
 	SAst * pAstType; 	// Optional explicit type, probably should have either type or value
-	SAst * pAstValue;	// Value to unpack
+	SAst * pAstValue;	// Value to unpack, a call returning multiple values
 	bool fIsConstant;
 };
 
@@ -2441,7 +2895,7 @@ struct SAstAssignMulti : public SAst
 {
 	static const ASTK s_astk = ASTK_AssignMulti;
 
-	SArray<const char *> arypChzName;
+	SArray<SAst *> arypAstName; // Identifiers assigned to
 	SAst * pAstValue;	// Value to unpack
 };
 
@@ -2471,8 +2925,12 @@ struct SAstProcedure : public SAst
 	SArray<SAst *> arypAstDeclRet;
 
 	bool fIsInline;
+	bool fIsNoInline;
 	bool fIsForeign;
 	bool fIsPolymorphic;
+	bool fIsValue;			// Referenced other than by a direct call, so keeps the C ABI (see ArgpassCompute)
+
+	const char * pChzLink;	// Unique symbol name for generated code, see AssignLinkNames
 
 	int iModuleOwner;
 	const char * pChzForeign;
@@ -2501,6 +2959,7 @@ struct SAstTypeArray : public SAst
 	SAst * pAstSize; 		// Int literal, identifier, etc // BB (adrianb) Extend to statically evaluatable expressions?
 	bool fDynamicallySized;	// Size of ..
 	bool fSoa;
+	s64 cSoaChunk;			// SOA(n) is AOSOA with chunks of n elements, 0 for plain SOA
 
 	SAst * pAstTypeInner;
 };
@@ -2550,8 +3009,8 @@ void Destroy(SAst * pAst)
 	case ASTK_Block: Destroy(&PastCast<SAstBlock>(pAst)->arypAst); break;
 	case ASTK_Call: Destroy(&PastCast<SAstCall>(pAst)->arypAstArgs); break;
 	case ASTK_Return: Destroy(&PastCast<SAstReturn>(pAst)->arypAstRet); break;
-	case ASTK_DeclareMulti: Destroy(&PastCast<SAstDeclareMulti>(pAst)->aryName); break;
-	case ASTK_AssignMulti: Destroy(&PastCast<SAstAssignMulti>(pAst)->arypChzName); break;
+	case ASTK_DeclareMulti: Destroy(&PastCast<SAstDeclareMulti>(pAst)->arypAstdecl); break;
+	case ASTK_AssignMulti: Destroy(&PastCast<SAstAssignMulti>(pAst)->arypAstName); break;
 	case ASTK_Struct: Destroy(&PastCast<SAstStruct>(pAst)->arypAstDecl); break;
 	case ASTK_Enum: Destroy(&PastCast<SAstEnum>(pAst)->arypAstDecl); break;
 	case ASTK_Procedure:
@@ -2601,6 +3060,22 @@ SAstIdentifier * PastidentCreate(SWorkspace * pWork, const SToken & tok)
 	}
 }
 
+SAstIdentifier * PastidentCreate(SWorkspace * pWork, const SErrorInfo & errinfo, const char * pChz)
+{
+	SAstIdentifier * pAstident = PastCreate<SAstIdentifier>(pWork, errinfo);
+	pAstident->pChz = pChz;
+	return pAstident;
+}
+
+SAst * PastopCreateContextAssign(SWorkspace * pWork, const SErrorInfo & errinfo, SAst * pAstValue)
+{
+	auto pAstop = PastCreate<SAstOperator>(pWork, errinfo);
+	pAstop->op = OP_Assign;
+	pAstop->pAstLeft = PastidentCreate(pWork, errinfo, "context");
+	pAstop->pAstRight = pAstValue;
+	return pAstop;
+}
+
 SAst * PastParseStatement(SWorkspace * pWork);
 SAst * PastTryParseExpression(SWorkspace * pWork);
 SAstBlock * PastParseBlock(SWorkspace * pWork);
@@ -2733,7 +3208,7 @@ SAst * PastTryParsePrimary(SWorkspace * pWork)
 	while (FTryConsumeToken(pWork, TOKK_Operator, &tok))
 	{
 		auto pAstop = PastCreate<SAstOperator>(pWork, tok.errinfo);
-		pAstop->pChzOp = tok.op.pChz;
+		pAstop->op = tok.op;
 		*ppAst = pAstop;
 		ppAst = &pAstop->pAstRight;
 	}
@@ -2787,7 +3262,7 @@ SAst * PastTryParsePrimary(SWorkspace * pWork)
 
 			ConsumeExpectedToken(pWork, TOKK_CloseBracket);
 		}
-		else if (FTryConsumeOperator(pWork, ".", &tok))
+		else if (FTryConsumeOperator(pWork, OP_Dot, &tok))
 		{
 			SToken tokIdent;
 			ConsumeExpectedToken(pWork, TOKK_Identifier, &tokIdent);
@@ -2796,7 +3271,7 @@ SAst * PastTryParsePrimary(SWorkspace * pWork)
 			pAstident->pChz = tokIdent.ident.pChz;
 
 			auto pAstop = PastCreate<SAstOperator>(pWork, tok.errinfo);
-			pAstop->pChzOp = tok.op.pChz;
+			pAstop->op = tok.op;
 			pAstop->pAstLeft = *ppAst;
 			pAstop->pAstRight = pAstident;
 
@@ -2843,8 +3318,8 @@ SAst * PastTryParseBinaryOperator(SWorkspace * pWork, int iOperator)
 
 LTryOp:
 		SToken tok = TokPeek(pWork);
-        int nLevelCur = (cTokOperator > 0) ? aTokOperator[cTokOperator - 1].op.nLevel : -1;
-		if (tok.tokk != TOKK_Operator || tok.op.nLevel <= nLevelCur)
+        int oplevelCur = (cTokOperator > 0) ? OplevelFromOp(aTokOperator[cTokOperator - 1].op) : OPLEVEL_Nil;
+		if (tok.tokk != TOKK_Operator || OplevelFromOp(tok.op) <= oplevelCur)
 		{
 			if (cTokOperator > 0)
 			{
@@ -2854,7 +3329,7 @@ LTryOp:
 				tok = aTokOperator[--cTokOperator];
 
 				auto pAstop = PastCreate<SAstOperator>(pWork, tok.errinfo);
-				pAstop->pChzOp = tok.op.pChz;
+				pAstop->op = tok.op;
 				pAstop->pAstLeft = pAstLeft;
 				pAstop->pAstRight = pAstRight;
 				apAst[cpAst++] = pAstop;
@@ -2867,7 +3342,6 @@ LTryOp:
 		else
 		{
 			ASSERT(cTokOperator < DIM(aTokOperator));
-			ASSERTCHZ(tok.op.nLevel != INT_MAX, "Operator %s doesn't have precedence", tok.op.pChz);
             ConsumeToken(pWork, 1);
 			aTokOperator[cTokOperator++] = tok;
 		}
@@ -2894,9 +3368,10 @@ SAst * PastTryParseExpression(SWorkspace * pWork)
 		}
 		return pAstrun;
 	}
-	else if (FTryConsumeKeyword(pWork, KEYWORD_Inline, &tok))
+	else if (FTryConsumeKeyword(pWork, KEYWORD_Inline, &tok) || FTryConsumeKeyword(pWork, KEYWORD_NoInline, &tok))
 	{
 		auto pAstinline = PastCreate<SAstInline>(pWork, tok.errinfo);
+		pAstinline->fNoInline = (tok.keyword == KEYWORD_NoInline);
 		pAstinline->pAstExpr = PastParseExpression(pWork);
 		return pAstinline;
 	}
@@ -2907,7 +3382,7 @@ SAst * PastTryParseExpression(SWorkspace * pWork)
 		pAstloopctrl->fContinue = (tok.keyword == KEYWORD_Continue);
 		return pAstloopctrl;
 	}
-	else if (FTryConsumeOperator(pWork, "---", &tok))
+	else if (FTryConsumeOperator(pWork, OP_Uninitialized, &tok))
 	{
 		// BB (adrianb) Make operators all manual so we don't have special case here?  
 		//  Can't manually define operators then though.
@@ -2948,11 +3423,11 @@ SAst * PastParseType(SWorkspace * pWork)
 {
 	SToken tok = {};
 
-	if (FTryConsumeOperator(pWork, "..", &tok))
+	if (FTryConsumeOperator(pWork, OP_Range, &tok))
 	{
 		return PastCreateManual<SAst>(pWork, ASTK_TypeVararg, tok.errinfo);
 	}
-	else if (FTryConsumeOperator(pWork, "$"))
+	else if (FTryConsumeOperator(pWork, OP_Polymorphic))
 	{
 		// BB (adrianb) Can this have $T.S somehow?
 
@@ -2961,7 +3436,7 @@ SAst * PastParseType(SWorkspace * pWork)
 		pAtypepoly->pChzName = tok.ident.pChz;
 		return pAtypepoly;
 	}
-	else if (FTryConsumeOperator(pWork, "*", &tok))
+	else if (FTryConsumeOperator(pWork, OP_Mul, &tok))
 	{
 		SAstTypePointer * pAtypepointer = PastCreate<SAstTypePointer>(pWork, tok.errinfo);
 
@@ -2983,7 +3458,7 @@ SAst * PastParseType(SWorkspace * pWork)
 
 		if (TokPeek(pWork).tokk != TOKK_CloseBracket)
 		{
-			if (FTryConsumeOperator(pWork, ".."))
+			if (FTryConsumeOperator(pWork, OP_Range))
 			{
 				pAtypearray->fDynamicallySized = true;
 			}
@@ -2999,6 +3474,23 @@ SAst * PastParseType(SWorkspace * pWork)
 		{
 			ConsumeToken(pWork);
 			pAtypearray->fSoa = true;
+
+			// SOA(n) gives the AOSOA chunk size. Only an int literal can follow so it isn't a procedure type.
+
+			if (TokPeek(pWork).tokk == TOKK_OpenParen && TokPeek(pWork, 1).tokk == TOKK_Literal)
+			{
+				ConsumeToken(pWork);
+
+				SToken tokChunk;
+				ConsumeExpectedLiteral(pWork, LITK_Int, &tokChunk);
+				if (tokChunk.lit.n <= 0)
+				{
+					ShowErr(tokChunk.errinfo, "SOA chunk size must be positive");
+				}
+
+				pAtypearray->cSoaChunk = tokChunk.lit.n;
+				ConsumeExpectedToken(pWork, TOKK_CloseParen);
+			}
 		}
 
 		pAtypearray->pAstTypeInner = PastParseType(pWork);
@@ -3018,7 +3510,7 @@ SAst * PastParseType(SWorkspace * pWork)
 		
 		ConsumeExpectedToken(pWork, TOKK_CloseParen);
 
-		if (FTryConsumeOperator(pWork, "->"))
+		if (FTryConsumeOperator(pWork, OP_Arrow))
 		{
 			ParseReturnValues(pWork, &pAtypproc->arypAstDeclRet);
 		}
@@ -3036,11 +3528,11 @@ SAst * PastParseType(SWorkspace * pWork)
 
 		SAst * pAstType = pAstident;
 
-		while (FTryConsumeOperator(pWork, ".", &tok))
+		while (FTryConsumeOperator(pWork, OP_Dot, &tok))
 		{
 			auto pAstop = PastCreate<SAstOperator>(pWork, tok.errinfo);
 
-			pAstop->pChzOp = tok.op.pChz;
+			pAstop->op = tok.op;
 			pAstop->pAstLeft = pAstType;
 
 			ConsumeExpectedToken(pWork, TOKK_Identifier, &tok);
@@ -3053,7 +3545,7 @@ SAst * PastParseType(SWorkspace * pWork)
 
 		return pAstType;
 	}
-	else if (FTryConsumeOperator(pWork, "..", &tok))
+	else if (FTryConsumeOperator(pWork, OP_Range, &tok))
 	{
 		return PastCreateManual<SAst>(pWork, ASTK_TypeVararg, tok.errinfo);
 	}
@@ -3091,19 +3583,19 @@ SAstDeclareSingle * PastdeclParseSimple(SWorkspace * pWork)
 	pAstdecl->pChzName = tokIdent.ident.pChz;
 	pAstdecl->fUsing = fUsing;
 
-	const char * pChzColonOp = tokDefineOp.op.pChz;
-	if (strcmp(pChzColonOp, ":") == 0)
+	OP opColon = tokDefineOp.op;
+	if (opColon == OP_Define)
 	{
 		// ident : type = value;
 		// BB (adrianb) Can we have : = mean infer type too?
 
 		pAstdecl->pAstType = PastParseType(pWork);
 
-		if (FTryConsumeOperator(pWork, "="))
+		if (FTryConsumeOperator(pWork, OP_Assign))
 		{
 			pAstdecl->pAstValue = PastParseExpression(pWork);
 		}
-		else if (FTryConsumeOperator(pWork, ":"))
+		else if (FTryConsumeOperator(pWork, OP_Define))
 		{
 			// BB (adrianb) Does this syntax even make sense?
 
@@ -3111,12 +3603,11 @@ SAstDeclareSingle * PastdeclParseSimple(SWorkspace * pWork)
 			pAstdecl->pAstValue = PastParseExpression(pWork);
 		}
 	}
-	else if (strcmp(pChzColonOp, ":=") == 0 ||
-			 strcmp(pChzColonOp, "::") == 0)
+	else if (opColon == OP_DefineAssign || opColon == OP_DefineConstant)
 	{
 		// ident := value
 
-		pAstdecl->fIsConstant = strcmp(pChzColonOp, ":=") != 0;
+		pAstdecl->fIsConstant = opColon == OP_DefineConstant;
 
 		if (pAstdecl->fIsConstant && FTryConsumeKeyword(pWork, KEYWORD_TypeDirective))
 		{
@@ -3170,39 +3661,46 @@ SAst * PastParseMultiDeclarationOrAssign(SWorkspace * pWork)
 
 	SToken tok = TokPeek(pWork);
 	bool fIsConstant = false;
-	if (FTryConsumeOperator(pWork, ":", &tok) || 
-		FTryConsumeOperator(pWork, "::", &tok) || 
-		FTryConsumeOperator(pWork, ":=", &tok))
+	if (FTryConsumeOperator(pWork, OP_Define, &tok) || 
+		FTryConsumeOperator(pWork, OP_DefineConstant, &tok) || 
+		FTryConsumeOperator(pWork, OP_DefineAssign, &tok))
 	{
 		auto pAstdecmul = PastCreate<SAstDeclareMulti>(pWork, tok.errinfo); // BB (adrianb) Want the error info for all the identifiers?
 
 		SAst * pAstType = nullptr;
-		bool fHasType = (strcmp(tok.op.pChz, ":") == 0);
+		bool fHasType = (tok.op == OP_Define);
 		if (fHasType)
 		{
 			pAstType = PastParseType(pWork);
 		}
 
-		fIsConstant = (strcmp(tok.op.pChz, "::") == 0);
+		fIsConstant = (tok.op == OP_DefineConstant);
+		pAstdecmul->pAstType = pAstType;
+		pAstdecmul->fIsConstant = fIsConstant;
 
 		for (int iTok : IterCount(cTokIdent))
 		{
 			const SToken & tokIdent = aTokIdent[iTok];
-			SAstDeclareMulti::SName * pName = PtAppendNew(&pAstdecmul->aryName);
-			pName->pChzName = tokIdent.ident.pChz;
-			pName->errinfo = tokIdent.errinfo;
+			auto pAstdecl = PastCreate<SAstDeclareSingle>(pWork, tokIdent.errinfo);
+			pAstdecl->pChzName = tokIdent.ident.pChz;
+			pAstdecl->fIsConstant = fIsConstant;
+			Append(&pAstdecmul->arypAstdecl, pAstdecl);
 		}
 
-		if (!fHasType || FTryConsumeOperator(pWork, "="))
+		if (!fHasType || FTryConsumeOperator(pWork, OP_Assign))
 		{
 			pAstdecmul->pAstValue = PastParseExpression(pWork);
 		}
 
 		return pAstdecmul;
 	}
-	else if (FTryConsumeOperator(pWork, "=", &tok))
+	else if (FTryConsumeOperator(pWork, OP_Assign, &tok))
 	{
 		auto pAstassignmul = PastCreate<SAstAssignMulti>(pWork, tok.errinfo);
+		for (int iTok : IterCount(cTokIdent))
+		{
+			Append(&pAstassignmul->arypAstName, static_cast<SAst *>(PastidentCreate(pWork, aTokIdent[iTok])));
+		}
 		pAstassignmul->pAstValue = PastParseExpression(pWork);
 		return pAstassignmul;
 	}
@@ -3277,7 +3775,8 @@ SAst * PastTryParseDeclaration(SWorkspace * pWork)
 
 		return PastParseMultiDeclarationOrAssign(pWork);
 	}
-	else if (tokDefine.tokk == TOKK_Operator && *tokDefine.op.pChz == ':') // BB (adrianb) Check for exact set of operators?
+	else if (FIsOperator(tokDefine, OP_Define) || FIsOperator(tokDefine, OP_DefineConstant) || 
+			 FIsOperator(tokDefine, OP_DefineAssign))
 	{
 		return PastdeclParseSimple(pWork);
 	}
@@ -3322,7 +3821,7 @@ SAst * PastDupForEnumValue(SWorkspace * pWork, SAst * pAst, int cEnumRow)
 			auto pAstopNew = PastDup(pWork, pAstop);
 
 			// Don't substitute inside external declarations
-			if (strcmp(pAstop->pChzOp, ".") == 0)
+			if (pAstop->op == OP_Dot)
 				cEnumRow = -1;
 
 			pAstopNew->pAstLeft = PastDupForEnumValue(pWork, pAstop->pAstLeft, cEnumRow);
@@ -3346,7 +3845,7 @@ SAst * PastTryParseStructOrProcedureDeclaration(SWorkspace * pWork)
 	if (tokIdent.tokk != TOKK_Identifier || tokDefineOp.tokk != TOKK_Operator)
 		return nullptr;
 
-	if (strcmp(tokDefineOp.op.pChz, "::") != 0)
+	if (tokDefineOp.op != OP_DefineConstant)
 		return nullptr;
 	
 	// BB (adrianb) Set these up as declarations too? Naming for procedures is special though in 
@@ -3369,10 +3868,12 @@ SAst * PastTryParseStructOrProcedureDeclaration(SWorkspace * pWork)
 	SToken tokValue = TokPeek(pWork, iTok);
 	
 	bool fInline = (tokValue.tokk == TOKK_Keyword && tokValue.keyword == KEYWORD_Inline);
-	if (tokValue.tokk == TOKK_OpenParen || (fInline && TokPeek(pWork, iTok + 1).tokk == TOKK_OpenParen)) // procedure
+	bool fNoInline = (tokValue.tokk == TOKK_Keyword && tokValue.keyword == KEYWORD_NoInline);
+	if (tokValue.tokk == TOKK_OpenParen || 
+		((fInline || fNoInline) && TokPeek(pWork, iTok + 1).tokk == TOKK_OpenParen)) // procedure
 	{
 		ConsumeThroughToken(pWork, tokValue);
-		if (fInline)
+		if (fInline || fNoInline)
 			ConsumeExpectedToken(pWork, TOKK_OpenParen);
 
 		auto pAstdecl = PastCreate<SAstDeclareSingle>(pWork, tokIdent.errinfo);
@@ -3380,6 +3881,7 @@ SAst * PastTryParseStructOrProcedureDeclaration(SWorkspace * pWork)
 		auto pAstproc = PastCreate<SAstProcedure>(pWork, tokIdent.errinfo);
 		pAstproc->pChzName = tokIdent.ident.pChz;
 		pAstproc->fIsInline = fInline;
+		pAstproc->fIsNoInline = fNoInline;
 		pAstproc->iModuleOwner = pWork->iModuleParse;
 
 		pAstdecl->pChzName = pAstproc->pChzName;
@@ -3401,7 +3903,7 @@ SAst * PastTryParseStructOrProcedureDeclaration(SWorkspace * pWork)
 
 		ConsumeExpectedToken(pWork, TOKK_CloseParen);
 
-		if (FTryConsumeOperator(pWork, "->"))
+		if (FTryConsumeOperator(pWork, OP_Arrow))
 		{
 			ParseReturnValues(pWork, &pAstproc->arypAstDeclRet);
 		}
@@ -3533,7 +4035,7 @@ SAst * PastTryParseStructOrProcedureDeclaration(SWorkspace * pWork)
 				ConsumeExpectedToken(pWork, TOKK_Identifier, PtAppendNew(&aryTokIdent));
 			}
 
-			if (FTryConsumeOperator(pWork, "="))
+			if (FTryConsumeOperator(pWork, OP_Assign))
 			{
 				arypAstValueLast.c = 0;
 				
@@ -3630,17 +4132,38 @@ SAst * PastTryParseStatement(SWorkspace * pWork)
 	{
 		auto pAstfor = PastCreate<SAstFor>(pWork, tok.errinfo);
 
-		// BB (adrianb) Parse *, any other for modifiers?
+		// BB (adrianb) Any other for modifiers?
+
+		pAstfor->fTakesPointer = FTryConsumeOperator(pWork, OP_Mul);
 
 		SToken tokIdent = TokPeek(pWork);
 		SToken tokColon = TokPeek(pWork, 1);
-		if (tokIdent.tokk == TOKK_Identifier && FIsOperator(tokColon, ":"))
+		if (tokIdent.tokk == TOKK_Identifier && FIsOperator(tokColon, OP_Define))
 		{
 			ConsumeToken(pWork, 2);
 			pAstfor->pAstIter = PastidentCreate(pWork, tokIdent);
 		}
 
 		pAstfor->pAstIterRight = PastParseExpression(pWork);
+
+		// Split up ranges, .. isn't a real operator
+
+		if (pAstfor->pAstIterRight->astk == ASTK_Operator)
+		{
+			auto pAstop = PastCast<SAstOperator>(pAstfor->pAstIterRight);
+			if (pAstop->op == OP_Range)
+			{
+				pAstfor->pAstIterRight = pAstop->pAstLeft;
+				pAstfor->pAstRangeEnd = pAstop->pAstRight;
+			}
+		}
+
+		auto pErrinfoIt = (pAstfor->pAstIter) ? &pAstfor->pAstIter->errinfo : &tok.errinfo;
+		pAstfor->pAstdeclIt = PastCreate<SAstDeclareSingle>(pWork, *pErrinfoIt);
+		pAstfor->pAstdeclIt->pChzName = (pAstfor->pAstIter) ? PastCast<SAstIdentifier>(pAstfor->pAstIter)->pChz : "it";
+		pAstfor->pAstdeclItIndex = PastCreate<SAstDeclareSingle>(pWork, tok.errinfo);
+		pAstfor->pAstdeclItIndex->pChzName = "it_index";
+
 		pAstfor->pAstLoop = PastParseStatement(pWork);
 
 		return pAstfor;
@@ -3674,10 +4197,34 @@ SAst * PastTryParseStatement(SWorkspace * pWork)
 	}
 	else if (FTryConsumeKeyword(pWork, KEYWORD_PushContext, &tok))
 	{
+		// Expands to { saved := context; context = ident; defer context = saved; block } so returns and
+		//  breaks out of the block restore the context like any other defer.
+
 		auto pAstpushctx = PastCreate<SAstPushContext>(pWork, tok.errinfo);
-		ConsumeExpectedToken(pWork, TOKK_Identifier, &tok);
-		pAstpushctx->pChzContext = tok.ident.pChz;
-		pAstpushctx->pAstblock = PastParseBlock(pWork);
+		SToken tokContext;
+		ConsumeExpectedToken(pWork, TOKK_Identifier, &tokContext);
+		pAstpushctx->pChzContext = tokContext.ident.pChz;
+
+		// NOTE (adrianb) Saved names can't be typed by the user and are unique so nested pushes don't collide.
+
+		char aChzSaved[32];
+		int cChSaved = snprintf(aChzSaved, DIM(aChzSaved), "context.saved%d", pWork->cPushContext++);
+		
+		auto pAstdeclSaved = PastCreate<SAstDeclareSingle>(pWork, tok.errinfo);
+		pAstdeclSaved->pChzName = PchzCopy(pWork, aChzSaved, cChSaved);
+		pAstdeclSaved->pAstValue = PastidentCreate(pWork, tok.errinfo, "context");
+
+		auto pAstdefer = PastCreate<SAstDefer>(pWork, tok.errinfo);
+		pAstdefer->pAstStmt = PastopCreateContextAssign(pWork, tok.errinfo, 
+														PastidentCreate(pWork, tok.errinfo, pAstdeclSaved->pChzName));
+
+		auto pAstblock = PastCreate<SAstBlock>(pWork, tok.errinfo);
+		Append(&pAstblock->arypAst, static_cast<SAst *>(pAstdeclSaved));
+		Append(&pAstblock->arypAst, PastopCreateContextAssign(pWork, tok.errinfo, PastidentCreate(pWork, tokContext)));
+		Append(&pAstblock->arypAst, static_cast<SAst *>(pAstdefer));
+		Append(&pAstblock->arypAst, static_cast<SAst *>(PastParseBlock(pWork)));
+
+		pAstpushctx->pAstblock = pAstblock;
 		return pAstpushctx;
 	}
 
@@ -3853,6 +4400,13 @@ struct SAstCtx
 	int cScope;
 	bool fPrintedAnything;
 	bool fPrintType;
+
+	// Print what identifiers resolve to and struct layouts, used to build codegen cache keys (see HvCodegenKey)
+
+	SWorkspace * pWorkResolve;
+	SArray<const STypeStruct *> arypTypestructPrinted;
+	SArray<const SAstProcedure *> arypAstprocPrinted; // Bodies of inlined procedures
+	bool fInlineCall; // Printing the call of an inline expression
 };
 
 void PrintEscapedString(const SPrintFuncImpl & print, const char * pChz)
@@ -3883,6 +4437,8 @@ inline void PrintSchemeType(SAstCtx * pAcx, STypeId tid)
 	PrintSchemeType(pAcx, tid.pType);
 }
 
+void PrintResolved(SAstCtx * pAcx, const SAst * pAstIdent);
+
 void PrintSchemeAst(SAstCtx * pAcx, const SAst * pAst)
 {
 	if (!pAst)
@@ -3934,12 +4490,14 @@ void PrintSchemeAst(SAstCtx * pAcx, const SAst * pAst)
 
 		case ASTK_Identifier:
 			print("'%s", PastCast<SAstIdentifier>(pAst)->pChz);
+			if (pAcx->pWorkResolve)
+				PrintResolved(pAcx, pAst);
 			break;
 
 		case ASTK_Operator:
 			{
 				auto pAstop = PastCast<SAstOperator>(pAst);
-				print("(%s", pAstop->pChzOp);
+				print("(%s", PchzFromOp(pAstop->op));
 				PrintSchemeAst(pAcx, pAstop->pAstLeft);
 				PrintSchemeAst(pAcx, pAstop->pAstRight);
 				print(")");
@@ -3999,7 +4557,7 @@ void PrintSchemeAst(SAstCtx * pAcx, const SAst * pAst)
 		case ASTK_Operator:
 			{
 				auto pAstop = PastCast<SAstOperator>(pAst);
-				print("(%s", pAstop->pChzOp);
+				print("(%s", PchzFromOp(pAstop->op));
 				PrintSchemeType(pAcx, pAstop->tid);
 				PrintSchemeAst(pAcx, pAstop->pAstLeft);
 				PrintSchemeAst(pAcx, pAstop->pAstRight);
@@ -4061,12 +4619,23 @@ LNested:
 	case ASTK_For:
 		{
 			auto pAstfor = PastCast<SAstFor>(pAst);
+			if (pAstfor->fTakesPointer)
+			{
+				print(" *");
+			}
+
 			if (pAstfor->pAstIter)
 			{
 				PrintSchemeAst(pAcx, pAstfor->pAstIter);
 			}
 
 			PrintSchemeAst(pAcx, pAstfor->pAstIterRight);
+			if (pAstfor->pAstRangeEnd)
+			{
+				print(" ..");
+				PrintSchemeAst(pAcx, pAstfor->pAstRangeEnd);
+			}
+
 			PrintSchemeAst(pAcx, pAstfor->pAstLoop);
 		}
 		break;
@@ -4119,7 +4688,18 @@ LNested:
 
 	case ASTK_Inline:
 		{
-			PrintSchemeAst(pAcx, PastCast<SAstInline>(pAst)->pAstExpr);
+			auto pAstinline = PastCast<SAstInline>(pAst);
+			if (pAstinline->fNoInline)
+			{
+				print(" no");
+			}
+
+			// Inlined calls generate the callee's body, so it's part of the codegen cache key
+
+			bool fInlineCallPrev = pAcx->fInlineCall;
+			pAcx->fInlineCall = !pAstinline->fNoInline;
+			PrintSchemeAst(pAcx, pAstinline->pAstExpr);
+			pAcx->fInlineCall = fInlineCallPrev;
 		}
 		break;
 
@@ -4207,9 +4787,9 @@ LNested:
 				}
 
 				print(" (names");
-				for (const auto & name : pAstdecmul->aryName)
+				for (auto pAstdecl : pAstdecmul->arypAstdecl)
 				{
-					print(" %s", name.pChzName);
+					print(" %s", pAstdecl->pChzName);
 				}
 				print(")");
 			}
@@ -4228,24 +4808,18 @@ LNested:
 			{
 				PrintSchemeAst(pAcx, pAstdecmul->pAstValue);
 			}
-
-			if (pAstdecmul->pAstValue)
-				PrintSchemeAst(pAcx, pAstdecmul->pAstValue);
 		}
 		break;
 
 	case ASTK_AssignMulti:
 		{
 			auto pAstassignmul = PastCast<SAstAssignMulti>(pAst);
-			if (fPrintAst)
+			print(" (names");
+			for (auto pAstName : pAstassignmul->arypAstName)
 			{
-				print(" (names");
-				for (int ipChz = 0; ipChz < pAstassignmul->arypChzName.c; ++ipChz)
-				{
-					print(" %s", pAstassignmul->arypChzName[ipChz]);
-				}
-				print(")");
+				PrintSchemeAst(pAcx, pAstName);
 			}
+			print(")");
 
 			PrintSchemeAst(pAcx, pAstassignmul->pAstValue);
 		}
@@ -4346,7 +4920,11 @@ LNested:
 
 	case ASTK_TypePointer:
 		{
-			PrintSchemeAst(pAcx, PastCast<SAstTypePointer>(pAst)->pAstTypeInner);
+			auto pAtypepointer = PastCast<SAstTypePointer>(pAst);
+			if (pAtypepointer->fSoa)
+				print(" soa");
+
+			PrintSchemeAst(pAcx, pAtypepointer->pAstTypeInner);
 		}
 		break;
 
@@ -4367,6 +4945,14 @@ LNested:
 				}
 			}
 
+			if (pAtypearray->fSoa)
+			{
+				if (pAtypearray->cSoaChunk > 0)
+					print(" (soa %lld)", pAtypearray->cSoaChunk);
+				else
+					print(" soa");
+			}
+
 			PrintSchemeAst(pAcx, PastCast<SAstTypeArray>(pAst)->pAstTypeInner);
 		}
 		break;
@@ -4410,8 +4996,10 @@ void ParseAll(SWorkspace * pWork)
 			}
 		}
 		
+		u64 nsStart = NsNow();
 		StartParseNewFile(pWork, pChzFile, pModule->pChzContents);
 		pModule->pAstblockRoot = PastblockParseRoot(pWork);
+		AddTraceSpan(pWork, "parse", pChzFile, nsStart);
 
 #if 0
 		printf("\nParsed file %s\n", pChzFile);
@@ -4468,9 +5056,11 @@ enum TYPEK
 	TYPEK_Enum,
 	TYPEK_TypeOf,
 	TYPEK_Vararg,
+	TYPEK_Vector,
 	//TYPEK_PolymorphicVariable, 
 
 	TYPEK_Max,
+	TYPEK_Nil = -1,
 
 	TYPEK_IntMic = TYPEK_S8,
 	TYPEK_IntMac = TYPEK_U64 + 1,
@@ -4486,6 +5076,13 @@ inline bool FIsFloat(TYPEK typek)
 	return typek >= TYPEK_Float && typek <= TYPEK_Double;
 }
 
+inline bool FIsPointerOrProcedure(TYPEK typek)
+{
+	// Procedure values are pointers too, they compare the same way
+
+	return typek == TYPEK_Pointer || typek == TYPEK_Procedure;
+}
+
 const char * PchzFromTypek(TYPEK typek)
 {
 	static const char * s_mpTypekPchz[] =
@@ -4511,6 +5108,7 @@ const char * PchzFromTypek(TYPEK typek)
 		"enum",
 		"typeof",
 		"vararg",
+		"vector",
 	};
 	CASSERT(DIM(s_mpTypekPchz) == TYPEK_Max);
 	ASSERT(typek >= 0 && typek < TYPEK_Max);
@@ -4524,6 +5122,7 @@ struct SType
 	u32 cB;
 	bool fSizeComputed;
 	u16 cBAlign;
+	SWorkspace * pWork;		// Owner, whose mutex guards computing the size (see EnsureTypeSize)
 	// BB (adrianb) Story cB and cBAlign?
 };
 
@@ -4531,7 +5130,7 @@ struct STypePointer : public SType
 {
 	static const TYPEK s_typek = TYPEK_Pointer;
 	STypeId tidPointedTo;
-	bool fSoa;				// BB (adrianb) Extend this to: -1 means no SOA. 0 means no size limit. >0 is AOSOA of that chunk size.
+	bool fSoa;				// Points at an element of an SOA array, stored as a pointer per member (see PltypeGenerate)
 };
 
 struct STypeProcedure : public SType
@@ -4570,7 +5169,8 @@ struct STypeArray : public SType
 	bool fDynamicallySized;	// Size of ..
 	s64 cSizeFixed;			// If >= 0 fixed size BB (adrianb) Is this enough to cover static/fixed?
 
-	bool fSoa;				// BB (adrianb) Extend this to: -1 means no SOA. 0 means no size limit. >0 is AOSOA of that chunk size.
+	bool fSoa;				// Struct elements stored a column per member (see EnsureTypeSize for layout)
+	s64 cSoaChunk;			// If > 0 AOSOA, columns are interleaved in chunks of this many elements (fixed size only)
 
 	STypeId tidElement;
 
@@ -4598,6 +5198,13 @@ struct STypeTypeOf : public SType
 	STypeId tid;
 };
 
+struct STypeVector : public SType
+{
+	static const TYPEK s_typek = TYPEK_Vector;
+	STypeId tidElement;		// Int or float, see InitWorkspace for the builtin names (float4, s32x8, ...)
+	int cElement;			// Power of two so the layout matches llvm's vectors with no padding
+};
+
 template <class T>
 T * PtypeCast(SType * pType)
 {
@@ -4854,6 +5461,13 @@ void PatchExt(SStringBuilder * pStrb, const char * pChzExt)
 	Print(pStrb, "%s", pChzExt);
 }
 
+void PrintVectorName(SStringBuilder * pStrb, TYPEK typekElement, int cElement)
+{
+	// float4, double2, s32x8 et al, the x keeps the count apart from int sizes
+
+	Print(pStrb, "%s%s%d", PchzFromTypek(typekElement), (FIsFloat(typekElement)) ? "" : "x", cElement);
+}
+
 void PrintFriendlyTypeRecursive(const SType * pType, SStringBuilder * pStrb)
 {
 	if (!pType)
@@ -4890,7 +5504,9 @@ void PrintFriendlyTypeRecursive(const SType * pType, SStringBuilder * pStrb)
 			else
 				Print(pStrb, "[] ");
 
-			if (pTypearray->fSoa)
+			if (pTypearray->fSoa && pTypearray->cSoaChunk > 0)
+				Print(pStrb, "SOA(%lld) ", pTypearray->cSoaChunk);
+			else if (pTypearray->fSoa)
 				Print(pStrb, "SOA ");
 
 			PrintFriendlyTypeRecursive(pTypearray->tidElement.pType, pStrb);
@@ -4942,6 +5558,13 @@ void PrintFriendlyTypeRecursive(const SType * pType, SStringBuilder * pStrb)
 			return;
 		}
 
+	case TYPEK_Vector:
+		{
+			auto pTypevec = PtypeCast<STypeVector>(pType);
+			PrintVectorName(pStrb, pTypevec->tidElement.pType->typek, pTypevec->cElement);
+			return;
+		}
+
 	default:
 		ASSERTCHZ(false, "Can't print type %s(%d)", PchzFromTypek(typek), typek);
 		break;
@@ -5030,6 +5653,27 @@ void PrintSchemeType(SAstCtx * pAcx, const SType * pType)
 			auto pTypestruct = static_cast<const STypeStruct *>(pType);
 			print("%s", pTypestruct->pChzName);
 			// BB (adrianb) Print member info?
+
+			if (pAcx->pWorkResolve && !FContains(pAcx->arypTypestructPrinted, pTypestruct))
+			{
+				// Layout once per struct, member defaults as syntax since they feed default initialization
+
+				Append(&pAcx->arypTypestructPrinted, pTypestruct);
+
+				bool fPrintTypePrev = pAcx->fPrintType;
+				print(" {");
+				for (int iMember : IterCount(pTypestruct->cMember))
+				{
+					auto pMember = &pTypestruct->aMember[iMember];
+					print(" %s@%d", pMember->pAstdecl->pChzName, pMember->iBOffset);
+					PrintSchemeType(pAcx, pMember->pAstdecl->tid);
+
+					pAcx->fPrintType = false;
+					PrintSchemeAst(pAcx, pMember->pAstdecl->pAstValue);
+					pAcx->fPrintType = fPrintTypePrev;
+				}
+				print(" }");
+			}
 		}
 		break;
 
@@ -5094,6 +5738,9 @@ LNested:
 			if (pTypearray->fSoa)
 				print(" SOA");
 
+			if (pTypearray->cSoaChunk > 0)
+				print("(%lld)", pTypearray->cSoaChunk);
+
 			PrintSchemeType(pAcx, pTypearray->tidElement);
 		}
 		break;
@@ -5126,6 +5773,14 @@ LNested:
 		}
 		break;
 
+	case TYPEK_Vector:
+		{
+			auto pTypevec = PtypeCast<STypeVector>(pType);
+			print("Vector %d", pTypevec->cElement);
+			PrintSchemeType(pAcx, pTypevec->tidElement);
+		}
+		break;
+
 	default:
 		ASSERTCHZ(false, "Can't print type %s(%d)", PchzFromTypek(typek), typek);
 		break;
@@ -5161,6 +5816,7 @@ bool FAreSameType(const SType * pType0, const SType * pType1)
 			return pTypearray0->fDynamicallySized == pTypearray1->fDynamicallySized &&
 					pTypearray0->cSizeFixed == pTypearray1->cSizeFixed &&
 					pTypearray0->fSoa == pTypearray1->fSoa &&
+					pTypearray0->cSoaChunk == pTypearray1->cSoaChunk &&
 					pTypearray0->tidElement == pTypearray1->tidElement;
 		}
 		break;
@@ -5233,6 +5889,14 @@ bool FAreSameType(const SType * pType0, const SType * pType1)
 			return true;
 		}
 
+	case TYPEK_Vector:
+		{
+			auto pTypevec0 = static_cast<const STypeVector *>(pType0);
+			auto pTypevec1 = static_cast<const STypeVector *>(pType1);
+
+			return pTypevec0->cElement == pTypevec1->cElement && pTypevec0->tidElement == pTypevec1->tidElement;
+		}
+
 	default:
 		ASSERTCHZ(false, "Missing clause for typek %d", pType0->typek);
 		return false;
@@ -5279,6 +5943,7 @@ u64 HvFromType(const SType & type)
 			hv = HvAccum(hv, pTypearray->fDynamicallySized);
 			hv = HvAccum(hv, pTypearray->cSizeFixed);
 			hv = HvAccum(hv, pTypearray->fSoa);
+			hv = HvAccum(hv, pTypearray->cSoaChunk);
 			hv = HvAccum(hv, pTypearray->tidElement);
 		}
 		break;
@@ -5327,6 +5992,14 @@ u64 HvFromType(const SType & type)
 		}
 		break;
 
+	case TYPEK_Vector:
+		{
+			auto pTypevec = static_cast<const STypeVector *>(&type);
+			hv = HvAccum(hv, pTypevec->cElement);
+			hv = HvAccum(hv, pTypevec->tidElement);
+		}
+		break;
+
 	default:
 		ASSERTCHZ(false, "Unknown type %s(%d)", PchzFromTypek(type.typek), type.typek);
 		break;
@@ -5366,6 +6039,11 @@ struct SDeclaration
 
 	int iTrecCur;
 	SArray<STypeRecurse> aryTrec;
+
+	// Dependencies between out of order declarations, see TypeCheckAll
+
+	SArray<SDeclaration *> arypDeclWaiting; // Suspended until we finish type checking
+	bool fSuspended;						// Waiting on another declaration, needing us now would be a cycle
 };
 
 struct SResolveDecl
@@ -5383,6 +6061,7 @@ T * PtypeClone(SWorkspace * pWork, const T * pTIn, SType ** ppType)
 
 	T * pT = PtAlloc<T>(&pWork->pagealloc);
 	memcpy(pT, pTIn, sizeof(T));
+	pT->pWork = pWork;
 	*ppType = pT;
 	return pT;
 }
@@ -5404,6 +6083,8 @@ void SetType(SWorkspace * pWork, STypeId tid)
 
 STypeId TidEnsure(SWorkspace * pWork, const SType * const pTypeTry)
 {
+	std::lock_guard<std::recursive_mutex> lock(*pWork->pMutex);
+
 	u32 hv = HvFromType(*pTypeTry);
 	const STypeId * pTid = PtLookupImpl(&pWork->setTid, hv, *pTypeTry);
 	
@@ -5448,6 +6129,12 @@ STypeId TidEnsure(SWorkspace * pWork, const SType * const pTypeTry)
 		}
 		break;
 
+	case TYPEK_Vector:
+		{
+			(void) PtypeClone(pWork, static_cast<const STypeVector *>(pTypeTry), &pType);
+		}
+		break;
+
 	default:
 		{
 			ASSERTCHZ(FIsBuiltinType(pTypeTry->typek), "Don't support uniquifying typek %s(%d)", 
@@ -5483,6 +6170,152 @@ struct STypeCheckSwitch // tag = tcswitch
 	SDeclaration * pDecl;
 };
 
+enum MATCHK
+{
+	MATCHK_Suspend,
+	MATCHK_None,
+	MATCHK_Coerce,
+	MATCHK_Exact,
+};
+
+struct SArgTypesKey // tag = argtypes
+{
+	const STypeId * aTid;
+	int cTid;
+};
+
+struct SOverloadMatch // tag = ovmatch
+{
+	// Best candidates in one overload set for some argument types, more than one is ambiguous (or none matched)
+
+	MATCHK matchk;
+	SResolveDecl ** apResdecl;
+	int cpResdecl;
+};
+
+struct SOverloadSet // tag = ovset
+{
+	// Every declaration of a name in one symbol table. Procedures are bucketed by argument count so a call only
+	//  looks at candidates that could take its arguments.
+
+	const char * pChzName;
+	SArray<SResolveDecl *> arypResdecl;				// All declarations in declaration order
+	SArray<SArray<SResolveDecl *>> mpCArgArypResdecl;	// Constant procedures by argument count
+	SArray<SResolveDecl *> arypResdeclAnyArity;		// Procedure pointers, C varargs and non-procedures
+	SArray<int> aryiPolyproc;						// Polymorphic procedures in SSymbolTable::aryPolyproc
+
+	SHash<SArgTypesKey, SOverloadMatch> hashArgtypesOvmatch; // Cached matches, cleared when a declaration is added
+};
+
+u32 HvFromKey(const SArgTypesKey & argtypes)
+{
+	u64 hv = s_nFNVOffsetBasis;
+	for (int iTid : IterCount(argtypes.cTid))
+	{
+		hv = HvAccum(hv, argtypes.aTid[iTid]);
+	}
+
+	return u32(hv);
+}
+
+bool FIsKeyEqual(const SArgTypesKey & argtypes0, const SArgTypesKey & argtypes1)
+{
+	if (argtypes0.cTid != argtypes1.cTid)
+		return false;
+
+	for (int iTid : IterCount(argtypes0.cTid))
+	{
+		if (argtypes0.aTid[iTid] != argtypes1.aTid[iTid])
+			return false;
+	}
+
+	return true;
+}
+
+inline u32 HvFromKey(const char * pChz)
+{
+	return HvFromKey(pChz, int(strlen(pChz)));
+}
+
+SOverloadSet * PovsetLookup(SSymbolTable * pSymt, const char * pChzName)
+{
+	SOverloadSet ** ppOvset = PtLookupImpl(&pSymt->hashPchzPovset, HvFromKey(pChzName), pChzName);
+	return (ppOvset) ? *ppOvset : nullptr;
+}
+
+SOverloadSet * PovsetEnsure(SWorkspace * pWork, SSymbolTable * pSymt, const char * pChzName)
+{
+	u32 hv = HvFromKey(pChzName);
+	SOverloadSet ** ppOvset = PtLookupImpl(&pSymt->hashPchzPovset, hv, pChzName);
+	if (ppOvset)
+		return *ppOvset;
+
+	auto pOvset = PtAlloc<SOverloadSet>(&pWork->pagealloc);
+	pOvset->pChzName = pChzName;
+	Add(&pSymt->hashPchzPovset, hv, pChzName, pOvset);
+	return pOvset;
+}
+
+void Destroy(SOverloadSet * pOvset)
+{
+	Destroy(&pOvset->arypResdecl);
+	for (auto * paryResdecl : IterPointer(pOvset->mpCArgArypResdecl))
+	{
+		Destroy(paryResdecl);
+	}
+	Destroy(&pOvset->mpCArgArypResdecl);
+	Destroy(&pOvset->arypResdeclAnyArity);
+	Destroy(&pOvset->aryiPolyproc);
+	Destroy(&pOvset->hashArgtypesOvmatch);
+}
+
+int CArgOverload(SDeclaration * pDecl)
+{
+	// Argument count a call needs to match this declaration, -1 if it can't be known from the declaration alone
+
+	auto pAstdecl = pDecl->pAstdecl;
+	if (!pAstdecl->fIsConstant || !pAstdecl->pAstValue || pAstdecl->pAstValue->astk != ASTK_Procedure)
+		return -1;
+
+	auto pAstproc = PastCast<SAstProcedure>(pAstdecl->pAstValue);
+	int cpAstArg = pAstproc->arypAstDeclArg.c;
+	if (pAstproc->fIsForeign && cpAstArg > 0)
+	{
+		auto pAstArgLastType = PastCast<SAstDeclareSingle>(pAstproc->arypAstDeclArg[cpAstArg - 1])->pAstType;
+		if (pAstArgLastType && pAstArgLastType->astk == ASTK_TypeVararg)
+			return -1;
+	}
+
+	return cpAstArg;
+}
+
+void AddToOverloadSet(SWorkspace * pWork, SSymbolTable * pSymt, SResolveDecl * pResdecl)
+{
+	auto pOvset = PovsetEnsure(pWork, pSymt, pResdecl->pDecl->pChzName);
+	Append(&pOvset->arypResdecl, pResdecl);
+
+	int cArg = CArgOverload(pResdecl->pDecl);
+	if (cArg < 0)
+	{
+		Append(&pOvset->arypResdeclAnyArity, pResdecl);
+	}
+	else
+	{
+		if (cArg >= pOvset->mpCArgArypResdecl.c)
+		{
+			int cNew = cArg + 1 - pOvset->mpCArgArypResdecl.c;
+			auto aryResdeclNew = PtAppendNew(&pOvset->mpCArgArypResdecl, cNew);
+			memset(aryResdeclNew, 0, cNew * sizeof(*aryResdeclNew));
+		}
+
+		Append(&pOvset->mpCArgArypResdecl[cArg], pResdecl);
+	}
+
+	// Cached matches are only valid for the candidates they were computed from
+
+	Destroy(&pOvset->hashArgtypesOvmatch);
+}
+
 enum FRESL
 {
 	FRESL_IgnoreProcedures = 0x01,
@@ -5495,9 +6328,9 @@ SResolveDecl * PresdeclLookup(SSymbolTable * pSymt, const char * pChzName, GRFRE
 	// BB (adrianb) Need to distinguish between looking up one level only and looking up globally?	
 
 	SResolveDecl * pResdeclFound = nullptr;
-	for (auto pResdecl : pSymt->arypResdecl)
+	if (SOverloadSet * pOvset = PovsetLookup(pSymt, pChzName))
 	{
-		if (strcmp(pResdecl->pDecl->pChzName, pChzName) == 0)
+		for (auto pResdecl : pOvset->arypResdecl)
 		{
 			if (grfresl & FRESL_IgnoreProcedures)
 			{
@@ -5528,8 +6361,23 @@ SResolveDecl * PresdeclLookup(SSymbolTable * pSymt, const char * pChzName, GRFRE
 	return nullptr;
 }
 
+bool FIsDeclared(SSymbolTable * pSymt, const char * pChzName)
+{
+	// Whether anything, including polymorphic procedures, is declared with this name in this scope or its parents.
+	//  Resolve using first so imported declarations count.
+
+	for (auto pSymtCur = pSymt; pSymtCur; pSymtCur = pSymtCur->pSymtParent)
+	{
+		SOverloadSet * pOvset = PovsetLookup(pSymtCur, pChzName);
+		if (pOvset && (pOvset->arypResdecl.c > 0 || pOvset->aryiPolyproc.c > 0))
+			return true;
+	}
+
+	return false;
+}
+
 void AddResolveDeclaration(SWorkspace * pWork, SSymbolTable * pSymt, SDeclaration * pDecl,
-							const SArray<SDeclaration *> & arypDeclUsingPath)
+							const SArray<SDeclaration *> & arypDeclUsingPath, bool fShadow = false)
 {
 	auto pAstdecl = pDecl->pAstdecl;
 	ASSERT(pAstdecl);
@@ -5543,7 +6391,10 @@ void AddResolveDeclaration(SWorkspace * pWork, SSymbolTable * pSymt, SDeclaratio
 		grfresl = FRESL_IgnoreProcedures;
 	}
 
-	if (SResolveDecl * pResdeclOrig = PresdeclLookup(pSymt, pChzName, grfresl, {}))
+	// Implicit declarations (for loop's it and it_index) are allowed to shadow so loops can nest
+
+	SResolveDecl * pResdeclOrig = (fShadow) ? nullptr : PresdeclLookup(pSymt, pChzName, grfresl, {});
+	if (pResdeclOrig)
 	{
 		PrintErr(pAstdecl->errinfo, "Duplicate symbol found");
 		PrintErr(pResdeclOrig->pDecl->pAstdecl->errinfo, "Original symbol");
@@ -5555,10 +6406,15 @@ void AddResolveDeclaration(SWorkspace * pWork, SSymbolTable * pSymt, SDeclaratio
 	pResdecl->arypDeclUsingPath = arypDeclUsingPath;
 
 	Append(&pSymt->arypResdecl, pResdecl);
+	AddToOverloadSet(pWork, pSymt, pResdecl);
+
+	if (pAstdecl->fUsing)
+		++pWork->nUsingEpoch;
 }
 
 void AddDeclaration(SWorkspace * pWork, SSymbolTable * pSymt, const char * pChzName, SAstDeclareSingle * pAstdecl,
-					SDeclaration ** ppDeclRet = nullptr, const SArray<SDeclaration *> & arypDeclUsingPath = {})
+					SDeclaration ** ppDeclRet = nullptr, const SArray<SDeclaration *> & arypDeclUsingPath = {},
+					bool fShadow = false)
 {
 	ASSERT(pAstdecl);
 
@@ -5569,18 +6425,24 @@ void AddDeclaration(SWorkspace * pWork, SSymbolTable * pSymt, const char * pChzN
 	if (ppDeclRet)
 		*ppDeclRet = pDecl;
 
-	AddResolveDeclaration(pWork, pSymt, pDecl, arypDeclUsingPath);
+	AddResolveDeclaration(pWork, pSymt, pDecl, arypDeclUsingPath, fShadow);
 }
 
 SSymbolTable * PsymtStructLookup(SWorkspace * pWork, STypeId tid);
 
-bool FTryResolveUsing(SWorkspace * pWork, SSymbolTable * pSymt, STypeCheckSwitch * pTcswitch)
+bool FTryResolveUsingRecursive(SWorkspace * pWork, SSymbolTable * pSymt, STypeCheckSwitch * pTcswitch)
 {
-	// Finish importing using declarations before finishing this resolve, first parent then us
+	// Finish importing using declarations before finishing this resolve, first parent then us.
+	//  Nothing to do if no using was added anywhere since this scope was last resolved.
+
+	if (pSymt->nUsingEpochResolved == pWork->nUsingEpoch)
+		return true;
+
+	++pWork->cUsingScopeVisit;
 
 	if (pSymt->pSymtParent)
 	{
-		if (!FTryResolveUsing(pWork, pSymt->pSymtParent, pTcswitch))
+		if (!FTryResolveUsingRecursive(pWork, pSymt->pSymtParent, pTcswitch))
 			return false;
 	}
 
@@ -5613,6 +6475,17 @@ bool FTryResolveUsing(SWorkspace * pWork, SSymbolTable * pSymt, STypeCheckSwitch
 				ShowErr(pAstdecl->errinfo, "Loop in using members.");
 			}
 
+			// Every member comes through this using, so they all share one path
+
+			int cpDeclUsing = pResdecl->arypDeclUsingPath.c + 1;
+			auto apDeclUsing = PtAlloc<SDeclaration *>(&pWork->pagealloc, cpDeclUsing);
+			for (int ipDeclUsing : IterCount(cpDeclUsing - 1))
+			{
+				apDeclUsing[ipDeclUsing] = pResdecl->arypDeclUsingPath[ipDeclUsing];
+			}
+
+			apDeclUsing[cpDeclUsing - 1] = pResdecl->pDecl;
+
 			for (auto pResdeclUse : pSymtStruct->arypResdecl)
 			{
 				// Ignore symbol table retrieved by using, we'll get there eventually
@@ -5620,15 +6493,6 @@ bool FTryResolveUsing(SWorkspace * pWork, SSymbolTable * pSymt, STypeCheckSwitch
 				if (pResdeclUse->arypDeclUsingPath.c > 0)
 					continue;
 
-				int cpDeclUsing = pResdecl->arypDeclUsingPath.c + 1;
-				auto apDeclUsing = PtAlloc<SDeclaration *>(&pWork->pagealloc, cpDeclUsing);
-				for (int ipDeclUsing : IterCount(cpDeclUsing - 1))
-				{
-					apDeclUsing[ipDeclUsing] = pResdecl->arypDeclUsingPath[ipDeclUsing];
-				}
-
-				apDeclUsing[cpDeclUsing - 1] = pResdecl->pDecl;
-
 				AddResolveDeclaration(pWork, pSymt, pResdeclUse->pDecl, { apDeclUsing, cpDeclUsing });
 			}
 		}
@@ -5638,9 +6502,22 @@ bool FTryResolveUsing(SWorkspace * pWork, SSymbolTable * pSymt, STypeCheckSwitch
 		}
 	}
 
+	pSymt->nUsingEpochResolved = pWork->nUsingEpoch;
 	return true;
 }
 
+bool FTryResolveUsing(SWorkspace * pWork, SSymbolTable * pSymt, STypeCheckSwitch * pTcswitch)
+{
+	++pWork->cUsingResolve;
+	if (pSymt->nUsingEpochResolved == pWork->nUsingEpoch)
+	{
+		++pWork->cUsingResolveSkip;
+		return true;
+	}
+
+	return FTryResolveUsingRecursive(pWork, pSymt, pTcswitch);
+}
+
 bool FTryResolveSymbolWithUsing(SWorkspace * pWork, SSymbolTable * pSymt, const char * pChzName, 
 								const SErrorInfo & errinfo, STypeCheckSwitch * pTcswitch, 
 								SResolveDecl ** ppResdecl)
@@ -5651,6 +6528,7 @@ bool FTryResolveSymbolWithUsing(SWorkspace * pWork, SSymbolTable * pSymt, const
 
 	// BB (adrianb) Error on ambiguous symbol.
 
+	++pWork->cSymbolLookup;
 	auto pResdecl = PresdeclLookup(pSymt, pChzName, 0, errinfo);
 	if (pResdecl && pResdecl->pDecl->pAstdecl->tid.pType == nullptr)
 	{
@@ -5664,14 +6542,6 @@ bool FTryResolveSymbolWithUsing(SWorkspace * pWork, SSymbolTable * pSymt, const
 
 bool FCanCoerce(const SAst * pAst, const STypeId & tidTo);
 
-enum MATCHK
-{
-	MATCHK_Suspend,
-	MATCHK_None,
-	MATCHK_Coerce,
-	MATCHK_Exact,
-};
-
 MATCHK MatchkTryPolymorph(SWorkspace * pWork, SSymbolTable * pSymt, SAst * pAstType, STypeId tidArg, 
 						  bool fExtract, SArray<SPolyArg> * paryParg, STypeCheckSwitch * pTcswitch)
 {
@@ -5736,7 +6606,7 @@ MATCHK MatchkTryPolymorph(SWorkspace * pWork, SSymbolTable * pSymt, SAst * pAstT
 			auto pTypearray = PtypeCast<STypeArray>(tidArg.pType);
 			auto pAstarray = PastCast<SAstTypeArray>(pAstType);
 
-			if (pAstarray->fSoa != pAstarray->fSoa)
+			if (pAstarray->fSoa != pTypearray->fSoa || pAstarray->cSoaChunk != pTypearray->cSoaChunk)
 				return MATCHK_None;
 
 			// Simple array matches all other array arguments (either exact or coerce)
@@ -5768,7 +6638,7 @@ MATCHK MatchkTryPolymorph(SWorkspace * pWork, SSymbolTable * pSymt, SAst * pAstT
 			auto pTypeptr = PtypeCast<STypePointer>(tidArg.pType);
 			auto pAstptr = PastCast<SAstTypePointer>(pAstType);
 
-			if (pAstptr->fSoa != pAstptr->fSoa)
+			if (pAstptr->fSoa != pTypeptr->fSoa)
 				return MATCHK_None;
 
 			return MatchkTryPolymorph(pWork, pSymt, pAstptr->pAstTypeInner, pTypeptr->tidPointedTo, fExtract, paryParg, pTcswitch);
@@ -5924,15 +6794,49 @@ STypeId TidWrap(SWorkspace * pWork, const STypeId & tid)
 	return TidEnsure(pWork, &ttypeof);
 }
 
-STypeId TidPointer(SWorkspace * pWork, STypeId tid)
+STypeId TidPointer(SWorkspace * pWork, STypeId tid, bool fSoa = false)
 {
 	STypePointer typeptr = {};
 	typeptr.typek = TYPEK_Pointer;
 	typeptr.tidPointedTo = tid;
+	typeptr.fSoa = fSoa;
 
 	return TidEnsure(pWork, &typeptr);
 }
 
+STypeId TidVector(SWorkspace * pWork, STypeId tidElement, int cElement)
+{
+	STypeVector typevec = {};
+	typevec.typek = TYPEK_Vector;
+	typevec.tidElement = tidElement;
+	typevec.cElement = cElement;
+
+	return TidEnsure(pWork, &typevec);
+}
+
+bool FIsVector(STypeId tid)
+{
+	return tid.pType && tid.pType->typek == TYPEK_Vector;
+}
+
+STypeId TidVectorMask(SWorkspace * pWork, STypeId tidVector)
+{
+	// Vector comparisons give a signed int per element, all ones where true, same width as the elements compared
+
+	auto pTypevec = PtypeCast<STypeVector>(tidVector.pType);
+
+	TYPEK typekMask;
+	switch (CBit(pTypevec->tidElement.pType->typek))
+	{
+	case 8: typekMask = TYPEK_S8; break;
+	case 16: typekMask = TYPEK_S16; break;
+	case 32: typekMask = TYPEK_S32; break;
+	default: typekMask = TYPEK_S64; break;
+	}
+
+	return TidVector(pWork, TidEnsure(pWork, SType{typekMask}), pTypevec->cElement);
+}
+
 SAstDeclareSingle * PastdeclCreateTyped(SWorkspace * pWork, const char * pChzName, STypeId tid)
 {
 	auto pAstdecl = PastCreate<SAstDeclareSingle>(pWork, SErrorInfo());
@@ -5974,8 +6878,8 @@ typedef u32 GRFWINIT;
 void InitWorkspace(SWorkspace * pWork, GRFWINIT grfwinit)
 {
 	ClearStruct(pWork);
-	pWork->cOperator = DIM(g_aOperator);
 
+	pWork->pMutex = new std::recursive_mutex;
 	Init(&pWork->pagealloc, 64 * 1024);
 
 	pWork->symtRoot.pSymtParent = &pWork->symtBuiltin;
@@ -6007,10 +6911,29 @@ void InitWorkspace(SWorkspace * pWork, GRFWINIT grfwinit)
 	AddBuiltinType(pWork, "f32", SType{TYPEK_Float});
 	AddBuiltinType(pWork, "f64", SType{TYPEK_Double});
 
+	// Vectors of every int and float type, up to 16 elements and 64 bytes (an avx-512 register)
+
+	for (TYPEK typekElement = TYPEK_IntMic; typekElement <= TYPEK_Double; typekElement = TYPEK(typekElement + 1))
+	{
+		STypeId tidElement = TidEnsure(pWork, SType{typekElement});
+		for (int cElement = 2; cElement <= 16 && cElement * CBit(typekElement) <= 512; cElement *= 2)
+		{
+			SStringBuilder strb;
+			PrintVectorName(&strb, typekElement, cElement);
+
+			STypeVector typevec = {};
+			typevec.typek = TYPEK_Vector;
+			typevec.tidElement = tidElement;
+			typevec.cElement = cElement;
+			AddBuiltinType(pWork, PchzCopy(pWork, strb.aChz, strb.cCh), typevec);
+		}
+	}
+
 	{
 		SSymbolTable * pSymtString = PsymtCreate(SYMTBLK_Struct, pWork, nullptr);
 		auto pTypestructString = PtAlloc<STypeStruct>(&pWork->pagealloc);
 		pTypestructString->typek = TYPEK_Struct;
+		pTypestructString->pWork = pWork;
 		pTypestructString->pChzName = "_string";
 		pTypestructString->aMember = PtAlloc<STypeStruct::SMember>(&pWork->pagealloc, 2);
 		pTypestructString->cMember = 2;
@@ -6035,6 +6958,7 @@ void InitWorkspace(SWorkspace * pWork, GRFWINIT grfwinit)
 	}
 
 	//AddBuiltinType(pWork, "Any", SType{TYPEK_Any});
+
 }
 
 void Destroy(SWorkspace * pWork)
@@ -6061,9 +6985,18 @@ void Destroy(SWorkspace * pWork)
 				Destroy(&pSpecproc->pResdecl->pDecl->aryTrec);
 			}
 			Destroy(&pPolyproc->arySpecproc);
+			Destroy(&pPolyproc->hashPolykeyPresdecl);
 		}
 		Destroy(&pSymt->aryPolyproc);
 
+		for (int iNode : IterCount(pSymt->hashPchzPovset.cMax))
+		{
+			auto pNode = &pSymt->hashPchzPovset.aNode[iNode];
+			if (pNode->fFull)
+				Destroy(pNode->e);
+		}
+		Destroy(&pSymt->hashPchzPovset);
+
 		for (auto pResdecl : pSymt->arypResdecl)
 		{
 			Destroy(&pResdecl->pDecl->aryTrec);
@@ -6085,8 +7018,18 @@ void Destroy(SWorkspace * pWork)
 	Destroy(&pWork->aryModule);
 
 	Destroy(&pWork->hashPastPresdeclResolved);
+	Destroy(&pWork->hashPolycallPresdecl);
+	Destroy(&pWork->aryBuiltinref);
 	Destroy(&pWork->arypTypestruct);
 
+	for (int iNode : IterCount(pWork->hashPastdeclPvConst.cMax))
+	{
+		auto pNode = &pWork->hashPastdeclPvConst.aNode[iNode];
+		if (pNode->fFull)
+			free(pNode->e);
+	}
+	Destroy(&pWork->hashPastdeclPvConst);
+
 	Destroy(&pWork->setpChz);
 	Destroy(&pWork->aryTokNext);
 	Destroy(&pWork->pagealloc);
@@ -6095,6 +7038,7 @@ void Destroy(SWorkspace * pWork)
 
 	Destroy(&pWork->setTid);
 	Destroy(&pWork->pagealloc);
+	delete pWork->pMutex;
 	
 	ClearStruct(pWork);
 }
@@ -6235,6 +7179,8 @@ void RecurseTypeCheckDecl(const SRecurseCtx & recxIn, SAst ** ppAst)
 				if (pAstproc->fIsPolymorphic)
 				{
 					ASSERT(!recxIn.paryParg);
+					auto pOvset = PovsetEnsure(recx.pWork, recx.pSymtParent, pAstdecl->pChzName);
+					Append(&pOvset->aryiPolyproc, recx.pSymtParent->aryPolyproc.c);
 					Append(&recx.pSymtParent->aryPolyproc, SPolymorphicProc{pAstdecl});
 					break;
 				}
@@ -6355,7 +7301,7 @@ void RecurseTypeCheck(const SRecurseCtx & recx, SAst ** ppAst)
 
 			// . doesn't process its right expression (should be identifier)
 
-			if (strcmp(".", pAstop->pChzOp) != 0)
+			if (pAstop->op != OP_Dot)
 			{
 				RecurseTypeCheck(recx, &pAstop->pAstRight);
 			}
@@ -6396,6 +7342,11 @@ void RecurseTypeCheck(const SRecurseCtx & recx, SAst ** ppAst)
 			auto pAstfor = PastPrepare<SAstFor>(recxFor, ppAst);
 			// NOTE (adrianb) pAstIter is just a identifier which absorbs the type on the right or so
 			RecurseTypeCheck(recx, &pAstfor->pAstIterRight);
+			if (pAstfor->pAstRangeEnd)
+				RecurseTypeCheck(recx, &pAstfor->pAstRangeEnd);
+
+			(void) PastPrepare<SAstDeclareSingle>(recxFor, &pAstfor->pAstdeclIt);
+			(void) PastPrepare<SAstDeclareSingle>(recxFor, &pAstfor->pAstdeclItIndex);
 			AppendAst(recxFor, ppAst); // Type check for and iterator names and such.
 
 			SRecurseCtx recxLoop = RecxNewScope(recxFor);
@@ -6502,13 +7453,29 @@ void RecurseTypeCheck(const SRecurseCtx & recx, SAst ** ppAst)
 			return;
 		}
 
-#if 0
 	case ASTK_DeclareMulti:
+		{
+			auto pAstdecmul = PastPrepare<SAstDeclareMulti>(recx, ppAst);
+			if (pAstdecmul->pAstType)
+				RecurseTypeCheck(recx, &pAstdecmul->pAstType);
+			if (pAstdecmul->pAstValue)
+				RecurseTypeCheck(recx, &pAstdecmul->pAstValue);
+
+			Prepare(recx, &pAstdecmul->arypAstdecl);
+			for (int ipAstdecl : IterCount(pAstdecmul->arypAstdecl.c))
+				(void) PastPrepare<SAstDeclareSingle>(recx, &pAstdecmul->arypAstdecl[ipAstdecl]);
+		}
 		break;
 
 	case ASTK_AssignMulti:
+		{
+			auto pAstassignmul = PastPrepare<SAstAssignMulti>(recx, ppAst);
+			Prepare(recx, &pAstassignmul->arypAstName);
+			for (int ipAst : IterCount(pAstassignmul->arypAstName.c))
+				RecurseTypeCheck(recx, &pAstassignmul->arypAstName[ipAst]);
+			RecurseTypeCheck(recx, &pAstassignmul->pAstValue);
+		}
 		break;
-#endif
 
 	case ASTK_Struct:
 		{
@@ -6654,8 +7621,6 @@ void RecurseTypeCheck(const SRecurseCtx & recx, SAst ** ppAst)
 		}
 		break;
 
-	case ASTK_DeclareMulti:
-	case ASTK_AssignMulti:
 	case ASTK_TypeDefinition:
 	case ASTK_ForeignLibraryDirective:
 	case ASTK_Invalid:
@@ -6672,237 +7637,374 @@ void RecurseTypeCheck(const SRecurseCtx & recx, SAst ** ppAst)
 	AppendAst(recx, ppAst);
 }
 
-MATCHK MatchkTryResolveOverloadWithUsing(SWorkspace * pWork, SSymbolTable * pSymtStart, SAstCall * pAstcall, 
-										 STypeCheckSwitch * pTcswitch, SResolveDecl ** ppResdecl)
+u32 HvFromKey(const SPolyArgKey & polykey)
 {
-	auto pAstident = PastCast<SAstIdentifier>(pAstcall->pAstFunc);
-	const char * pChzName = pAstident->pChz;
+	u64 hv = s_nFNVOffsetBasis;
+	for (int iParg : IterCount(polykey.cParg))
+	{
+		hv = HvAccum(hv, polykey.aParg[iParg].tid);
+	}
 
-	// Resolve using declarations all the way up the chain
+	return u32(hv);
+}
 
-	if (!FTryResolveUsing(pWork, pSymtStart, pTcswitch))
-		return MATCHK_Suspend;
+bool FIsKeyEqual(const SPolyArgKey & polykey0, const SPolyArgKey & polykey1)
+{
+	if (polykey0.cParg != polykey1.cParg)
+		return false;
 
-	SFixArray<SResolveDecl *, 8> arypResdeclMatch = {};
-	MATCHK matchkBest = MATCHK_None;
-	for (auto pSymtCur = pSymtStart; pSymtCur; pSymtCur = pSymtCur->pSymtParent)
+	for (int iParg : IterCount(polykey0.cParg))
 	{
-		for (auto pResdecl : pSymtCur->arypResdecl)
-		{
-			if (strcmp(pResdecl->pDecl->pChzName, pChzName) != 0)
-				continue;
+		ASSERT(polykey0.aParg[iParg].pChz == polykey1.aParg[iParg].pChz);
+		if (polykey0.aParg[iParg].tid != polykey1.aParg[iParg].tid)
+			return false;
+	}
 
-			// Make sure type of declaration is determined first
-			auto pAstdecl = pResdecl->pDecl->pAstdecl;
-			STypeId tidProc = pAstdecl->tid;
-			if (tidProc.pType == nullptr)
-			{
-				pTcswitch->pDecl = pResdecl->pDecl;
-				return MATCHK_Suspend;
-			}
+	return true;
+}
 
-			if (tidProc.pType->typek != TYPEK_Procedure)
-			{
-				ShowErr(pAstcall->errinfo, "Cannot call non-procedure");
-				break;
-			}
+inline u32 HvFromKey(const SPolyCallKey & polycall)
+{
+	return u32(HvMem(polycall));
+}
 
-			// See if this is a better match for arguments
+inline bool FIsKeyEqual(const SPolyCallKey & polycall0, const SPolyCallKey & polycall1)
+{
+	return polycall0.pAstcall == polycall1.pAstcall && polycall0.pAstdeclPoly == polycall1.pAstdeclPoly;
+}
 
-			MATCHK matchk = MATCHK_None;
-			if (!pAstdecl->fIsConstant)
-			{
-				// BB (adrianb) Pointer to function. Still look at parameters for overload? Somehow?
-				//  Or just disallow any other match?
-				matchk = MATCHK_Exact;
-			}
-			else
-			{
-				auto pTypeproc = PtypeCast<STypeProcedure>(tidProc.pType);
-				if (pTypeproc->cTidArg != pAstcall->arypAstArgs.c)
-				{
-					if (!pTypeproc->fUsesCVararg || pTypeproc->cTidArg > pAstcall->arypAstArgs.c)
-						continue;
-				}
+bool FTryMatchSpecialization(SWorkspace * pWork, SSymbolTable * pSymt, SPolymorphicProc * pPolyproc, 
+							 SAstCall * pAstcall, STypeCheckSwitch * pTcswitch, SResolveDecl ** ppResdecl)
+{
+	// Infers the polymorphic types from the call arguments and finds or creates the specialization for them.
+	//  Returns false if we need to suspend, *ppResdecl is null if the arguments don't match.
 
-				matchk = MATCHK_Exact;
-				for (int iArg : IterCount(pTypeproc->cTidArg))
-				{
-					auto pAstArg = pAstcall->arypAstArgs[iArg];
-					auto tidExpected = pTypeproc->aTidArg[iArg];
-					if (pAstArg->tid == tidExpected)
-						continue;
+	*ppResdecl = nullptr;
 
-					// BB (adrianb) to do this for literals we need to choose those closest.
-					//  This implies a better match function.
+	auto * pAstdeclOrig = pPolyproc->pAstdeclProcOrig;
+	auto pAstprocPoly = PastCast<SAstProcedure>(pAstdeclOrig->pAstValue);
+	ASSERT(pAstprocPoly->arypAstDeclArg.c == pAstcall->arypAstArgs.c);
 
-					if (!FCanCoerce(pAstArg, tidExpected))
-					{
-						matchk = MATCHK_None;
-						break;
-					}
+	// BB (adrianb) Provide stack allocation instead/addition. Would need to alloc in those cases when we pull into a specialization.
 
-					matchk = MATCHK_Coerce; // Implicit?
-				}
-			}
+	SArray<SPolyArg> aryParg = {};
+	defer { Destroy(&aryParg); };
 
-			if (matchk < matchkBest)
-				continue;
-			
-			// BB (adrianb) Disambiguate multiple implicit matches? E.g. compare scores.
+	// Match arguments and figure out inferred types
+	// BB (adrianb) Support varargs here? Need to look at args list to determine var arg presence.
 
-			if (matchk > matchkBest)
-				arypResdeclMatch.c = 0;
+	for (int i = 0; i < pAstcall->arypAstArgs.c; ++i)
+	{
+		auto pAstdeclArg = PastCast<SAstDeclareSingle>(pAstprocPoly->arypAstDeclArg[i]);
+		// BB (adrianb) Bundle work+symt+switch? It's a lot of typing to forward this stuff everywhere.
+		auto matchk = MatchkTryPolymorph(pWork, pSymt, pAstdeclArg->pAstType, pAstcall->arypAstArgs[i], true, &aryParg, pTcswitch);
+		if (matchk == MATCHK_Suspend)
+			return false;
+		if (matchk != MATCHK_Exact)
+			return true;
+	}
 
-			// BB (adrianb) Provide an expansion mechanism so we can show all possibilities.
+	// Check inferred types match destination
+	for (int i = 0; i < pAstcall->arypAstArgs.c; ++i)
+	{
+		auto pAstdeclArg = PastCast<SAstDeclareSingle>(pAstprocPoly->arypAstDeclArg[i]);
+		MATCHK matchk = MatchkTryPolymorph(pWork, pSymt, pAstdeclArg->pAstType, pAstcall->arypAstArgs[i], false, &aryParg, pTcswitch);
+		ASSERT(matchk != MATCHK_Suspend);
+		if (matchk != MATCHK_Exact)
+			return true;
+	}
 
-			if (!FIsFull(&arypResdeclMatch))
-				Append(&arypResdeclMatch, pResdecl);
+	// See if we've already specialized this routine
 
-			matchkBest = matchk;
-		}
+	pWork->cPolyLookup++;
 
-		// Try matching any 
+	SPolyArgKey polykey = { aryParg.a, aryParg.c };
+	u32 hvPolykey = HvFromKey(polykey);
+	if (SResolveDecl ** ppResdeclSpec = PtLookupImpl(&pPolyproc->hashPolykeyPresdecl, hvPolykey, polykey))
+	{
+		pWork->cPolyHit++;
+		*ppResdecl = *ppResdeclSpec;
+		return true;
+	}
 
-		if (matchkBest == MATCHK_None)
-		{
-			// BB (adrianb) Provide stack allocation instead/addition. Would need to alloc in those cases when we pull into a specialization.
+	// Add new specialization, take over allocated array
 
-			SArray<SPolyArg> aryParg = {};
-			defer { Destroy(&aryParg); };
+	auto pSpecproc = PtAppendNew(&pPolyproc->arySpecproc);
+	pSpecproc->aryParg = aryParg;
+	aryParg = {};
 
-			for (auto * pPolyproc : IterPointer(pSymtCur->aryPolyproc))
-			{
-				// Reset array
+	// Duplicate the entire AST for the procedure, annotate the types on the polymorphic elements,
+	//  and unflag as polymorphic
 
-				aryParg.c = 0;
+	SRecurseCtx recx = { pWork, nullptr, pSymt, &pSpecproc->aryParg };
 
-				// BB (adrianb) Use interred strings for faster compare?
-				auto * pAstdeclOrig = pPolyproc->pAstdeclProcOrig;
-				if (strcmp(pAstdeclOrig->pChzName, pChzName) != 0)
-					continue;
-				
-				// Match arguments and figure out inferred types
-				// BB (adrianb) Support varargs here? Need to look at args list to determine var arg presence.
+	SAstDeclareSingle * pAstdecl = pAstdeclOrig;
+	auto pAstdeclNew = PastPrepare<SAstDeclareSingle>(recx, &pAstdecl);
+	ASSERT(pAstdeclNew == pAstdecl);
+	
+	auto pDecl = PtAlloc<SDeclaration>(&pWork->pagealloc);
+	pDecl->pChzName = pAstdeclOrig->pChzName;
+	pDecl->pAstdecl = pAstdecl;
 
-				// BB (adrianb) In all these continue cases, we should be appending if best match is none.
-				//  We don't currently have a SResolveDecl yet.
+	// NOTE (adrianb) Not calling AddResolveDeclaration because we are stored in this symbol table
 
-				auto pAstprocPoly = PastCast<SAstProcedure>(pAstdeclOrig->pAstValue);
-				if (pAstprocPoly->arypAstDeclArg.c != pAstcall->arypAstArgs.c)
-					continue;
+	auto pResdecl = PtAlloc<SResolveDecl>(&pWork->pagealloc);
+	pResdecl->pDecl = pDecl;
+	pSpecproc->pResdecl = pResdecl;
+	*ppResdecl = pResdecl;
+
+	// Key points at the array now owned by the specialization, which doesn't move with arySpecproc
+
+	SPolyArgKey polykeySpec = { pSpecproc->aryParg.a, pSpecproc->aryParg.c };
+	Add(&pPolyproc->hashPolykeyPresdecl, hvPolykey, polykeySpec, pResdecl);
+	
+	// Procedure handles its own declaration addition
+
+	if (recx.pSymtParent->symtblk != SYMTBLK_Procedure)
+		recx.paryTrec = &pDecl->aryTrec;
+
+	ASSERT(!pAstdecl->pAstType);
+	ASSERT(pAstdecl->pAstValue);
+	ASSERT(pAstdecl->pAstValue->astk == ASTK_Procedure);
+
+	// Recurse differently for procedures to support recursion
+	//  Type check: arg/ret, proc, declaration, body
+
+	auto pAstproc = PastPrepare<SAstProcedure>(recx, &pAstdecl->pAstValue);
+	pAstproc->fIsPolymorphic = false;
+	
+	SRecurseCtx recxProc = recx;
+	RecurseProcArgRet(&recxProc, pAstproc);
+	AppendAst(recx, &pAstdecl->pAstValue);
+	AppendAst(recx, reinterpret_cast<SAst **>(&pDecl->pAstdecl));
+
+	RecurseTypeCheck(recxProc, reinterpret_cast<SAst **>(&pAstproc->pAstblock));
+
+	return true;
+}
+
+bool FTryMatchOverloadSet(SWorkspace * pWork, SOverloadSet * pOvset, SAstCall * pAstcall, STypeCheckSwitch * pTcswitch,
+						  MATCHK * pMatchk, SArray<SResolveDecl *> * parypResdeclMatch)
+{
+	// Best matching declarations in one overload set, more than one is ambiguous. Returns false if we need to
+	//  suspend. Cached by argument types unless the answer depends on literal values.
+
+	*pMatchk = MATCHK_None;
+	parypResdeclMatch->c = 0;
+
+	int cArg = pAstcall->arypAstArgs.c;
+	auto aTidArg = static_cast<STypeId *>(alloca(sizeof(STypeId) * Max(cArg, 1)));
+	bool fCache = true;
+	for (int iArg : IterCount(cArg))
+	{
+		auto pAstArg = pAstcall->arypAstArgs[iArg];
+		if (pAstArg->astk == ASTK_Literal || pAstArg->astk == ASTK_Null || 
+			pAstArg->astk == ASTK_UninitializedValue || !pAstArg->tid.pType)
+		{
+			fCache = false;
+		}
+
+		aTidArg[iArg] = pAstArg->tid;
+	}
+
+	SArgTypesKey argtypes = { aTidArg, cArg };
+	u32 hvArgtypes = 0;
+	if (fCache)
+	{
+		pWork->cOverloadLookup++;
+		hvArgtypes = HvFromKey(argtypes);
+		if (SOverloadMatch * pOvmatch = PtLookupImpl(&pOvset->hashArgtypesOvmatch, hvArgtypes, argtypes))
+		{
+			pWork->cOverloadHit++;
+			*pMatchk = pOvmatch->matchk;
+			for (int ipResdecl : IterCount(pOvmatch->cpResdecl))
+			{
+				Append(parypResdeclMatch, pOvmatch->apResdecl[ipResdecl]);
+			}
+			return true;
+		}
+	}
+
+	const SArray<SResolveDecl *> * aparypResdecl[] = 
+	{
+		(cArg < pOvset->mpCArgArypResdecl.c) ? &pOvset->mpCArgArypResdecl[cArg] : nullptr,
+		&pOvset->arypResdeclAnyArity,
+	};
+
+	MATCHK matchkBest = MATCHK_None;
+	for (auto paryResdecl : aparypResdecl)
+	{
+		if (!paryResdecl)
+			continue;
+
+		for (auto pResdecl : *paryResdecl)
+		{
+			// Make sure type of declaration is determined first
+			auto pAstdecl = pResdecl->pDecl->pAstdecl;
+			STypeId tidProc = pAstdecl->tid;
+			if (tidProc.pType == nullptr)
+			{
+				pTcswitch->pDecl = pResdecl->pDecl;
+				return false;
+			}
+
+			if (tidProc.pType->typek != TYPEK_Procedure)
+			{
+				ShowErr(pAstcall->errinfo, "Cannot call non-procedure");
+			}
 
-				bool fMatches = true;
+			// See if this is a better match for arguments
 
-				for (int i = 0; i < pAstcall->arypAstArgs.c; ++i)
+			MATCHK matchk = MATCHK_None;
+			if (!pAstdecl->fIsConstant)
+			{
+				// BB (adrianb) Pointer to function. Still look at parameters for overload? Somehow?
+				//  Or just disallow any other match?
+				matchk = MATCHK_Exact;
+			}
+			else
+			{
+				auto pTypeproc = PtypeCast<STypeProcedure>(tidProc.pType);
+				if (pTypeproc->cTidArg != cArg)
 				{
-					auto pAstdeclArg = PastCast<SAstDeclareSingle>(pAstprocPoly->arypAstDeclArg[i]);
-					// BB (adrianb) Bundle work+symt+switch? It's a lot of typing to forward this stuff everywhere.
-					auto matchk = MatchkTryPolymorph(pWork, pSymtCur, pAstdeclArg->pAstType, pAstcall->arypAstArgs[i], true, &aryParg, pTcswitch);
-					if (matchk == MATCHK_Suspend)
-						return MATCHK_Suspend;
-					if (matchk != MATCHK_Exact)
-					{
-						fMatches = false;
-						break;
-					}
+					if (!pTypeproc->fUsesCVararg || pTypeproc->cTidArg > cArg)
+						continue;
 				}
 
-				if (!fMatches)
-					continue;
-
-				// Check inferred types match destination
-				for (int i = 0; i < pAstcall->arypAstArgs.c; ++i)
+				matchk = MATCHK_Exact;
+				for (int iArg : IterCount(pTypeproc->cTidArg))
 				{
-					auto pAstdeclArg = PastCast<SAstDeclareSingle>(pAstprocPoly->arypAstDeclArg[i]);
-					MATCHK matchk = MatchkTryPolymorph(pWork, pSymtCur, pAstdeclArg->pAstType, pAstcall->arypAstArgs[i], false, &aryParg, pTcswitch);
-					ASSERT(matchk != MATCHK_Suspend);
-					if (matchk != MATCHK_Exact)
+					auto pAstArg = pAstcall->arypAstArgs[iArg];
+					auto tidExpected = pTypeproc->aTidArg[iArg];
+					if (pAstArg->tid == tidExpected)
+						continue;
+
+					// BB (adrianb) to do this for literals we need to choose those closest.
+					//  This implies a better match function.
+
+					if (!FCanCoerce(pAstArg, tidExpected))
 					{
-						fMatches = false;
+						matchk = MATCHK_None;
 						break;
 					}
+
+					matchk = MATCHK_Coerce; // Implicit?
 				}
+			}
 
-				if (!fMatches)
-					continue;
+			if (matchk < matchkBest)
+				continue;
 
-				// See if we've already specialized this routine
+			if (matchk > matchkBest)
+				parypResdeclMatch->c = 0;
 
-				SResolveDecl * pResdeclFound = nullptr;
-				for (const auto & specproc : pPolyproc->arySpecproc)
-				{
-					ASSERT(specproc.aryParg.c == aryParg.c);
-					for (int i = 0;; ++i)
-					{
-						if (i >= aryParg.c)
-						{
-							ASSERT(pResdeclFound == nullptr);
-							pResdeclFound = specproc.pResdecl;
-							break;
-						}
-						
-						ASSERT(specproc.aryParg[i].pChz == aryParg[i].pChz);
-						if (specproc.aryParg[i].tid != aryParg[i].tid)
-							break;
-					}
-				}
+			Append(parypResdeclMatch, pResdecl);
+			matchkBest = matchk;
+		}
+	}
 
-				if (!pResdeclFound)
-				{
-					// Add new specialization, take over allocated array
+	*pMatchk = matchkBest;
 
-					auto pSpecproc = PtAppendNew(&pPolyproc->arySpecproc);
-					pSpecproc->aryParg = aryParg;
-					aryParg = {};
+	if (fCache)
+	{
+		SOverloadMatch ovmatch = { matchkBest, nullptr, parypResdeclMatch->c };
+		if (ovmatch.cpResdecl > 0)
+		{
+			ovmatch.apResdecl = PtClone<SResolveDecl *>(&pWork->pagealloc, parypResdeclMatch->a, ovmatch.cpResdecl);
+		}
 
-					// Duplicate the entire AST for the procedure, annotate the types on the polymorphic elements,
-					//  and unflag as polymorphic
+		argtypes.aTid = (cArg > 0) ? PtClone<STypeId>(&pWork->pagealloc, aTidArg, cArg) : nullptr;
+		Add(&pOvset->hashArgtypesOvmatch, hvArgtypes, argtypes, ovmatch);
+	}
 
-					SRecurseCtx recx = { pWork, nullptr, pSymtCur, &pSpecproc->aryParg };
+	return true;
+}
 
-					SAstDeclareSingle * pAstdecl = pAstdeclOrig;
-					auto pAstdeclNew = PastPrepare<SAstDeclareSingle>(recx, &pAstdecl);
-					ASSERT(pAstdeclNew == pAstdecl);
-					
-					auto pDecl = PtAlloc<SDeclaration>(&pWork->pagealloc);
-					pDecl->pChzName = pChzName;
-					pDecl->pAstdecl = pAstdecl;
+MATCHK MatchkTryResolveOverloadWithUsing(SWorkspace * pWork, SSymbolTable * pSymtStart, SAstCall * pAstcall, 
+										 STypeCheckSwitch * pTcswitch, SResolveDecl ** ppResdecl)
+{
+	auto pAstident = PastCast<SAstIdentifier>(pAstcall->pAstFunc);
+	const char * pChzName = pAstident->pChz;
 
-					// NOTE (adrianb) Not calling AddResolveDeclaration because we are stored in this symbol table
+	// Resolve using declarations all the way up the chain
 
-					auto pResdecl = PtAlloc<SResolveDecl>(&pWork->pagealloc);
-					pResdecl->pDecl = pDecl;
-					pSpecproc->pResdecl = pResdecl;
-					pResdeclFound = pResdecl;
-					
-					// Procedure handles its own declaration addition
+	if (!FTryResolveUsing(pWork, pSymtStart, pTcswitch))
+		return MATCHK_Suspend;
 
-					if (recx.pSymtParent->symtblk != SYMTBLK_Procedure)
-						recx.paryTrec = &pDecl->aryTrec;
+	++pWork->cSymbolLookup;
 
-					ASSERT(!pAstdecl->pAstType);
-					ASSERT(pAstdecl->pAstValue);
-					ASSERT(pAstdecl->pAstValue->astk == ASTK_Procedure);
+	SArray<SResolveDecl *> arypResdeclMatch = {};
+	SArray<SResolveDecl *> arypResdeclSet = {};
+	defer { Destroy(&arypResdeclMatch); Destroy(&arypResdeclSet); };
 
-					// Recurse differently for procedures to support recursion
-					//  Type check: arg/ret, proc, declaration, body
+	MATCHK matchkBest = MATCHK_None;
+	for (auto pSymtCur = pSymtStart; pSymtCur; pSymtCur = pSymtCur->pSymtParent)
+	{
+		SOverloadSet * pOvset = PovsetLookup(pSymtCur, pChzName);
+		if (!pOvset)
+			continue;
 
-					auto pAstproc = PastPrepare<SAstProcedure>(recx, &pAstdecl->pAstValue);
-					pAstproc->fIsPolymorphic = false;
-					
-					SRecurseCtx recxProc = recx;
-					RecurseProcArgRet(&recxProc, pAstproc);
-					AppendAst(recx, &pAstdecl->pAstValue);
-					AppendAst(recx, reinterpret_cast<SAst **>(&pDecl->pAstdecl));
+		MATCHK matchk;
+		if (!FTryMatchOverloadSet(pWork, pOvset, pAstcall, pTcswitch, &matchk, &arypResdeclSet))
+			return MATCHK_Suspend;
+
+		if (matchk >= matchkBest)
+		{
+			// BB (adrianb) Disambiguate multiple implicit matches? E.g. compare scores.
+
+			if (matchk > matchkBest)
+				arypResdeclMatch.c = 0;
+
+			for (auto pResdecl : arypResdeclSet)
+			{
+				Append(&arypResdeclMatch, pResdecl);
+			}
+
+			matchkBest = matchk;
+		}
+
+		// Try matching any 
+
+		if (matchkBest == MATCHK_None)
+		{
+			for (int iiPolyproc = 0; iiPolyproc < pOvset->aryiPolyproc.c; ++iiPolyproc)
+			{
+				auto * pPolyproc = &pSymtCur->aryPolyproc[pOvset->aryiPolyproc[iiPolyproc]];
+				auto * pAstdeclOrig = pPolyproc->pAstdeclProcOrig;
+				
+				// BB (adrianb) In all these continue cases, we should be appending if best match is none.
+				//  We don't currently have a SResolveDecl yet.
+
+				auto pAstprocPoly = PastCast<SAstProcedure>(pAstdeclOrig->pAstValue);
+				if (pAstprocPoly->arypAstDeclArg.c != pAstcall->arypAstArgs.c)
+					continue;
 
-					RecurseTypeCheck(recxProc, reinterpret_cast<SAst **>(&pAstproc->pAstblock));
+				// A call that suspended waiting on a specialization already did the matching below, the argument
+				//  types can't have changed since.
+
+				SPolyCallKey polycall = { pAstcall, pAstdeclOrig };
+				u32 hvPolycall = HvFromKey(polycall);
+				SResolveDecl * pResdeclFound = nullptr;
+				if (SResolveDecl ** ppResdecl = PtLookupImpl(&pWork->hashPolycallPresdecl, hvPolycall, polycall))
+				{
+					pWork->cPolyCallMemoHit++;
+					pResdeclFound = *ppResdecl;
+				}
+				else if (!FTryMatchSpecialization(pWork, pSymtCur, pPolyproc, pAstcall, pTcswitch, &pResdeclFound))
+				{
+					return MATCHK_Suspend;
 				}
 
+				if (!pResdeclFound)
+					continue;
+
 				auto pAstdecl =  pResdeclFound->pDecl->pAstdecl;
 				STypeId tidProc = pAstdecl->tid;
 				if (tidProc.pType == nullptr)
 				{
+					if (!PtLookupImpl(&pWork->hashPolycallPresdecl, hvPolycall, polycall))
+						Add(&pWork->hashPolycallPresdecl, hvPolycall, polycall, pResdeclFound);
+
 					pTcswitch->pDecl = pResdeclFound->pDecl;
 					return MATCHK_Suspend;
 				}
@@ -6911,8 +8013,7 @@ MATCHK MatchkTryResolveOverloadWithUsing(SWorkspace * pWork, SSymbolTable * pSym
 					arypResdeclMatch.c = 0;
 				
 				matchkBest = MATCHK_Exact;
-				if (!FIsFull(&arypResdeclMatch))
-					Append(&arypResdeclMatch, pResdeclFound);
+				Append(&arypResdeclMatch, pResdeclFound);
 			}
 		}
 	}
@@ -6922,7 +8023,7 @@ MATCHK MatchkTryResolveOverloadWithUsing(SWorkspace * pWork, SSymbolTable * pSym
 		PrintErr(pAstcall->errinfo, "Couldn't find specific overload for procedure call");
 		if (arypResdeclMatch.c > 0)
 		{
-			fprintf(stderr, "Options:");
+			fprintf(stderr, "Options:\n");
 			for (auto pResdecl : arypResdeclMatch)
 			{
 				PrintErr(pResdecl->pDecl->pAstdecl->errinfo, "candidate procedure");
@@ -6967,7 +8068,7 @@ STypeId TidFromLiteral(SWorkspace * pWork, const SLiteral & lit)
 	switch (lit.litk)
 	{
 	case LITK_String: tid = pWork->tidString; break;
-	case LITK_Int: tid = TidInferFromInt(pWork, lit.n); break;
+	case LITK_Int: tid = (lit.fUnsigned) ? pWork->tidU64 : TidInferFromInt(pWork, lit.n); break;
 	case LITK_Float: tid = pWork->tidFloat; break; // BB (adrianb) Any way to choose double?
 	case LITK_Bool: tid = pWork->tidBool; break;
 	default: ASSERT(false); break;
@@ -6991,6 +8092,7 @@ void TryCoerceLit(SWorkspace * pWork, SAst * pAst)
 }
 
 void Coerce(SWorkspace * pWork, SAst ** ppAst, const STypeId & tid);
+void MarkModified(SWorkspace * pWork, SAst * pAst, bool fAddressed = false);
 void TryCoerceCVararg(SWorkspace * pWork, SAst ** ppAst)
 {
 	auto pAst = *ppAst;
@@ -7034,8 +8136,102 @@ enum TFN
 	TFN_Nil = -1,
 };
 
+// Integer types in the order operators try them, the first both sides coerce to wins
+
+static const TYPEK s_aTypekIntPromote[] =
+{
+	TYPEK_S8,
+	TYPEK_U8,
+	TYPEK_S16,
+	TYPEK_U16,
+	TYPEK_S32,
+	TYPEK_U32,
+	TYPEK_S64,
+	TYPEK_U64,
+};
+CASSERT(DIM(s_aTypekIntPromote) == TYPEK_IntMac - TYPEK_IntMic);
+
+struct SCoerceMatrix // tag = coercemat
+{
+	// Implicit conversions decided by the kinds of the types alone, nil when they don't decide it. Checked for 
+	//  every operand and argument, so built once rather than working through the rules each time.
+
+	TFN mpTypekTypekTfn[TYPEK_Max][TYPEK_Max];
+	TYPEK mpTypekTypekTypekInt[TYPEK_Max][TYPEK_Max]; // Smallest integer type both coerce to, see s_aTypekIntPromote
+
+	SCoerceMatrix()
+	{
+		for (int typekFrom = 0; typekFrom < TYPEK_Max; ++typekFrom)
+		{
+			for (int typekTo = 0; typekTo < TYPEK_Max; ++typekTo)
+			{
+				mpTypekTypekTfn[typekFrom][typekTo] = TfnCompute(TYPEK(typekFrom), TYPEK(typekTo));
+			}
+		}
+
+		for (int typekLeft = 0; typekLeft < TYPEK_Max; ++typekLeft)
+		{
+			for (int typekRight = 0; typekRight < TYPEK_Max; ++typekRight)
+			{
+				TYPEK typekInt = TYPEK_Nil;
+				for (TYPEK typek : s_aTypekIntPromote)
+				{
+					if (mpTypekTypekTfn[typekLeft][typek] == TFN_True && mpTypekTypekTfn[typekRight][typek] == TFN_True)
+					{
+						typekInt = typek;
+						break;
+					}
+				}
+
+				mpTypekTypekTypekInt[typekLeft][typekRight] = typekInt;
+			}
+		}
+	}
+
+	static TFN TfnCompute(TYPEK typekFrom, TYPEK typekTo)
+	{
+		// Allow coercing to larger integer type
+
+		if (FIsInt(typekFrom) && FIsInt(typekTo))
+		{
+			// A signed type can only fit in an >= signed type
+
+			if (FSigned(typekFrom))
+				return (FSigned(typekTo) && CBit(typekTo) >= CBit(typekFrom)) ? TFN_True : TFN_False;
+			
+			// An unsigned type can fix in a >= unsigned type or > signed type
+
+			bool fCompatible = (!FSigned(typekTo)) ? CBit(typekTo) >= CBit(typekFrom) : CBit(typekTo) > CBit(typekFrom);
+			return (fCompatible) ? TFN_True : TFN_False;
+		}
+
+		if (typekFrom == TYPEK_Float && typekTo == TYPEK_Double)
+		{
+			return TFN_True;
+		}
+
+		// Don't know how to deal with this one
+
+		return TFN_Nil;
+	}
+};
+
+inline const SCoerceMatrix & CoercematGet()
+{
+	static const SCoerceMatrix s_coercemat;
+	return s_coercemat;
+}
+
+inline TFN TfnCanCoerce(TYPEK typekFrom, TYPEK typekTo)
+{
+	ASSERT(typekFrom >= 0 && typekFrom < TYPEK_Max && typekTo >= 0 && typekTo < TYPEK_Max);
+	return CoercematGet().mpTypekTypekTfn[typekFrom][typekTo];
+}
+
 TFN TfnCanCoerce(const SAst * pAst, TYPEK typek)
 {
+	// Literals, null and uninitialized values have their own rules, everything else is decided by the matrix
+
 	if (pAst->astk == ASTK_Literal)
 	{
 		const SLiteral & lit = PastCast<SAstLiteral>(pAst)->lit;
@@ -7060,14 +8256,16 @@ TFN TfnCanCoerce(const SAst * pAst, TYPEK typek)
 				if (typek == TYPEK_S8 || typek == TYPEK_S16 ||
 					typek == TYPEK_S32 || typek == TYPEK_S64)
 				{
-					s64 nPow2 = 1ll << (CBit(typek) - 1);
-					return (lit.n >= -nPow2 && lit.n <= nPow2 - 1) ? TFN_True : TFN_False;
+					// NOTE (adrianb) Shifting into the sign bit for s64 overflows, so build the range from u64.
+
+					s64 nMax = s64(~0ull >> (65 - CBit(typek)));
+					return (!lit.fUnsigned && lit.n >= -nMax - 1 && lit.n <= nMax) ? TFN_True : TFN_False;
 				}
 				else if (typek == TYPEK_U8 || typek == TYPEK_U16 ||
 						 typek == TYPEK_U32 || typek == TYPEK_U64)
 				{
-					u64 nMax = (1ull << CBit(typek)) - 1;
-					return (lit.n >= 0 && u64(lit.n) <= nMax) ? TFN_True : TFN_False;
+					u64 nMax = ~0ull >> (64 - CBit(typek));
+					return ((lit.fUnsigned || lit.n >= 0) && u64(lit.n) <= nMax) ? TFN_True : TFN_False;
 				}
 				else if (typek == TYPEK_Float || typek == TYPEK_Double)
 				{
@@ -7097,7 +8295,7 @@ TFN TfnCanCoerce(const SAst * pAst, TYPEK typek)
 	}
 	else if (pAst->astk == ASTK_Null)
 	{
-		return (typek == TYPEK_Pointer) ? TFN_True : TFN_False;
+		return (typek == TYPEK_Pointer || typek == TYPEK_Procedure) ? TFN_True : TFN_False;
 	}
 	else if (pAst->astk == ASTK_UninitializedValue)
 	{
@@ -7105,33 +8303,16 @@ TFN TfnCanCoerce(const SAst * pAst, TYPEK typek)
 		return TFN_True;
 	}
 
-	// Allow coercing to larger integer type
-
 	ASSERT(pAst->tid.pType != nullptr);
 
-	TYPEK typekAst = pAst->tid.pType->typek;
-	
-	if (FIsInt(typekAst) && FIsInt(typek))
-	{
-		// A signed type can only fit in an >= signed type
-
-		if (FSigned(typekAst))
-			return (FSigned(typek) && CBit(typek) >= CBit(typekAst)) ? TFN_True : TFN_False;
-		
-		// An unsigned type can fix in a >= unsigned type or > signed type
-
-		bool fCompatible = (!FSigned(typek)) ? CBit(typek) >= CBit(typekAst) : CBit(typek) > CBit(typekAst);
-		return (fCompatible) ? TFN_True : TFN_False;
-	}
-
-	if (typekAst == TYPEK_Float && typek == TYPEK_Double)
-	{
-		return TFN_True;
-	}
+	return TfnCanCoerce(pAst->tid.pType->typek, typek);
+}
 
-	// Don't know how to deal with this one
+inline bool FHasValueRules(const SAst * pAst)
+{
+	// Whether coercing depends on the value rather than just the type (see TfnCanCoerce)
 
-	return TFN_Nil;
+	return pAst->astk == ASTK_Literal || pAst->astk == ASTK_Null || pAst->astk == ASTK_UninitializedValue;
 }
 
 bool FCanCoerce(const SAst * pAst, TYPEK typek)
@@ -7145,11 +8326,21 @@ bool FCanCoerce(const SAst * pAst, TYPEK typek)
 	return pAst->tid.pType && pAst->tid.pType->typek == typek;
 }
 
+bool FIsSplat(const SAst * pAst, const STypeId & tidTo)
+{
+	// Scalars coerce to vectors by converting to the element type and copying to every element
+
+	return FIsVector(tidTo) && !FIsVector(pAst->tid) && pAst->astk != ASTK_UninitializedValue;
+}
+
 bool FCanCoerce(const SAst * pAst, const STypeId & tidTo)
 {
 	if (tidTo == pAst->tid)
 		return true;
 
+	if (FIsSplat(pAst, tidTo))
+		return FCanCoerce(pAst, PtypeCast<STypeVector>(tidTo.pType)->tidElement);
+
 	// BB (adrianb) In most of these cases we can return false after knowing about this too
 
 	TFN tfn = TfnCanCoerce(pAst, tidTo.pType->typek);
@@ -7182,6 +8373,11 @@ bool FCanCoerce(const SAst * pAst, const STypeId & tidTo)
 		auto pTypearrayTo = PtypeCast<STypeArray>(pTypeTo);
 		auto pTypearrayFrom = PtypeCast<STypeArray>(pAst->tid.pType);
 
+		// SOA slices need whole columns, so they can't view an AOSOA array
+
+		if (pTypearrayTo->fSoa != pTypearrayFrom->fSoa || pTypearrayFrom->cSoaChunk > 0)
+			return false;
+
 		return pTypearrayTo->cSizeFixed < 0 && !pTypearrayTo->fDynamicallySized &&
 				(pTypearrayFrom->cSizeFixed >= 0 || pTypearrayFrom->fDynamicallySized);
 	}
@@ -7211,7 +8407,14 @@ void Coerce(SWorkspace * pWork, SAst ** ppAst, const STypeId & tid)
 
 	auto pTypeTo = tid.pType;
 
-	switch (pAst->astk)
+	if (FIsSplat(pAst, tid))
+	{
+		Coerce(pWork, ppAst, PtypeCast<STypeVector>(pTypeTo)->tidElement);
+		pAst = *ppAst;
+		goto LCast;
+	}
+
+	switch (pAst->astk)
 	{
 	case ASTK_Literal:
 		{
@@ -7219,7 +8422,7 @@ void Coerce(SWorkspace * pWork, SAst ** ppAst, const STypeId & tid)
 			if (pLit->litk == LITK_Int && (pTypeTo->typek == TYPEK_Float || pTypeTo->typek == TYPEK_Double))
 			{
 				pLit->litk = LITK_Float;
-				pLit->g = static_cast<double>(pLit->n);
+				pLit->g = (pLit->fUnsigned) ? static_cast<double>(u64(pLit->n)) : static_cast<double>(pLit->n);
 			}
 
 			pAst->tid = tid;
@@ -7247,8 +8450,17 @@ void Coerce(SWorkspace * pWork, SAst ** ppAst, const STypeId & tid)
 	if (pAst->tid == tid)
 		return;
 
+	// Views of a fixed array point at its elements, so they can modify it
+
+	if (pAst->tid.pType->typek == TYPEK_Array && PtypeCast<STypeArray>(pAst->tid.pType)->cSizeFixed >= 0 && 
+		pTypeTo->typek == TYPEK_Array)
+	{
+		MarkModified(pWork, pAst, true);
+	}
+
 	// Insert implicit cast
 
+LCast:
 	auto pAstcast = PastCreate<SAstCast>(pWork, pAst->errinfo);
 	pAstcast->tid = tid;
 	pAstcast->pAstExpr = pAst;
@@ -7263,6 +8475,8 @@ enum FBOPI
 	FBOPI_AllFloats 	= 0x04,
 	FBOPI_Pointers	 	= 0x08,
 	FBOPI_PointerAndInt	= 0x10,
+	FBOPI_Vectors		= 0x20,		// Elementwise on vectors of the int/float types allowed above
+	FBOPI_Shift			= 0x40,		// Result is the left type, the right is any integer shift amount
 
 	FBOPI_AnySame 		= 0x100,
 
@@ -7275,30 +8489,147 @@ typedef u32 GRFBOPI;
 
 struct SBinaryOperatorInst
 {
-	const char * pChzOp;
+	OP op;
 	GRFBOPI grfbopi;
 };
 
 static const SBinaryOperatorInst s_aBopi[] =
 {
-	{ "<", FBOPI_AllIntegers | FBOPI_AllFloats | FBOPI_Pointers | FBOPI_ReturnBool },
-	{ ">", FBOPI_AllIntegers | FBOPI_AllFloats | FBOPI_Pointers | FBOPI_ReturnBool },
-	{ "<=", FBOPI_AllIntegers | FBOPI_AllFloats | FBOPI_Pointers | FBOPI_ReturnBool },
-	{ ">=", FBOPI_AllIntegers | FBOPI_AllFloats | FBOPI_Pointers | FBOPI_ReturnBool },
-	{ "==", FBOPI_AllIntegers | FBOPI_Bools | FBOPI_AllFloats | FBOPI_Pointers | FBOPI_ReturnBool }, // Floats for == et al?
-	{ "!=", FBOPI_AllIntegers | FBOPI_Bools | FBOPI_AllFloats | FBOPI_Pointers | FBOPI_ReturnBool },
+	{ OP_Less, FBOPI_AllIntegers | FBOPI_AllFloats | FBOPI_Pointers | FBOPI_Vectors | FBOPI_ReturnBool },
+	{ OP_Greater, FBOPI_AllIntegers | FBOPI_AllFloats | FBOPI_Pointers | FBOPI_Vectors | FBOPI_ReturnBool },
+	{ OP_LessEqual, FBOPI_AllIntegers | FBOPI_AllFloats | FBOPI_Pointers | FBOPI_Vectors | FBOPI_ReturnBool },
+	{ OP_GreaterEqual, FBOPI_AllIntegers | FBOPI_AllFloats | FBOPI_Pointers | FBOPI_Vectors | FBOPI_ReturnBool },
+	{ OP_Equal, FBOPI_AllIntegers | FBOPI_Bools | FBOPI_AllFloats | FBOPI_Pointers | FBOPI_Vectors | FBOPI_ReturnBool }, // Floats for == et al?
+	{ OP_NotEqual, FBOPI_AllIntegers | FBOPI_Bools | FBOPI_AllFloats | FBOPI_Pointers | FBOPI_Vectors | FBOPI_ReturnBool },
+
+	{ OP_And, FBOPI_Bools },
+	{ OP_Or, FBOPI_Bools },
+
+	{ OP_Add, FBOPI_AllIntegers | FBOPI_AllFloats | FBOPI_PointerAndInt | FBOPI_Vectors }, // BB (adrianb) Reuse these with += et al?
+	{ OP_Sub, FBOPI_AllIntegers | FBOPI_AllFloats | FBOPI_PointerAndInt | FBOPI_Vectors },
+	{ OP_Mul, FBOPI_AllIntegers | FBOPI_AllFloats | FBOPI_Vectors },
+	{ OP_Div, FBOPI_AllIntegers | FBOPI_AllFloats | FBOPI_Vectors },
+	{ OP_Rem, FBOPI_AllIntegers | FBOPI_Vectors },
+
+	{ OP_BitAnd, FBOPI_AllIntegers | FBOPI_Vectors },
+	{ OP_BitOr, FBOPI_AllIntegers | FBOPI_Vectors },
+	{ OP_BitXor, FBOPI_AllIntegers | FBOPI_Vectors },
+	{ OP_ShiftLeft, FBOPI_AllIntegers | FBOPI_Vectors | FBOPI_Shift },
+	{ OP_ShiftRight, FBOPI_AllIntegers | FBOPI_Vectors | FBOPI_Shift },
+};
 
-	{ "and", FBOPI_Bools },
-	{ "or", FBOPI_Bools },
+static const SOperatorTable<SBinaryOperatorInst> s_optableBopi(s_aBopi);
 
-	{ "+", FBOPI_AllIntegers | FBOPI_AllFloats | FBOPI_PointerAndInt }, // BB (adrianb) Reuse these with += et al?
-	{ "-", FBOPI_AllIntegers | FBOPI_AllFloats | FBOPI_PointerAndInt },
-	{ "*", FBOPI_AllIntegers | FBOPI_AllFloats },
-	{ "/", FBOPI_AllIntegers | FBOPI_AllFloats },
-	{ "%", FBOPI_AllIntegers },
+bool FIsSoaPointer(STypeId tid)
+{
+	return tid.pType && tid.pType->typek == TYPEK_Pointer && PtypeCast<STypePointer>(tid.pType)->fSoa;
+}
 
-	// TODO bitwise operators (what are they?), logical operators (&&, ||?)
-};
+bool FIsSoaElement(SAst * pAst)
+{
+	// An element of an SOA array (a[i]) or what an SOA pointer points to (<<p). Its members are stored apart, so 
+	//  it has no single address.
+
+	if (pAst->astk == ASTK_ArrayIndex)
+	{
+		auto pType = PastCast<SAstArrayIndex>(pAst)->pAstArray->tid.pType;
+		return pType && pType->typek == TYPEK_Array && PtypeCast<STypeArray>(pType)->fSoa;
+	}
+
+	if (pAst->astk == ASTK_Operator)
+	{
+		auto pAstop = PastCast<SAstOperator>(pAst);
+		if (pAstop->pAstLeft == nullptr && pAstop->op == OP_ShiftLeft)
+			return FIsSoaPointer(pAstop->pAstRight->tid);
+	}
+
+	return false;
+}
+
+bool FBopiAllowsVector(GRFBOPI grfbopi, STypeId tidVector)
+{
+	if ((grfbopi & FBOPI_Vectors) == 0)
+		return false;
+
+	TYPEK typekElement = PtypeCast<STypeVector>(tidVector.pType)->tidElement.pType->typek;
+	return ((grfbopi & FBOPI_AllIntegers) && FIsInt(typekElement)) || 
+			((grfbopi & FBOPI_AllFloats) && FIsFloat(typekElement));
+}
+
+bool FTryCoerceShiftAmount(SWorkspace * pWork, SAst ** ppAst, const STypeId & tidShifted)
+{
+	// Shift amounts can be any integer type, llvm wants the same type as the value shifted so convert them
+
+	auto pAst = *ppAst;
+	if (pAst->astk == ASTK_Literal && PastCast<SAstLiteral>(pAst)->lit.litk == LITK_Int)
+	{
+		STypeId tidElement = (FIsVector(tidShifted)) ? PtypeCast<STypeVector>(tidShifted.pType)->tidElement : tidShifted;
+		s64 nShift = PastCast<SAstLiteral>(pAst)->lit.n;
+		if (nShift < 0 || nShift >= CBit(tidElement.pType->typek))
+		{
+			ShowErr(pAst->errinfo, "Shift amount %lld is out of range for %s", nShift, StrPrintType(tidElement).Pchz());
+		}
+	}
+
+	if (FCanCoerce(pAst, tidShifted))
+	{
+		Coerce(pWork, ppAst, tidShifted);
+		return true;
+	}
+
+	if (FIsVector(tidShifted) || !pAst->tid.pType || !FIsInt(pAst->tid.pType->typek))
+		return false;
+
+	auto pAstcast = PastCreate<SAstCast>(pWork, pAst->errinfo);
+	pAstcast->tid = tidShifted;
+	pAstcast->pAstExpr = pAst;
+	*ppAst = pAstcast;
+	return true;
+}
+
+bool FIsUntypedIntLiteral(const SAst * pAst)
+{
+	return pAst->astk == ASTK_Literal && pAst->tid.pType == nullptr && 
+			PastCast<SAstLiteral>(pAst)->lit.litk == LITK_Int;
+}
+
+SAstLiteral * PastlitShiftLiterals(SWorkspace * pWork, SAstOperator * pAstop)
+{
+	// Shifting two untyped literals gives an untyped literal, so the result coerces by value like any other literal
+	//  (x : u8 = 1 << 3, E : u64 : 1 << 63). Shifts happen at 64 bits.
+
+	const SLiteral & litLeft = PastCast<SAstLiteral>(pAstop->pAstLeft)->lit;
+	const SLiteral & litRight = PastCast<SAstLiteral>(pAstop->pAstRight)->lit;
+	if (litRight.fUnsigned || litRight.n < 0 || litRight.n >= 64)
+	{
+		ShowErr(pAstop->pAstRight->errinfo, "Shift amount %lld is out of range for a literal", litRight.n);
+	}
+
+	int cBitShift = int(litRight.n);
+	bool fNegative = !litLeft.fUnsigned && litLeft.n < 0;
+
+	auto pAstlit = PastCreate<SAstLiteral>(pWork, pAstop->errinfo);
+	pAstlit->lit.litk = LITK_Int;
+
+	if (pAstop->op == OP_ShiftLeft)
+	{
+		u64 n = u64(litLeft.n) << cBitShift;
+		bool fFits = (fNegative) ? (s64(n) >> cBitShift) == litLeft.n : (n >> cBitShift) == u64(litLeft.n);
+		if (!fFits)
+		{
+			ShowErr(pAstop->errinfo, "Shifting literal %lld left by %d overflows 64 bits", litLeft.n, cBitShift);
+		}
+
+		pAstlit->lit.n = s64(n);
+	}
+	else
+	{
+		pAstlit->lit.n = (fNegative) ? litLeft.n >> cBitShift : s64(u64(litLeft.n) >> cBitShift);
+	}
+
+	pAstlit->lit.fUnsigned = !fNegative && pAstlit->lit.n < 0;
+	return pAstlit;
+}
 
 bool FTryCoerceOperatorArgs(SWorkspace * pWork, SAstOperator * pAstop, GRFBOPI grfbopi, STypeId * pTidRet)
 {
@@ -7307,32 +8638,78 @@ bool FTryCoerceOperatorArgs(SWorkspace * pWork, SAstOperator * pAstop, GRFBOPI g
 	auto pAstLeft = pAstop->pAstLeft;
 	auto pAstRight = pAstop->pAstRight;
 
-	if (grfbopi & FBOPI_AllIntegers)
+	// SOA pointers are a pointer per member, there is no single address to offset or compare
+
+	if (FIsSoaPointer(pAstLeft->tid) || FIsSoaPointer(pAstRight->tid))
+		return false;
+
+	// Vectors operate elementwise, a scalar on either side is splat to match the vector (see Coerce)
+
+	STypeId tidVector = (FIsVector(pAstLeft->tid)) ? pAstLeft->tid : pAstRight->tid;
+	if (FIsVector(tidVector))
 	{
-		static const TYPEK s_aTypekInt[] =
+		if (!FBopiAllowsVector(grfbopi, tidVector) || 
+			!FCanCoerce(pAstLeft, tidVector) || !FCanCoerce(pAstRight, tidVector))
 		{
-			TYPEK_S8,
-			TYPEK_U8,
-			TYPEK_S16,
-			TYPEK_U16,
-			TYPEK_S32,
-			TYPEK_U32,
-			TYPEK_S64,
-			TYPEK_U64,
-		};
-		CASSERT(DIM(s_aTypekInt) == TYPEK_IntMac - TYPEK_IntMic);
+			return false;
+		}
+
+		Coerce(pWork, &pAstop->pAstLeft, tidVector);
+		Coerce(pWork, &pAstop->pAstRight, tidVector);
+		*pTidRet = tidVector;
+		return true;
+	}
 
-		for (TYPEK typek : s_aTypekInt)
+	if (grfbopi & FBOPI_Shift)
+	{
+		// The result has the type of the value shifted. An untyped literal shifted by a typed amount (shifts of two
+		//  literals fold, see PastlitShiftLiterals) shifts at 64 bits so 1 << n doesn't overflow the u8 the literal
+		//  would otherwise get.
+
+		if (FIsUntypedIntLiteral(pAstLeft))
 		{
-			if (FCanCoerce(pAstLeft, typek) && FCanCoerce(pAstRight, typek))
+			TYPEK typekLit = (FCanCoerce(pAstLeft, TYPEK_S64)) ? TYPEK_S64 : TYPEK_U64;
+			Coerce(pWork, &pAstop->pAstLeft, TidEnsure(pWork, SType{typekLit}));
+		}
+
+		STypeId tidLeft = pAstop->pAstLeft->tid;
+		if (!tidLeft.pType || !FIsInt(tidLeft.pType->typek))
+			return false;
+
+		if (!FTryCoerceShiftAmount(pWork, &pAstop->pAstRight, tidLeft))
+			return false;
+
+		*pTidRet = tidLeft;
+		return true;
+	}
+
+	if (grfbopi & FBOPI_AllIntegers)
+	{
+		TYPEK typekInt = TYPEK_Nil;
+		if (!FHasValueRules(pAstLeft) && !FHasValueRules(pAstRight))
+		{
+			typekInt = CoercematGet().mpTypekTypekTypekInt[pAstLeft->tid.pType->typek][pAstRight->tid.pType->typek];
+		}
+		else
+		{
+			for (TYPEK typek : s_aTypekIntPromote)
 			{
-				auto tid = TidEnsure(pWork, SType{typek});
-				Coerce(pWork, &pAstop->pAstLeft, tid);
-				Coerce(pWork, &pAstop->pAstRight, tid);
-				*pTidRet = tid;
-				return true;
+				if (FCanCoerce(pAstLeft, typek) && FCanCoerce(pAstRight, typek))
+				{
+					typekInt = typek;
+					break;
+				}
 			}
 		}
+
+		if (typekInt != TYPEK_Nil)
+		{
+			auto tid = TidEnsure(pWork, SType{typekInt});
+			Coerce(pWork, &pAstop->pAstLeft, tid);
+			Coerce(pWork, &pAstop->pAstRight, tid);
+			*pTidRet = tid;
+			return true;
+		}
 	}
 
 	if (grfbopi & FBOPI_Bools)
@@ -7367,19 +8744,19 @@ bool FTryCoerceOperatorArgs(SWorkspace * pWork, SAstOperator * pAstop, GRFBOPI g
 		auto pTypeLeft = pAstLeft->tid.pType;
 		auto pTypeRight = pAstRight->tid.pType;
 		if (pAstLeft->tid == pAstRight->tid && 
-			pTypeLeft && pTypeLeft->typek == TYPEK_Pointer &&
-			pTypeRight && pTypeRight->typek == TYPEK_Pointer)
+			pTypeLeft && FIsPointerOrProcedure(pTypeLeft->typek) &&
+			pTypeRight && FIsPointerOrProcedure(pTypeRight->typek))
 		{
 			*pTidRet = pAstLeft->tid;
 			return true;
 		}
-		else if (pAstLeft->astk == ASTK_Null && pTypeRight && pTypeRight->typek == TYPEK_Pointer)
+		else if (pAstLeft->astk == ASTK_Null && pTypeRight && FIsPointerOrProcedure(pTypeRight->typek))
 		{
 			Coerce(pWork, &pAstop->pAstLeft, pAstRight->tid);
 			*pTidRet = pAstRight->tid;
 			return true;
 		}
-		else if (pAstRight->astk == ASTK_Null && pTypeLeft && pTypeLeft->typek == TYPEK_Pointer)
+		else if (pAstRight->astk == ASTK_Null && pTypeLeft && FIsPointerOrProcedure(pTypeLeft->typek))
 		{
 			Coerce(pWork, &pAstop->pAstRight, pAstLeft->tid);
 			*pTidRet = pAstLeft->tid;
@@ -7412,11 +8789,44 @@ void TryCoerceOperator(SWorkspace * pWork, SAstOperator * pAstop, GRFBOPI grfbop
 {
 	if (FTryCoerceOperatorArgs(pWork, pAstop, grfbopi, &pAstop->tid))
 	{
-		if (grfbopi & FBOPI_ReturnBool)
+		if ((grfbopi & FBOPI_ReturnBool) && FIsVector(pAstop->tid))
+			pAstop->tid = TidVectorMask(pWork, pAstop->tid);
+		else if (grfbopi & FBOPI_ReturnBool)
 			pAstop->tid = pWork->tidBool;
 	}
 }
 
+const STypeVector * PtypevecSwizzled(SAstOperator * pAstop)
+{
+	// Vector on the left of a ., directly or through a pointer, null if it's not a swizzle
+
+	STypeId tid = pAstop->pAstLeft->tid;
+	if (tid.pType && tid.pType->typek == TYPEK_Pointer && !FIsSoaPointer(tid))
+		tid = PtypeCast<STypePointer>(tid.pType)->tidPointedTo;
+
+	return (FIsVector(tid)) ? PtypeCast<STypeVector>(tid.pType) : nullptr;
+}
+
+int CElementSwizzle(const char * pChz, int cElementMax, int * aiElement)
+{
+	// Swizzles pick up to four of the first four elements with x, y, z and w, e.g. v.x, v.zw or v.wzyx. 
+	//  Returns 0 if pChz isn't one.
+
+	static const char s_aChElement[] = "xyzw";
+
+	int cElement = 0;
+	for (const char * pCh = pChz; *pCh; ++pCh)
+	{
+		const char * pChElement = strchr(s_aChElement, *pCh);
+		if (!pChElement || cElement == 4 || pChElement - s_aChElement >= cElementMax)
+			return 0;
+
+		aiElement[cElement++] = int(pChElement - s_aChElement);
+	}
+
+	return cElement;
+}
+
 bool FCanGetAddress(SAst * pAst)
 {
 	ASTK astk = pAst->astk;
@@ -7424,11 +8834,18 @@ bool FCanGetAddress(SAst * pAst)
 	{
 		// BB (adrianb) Validate that the right type inside is a non-constant? Or do that at generation time?
 		auto pAstop = PastCast<SAstOperator>(pAst);
-		auto pChzOp = pAstop->pChzOp;
-		if (pAstop->pAstLeft && strcmp(pChzOp, ".") == 0)
+		auto op = pAstop->op;
+		if (pAstop->pAstLeft && op == OP_Dot)
+		{
+			// Swizzles of more than one element build a new vector
+
+			if (PtypevecSwizzled(pAstop))
+				return strlen(PastCast<SAstIdentifier>(pAstop->pAstRight)->pChz) == 1;
+
 			return true;
+		}
 
-		if (pAstop->pAstLeft == nullptr && strcmp(pChzOp, "<<") == 0)
+		if (pAstop->pAstLeft == nullptr && op == OP_ShiftLeft)
 			return true;
 	}
 
@@ -7440,14 +8857,21 @@ bool FCanGetAddress(SAst * pAst)
 
 static SBinaryOperatorInst s_aBopiModify[] =
 {
-	{ "=", FBOPI_AnySame },
-	{ "+=", FBOPI_AllIntegers | FBOPI_AllFloats | FBOPI_PointerAndInt },
-	{ "-=", FBOPI_AllIntegers | FBOPI_AllFloats | FBOPI_PointerAndInt },
-	{ "*=", FBOPI_AllIntegers | FBOPI_AllFloats },
-	{ "/=", FBOPI_AllIntegers | FBOPI_AllFloats },
-	{ "%=", FBOPI_AllIntegers },
+	{ OP_Assign, FBOPI_AnySame },
+	{ OP_AddAssign, FBOPI_AllIntegers | FBOPI_AllFloats | FBOPI_PointerAndInt | FBOPI_Vectors },
+	{ OP_SubAssign, FBOPI_AllIntegers | FBOPI_AllFloats | FBOPI_PointerAndInt | FBOPI_Vectors },
+	{ OP_MulAssign, FBOPI_AllIntegers | FBOPI_AllFloats | FBOPI_Vectors },
+	{ OP_DivAssign, FBOPI_AllIntegers | FBOPI_AllFloats | FBOPI_Vectors },
+	{ OP_RemAssign, FBOPI_AllIntegers | FBOPI_Vectors },
+	{ OP_BitAndAssign, FBOPI_AllIntegers | FBOPI_Vectors },
+	{ OP_BitOrAssign, FBOPI_AllIntegers | FBOPI_Vectors },
+	{ OP_BitXorAssign, FBOPI_AllIntegers | FBOPI_Vectors },
+	{ OP_ShiftLeftAssign, FBOPI_AllIntegers | FBOPI_Vectors | FBOPI_Shift },
+	{ OP_ShiftRightAssign, FBOPI_AllIntegers | FBOPI_Vectors | FBOPI_Shift },
 };
 
+static const SOperatorTable<SBinaryOperatorInst> s_optableBopiModify(s_aBopiModify);
+
 bool FTryCoerceOperatorAssign(SWorkspace * pWork, SAstOperator * pAstop, GRFBOPI grfbopi)
 {
 	auto pAstLeft = pAstop->pAstLeft;
@@ -7460,8 +8884,12 @@ bool FTryCoerceOperatorAssign(SWorkspace * pWork, SAstOperator * pAstop, GRFBOPI
 	if ((grfbopi & FBOPI_AnySame) != 0 ||
 		((grfbopi & FBOPI_AllIntegers) != 0 && FIsInt(typekStore)) ||
 		((grfbopi & FBOPI_AllFloats) != 0 && FIsFloat(typekStore)) ||
-		((grfbopi & FBOPI_Bools) != 0 && typekStore == TYPEK_Bool))
+		((grfbopi & FBOPI_Bools) != 0 && typekStore == TYPEK_Bool) ||
+		(typekStore == TYPEK_Vector && FBopiAllowsVector(grfbopi, tidStore)))
 	{
+		if (grfbopi & FBOPI_Shift)
+			return FTryCoerceShiftAmount(pWork, &pAstop->pAstRight, tidStore);
+
 		if (FCanCoerce(pAstRight, tidStore))
 		{
 			Coerce(pWork, &pAstop->pAstRight, tidStore);
@@ -7471,7 +8899,7 @@ bool FTryCoerceOperatorAssign(SWorkspace * pWork, SAstOperator * pAstop, GRFBOPI
 		return false;
 	}
 
-	if ((grfbopi & FBOPI_PointerAndInt) != 0 && typekStore == TYPEK_Pointer)
+	if ((grfbopi & FBOPI_PointerAndInt) != 0 && typekStore == TYPEK_Pointer && !FIsSoaPointer(pAstLeft->tid))
 	{
 		if (FCanCoerce(pAstRight, TYPEK_S64))
 		{
@@ -7492,13 +8920,129 @@ SResolveDecl * PresdeclResolved(SWorkspace * pWork, SAst * pAstIdent)
 	return (ppResdecl) ? *ppResdecl : nullptr;
 }
 
-void RegisterResolved(SWorkspace * pWork, SAst * pAstIdent, SResolveDecl * pResdecl)
+void MarkModified(SWorkspace * pWork, SAst * pAst, bool fAddressed)
+{
+	// Flag the variable an assignment, increment or address-of reaches. Locals that are never modified don't need
+	//  storage, see ASTK_DeclareSingle generation. Going through a pointer doesn't modify the pointer.
+
+	while (pAst->astk != ASTK_Identifier)
+	{
+		if (pAst->astk == ASTK_ArrayIndex)
+		{
+			pAst = PastCast<SAstArrayIndex>(pAst)->pAstArray;
+		}
+		else if (pAst->astk == ASTK_Operator && PastCast<SAstOperator>(pAst)->pAstLeft && 
+				 PastCast<SAstOperator>(pAst)->op == OP_Dot)
+		{
+			pAst = PastCast<SAstOperator>(pAst)->pAstLeft;
+		}
+		else
+		{
+			return;
+		}
+
+		if (!pAst->tid.pType || pAst->tid.pType->typek == TYPEK_Pointer)
+			return;
+	}
+
+	auto pResdecl = PresdeclResolved(pWork, pAst);
+	if (!pResdecl)
+		return;
+
+	auto pDecl = (pResdecl->arypDeclUsingPath.c) ? pResdecl->arypDeclUsingPath[0] : pResdecl->pDecl;
+	if (pDecl->pAstdecl)
+	{
+		pDecl->pAstdecl->fIsModified = true;
+		pDecl->pAstdecl->fIsAddressed |= fAddressed;
+	}
+}
+
+void RegisterResolved(SWorkspace * pWork, const SSymbolTable * pSymt, SAst * pAstIdent, SResolveDecl * pResdecl, 
+					  bool fIsCallee = false)
 {
 	ASSERT(PresdeclResolved(pWork, pAstIdent) == nullptr);
+
+	auto pAstdecl = pResdecl->pDecl->pAstdecl;
+	if (pAstdecl && pAstdecl->fIsConstant && pAstdecl->pAstValue && pAstdecl->pAstValue->astk == ASTK_Procedure)
+	{
+		auto pAstproc = PastCast<SAstProcedure>(pAstdecl->pAstValue);
+
+		// Procedures used as values can be called through pointers, see ArgpassCompute
+
+		if (!fIsCallee)
+			pAstproc->fIsValue = true;
+
+		if (pWork->aryModule[pAstproc->iModuleOwner].fBuiltIn)
+		{
+			while (pSymt && pSymt->symtblk != SYMTBLK_Procedure)
+				pSymt = pSymt->pSymtParent;
+
+			Append(&pWork->aryBuiltinref, SBuiltinRef{(pSymt) ? pSymt->pAstproc : nullptr, pAstproc});
+		}
+	}
+
 	auto hv = HvFromKey(reinterpret_cast<u64>(pAstIdent));
 	Add(&pWork->hashPastPresdeclResolved, hv, pAstIdent, pResdecl);
 }
 
+u64 GrfArgReference(const SAstProcedure * pAstproc);
+
+void PrintResolved(SAstCtx * pAcx, const SAst * pAstIdent)
+{
+	// Identifiers print by name, so also print what they resolve to. Procedures by their unique link name, other 
+	//  constants by their value since code generation folds them in.
+
+	auto pResdecl = PresdeclResolved(pAcx->pWorkResolve, const_cast<SAst *>(pAstIdent));
+	if (!pResdecl)
+		return;
+
+	const SPrintFuncImpl & print = pAcx->print;
+	for (auto pDecl : pResdecl->arypDeclUsingPath)
+	{
+		print(" .%s", pDecl->pChzName);
+	}
+
+	auto pAstdecl = pResdecl->pDecl->pAstdecl;
+	if (!pAstdecl || !pAstdecl->fIsConstant)
+		return;
+
+	auto pAstValue = pAstdecl->pAstValue;
+	if (pAstValue && pAstValue->astk == ASTK_Procedure)
+	{
+		auto pAstproc = PastCast<SAstProcedure>(pAstValue);
+		print(" @%s", (pAstproc->pChzLink) ? pAstproc->pChzLink : pAstproc->pChzName);
+
+		// Calls pass memory arguments by reference or as values, see ArgpassCompute
+
+		if (u64 grfArgReference = GrfArgReference(pAstproc))
+			print(" ref%llx", grfArgReference);
+
+		// Procedures which might be generated in place print their body (once)
+
+		if ((pAstproc->fIsInline || pAcx->fInlineCall) && !FContains(pAcx->arypAstprocPrinted, pAstproc))
+		{
+			Append(&pAcx->arypAstprocPrinted, pAstproc);
+
+			bool fInlineCallPrev = pAcx->fInlineCall;
+			pAcx->fInlineCall = false;
+			PrintSchemeAst(pAcx, pAstproc);
+			pAcx->fInlineCall = fInlineCallPrev;
+		}
+	}
+	else if (pAstdecl->tid.pType && pAstdecl->tid.pType->typek == TYPEK_TypeOf)
+	{
+		// Types print their layout instead, their syntax can refer back to themselves (pNext : * Node)
+
+		print(" =");
+		PrintSchemeType(pAcx, PtypeCast<STypeTypeOf>(pAstdecl->tid.pType)->tid.pType);
+	}
+	else
+	{
+		print(" =");
+		PrintSchemeAst(pAcx, pAstValue);
+	}
+}
+
 
 void TryDefaultType(SWorkspace * pWork, SAst * pAst)
 {
@@ -7508,87 +9052,318 @@ void TryDefaultType(SWorkspace * pWork, SAst * pAst)
 
 void EvalConst(SWorkspace * pWork, SAst * pAst, void * pVRet);
 
-void TypeCheck(SWorkspace * pWork, STypeRecurse * pTrec, STypeCheckSwitch * pTcswitch)
+// Builtin dynamic array operations, called like procedures with a pointer to the array as the first argument
+
+const STypeProcedure * PtypeprocMultiValue(SAst * pAstValue)
 {
-	SAst * pAst = *pTrec->ppAst;
+	// Multiple values come from procedure calls (inline or not), null for anything else
 
-	switch (pAst->astk)
-	{
-	case ASTK_Literal:
-	case ASTK_Null:
-		// Literals of all kinds infer their type from above
-		break;
+	if (pAstValue->astk == ASTK_Inline)
+		pAstValue = PastCast<SAstInline>(pAstValue)->pAstExpr;
 
-	case ASTK_UninitializedValue: // Never gets a type
-		break;
-	
-	case ASTK_Block:
-	case ASTK_EmptyStatement:
-		// BB (adrianb) Try and process any un-processed constant definitions in blocks or just let on 
-		//  demand processing do its thing? Maybe we should list those declarations in the list and still
-		//  process them as we get to them too?
-		pAst->tid = pWork->tidVoid;
-		break;
+	if (pAstValue->astk != ASTK_Call)
+		return nullptr;
 
-	case ASTK_Identifier:
-		{
-			// Lookup identifier
-			// if found, use type
-			// if not, find declaration (error if not found or if already on stack)
-			//   set pTcsw to switch to that declaration (pushing the current one on the stack).
+	STypeId tidFunc = PastCast<SAstCall>(pAstValue)->pAstFunc->tid;
+	if (!tidFunc.pType || tidFunc.pType->typek != TYPEK_Procedure)
+		return nullptr;
 
-			auto pAstident = PastCast<SAstIdentifier>(pAst);
-			auto pSymt = pTrec->pSymtParent;
+	return PtypeCast<STypeProcedure>(tidFunc.pType);
+}
 
-			SResolveDecl * pResdecl;
-			if (pSymt->symtblk >= SYMTBLK_RegisterAllMic)
-			{
-				pResdecl = PresdeclLookup(pSymt, pAstident->pChz, 0, pAst->errinfo);
-			}
-			else if (!FTryResolveSymbolWithUsing(pWork, pSymt, pAstident->pChz, pAst->errinfo, pTcswitch, &pResdecl))
-			{
-				// We have switched to resolving another declaration
-				ASSERT(pTcswitch->pDecl);
-				break;
-			}
+enum ARYOP
+{
+	ARYOP_Add,				// array_add(*a, t)
+	ARYOP_Reserve,			// array_reserve(*a, cMin)
+	ARYOP_Resize,			// array_resize(*a, c), new elements get their default value
+	ARYOP_UnorderedRemove,	// array_unordered_remove(*a, i), moves the last element into i
+	ARYOP_Pop,				// array_pop(*a) -> T
+	ARYOP_Free,				// array_free(*a)
 
-			if (!pResdecl)
-			{
-				ShowErr(pAst->errinfo, "Couldn't find declaration for identifier");
-			}
+	ARYOP_Max,
+	ARYOP_Nil = -1,
+};
 
-			STypeId tid = pResdecl->pDecl->pAstdecl->tid;
-			if (tid.pType == nullptr)
-			{
-				pTcswitch->pDecl = pResdecl->pDecl;
-				break;
-			}
-			
-			pAstident->tid = tid;
+const char * PchzFromAryop(ARYOP aryop)
+{
+	static const char * s_mpAryopPchz[] =
+	{
+		"array_add",
+		"array_reserve",
+		"array_resize",
+		"array_unordered_remove",
+		"array_pop",
+		"array_free",
+	};
+	CASSERT(DIM(s_mpAryopPchz) == ARYOP_Max);
+	ASSERT(aryop >= 0 && aryop < ARYOP_Max);
 
-			RegisterResolved(pWork, pAstident, pResdecl);
-		}
-		break;
+	return s_mpAryopPchz[aryop];
+}
+
+ARYOP AryopFromPchz(const char * pChz)
+{
+	for (int aryop = 0; aryop < ARYOP_Max; ++aryop)
+	{
+		if (strcmp(pChz, PchzFromAryop(ARYOP(aryop))) == 0)
+			return ARYOP(aryop);
+	}
+
+	return ARYOP_Nil;
+}
+
+const STypeArray * PtypearrayFromAryopArg(STypeId tidArg)
+{
+	// Array an operation's first argument points to, or null if it's not a pointer to a dynamic array
+
+	if (tidArg.pType->typek != TYPEK_Pointer || FIsSoaPointer(tidArg))
+		return nullptr;
+
+	auto pTypePointedTo = PtypeCast<STypePointer>(tidArg.pType)->tidPointedTo.pType;
+	if (pTypePointedTo->typek != TYPEK_Array || !PtypeCast<STypeArray>(pTypePointedTo)->fDynamicallySized)
+		return nullptr;
+
+	return PtypeCast<STypeArray>(pTypePointedTo);
+}
+
+void TypeCheckAryop(SWorkspace * pWork, SAstCall * pAstcall, ARYOP aryop)
+{
+	int cArg = (aryop == ARYOP_Pop || aryop == ARYOP_Free) ? 1 : 2;
+	if (pAstcall->arypAstArgs.c != cArg)
+	{
+		ShowErr(pAstcall->errinfo, "%s expects %d argument(s)", PchzFromAryop(aryop), cArg);
+	}
+
+	SAst * pAstAry = pAstcall->arypAstArgs[0];
+	TryCoerceLit(pWork, pAstAry);
+
+	auto pTypearray = PtypearrayFromAryopArg(pAstAry->tid);
+	if (!pTypearray)
+	{
+		ShowErr(pAstAry->errinfo, "%s expects a pointer to a dynamic array but found %s", PchzFromAryop(aryop),
+				StrPrintType(pAstAry->tid.pType).Pchz());
+	}
+
+	switch (aryop)
+	{
+	case ARYOP_Add:
+		Coerce(pWork, &pAstcall->arypAstArgs[1], pTypearray->tidElement);
+		break;
+
+	case ARYOP_Reserve:
+	case ARYOP_Resize:
+	case ARYOP_UnorderedRemove:
+		Coerce(pWork, &pAstcall->arypAstArgs[1], pWork->tidS64);
+		break;
+
+	default:
+		break;
+	}
+
+	pAstcall->tid = (aryop == ARYOP_Pop) ? pTypearray->tidElement : pWork->tidVoid;
+}
+
+enum VECOP
+{
+	VECOP_Shuffle,			// vector_shuffle(a, b, i0, i1, ..), constant indices into the elements of a then b
+	VECOP_Select,			// vector_select(mask, a, b), elements of a where mask is set, b elsewhere
+	VECOP_ReduceAdd,		// vector_reduce_add(v) -> element, in order for floats
+	VECOP_ReduceMul,		// vector_reduce_mul(v) -> element
+	VECOP_ReduceMin,		// vector_reduce_min(v) -> element
+	VECOP_ReduceMax,		// vector_reduce_max(v) -> element
+
+	VECOP_Max,
+	VECOP_Nil = -1,
+};
+
+const char * PchzFromVecop(VECOP vecop)
+{
+	static const char * s_mpVecopPchz[] =
+	{
+		"vector_shuffle",
+		"vector_select",
+		"vector_reduce_add",
+		"vector_reduce_mul",
+		"vector_reduce_min",
+		"vector_reduce_max",
+	};
+	CASSERT(DIM(s_mpVecopPchz) == VECOP_Max);
+	ASSERT(vecop >= 0 && vecop < VECOP_Max);
+
+	return s_mpVecopPchz[vecop];
+}
+
+VECOP VecopFromPchz(const char * pChz)
+{
+	for (int vecop = 0; vecop < VECOP_Max; ++vecop)
+	{
+		if (strcmp(pChz, PchzFromVecop(VECOP(vecop))) == 0)
+			return VECOP(vecop);
+	}
+
+	return VECOP_Nil;
+}
+
+s64 IElementShuffle(SWorkspace * pWork, SAst * pAstIndex)
+{
+	s64 iElement = 0;
+	EvalConst(pWork, pAstIndex, &iElement);
+	return iElement;
+}
+
+void TypeCheckVecop(SWorkspace * pWork, SAstCall * pAstcall, VECOP vecop)
+{
+	auto pChzVecop = PchzFromVecop(vecop);
+	auto & arypAstArgs = pAstcall->arypAstArgs;
+
+	int cArgMin = (vecop == VECOP_Shuffle) ? 4 : (vecop == VECOP_Select) ? 3 : 1;
+	if (arypAstArgs.c < cArgMin || (vecop != VECOP_Shuffle && arypAstArgs.c != cArgMin))
+	{
+		ShowErr(pAstcall->errinfo, "%s expects %s%d argument(s)", pChzVecop, 
+				(vecop == VECOP_Shuffle) ? "at least " : "", cArgMin);
+	}
+
+	// The vector type comes from the first vector argument, others are coerced (splat) to match
+
+	int iArgVector = (vecop == VECOP_Select) ? 1 : 0;
+	STypeId tidVector = arypAstArgs[iArgVector]->tid;
+	if (vecop == VECOP_Select && !FIsVector(tidVector))
+		tidVector = arypAstArgs[2]->tid;
+
+	if (!FIsVector(tidVector))
+	{
+		TryCoerceLit(pWork, arypAstArgs[iArgVector]);
+		ShowErr(arypAstArgs[iArgVector]->errinfo, "%s expects a vector but found %s", pChzVecop,
+				StrPrintType(arypAstArgs[iArgVector]->tid).Pchz());
+	}
+
+	auto pTypevec = PtypeCast<STypeVector>(tidVector.pType);
+
+	switch (vecop)
+	{
+	case VECOP_Shuffle:
+		{
+			Coerce(pWork, &arypAstArgs[1], tidVector);
+
+			int cElement = arypAstArgs.c - 2;
+			if (cElement > 16 || (cElement & (cElement - 1)) != 0)
+			{
+				ShowErr(pAstcall->errinfo, "%s expects 2, 4, 8 or 16 indices, found %d", pChzVecop, cElement);
+			}
+
+			for (int iArg = 2; iArg < arypAstArgs.c; ++iArg)
+			{
+				Coerce(pWork, &arypAstArgs[iArg], pWork->tidS64);
+				s64 iElement = IElementShuffle(pWork, arypAstArgs[iArg]);
+				if (iElement < 0 || iElement >= 2 * pTypevec->cElement)
+				{
+					ShowErr(arypAstArgs[iArg]->errinfo, "Shuffle index %lld is out of range for two %s", iElement,
+							StrPrintType(tidVector).Pchz());
+				}
+			}
+
+			pAstcall->tid = TidVector(pWork, pTypevec->tidElement, cElement);
+		}
+		break;
+
+	case VECOP_Select:
+		Coerce(pWork, &arypAstArgs[0], TidVectorMask(pWork, tidVector));
+		Coerce(pWork, &arypAstArgs[1], tidVector);
+		Coerce(pWork, &arypAstArgs[2], tidVector);
+		pAstcall->tid = tidVector;
+		break;
+
+	default:
+		pAstcall->tid = pTypevec->tidElement;
+		break;
+	}
+}
+
+void TypeCheck(SWorkspace * pWork, STypeRecurse * pTrec, STypeCheckSwitch * pTcswitch)
+{
+	SAst * pAst = *pTrec->ppAst;
+
+	switch (pAst->astk)
+	{
+	case ASTK_Literal:
+	case ASTK_Null:
+		// Literals of all kinds infer their type from above
+		break;
+
+	case ASTK_UninitializedValue: // Never gets a type
+		break;
+	
+	case ASTK_Block:
+	case ASTK_EmptyStatement:
+		// BB (adrianb) Try and process any un-processed constant definitions in blocks or just let on 
+		//  demand processing do its thing? Maybe we should list those declarations in the list and still
+		//  process them as we get to them too?
+		pAst->tid = pWork->tidVoid;
+		break;
+
+	case ASTK_Identifier:
+		{
+			// Lookup identifier
+			// if found, use type
+			// if not, find declaration (error if not found or if already on stack)
+			//   set pTcsw to switch to that declaration (pushing the current one on the stack).
+
+			auto pAstident = PastCast<SAstIdentifier>(pAst);
+			auto pSymt = pTrec->pSymtParent;
+
+			SResolveDecl * pResdecl;
+			if (pSymt->symtblk >= SYMTBLK_RegisterAllMic)
+			{
+				++pWork->cSymbolLookup;
+				pResdecl = PresdeclLookup(pSymt, pAstident->pChz, 0, pAst->errinfo);
+			}
+			else if (!FTryResolveSymbolWithUsing(pWork, pSymt, pAstident->pChz, pAst->errinfo, pTcswitch, &pResdecl))
+			{
+				// We have switched to resolving another declaration
+				ASSERT(pTcswitch->pDecl);
+				break;
+			}
+
+			if (!pResdecl)
+			{
+				ShowErr(pAst->errinfo, "Couldn't find declaration for identifier");
+			}
+
+			STypeId tid = pResdecl->pDecl->pAstdecl->tid;
+			if (tid.pType == nullptr)
+			{
+				pTcswitch->pDecl = pResdecl->pDecl;
+				break;
+			}
+			
+			pAstident->tid = tid;
+
+			RegisterResolved(pWork, pTrec->pSymtParent, pAstident, pResdecl);
+		}
+		break;
 
 	case ASTK_Operator:
 		{
 			// Coerce arguments (where possible replace constants with literal result?)
 
 			auto pAstop = PastCast<SAstOperator>(pAst);
-			auto pChzOp = pAstop->pChzOp;
+			auto op = pAstop->op;
 			if (pAstop->pAstLeft == nullptr)
 			{
-				if (strcmp(pChzOp, "-") == 0)
+				if (op == OP_Sub)
 				{
 					TryCoerceLit(pWork, pAstop->pAstRight);
 					auto tid = pAstop->pAstRight->tid;
 					auto typek = tid.pType->typek;
+					if (typek == TYPEK_Vector)
+						typek = PtypeCast<STypeVector>(tid.pType)->tidElement.pType->typek;
+
 					if ((typek >= TYPEK_S8 && typek <= TYPEK_S64) || typek == TYPEK_Float)
 					{
 						pAstop->tid = tid;
 					}
 				}
-				else if (strcmp(pChzOp, "!") == 0)
+				else if (op == OP_Not)
 				{
 					TryCoerceLit(pWork, pAstop->pAstRight);
 					auto tid = pAstop->pAstRight->tid;
@@ -7598,16 +9373,31 @@ void TypeCheck(SWorkspace * pWork, STypeRecurse * pTrec, STypeCheckSwitch * pTcs
 						pAstop->tid = tid;
 					}
 				}
-				else if (strcmp(pChzOp, "--") == 0 || strcmp(pChzOp, "++") == 0)
+				else if (op == OP_BitNot)
+				{
+					TryCoerceLit(pWork, pAstop->pAstRight);
+					auto tid = pAstop->pAstRight->tid;
+					auto typek = tid.pType->typek;
+					if (typek == TYPEK_Vector)
+						typek = PtypeCast<STypeVector>(tid.pType)->tidElement.pType->typek;
+
+					if (FIsInt(typek))
+					{
+						pAstop->tid = tid;
+					}
+				}
+				else if (op == OP_Decrement || op == OP_Increment)
 				{
 					// BB (adrianb) Are prefix inc/dec a thing?
 
 					if (!FCanGetAddress(pAstop->pAstRight))
 					{
 						ShowErr(pAstop->errinfo, "Cannot modify argument using operator %s, "
-								"expected variable or struct member", pChzOp);
+								"expected variable or struct member", PchzFromOp(op));
 					}
 
+					MarkModified(pWork, pAstop->pAstRight);
+
 					auto tid = pAstop->pAstRight->tid;
 					ASSERT(tid.pType != nullptr);
 					auto typek = tid.pType->typek;
@@ -7622,22 +9412,24 @@ void TypeCheck(SWorkspace * pWork, STypeRecurse * pTrec, STypeCheckSwitch * pTcs
 
 					pAstop->tid = tid;
 				}
-				else if (strcmp(pChzOp, "*") == 0)
+				else if (op == OP_Mul)
 				{
 					if (!FCanGetAddress(pAstop->pAstRight))
 					{
 						ShowErr(pAstop->errinfo, "Cannot modify argument using operator %s, "
-								"expected variable or struct member", pChzOp);
+								"expected variable or struct member", PchzFromOp(op));
 					}
 
+					MarkModified(pWork, pAstop->pAstRight, true);
+
 					auto tid = pAstop->pAstRight->tid;
 					ASSERT(tid.pType != nullptr);
 					
 					// BB (adrianb) Verify declaration is not a constant expression?
 
-					pAstop->tid = TidPointer(pWork, tid);
+					pAstop->tid = TidPointer(pWork, tid, FIsSoaElement(pAstop->pAstRight));
 				}
-				else if (strcmp(pChzOp, "<<") == 0)
+				else if (op == OP_ShiftLeft)
 				{
 					auto tid = pAstop->pAstRight->tid;
 					ASSERT(tid.pType != nullptr);
@@ -7656,7 +9448,7 @@ void TypeCheck(SWorkspace * pWork, STypeRecurse * pTrec, STypeCheckSwitch * pTcs
 			{
 				// Run special case operator comparisons
 
-				if (strcmp(pChzOp, ".") == 0)
+				if (op == OP_Dot)
 				{
 					// Lookup struct from type on the left (either struct or pointer) and get member type
 
@@ -7666,7 +9458,24 @@ void TypeCheck(SWorkspace * pWork, STypeRecurse * pTrec, STypeCheckSwitch * pTcs
 					}
 
 					STypeId tidStruct = pAstop->pAstLeft->tid;
-					if (tidStruct.pType)
+					if (auto pTypevec = PtypevecSwizzled(pAstop))
+					{
+						auto pChzSwizzle = PastCast<SAstIdentifier>(pAstop->pAstRight)->pChz;
+						int aiElement[4];
+						int cElement = CElementSwizzle(pChzSwizzle, pTypevec->cElement, aiElement);
+						if (cElement == 0 || cElement == 3)
+						{
+							ShowErr(pAstop->pAstRight->errinfo, 
+									"Expected 1, 2 or 4 of the elements xyzw to swizzle %s, found %s", 
+									StrPrintType(pTypevec).Pchz(), pChzSwizzle);
+						}
+
+						pAstop->tid = (cElement == 1) ? 
+										pTypevec->tidElement : 
+										TidVector(pWork, pTypevec->tidElement, cElement);
+						pAstop->pAstRight->tid = pAstop->tid;
+					}
+					else if (tidStruct.pType)
 					{
 						// BB (adrianb) Further null checks?
 						if (tidStruct.pType->typek == TYPEK_Pointer)
@@ -7727,7 +9536,7 @@ void TypeCheck(SWorkspace * pWork, STypeRecurse * pTrec, STypeCheckSwitch * pTcs
 
 							// BB (adrianb) We want to store using path with this!?
 
-							RegisterResolved(pWork, pAstident, pResdecl);
+							RegisterResolved(pWork, pTrec->pSymtParent, pAstident, pResdecl);
 						}
 					}
 
@@ -7740,31 +9549,35 @@ void TypeCheck(SWorkspace * pWork, STypeRecurse * pTrec, STypeCheckSwitch * pTcs
 				}
 				else
 				{
-					for (const auto & bopi : s_aBopiModify)
+					if (const SBinaryOperatorInst * pBopi = s_optableBopiModify.PtLookup(op))
 					{
-						if (strcmp(bopi.pChzOp, pChzOp) != 0)
-							continue;
-
 						if (!FCanGetAddress(pAstop->pAstLeft))
 						{
 							ShowErr(pAstop->pAstLeft->errinfo, "Cannot use assigning operator %s on non-memory location",
-									pChzOp);
+									PchzFromOp(op));
 						}
 
-						if (!FTryCoerceOperatorAssign(pWork, pAstop, bopi.grfbopi))
+						MarkModified(pWork, pAstop->pAstLeft);
+
+						if (!FTryCoerceOperatorAssign(pWork, pAstop, pBopi->grfbopi))
 							goto LOperatorDone;
 							
 						pAstop->tid = pWork->tidVoid;
 						goto LOperatorDone;
 					}
 
-					for (const auto & bopi : s_aBopi)
+					if ((op == OP_ShiftLeft || op == OP_ShiftRight) && 
+						FIsUntypedIntLiteral(pAstop->pAstLeft) && FIsUntypedIntLiteral(pAstop->pAstRight))
 					{
-						if (strcmp(bopi.pChzOp, pChzOp) == 0)
-						{
-							TryCoerceOperator(pWork, pAstop, bopi.grfbopi);
-							break;
-						}
+						// Untyped like the literals it replaces, skip checking for a type below
+
+						*pTrec->ppAst = PastlitShiftLiterals(pWork, pAstop);
+						return;
+					}
+
+					if (const SBinaryOperatorInst * pBopi = s_optableBopi.PtLookup(op))
+					{
+						TryCoerceOperator(pWork, pAstop, pBopi->grfbopi);
 					}
 				}
 			}
@@ -7779,14 +9592,14 @@ LOperatorDone:
 				if (pAstop->pAstLeft == nullptr)
 				{
 					ShowErr(pAstop->errinfo, "Invalid prefix operator %s given type %s, cannot be typechecked.", 
-							pChzOp, StrPrintType(pAstop->pAstRight->tid.pType).Pchz());
+							PchzFromOp(op), StrPrintType(pAstop->pAstRight->tid.pType).Pchz());
 				}
 				else
 				{
 					TryCoerceLit(pWork, pAstop->pAstLeft);
 				
 					ShowErr(pAstop->errinfo, "Invalid operator %s given types %s and %s, cannot be typechecked.", 
-							pChzOp, StrPrintType(pAstop->pAstLeft->tid.pType).Pchz(), 
+							PchzFromOp(op), StrPrintType(pAstop->pAstLeft->tid.pType).Pchz(), 
 							StrPrintType(pAstop->pAstRight->tid.pType).Pchz());
 				}
 			}
@@ -7820,9 +9633,65 @@ LOperatorDone:
 		break;
 
 	case ASTK_For:
-		ASSERT(false);
-		// Add identifier declaration based on iterRight, and any manual for declaration
-		pAst->tid = pWork->tidVoid;
+		{
+			// Declare it and it_index based on what we're iterating over
+
+			auto pAstfor = PastCast<SAstFor>(pAst);
+			STypeId tidIt;
+
+			if (pAstfor->pAstRangeEnd)
+			{
+				// Ranges take the type of whichever end is typed, s64 (same as it_index) if both are literals
+
+				if (pAstfor->fTakesPointer)
+					ShowErr(pAst->errinfo, "Can't iterate over a range by pointer");
+
+				tidIt = pAstfor->pAstIterRight->tid;
+				if (tidIt.pType == nullptr)
+					tidIt = pAstfor->pAstRangeEnd->tid;
+				if (tidIt.pType == nullptr)
+					tidIt = pWork->tidS64;
+
+				if (!FIsInt(tidIt.pType->typek))
+				{
+					ShowErr(pAstfor->pAstIterRight->errinfo, "Ranges must be integers, found %s", 
+							StrPrintType(tidIt).Pchz());
+				}
+
+				Coerce(pWork, &pAstfor->pAstIterRight, tidIt);
+				Coerce(pWork, &pAstfor->pAstRangeEnd, tidIt);
+			}
+			else
+			{
+				STypeId tidArray = pAstfor->pAstIterRight->tid;
+				if (tidArray.pType->typek != TYPEK_Array)
+				{
+					ShowErr(pAstfor->pAstIterRight->errinfo, "Can only iterate over arrays and ranges, found %s", 
+							StrPrintType(tidArray).Pchz());
+				}
+
+				auto pTypearray = PtypeCast<STypeArray>(tidArray.pType);
+				tidIt = pTypearray->tidElement;
+				if (pAstfor->fTakesPointer)
+				{
+					tidIt = TidPointer(pWork, tidIt, pTypearray->fSoa);
+
+					// Fixed arrays hold their elements, pointers to them can modify the array
+
+					if (pTypearray->cSizeFixed >= 0)
+						MarkModified(pWork, pAstfor->pAstIterRight, true);
+				}
+			}
+
+			pAstfor->pAstdeclIt->tid = tidIt;
+			pAstfor->pAstdeclItIndex->tid = pWork->tidS64;
+			AddDeclaration(pWork, pTrec->pSymtParent, pAstfor->pAstdeclIt->pChzName, pAstfor->pAstdeclIt, nullptr, {}, 
+							pAstfor->pAstIter == nullptr);
+			AddDeclaration(pWork, pTrec->pSymtParent, pAstfor->pAstdeclItIndex->pChzName, pAstfor->pAstdeclItIndex, 
+							nullptr, {}, true);
+
+			pAst->tid = pWork->tidVoid;
+		}
 		break;
 
 	case ASTK_LoopControl:
@@ -7834,6 +9703,10 @@ LOperatorDone:
 		{
 			auto pAstcast = PastCast<SAstCast>(pAst);
 
+			// Untyped literals take their default type and convert from there
+
+			TryDefaultType(pWork, pAstcast->pAstExpr);
+
 			STypeId tidSrc = pAstcast->pAstExpr->tid;
 			STypeId tidDst = pAstcast->pAstType->tid;
 
@@ -7843,11 +9716,45 @@ LOperatorDone:
 			tidDst = PtypeCast<STypeTypeOf>(tidDst.pType)->tid;
 
 			if (tidSrc == tidDst)
-				return;
+			{
+				pAst->tid = tidDst;
+				break;
+			}
 
 			TYPEK typekSrc = tidSrc.pType->typek;
 			TYPEK typekDst = tidDst.pType->typek;
 
+			if (typekDst == TYPEK_Vector && typekSrc != TYPEK_Vector)
+			{
+				// Convert scalars to the element type first, then splat them
+
+				STypeId tidElement = PtypeCast<STypeVector>(tidDst.pType)->tidElement;
+				if (tidSrc != tidElement)
+				{
+					auto pAstcastElement = PastCreate<SAstCast>(pWork, pAst->errinfo);
+					pAstcastElement->tid = tidElement;
+					pAstcastElement->pAstExpr = pAstcast->pAstExpr;
+					pAstcast->pAstExpr = pAstcastElement;
+				}
+
+				typekDst = tidElement.pType->typek;
+			}
+			else if (typekDst == TYPEK_Vector && typekSrc == TYPEK_Vector)
+			{
+				// Vectors convert elementwise
+
+				auto pTypevecSrc = PtypeCast<STypeVector>(tidSrc.pType);
+				auto pTypevecDst = PtypeCast<STypeVector>(tidDst.pType);
+				if (pTypevecSrc->cElement != pTypevecDst->cElement)
+				{
+					ShowErr(pAst->errinfo, "Cannot convert from %s to %s, element counts differ", 
+							StrPrintType(tidSrc).Pchz(), StrPrintType(tidDst).Pchz());
+				}
+
+				typekSrc = pTypevecSrc->tidElement.pType->typek;
+				typekDst = pTypevecDst->tidElement.pType->typek;
+			}
+
 			bool fCanConvert = false;
 			if (FIsInt(typekSrc))
 			{
@@ -7877,6 +9784,17 @@ LOperatorDone:
 		break;
 
 	case ASTK_Delete:
+		{
+			auto pAstExpr = PastCast<SAstDelete>(pAst)->pAstExpr;
+			if (pAstExpr->tid.pType->typek != TYPEK_Pointer)
+			{
+				ShowErr(pAst->errinfo, "Expected pointer to delete, found %s", StrPrintType(pAstExpr->tid.pType).Pchz());
+			}
+
+			pAst->tid = pWork->tidVoid;
+		}
+		break;
+
 	case ASTK_Remove:
 		pAst->tid = pWork->tidVoid;
 		break;
@@ -7886,7 +9804,15 @@ LOperatorDone:
 		break;
 
 	case ASTK_Inline:
-		pAst->tid = PastCast<SAstInline>(pAst)->pAstExpr->tid;
+		{
+			auto pAstinline = PastCast<SAstInline>(pAst);
+			if (pAstinline->pAstExpr->astk != ASTK_Call)
+			{
+				ShowErr(pAst->errinfo, "Expected procedure call after %s", (pAstinline->fNoInline) ? "noinline" : "inline");
+			}
+
+			pAst->tid = pAstinline->pAstExpr->tid;
+		}
 		break;
 
 	case ASTK_PushContext:
@@ -7907,8 +9833,17 @@ LOperatorDone:
 				{
 					pAst->tid = PtypeCast<STypeArray>(pTypeArray)->tidElement;
 				}
+				else if (pTypeArray->typek == TYPEK_Vector)
+				{
+					pAst->tid = PtypeCast<STypeVector>(pTypeArray)->tidElement;
+				}
 				else if (pTypeArray->typek == TYPEK_Pointer)
 				{
+					if (PtypeCast<STypePointer>(pTypeArray)->fSoa)
+					{
+						ShowErr(pAst->errinfo, "Can't index SOA pointer, index the SOA array instead");
+					}
+
 					pAst->tid = PtypeCast<STypePointer>(pTypeArray)->tidPointedTo;
 				}
 			}
@@ -7943,6 +9878,29 @@ LOperatorDone:
 
 					break;
 				}
+
+				// Builtin array and vector operations, unless the program declares something with the same name
+
+				ARYOP aryop = AryopFromPchz(pChzIdent);
+				VECOP vecop = VecopFromPchz(pChzIdent);
+				if (aryop != ARYOP_Nil || vecop != VECOP_Nil)
+				{
+					if (!FTryResolveUsing(pWork, pTrec->pSymtParent, pTcswitch))
+					{
+						// We have switched to resolving another declaration
+						ASSERT(pTcswitch->pDecl);
+						break;
+					}
+
+					if (!FIsDeclared(pTrec->pSymtParent, pChzIdent))
+					{
+						if (aryop != ARYOP_Nil)
+							TypeCheckAryop(pWork, pAstcall, aryop);
+						else
+							TypeCheckVecop(pWork, pAstcall, vecop);
+						break;
+					}
+				}
 				
 				SResolveDecl * pResdecl;
 				if (MatchkTryResolveOverloadWithUsing(pWork, pTrec->pSymtParent, pAstcall, pTcswitch, &pResdecl) == MATCHK_Suspend)
@@ -7954,7 +9912,7 @@ LOperatorDone:
 				
 				pAstcall->pAstFunc->tid = pResdecl->pDecl->pAstdecl->tid;
 
-				RegisterResolved(pWork, pAstcall->pAstFunc, pResdecl);
+				RegisterResolved(pWork, pTrec->pSymtParent, pAstcall->pAstFunc, pResdecl, true);
 			}
 
 			// Coerce arguments, use return type of pAstFunc
@@ -8005,9 +9963,10 @@ LOperatorDone:
 				}
 			}
 		
+			// Calls returning multiple values give the first in expressions, see ASTK_DeclareMulti for the rest
+
 			if (pTypeproc->cTidRet > 0)
 			{
-				ASSERT(pTypeproc->cTidRet == 1);
 				pAst->tid = pTypeproc->aTidRet[0];
 			}
 			else
@@ -8046,8 +10005,10 @@ LOperatorDone:
 			}
 			else if (pAstret->arypAstRet.c)
 			{
-				ASSERT(pTypeproc->cTidRet == 1);
-				Coerce(pWork, &pAstret->arypAstRet[0], pTypeproc->aTidRet[0]);
+				for (int ipAst : IterCount(pAstret->arypAstRet.c))
+				{
+					Coerce(pWork, &pAstret->arypAstRet[ipAst], pTypeproc->aTidRet[ipAst]);
+				}
 				pAst->tid = pTypeproc->aTidRet[0];
 			}
 			else
@@ -8099,13 +10060,80 @@ LOperatorDone:
 		break;
 
 	case ASTK_DeclareMulti:
-		ASSERT(false);
-		// Same as declare single except for multiple names and need to unpack tuples
-		// BB (adrianb) Need to unpack and coerce the structure. How?
-		break;
+		{
+			// Each name gets one of the values returned by a call, or without a value they all get the explicit type
 
-	case ASTK_AssignMulti:
-		ASSERT(false);
+			auto pAstdecmul = PastCast<SAstDeclareMulti>(pAst);
+			if (pAstdecmul->fIsConstant || pTrec->pSymtParent->symtblk >= SYMTBLK_RegisterAllMic)
+			{
+				ShowErr(pAst->errinfo, "Multiple declarations are only supported for variables inside procedures");
+			}
+
+			int cAstdecl = pAstdecmul->arypAstdecl.c;
+			const STypeProcedure * pTypeproc = nullptr;
+			if (pAstdecmul->pAstValue)
+			{
+				pTypeproc = PtypeprocMultiValue(pAstdecmul->pAstValue);
+				if (!pTypeproc || pTypeproc->cTidRet < cAstdecl)
+				{
+					ShowErr(pAstdecmul->pAstValue->errinfo, "Expected a call returning at least %d values", cAstdecl);
+				}
+			}
+
+			STypeId tidType = {};
+			if (pAstdecmul->pAstType)
+				tidType = TidUnwrap(pAstdecmul->pAstType->errinfo, pAstdecmul->pAstType->tid);
+
+			for (int ipAstdecl : IterCount(cAstdecl))
+			{
+				auto pAstdecl = pAstdecmul->arypAstdecl[ipAstdecl];
+				pAstdecl->tid = (pTypeproc) ? pTypeproc->aTidRet[ipAstdecl] : tidType;
+
+				// BB (adrianb) Coerce unpacked values to the explicit type?
+
+				if (pAstdecmul->pAstType && pAstdecl->tid != tidType)
+				{
+					ShowErr(pAstdecl->errinfo, "Cannot declare %s as %s, value is %s", pAstdecl->pChzName, 
+							StrPrintType(tidType).Pchz(), StrPrintType(pAstdecl->tid).Pchz());
+				}
+
+				AddDeclaration(pWork, pTrec->pSymtParent, pAstdecl->pChzName, pAstdecl);
+			}
+
+			pAst->tid = pWork->tidVoid;
+		}
+		break;
+
+	case ASTK_AssignMulti:
+		{
+			auto pAstassignmul = PastCast<SAstAssignMulti>(pAst);
+			int cAstName = pAstassignmul->arypAstName.c;
+			auto pTypeproc = PtypeprocMultiValue(pAstassignmul->pAstValue);
+			if (!pTypeproc || pTypeproc->cTidRet < cAstName)
+			{
+				ShowErr(pAstassignmul->pAstValue->errinfo, "Expected a call returning at least %d values", cAstName);
+			}
+
+			for (int ipAst : IterCount(cAstName))
+			{
+				auto pAstName = pAstassignmul->arypAstName[ipAst];
+				auto pResdecl = PresdeclResolved(pWork, pAstName);
+				if (pResdecl && pResdecl->pDecl->pAstdecl && pResdecl->pDecl->pAstdecl->fIsConstant)
+				{
+					ShowErr(pAstName->errinfo, "Cannot assign to constant %s", PastCast<SAstIdentifier>(pAstName)->pChz);
+				}
+
+				MarkModified(pWork, pAstName);
+
+				if (pAstName->tid != pTypeproc->aTidRet[ipAst])
+				{
+					ShowErr(pAstName->errinfo, "Cannot assign %s to %s", StrPrintType(pTypeproc->aTidRet[ipAst]).Pchz(), 
+							StrPrintType(pAstName->tid).Pchz());
+				}
+			}
+
+			pAst->tid = pWork->tidVoid;
+		}
 		break;
 
 	case ASTK_Struct:
@@ -8118,6 +10146,7 @@ LOperatorDone:
 
 			auto pTypestruct = PtAlloc<STypeStruct>(&pWork->pagealloc);
 			pTypestruct->typek = TYPEK_Struct;
+			pTypestruct->pWork = pWork;
 			pTypestruct->pChzName = pAststruct->pChzName;
 
 			int cMember = 0;
@@ -8257,7 +10286,13 @@ LOperatorDone:
 			//  type used as value and used as type?
 
 			auto pAtypeptr = PastCast<SAstTypePointer>(pAst);
-			pAst->tid = TidWrap(pWork, TidPointer(pWork, TidUnwrap(pAst->errinfo, pAtypeptr->pAstTypeInner->tid)));
+			STypeId tidPointedTo = TidUnwrap(pAst->errinfo, pAtypeptr->pAstTypeInner->tid);
+			if (pAtypeptr->fSoa && tidPointedTo.pType->typek != TYPEK_Struct)
+			{
+				ShowErr(pAst->errinfo, "SOA pointer must point to a struct, found %s", StrPrintType(tidPointedTo).Pchz());
+			}
+
+			pAst->tid = TidWrap(pWork, TidPointer(pWork, tidPointedTo, pAtypeptr->fSoa));
 		}
 		break;
 
@@ -8269,9 +10304,17 @@ LOperatorDone:
 			typearray.typek = TYPEK_Array;
 			typearray.cSizeFixed = -1;
 			typearray.fDynamicallySized = pAtypearray->fDynamicallySized;
+			typearray.fSoa = pAtypearray->fSoa;
+			typearray.cSoaChunk = pAtypearray->cSoaChunk;
 			typearray.tidElement = TidUnwrap(pAtypearray->pAstTypeInner->errinfo,
 											 pAtypearray->pAstTypeInner->tid);
 
+			if (typearray.fSoa && typearray.tidElement.pType->typek != TYPEK_Struct)
+			{
+				ShowErr(pAst->errinfo, "SOA array elements must be a struct, found %s", 
+						StrPrintType(typearray.tidElement).Pchz());
+			}
+
 			if (pAtypearray->pAstSize)
 			{
 				// BB (adrianb) Specially detect variable sized arrays?
@@ -8287,6 +10330,11 @@ LOperatorDone:
 				typearray.cSizeFixed = n;
 			}
 
+			if (typearray.cSoaChunk > 0 && typearray.cSizeFixed < 0)
+			{
+				ShowErr(pAst->errinfo, "SOA chunk size is only supported on fixed size arrays");
+			}
+
 			// Manually performing TidEnsure here, assumes that array contains sum total info and we can patch struct
 			//  in as needed
 
@@ -8303,13 +10351,18 @@ LOperatorDone:
 			SSymbolTable * pSymtArray = PsymtCreate(SYMTBLK_Struct, pWork, nullptr);
 
 			// BB (adrianb) Not filling in actual full AST.
+			// SOA arrays have no single data pointer, elements are only reached through indexing
 
-			auto pAstdeclA = PastdeclCreateTyped(pWork, "a", TidPointer(pWork, typearray.tidElement));
-			AddDeclaration(pWork, pSymtArray, "a", pAstdeclA);
+			SAstDeclareSingle * pAstdeclA = nullptr;
+			if (!typearray.fSoa)
+			{
+				pAstdeclA = PastdeclCreateTyped(pWork, "a", TidPointer(pWork, typearray.tidElement));
+				AddDeclaration(pWork, pSymtArray, "a", pAstdeclA);
+			}
 
-			// BB (adrianb) Use u64 to support >4GiB u8? For c and cMax.
+			// Counts are s64 so arrays can hold more than 4 billion elements
 
-			auto pAstdeclC = PastdeclCreateTyped(pWork, "c", pWork->tidU32);
+			auto pAstdeclC = PastdeclCreateTyped(pWork, "c", pWork->tidS64);
 
 			if (typearray.cSizeFixed >= 0)
 			{
@@ -8330,17 +10383,18 @@ LOperatorDone:
 			{
 				// Dynamic array just contains a cMax
 
-				pAstdeclCMax = PastdeclCreateTyped(pWork, "cMax", pWork->tidU32);
+				pAstdeclCMax = PastdeclCreateTyped(pWork, "cMax", pWork->tidS64);
 				AddDeclaration(pWork, pSymtArray, "cMax", pAstdeclCMax);
 			}
 
 			auto pTypestruct = PtAlloc<STypeStruct>(&pWork->pagealloc);
 			pTypestruct->typek = TYPEK_Struct;
+			pTypestruct->pWork = pWork;
 			pTypestruct->pChzName = "_array";
 
 			pTypestruct->cMemberMax = pTypestruct->cMember = (pAstdeclCMax) ? 3 : 2;
 
-			if (typearray.cSizeFixed < 0)
+			if (typearray.cSizeFixed < 0 && !typearray.fSoa)
 			{
 				pTypestruct->aMember = PtAlloc<STypeStruct::SMember>(&pWork->pagealloc, pTypestruct->cMember);
 				pTypestruct->aMember[0].pAstdecl = pAstdeclA;
@@ -8360,6 +10414,42 @@ LOperatorDone:
 		break;
 		
 	case ASTK_TypeProcedure:
+		{
+			// Same as the type of a procedure declaration, but only the argument types were type checked
+
+			auto pAtypeproc = PastCast<SAstTypeProcedure>(pAst);
+
+			int cpAstArg = pAtypeproc->arypAstDeclArg.c;
+			auto aTidArg = static_cast<STypeId *>(alloca(sizeof(STypeId) * (cpAstArg + 1)));
+			for (int ipAst : IterCount(cpAstArg))
+			{
+				auto pAstType = PastCast<SAstDeclareSingle>(pAtypeproc->arypAstDeclArg[ipAst])->pAstType;
+				aTidArg[ipAst] = TidUnwrap(pAstType->errinfo, pAstType->tid);
+				if (aTidArg[ipAst].pType->typek == TYPEK_Vararg)
+				{
+					ShowErr(pAstType->errinfo, "Procedure types can't take varargs");
+				}
+			}
+
+			int cpAstRet = pAtypeproc->arypAstDeclRet.c;
+			auto aTidRet = static_cast<STypeId *>(alloca(sizeof(STypeId) * (cpAstRet + 1)));
+			for (int ipAst : IterCount(cpAstRet))
+			{
+				auto pAstType = PastCast<SAstDeclareSingle>(pAtypeproc->arypAstDeclRet[ipAst])->pAstType;
+				aTidRet[ipAst] = TidUnwrap(pAstType->errinfo, pAstType->tid);
+			}
+
+			STypeProcedure typeproc = {};
+			typeproc.typek = TYPEK_Procedure;
+			typeproc.aTidArg = (cpAstArg > 0) ? aTidArg : nullptr;
+			typeproc.aTidRet = (cpAstRet > 0) ? aTidRet : nullptr;
+			typeproc.cTidArg = cpAstArg;
+			typeproc.cTidRet = cpAstRet;
+
+			pAst->tid = TidWrap(pWork, TidEnsure(pWork, &typeproc));
+		}
+		break;
+
 	case ASTK_TypePolymorphic:
 		ShowErr(pAst->errinfo, "NYI");
 		break;
@@ -8408,6 +10498,50 @@ struct STypeCheckEntry
 	SDeclaration * pDecl;
 };
 
+inline bool FIsTypeCheckDone(const SDeclaration * pDecl)
+{
+	return pDecl->iTrecCur >= pDecl->aryTrec.c;
+}
+
+void PruneBuiltinProcedures(SWorkspace * pWork)
+{
+	// Builtin module procedures only get code generated when the program references them, directly or through 
+	//  another referenced builtin procedure.
+
+	SArray<SAstProcedure *> arypAstprocLive = {};
+	defer { Destroy(&arypAstprocLive); };
+
+	for (bool fChanged = true; fChanged;)
+	{
+		fChanged = false;
+		for (const auto & builtinref : pWork->aryBuiltinref)
+		{
+			auto pAstprocFrom = builtinref.pAstprocFrom;
+			bool fLive = !pAstprocFrom || !pWork->aryModule[pAstprocFrom->iModuleOwner].fBuiltIn || 
+						 FContains(arypAstprocLive, pAstprocFrom);
+			if (fLive && !FContains(arypAstprocLive, builtinref.pAstprocTo))
+			{
+				Append(&arypAstprocLive, builtinref.pAstprocTo);
+				fChanged = true;
+			}
+		}
+	}
+
+	for (auto pModule : IterPointer(pWork->aryModule))
+	{
+		if (!pModule->fBuiltIn)
+			continue;
+
+		int cpAstprocGen = 0;
+		for (auto pAstproc : pModule->arypAstprocGen)
+		{
+			if (FContains(arypAstprocLive, pAstproc))
+				pModule->arypAstprocGen[cpAstprocGen++] = pAstproc;
+		}
+		pModule->arypAstprocGen.c = cpAstprocGen;
+	}
+}
+
 void TypeCheckAll(SWorkspace * pWork)
 {
 	// Only variable values inside function scopes must be type checked in order. These can be out of order:
@@ -8437,17 +10571,24 @@ void TypeCheckAll(SWorkspace * pWork)
 			
 	for (SModule * pModule : IterPointer(pWork->aryModule))
 	{
+		u64 nsStart = NsNow();
 		SRecurseCtx recx = { pWork, nullptr, &pWork->symtRoot };
 	
 		for (auto ppAst : IterPointer(pModule->pAstblockRoot->arypAst))
 		{
 			RecurseTypeCheckDecl(recx, ppAst);
 		}
+
+		AddTraceSpan(pWork, "declare", pModule->pChzFile, nsStart);
 	}
 
-	// Run type checking in prerecursion order
+	// Run type checking in prerecursion order. A declaration that needs another declaration's type suspends and 
+	//  waits on it, we switch to the needed declaration and resume the waiters once it finishes. Only the
+	//  declaration being checked can suspend, so every suspended declaration waits on some later link in the same
+	//  chain and needing one of them again is a cycle.
 
-	SArray<SDeclaration *> arypResolveWait = {};
+	SArray<SDeclaration *> arypDeclReady = {};
+	defer { Destroy(&arypDeclReady); };
 
 	// Type check everything, allowing for new symbol tables to be added in flight
     
@@ -8456,47 +10597,59 @@ void TypeCheckAll(SWorkspace * pWork)
 		auto pSymt = pWork->arypSymtAll[ipSymt];
 		for (int ipResdecl : IterCount(pSymt->arypResdecl.c))
 		{
-			auto pDecl = pSymt->arypResdecl[ipResdecl]->pDecl;
-			for (;;)
+			auto pDeclRoot = pSymt->arypResdecl[ipResdecl]->pDecl;
+			if (FIsTypeCheckDone(pDeclRoot))
+				continue;
+
+			ASSERT(!pDeclRoot->fSuspended);
+			Append(&arypDeclReady, pDeclRoot);
+
+			while (arypDeclReady.c > 0)
 			{
-				// Empty queue of waiting resolves after we've finished this one
+				auto pDecl = Tail(&arypDeclReady);
+				Pop(&arypDeclReady);
 
-				if (pDecl->iTrecCur >= pDecl->aryTrec.c)
+				while (!FIsTypeCheckDone(pDecl))
 				{
-					if (arypResolveWait.c == 0)
-						break;
+					STypeCheckSwitch tcswitch = {};
+					TypeCheck(pWork, &pDecl->aryTrec[pDecl->iTrecCur], &tcswitch);
 
-					pDecl = Tail(&arypResolveWait);
-					Pop(&arypResolveWait);
-					continue;
-				}
+					auto pDeclNeed = tcswitch.pDecl;
+					if (!pDeclNeed)
+					{
+						pDecl->iTrecCur++;
+						continue;
+					}
 
-				STypeCheckSwitch tcswitch = {};
-				TypeCheck(pWork, &pDecl->aryTrec[pDecl->iTrecCur], &tcswitch);
-                
-				if (tcswitch.pDecl)
-				{
-					for (SDeclaration * pResolveWait : arypResolveWait)
+					if (pDeclNeed == pDecl || pDeclNeed->fSuspended)
 					{
-						if (pResolveWait == tcswitch.pDecl)
-						{
-							// BB (adrianb) Display the full contents of the cycle (and where the references were from)?
-							ShowErr(pResolveWait->pAstdecl->errinfo, "Cycle asking for symbol resolution");
-						}
+						// BB (adrianb) Display the full contents of the cycle (and where the references were from)?
+						ShowErr(pDeclNeed->pAstdecl->errinfo, "Cycle asking for symbol resolution");
 					}
 
-					Append(&arypResolveWait, pDecl);
-					pDecl = tcswitch.pDecl;
+					ASSERTCHZ(!FIsTypeCheckDone(pDeclNeed), "Suspended on %s which has finished type checking", 
+							  pDeclNeed->pChzName);
+
+					pDecl->fSuspended = true;
+					Append(&pDeclNeed->arypDeclWaiting, pDecl);
+					++pWork->cTypeCheckSuspend;
+					pDecl = pDeclNeed;
 				}
-				else
+
+				// Resume everything waiting on this declaration, the next one to run is the most recent to suspend
+
+				for (auto pDeclWaiting : pDecl->arypDeclWaiting)
 				{
-					pDecl->iTrecCur++;
+					ASSERT(pDeclWaiting->fSuspended);
+					pDeclWaiting->fSuspended = false;
+					Append(&arypDeclReady, pDeclWaiting);
 				}
+				Destroy(&pDecl->arypDeclWaiting);
 			}
 		}
 	}
 
-	Destroy(&arypResolveWait);
+	PruneBuiltinProcedures(pWork);
 }
 
 
@@ -8537,6 +10690,7 @@ int CbBasicSize(TYPEK typek)
 		case TYPEK_Float: return 4;
 		case TYPEK_Double: return 8;
 		case TYPEK_Pointer: return 8;
+		case TYPEK_Procedure: return 8; // Procedure values are pointers to them
 		default: return -1;
 	}
 }
@@ -8546,20 +10700,75 @@ inline T max(T a, T b)
 {
 	return a < b ? b : a;
 }
-
 inline u32 CbAlign(u32 cB, u32 cBAlign)
 {
 	return (cB + cBAlign - 1) & ~(cBAlign - 1);
 }
 
+// Fixed size SOA arrays are laid out as chunks of columns, like [cChunk] struct { m0 : [cSoaChunk] M0; m1 : ... }.
+//  A plain SOA array is a single chunk holding every element. Slices and dynamic SOA arrays hold a pointer per 
+//  column followed by c (and cMax), SOA pointers just hold a pointer per member.
+
+const STypeStruct * PtypestructSoa(const SType * pType)
+{
+	STypeId tidElement = (pType->typek == TYPEK_Array) ? 
+							PtypeCast<STypeArray>(pType)->tidElement : 
+							PtypeCast<STypePointer>(pType)->tidPointedTo;
+	return PtypeCast<STypeStruct>(tidElement.pType);
+}
+
+s64 CSoaChunk(const STypeArray * pTypearray)
+{
+	ASSERT(pTypearray->fSoa && pTypearray->cSizeFixed >= 0);
+	return (pTypearray->cSoaChunk > 0) ? pTypearray->cSoaChunk : pTypearray->cSizeFixed;
+}
+
+s64 CChunkSoa(const STypeArray * pTypearray)
+{
+	s64 cSoaChunk = CSoaChunk(pTypearray);
+	return (cSoaChunk > 0) ? (pTypearray->cSizeFixed + cSoaChunk - 1) / cSoaChunk : 0;
+}
+
+u32 IBSoaColumn(const STypeArray * pTypearray, int iMember)
+{
+	// Offset of a member's column in a chunk, iMember == cMember gives the size of the chunk
+
+	auto pTypestruct = PtypestructSoa(pTypearray);
+	s64 cSoaChunk = CSoaChunk(pTypearray);
+
+	u32 cB = 0;
+	for (int iMemberPrev : IterCount(iMember))
+	{
+		STypeId tidMember = pTypestruct->aMember[iMemberPrev].pAstdecl->tid;
+		cB = CbAlign(cB, CbAlignOf(tidMember));
+		cB += cSoaChunk * CbSizeOf(tidMember);
+	}
+
+	if (iMember < pTypestruct->cMember)
+		return CbAlign(cB, CbAlignOf(pTypestruct->aMember[iMember].pAstdecl->tid));
+	
+	return CbAlign(cB, CbAlignOf(pTypearray->tidElement));
+}
+
 void EnsureTypeSize(const SType * pTypeIn)
 {
+	ASSERT(pTypeIn->pWork);
+	std::lock_guard<std::recursive_mutex> lock(*pTypeIn->pWork->pMutex);
+
 	auto pType = const_cast<SType *>(pTypeIn);
 	if (pType->fSizeComputed)
 		return;
 
 	pType->fSizeComputed = true;
 
+	if (pType->typek == TYPEK_Pointer && PtypeCast<STypePointer>(pType)->fSoa)
+	{
+		auto pTypestruct = PtypestructSoa(pType);
+		pType->cBAlign = CbBasicSize(TYPEK_Pointer);
+		pType->cB = pTypestruct->cMember * CbBasicSize(TYPEK_Pointer);
+		return;
+	}
+
     int cB = CbBasicSize(pType->typek);
 	if (cB >= 0)
 	{
@@ -8597,11 +10806,27 @@ LStruct:
 	case TYPEK_Array:
 		{
 			auto pTypearray = PtypeCast<STypeArray>(pType);
+			if (pTypearray->fSoa)
+			{
+				if (pTypearray->cSizeFixed >= 0)
+				{
+					pType->cBAlign = CbAlignOf(pTypearray->tidElement);
+					pType->cB = CChunkSoa(pTypearray) * IBSoaColumn(pTypearray, PtypestructSoa(pType)->cMember);
+				}
+				else
+				{
+					u32 cBPointer = CbBasicSize(TYPEK_Pointer);
+					u32 cBCount = CbBasicSize(TYPEK_S64);
+					pType->cBAlign = cBPointer;
+					pType->cB = CbAlign(PtypestructSoa(pType)->cMember * cBPointer + 
+											((pTypearray->fDynamicallySized) ? 2 : 1) * cBCount, cBPointer);
+				}
+				break;
+			}
+
 			if (pTypearray->cSizeFixed < 0)
 				goto LStruct;
 
-			ASSERT(!pTypearray->fSoa);
-
 			pType->cBAlign = CbAlignOf(pTypearray->tidElement);
 			pType->cB = pTypearray->cSizeFixed * CbSizeOf(pTypearray->tidElement);
 		}
@@ -8618,6 +10843,18 @@ LStruct:
 		}
 		break;
 	
+	case TYPEK_Vector:
+		{
+			// Vectors align to their size like llvm's do. 
+			// BB (adrianb) Heap allocations only get malloc's alignment (16), 32 and 64 byte vectors can end up 
+			//  misaligned there.
+
+			auto pTypevec = PtypeCast<STypeVector>(pType);
+			pType->cB = pTypevec->cElement * CbSizeOf(pTypevec->tidElement);
+			pType->cBAlign = pType->cB;
+		}
+		break;
+
 	//case TYPEK_TypeOf: return 1;
 	//case TYPEK_Vararg: return 1;
 
@@ -8635,6 +10872,16 @@ struct SValue
 	void * pV;
 };
 
+void FillRepeated(u8 * pB, size_t cBPattern, size_t cBTotal)
+{
+	// Copy the first cBPattern bytes until cBTotal are filled, doubling the copy size each time
+
+	for (size_t cBDone = cBPattern; cBDone < cBTotal; cBDone *= 2)
+	{
+		memcpy(pB + cBDone, pB, min(cBDone, cBTotal - cBDone));
+	}
+}
+
 struct SEvalCtx
 {
 	SWorkspace * pWork;
@@ -8658,9 +10905,10 @@ using PFNEVALCONSTBINARY = bool (*)(SValue valLeft, SValue valRight, SValue * pV
 
 struct SEvalConstBinaryOperator
 {
-	const char * pChzOp;
+	OP op;
 
 	PFNEVALCONSTBINARY pfnecb;
+	bool fCompare;				// Returns a bool, vectors fill the mask elements (see TidVectorMask) from it
 
 	// bools? 
 };
@@ -8773,6 +11021,122 @@ bool FTryRemValue(SValue val0, SValue val1, SValue * pValRet)
 	}
 }
 
+bool FTryEvalCastScalar(TYPEK typekSrc, const void * pVSrc, TYPEK typekDst, void * pVRet);
+
+bool FTryAndValue(SValue val0, SValue val1, SValue * pValRet)
+{
+	void * pV0 = val0.pV;
+	void * pV1 = val1.pV;
+	void * pVRet = pValRet->pV;
+	TYPEK typek = val0.tid.pType->typek;
+	switch (typek)
+	{
+	case TYPEK_S8: *static_cast<s8 *>(pVRet) = *static_cast<s8 *>(pV0) & *static_cast<s8 *>(pV1); return true;
+	case TYPEK_S16: *static_cast<s16 *>(pVRet) = *static_cast<s16 *>(pV0) & *static_cast<s16 *>(pV1); return true;
+	case TYPEK_S32: *static_cast<s32 *>(pVRet) = *static_cast<s32 *>(pV0) & *static_cast<s32 *>(pV1); return true;
+	case TYPEK_S64: *static_cast<s64 *>(pVRet) = *static_cast<s64 *>(pV0) & *static_cast<s64 *>(pV1); return true;
+	case TYPEK_U8: *static_cast<u8 *>(pVRet) = *static_cast<u8 *>(pV0) & *static_cast<u8 *>(pV1); return true;
+	case TYPEK_U16: *static_cast<u16 *>(pVRet) = *static_cast<u16 *>(pV0) & *static_cast<u16 *>(pV1); return true;
+	case TYPEK_U32: *static_cast<u32 *>(pVRet) = *static_cast<u32 *>(pV0) & *static_cast<u32 *>(pV1); return true;
+	case TYPEK_U64: *static_cast<u64 *>(pVRet) = *static_cast<u64 *>(pV0) & *static_cast<u64 *>(pV1); return true;
+	default: ASSERTCHZ(false, "Can't do operator & with type %s", StrPrintType(val0.tid).Pchz()); return false;
+	}
+}
+
+bool FTryOrValue(SValue val0, SValue val1, SValue * pValRet)
+{
+	void * pV0 = val0.pV;
+	void * pV1 = val1.pV;
+	void * pVRet = pValRet->pV;
+	TYPEK typek = val0.tid.pType->typek;
+	switch (typek)
+	{
+	case TYPEK_S8: *static_cast<s8 *>(pVRet) = *static_cast<s8 *>(pV0) | *static_cast<s8 *>(pV1); return true;
+	case TYPEK_S16: *static_cast<s16 *>(pVRet) = *static_cast<s16 *>(pV0) | *static_cast<s16 *>(pV1); return true;
+	case TYPEK_S32: *static_cast<s32 *>(pVRet) = *static_cast<s32 *>(pV0) | *static_cast<s32 *>(pV1); return true;
+	case TYPEK_S64: *static_cast<s64 *>(pVRet) = *static_cast<s64 *>(pV0) | *static_cast<s64 *>(pV1); return true;
+	case TYPEK_U8: *static_cast<u8 *>(pVRet) = *static_cast<u8 *>(pV0) | *static_cast<u8 *>(pV1); return true;
+	case TYPEK_U16: *static_cast<u16 *>(pVRet) = *static_cast<u16 *>(pV0) | *static_cast<u16 *>(pV1); return true;
+	case TYPEK_U32: *static_cast<u32 *>(pVRet) = *static_cast<u32 *>(pV0) | *static_cast<u32 *>(pV1); return true;
+	case TYPEK_U64: *static_cast<u64 *>(pVRet) = *static_cast<u64 *>(pV0) | *static_cast<u64 *>(pV1); return true;
+	default: ASSERTCHZ(false, "Can't do operator | with type %s", StrPrintType(val0.tid).Pchz()); return false;
+	}
+}
+
+bool FTryXorValue(SValue val0, SValue val1, SValue * pValRet)
+{
+	void * pV0 = val0.pV;
+	void * pV1 = val1.pV;
+	void * pVRet = pValRet->pV;
+	TYPEK typek = val0.tid.pType->typek;
+	switch (typek)
+	{
+	case TYPEK_S8: *static_cast<s8 *>(pVRet) = *static_cast<s8 *>(pV0) ^ *static_cast<s8 *>(pV1); return true;
+	case TYPEK_S16: *static_cast<s16 *>(pVRet) = *static_cast<s16 *>(pV0) ^ *static_cast<s16 *>(pV1); return true;
+	case TYPEK_S32: *static_cast<s32 *>(pVRet) = *static_cast<s32 *>(pV0) ^ *static_cast<s32 *>(pV1); return true;
+	case TYPEK_S64: *static_cast<s64 *>(pVRet) = *static_cast<s64 *>(pV0) ^ *static_cast<s64 *>(pV1); return true;
+	case TYPEK_U8: *static_cast<u8 *>(pVRet) = *static_cast<u8 *>(pV0) ^ *static_cast<u8 *>(pV1); return true;
+	case TYPEK_U16: *static_cast<u16 *>(pVRet) = *static_cast<u16 *>(pV0) ^ *static_cast<u16 *>(pV1); return true;
+	case TYPEK_U32: *static_cast<u32 *>(pVRet) = *static_cast<u32 *>(pV0) ^ *static_cast<u32 *>(pV1); return true;
+	case TYPEK_U64: *static_cast<u64 *>(pVRet) = *static_cast<u64 *>(pV0) ^ *static_cast<u64 *>(pV1); return true;
+	default: ASSERTCHZ(false, "Can't do operator ^ with type %s", StrPrintType(val0.tid).Pchz()); return false;
+	}
+}
+
+bool FTryShlValue(SValue val0, SValue val1, SValue * pValRet)
+{
+	void * pV0 = val0.pV;
+	void * pV1 = val1.pV;
+	void * pVRet = pValRet->pV;
+	TYPEK typek = val0.tid.pType->typek;
+
+	// Shifting by the bit count or more is undefined, report it rather than picking a value
+
+	s64 nShift;
+	if (!FIsInt(typek) || !FTryEvalCastScalar(typek, pV1, TYPEK_S64, &nShift) || nShift < 0 || nShift >= CBit(typek))
+		return false;
+
+	switch (typek)
+	{
+	case TYPEK_S8: *static_cast<s8 *>(pVRet) = s8(u8(*static_cast<s8 *>(pV0)) << nShift); return true;
+	case TYPEK_S16: *static_cast<s16 *>(pVRet) = s16(u16(*static_cast<s16 *>(pV0)) << nShift); return true;
+	case TYPEK_S32: *static_cast<s32 *>(pVRet) = s32(u32(*static_cast<s32 *>(pV0)) << nShift); return true;
+	case TYPEK_S64: *static_cast<s64 *>(pVRet) = s64(u64(*static_cast<s64 *>(pV0)) << nShift); return true;
+	case TYPEK_U8: *static_cast<u8 *>(pVRet) = *static_cast<u8 *>(pV0) << nShift; return true;
+	case TYPEK_U16: *static_cast<u16 *>(pVRet) = *static_cast<u16 *>(pV0) << nShift; return true;
+	case TYPEK_U32: *static_cast<u32 *>(pVRet) = *static_cast<u32 *>(pV0) << nShift; return true;
+	case TYPEK_U64: *static_cast<u64 *>(pVRet) = *static_cast<u64 *>(pV0) << nShift; return true;
+	default: ASSERTCHZ(false, "Can't do operator << with type %s", StrPrintType(val0.tid).Pchz()); return false;
+	}
+}
+
+bool FTryShrValue(SValue val0, SValue val1, SValue * pValRet)
+{
+	void * pV0 = val0.pV;
+	void * pV1 = val1.pV;
+	void * pVRet = pValRet->pV;
+	TYPEK typek = val0.tid.pType->typek;
+
+	// Shifting by the bit count or more is undefined, report it rather than picking a value
+
+	s64 nShift;
+	if (!FIsInt(typek) || !FTryEvalCastScalar(typek, pV1, TYPEK_S64, &nShift) || nShift < 0 || nShift >= CBit(typek))
+		return false;
+
+	switch (typek)
+	{
+	case TYPEK_S8: *static_cast<s8 *>(pVRet) = *static_cast<s8 *>(pV0) >> nShift; return true;
+	case TYPEK_S16: *static_cast<s16 *>(pVRet) = *static_cast<s16 *>(pV0) >> nShift; return true;
+	case TYPEK_S32: *static_cast<s32 *>(pVRet) = *static_cast<s32 *>(pV0) >> nShift; return true;
+	case TYPEK_S64: *static_cast<s64 *>(pVRet) = *static_cast<s64 *>(pV0) >> nShift; return true;
+	case TYPEK_U8: *static_cast<u8 *>(pVRet) = *static_cast<u8 *>(pV0) >> nShift; return true;
+	case TYPEK_U16: *static_cast<u16 *>(pVRet) = *static_cast<u16 *>(pV0) >> nShift; return true;
+	case TYPEK_U32: *static_cast<u32 *>(pVRet) = *static_cast<u32 *>(pV0) >> nShift; return true;
+	case TYPEK_U64: *static_cast<u64 *>(pVRet) = *static_cast<u64 *>(pV0) >> nShift; return true;
+	default: ASSERTCHZ(false, "Can't do operator >> with type %s", StrPrintType(val0.tid).Pchz()); return false;
+	}
+}
+
 bool FTryCmpEqValue(SValue val0, SValue val1, SValue * pValRet)
 {
 	void * pV0 = val0.pV;
@@ -8907,21 +11271,29 @@ bool FTryCmpGeqValue(SValue val0, SValue val1, SValue * pValRet)
 static const SEvalConstBinaryOperator s_aEcbop[] =
 {
 	// BB (adrianb) Unordered (either arg NaN) vs Ordered. Which to choose?
-	{ "<", FTryCmpLTValue },
-	{ ">", FTryCmpGTValue },
-	{ "<=", FTryCmpLeqValue },
-	{ ">=", FTryCmpGeqValue },
-
-	{ "==", FTryCmpEqValue },
-	{ "!=", FTryCmpNeqValue },
-
-	{ "+", FTryAddValue },
-	{ "-", FTrySubValue },
-	{ "*", FTryMulValue },
-	{ "/", FTryDivValue },
-	{ "%", FTryRemValue },
+	{ OP_Less, FTryCmpLTValue, true },
+	{ OP_Greater, FTryCmpGTValue, true },
+	{ OP_LessEqual, FTryCmpLeqValue, true },
+	{ OP_GreaterEqual, FTryCmpGeqValue, true },
+
+	{ OP_Equal, FTryCmpEqValue, true },
+	{ OP_NotEqual, FTryCmpNeqValue, true },
+
+	{ OP_Add, FTryAddValue },
+	{ OP_Sub, FTrySubValue },
+	{ OP_Mul, FTryMulValue },
+	{ OP_Div, FTryDivValue },
+	{ OP_Rem, FTryRemValue },
+
+	{ OP_BitAnd, FTryAndValue },
+	{ OP_BitOr, FTryOrValue },
+	{ OP_BitXor, FTryXorValue },
+	{ OP_ShiftLeft, FTryShlValue },
+	{ OP_ShiftRight, FTryShrValue },
 };
 
+static const SOperatorTable<SEvalConstBinaryOperator> s_optableEcbop(s_aEcbop);
+
 void EvalCode(SEvalCtx * pEval, SAst * pAst, void * pVRet);
 
 bool FTryEvalBinaryOperator(SEvalCtx * pEval, const SEvalConstBinaryOperator & ecbop, SAst * pAstLeft, SAst * pAstRight,
@@ -8933,15 +11305,48 @@ bool FTryEvalBinaryOperator(SEvalCtx * pEval, const SEvalConstBinaryOperator & e
 	EvalCode(pEval, pAstLeft, static_cast<u8 *>(pVLeft));
 	EvalCode(pEval, pAstRight, static_cast<u8 *>(pVRight));
 
+	if (FIsVector(pAstLeft->tid))
+	{
+		// Elementwise, both sides are the same vector type after coercion
+
+		auto pTypevec = PtypeCast<STypeVector>(pAstLeft->tid.pType);
+		STypeId tidElement = pTypevec->tidElement;
+		STypeId tidElementDst = PtypeCast<STypeVector>(tidDst.pType)->tidElement;
+		u32 cBElement = CbSizeOf(tidElement);
+		u32 cBElementDst = CbSizeOf(tidElementDst);
+
+		for (int iElement : IterCount(pTypevec->cElement))
+		{
+			SValue valLeft = { tidElement, static_cast<u8 *>(pVLeft) + iElement * cBElement };
+			SValue valRight = { tidElement, static_cast<u8 *>(pVRight) + iElement * cBElement };
+			u8 * pBDst = static_cast<u8 *>(pVDst) + iElement * cBElementDst;
+
+			if (ecbop.fCompare)
+			{
+				bool f;
+				SValue valRet = { pEval->pWork->tidBool, &f };
+				if (!ecbop.pfnecb(valLeft, valRight, &valRet))
+					return false;
+
+				memset(pBDst, (f) ? 0xff : 0, cBElementDst);
+			}
+			else
+			{
+				SValue valRet = { tidElementDst, pBDst };
+				if (!ecbop.pfnecb(valLeft, valRight, &valRet))
+					return false;
+			}
+		}
+
+		return true;
+	}
+
 	SValue valRet = { tidDst, pVDst };
 	return ecbop.pfnecb({pAstLeft->tid, pVLeft}, {pAstRight->tid, pVRight}, &valRet);
 }
 
 void EvalConst(SWorkspace * pWork, SAst * pAst, void * pVRet)
 {
-	// BB (adrianb) We should cache the result so we don't have to recompute the same constant again?
-	//  And register single identifiers with the declaring AST instead.
-
 	SEvalCtx eval = {};
 	Init(&eval, pWork);
 	defer { Destroy(&eval); };
@@ -8949,39 +11354,102 @@ void EvalConst(SWorkspace * pWork, SAst * pAst, void * pVRet)
 	EvalCode(&eval, pAst, pVRet);
 }
 
-void EvalDefaultValue(SWorkspace * pWork, STypeId tid, u8 * pBRet)
+const void * PvEvalConstDecl(SWorkspace * pWork, SAstDeclareSingle * pAstdecl)
 {
-	TYPEK typek = tid.pType->typek;
+	// Initializers are only ever constant expressions, so evaluate once per declaration and hand out the bytes.
+	//  Memory is malloced since large arrays don't fit in a page.
 
-	switch (typek)
+	std::lock_guard<std::recursive_mutex> lock(*pWork->pMutex);
+
+	auto hv = HvFromKey(reinterpret_cast<u64>(pAstdecl));
+	void ** ppV = PtLookupImpl(&pWork->hashPastdeclPvConst, hv, pAstdecl);
+	if (ppV)
 	{
-	case TYPEK_Bool:
-	case TYPEK_S8:
-	case TYPEK_S16:
-	case TYPEK_S32:
-	case TYPEK_S64:
-	case TYPEK_U8:
-	case TYPEK_U16:
+		pWork->cEvalConstHit++;
+		return *ppV;
+	}
+
+	pWork->cEvalConstMiss++;
+
+	auto pAstValue = pAstdecl->pAstValue;
+	ASSERT(pAstValue);
+
+	void * pV = calloc(1, max(CbSizeOf(pAstValue->tid), 1u));
+	EvalConst(pWork, pAstValue, pV);
+
+	// NOTE (adrianb) Evaluation can add to the hash, so don't hold onto anything inside it across EvalConst.
+
+	Add(&pWork->hashPastdeclPvConst, hv, pAstdecl, pV);
+	return pV;
+}
+
+void EvalConstDecl(SWorkspace * pWork, SAstDeclareSingle * pAstdecl, void * pVRet)
+{
+	memcpy(pVRet, PvEvalConstDecl(pWork, pAstdecl), CbSizeOf(pAstdecl->pAstValue->tid));
+}
+
+void EvalDefaultValue(SWorkspace * pWork, STypeId tid, u8 * pBRet)
+{
+	TYPEK typek = tid.pType->typek;
+
+	switch (typek)
+	{
+	case TYPEK_Bool:
+	case TYPEK_S8:
+	case TYPEK_S16:
+	case TYPEK_S32:
+	case TYPEK_S64:
+	case TYPEK_U8:
+	case TYPEK_U16:
 	case TYPEK_U32:
 	case TYPEK_U64:
 	case TYPEK_Float:
 	case TYPEK_Double:
 	case TYPEK_String:
 	case TYPEK_Pointer:
+	case TYPEK_Vector:
 		memset(pBRet, 0, CbSizeOf(tid));
 		break;
 		
 	case TYPEK_Array:
 		{
 			auto pTypearray = PtypeCast<STypeArray>(tid.pType);
-			ASSERT(!pTypearray->fSoa);
-			if (pTypearray->cSizeFixed >= 0)
+			if (pTypearray->fSoa && pTypearray->cSizeFixed > 0)
 			{
-				int cBMember = CbSizeOf(pTypearray->tidElement);
-				for (int i : IterCount(pTypearray->cSizeFixed))
+				// Scatter one default element into the first slot of each column, then replicate down the columns 
+				//  and across the chunks
+
+				memset(pBRet, 0, CbSizeOf(tid));
+
+				size_t cBElement = CbSizeOf(pTypearray->tidElement);
+				auto pBElement = static_cast<u8 *>(malloc(max(cBElement, size_t(1))));
+				defer { free(pBElement); };
+				EvalDefaultValue(pWork, pTypearray->tidElement, pBElement);
+
+				auto pTypestruct = PtypestructSoa(pTypearray);
+				s64 cSoaChunk = CSoaChunk(pTypearray);
+				for (int iMember : IterCount(pTypestruct->cMember))
 				{
-					EvalDefaultValue(pWork, pTypearray->tidElement, pBRet + i * cBMember);
+					auto pMember = &pTypestruct->aMember[iMember];
+					size_t cBMember = CbSizeOf(pMember->pAstdecl->tid);
+					u8 * pBColumn = pBRet + IBSoaColumn(pTypearray, iMember);
+					memcpy(pBColumn, pBElement + pMember->iBOffset, cBMember);
+					FillRepeated(pBColumn, cBMember, cBMember * cSoaChunk);
 				}
+
+				size_t cBChunk = IBSoaColumn(pTypearray, pTypestruct->cMember);
+				FillRepeated(pBRet, cBChunk, cBChunk * CChunkSoa(pTypearray));
+			}
+			else if (pTypearray->cSizeFixed >= 0 && !pTypearray->fSoa)
+			{
+				// Every element has the same default, so evaluate the first one and replicate it by doubling copies
+
+				if (pTypearray->cSizeFixed == 0)
+					break;
+
+				size_t cBElement = CbSizeOf(pTypearray->tidElement);
+				EvalDefaultValue(pWork, pTypearray->tidElement, pBRet);
+				FillRepeated(pBRet, cBElement, cBElement * pTypearray->cSizeFixed);
 			}
 			else
 			{
@@ -9000,7 +11468,7 @@ void EvalDefaultValue(SWorkspace * pWork, STypeId tid, u8 * pBRet)
 			{
 				auto pMember = &pTypestruct->aMember[iMember];
 				if (pMember->pAstdecl->pAstValue)
-					EvalConst(pWork, pMember->pAstdecl->pAstValue, pBRet + pMember->iBOffset);
+					EvalConstDecl(pWork, pMember->pAstdecl, pBRet + pMember->iBOffset);
 				else
 					EvalDefaultValue(pWork, pMember->pAstdecl->tid, pBRet + pMember->iBOffset);
 			}
@@ -9016,6 +11484,7 @@ void EvalDefaultValue(SWorkspace * pWork, STypeId tid, u8 * pBRet)
 	case TYPEK_Any:
 	case TYPEK_TypeOf:
 	case TYPEK_Vararg:
+	case TYPEK_Nil:
 	case TYPEK_Max:
 	// default:
 		ASSERTCHZ(false, "Can't set default value for %s(%d)", PchzFromTypek(typek), typek);
@@ -9024,6 +11493,91 @@ void EvalDefaultValue(SWorkspace * pWork, STypeId tid, u8 * pBRet)
 	}
 }
 
+void EvalNegate(TYPEK typek, const void * pV, void * pVRet)
+{
+	switch (typek)
+	{
+	case TYPEK_S8: *static_cast<s8 *>(pVRet) = - *static_cast<const s8 *>(pV); return;
+	case TYPEK_S16: *static_cast<s16 *>(pVRet) = - *static_cast<const s16 *>(pV); return;
+	case TYPEK_S32: *static_cast<s32 *>(pVRet) = - *static_cast<const s32 *>(pV); return;
+	case TYPEK_S64: *static_cast<s64 *>(pVRet) = - *static_cast<const s64 *>(pV); return;
+	case TYPEK_U8: *static_cast<u8 *>(pVRet) = - *static_cast<const u8 *>(pV); return;
+	case TYPEK_U16: *static_cast<u16 *>(pVRet) = - *static_cast<const u16 *>(pV); return;
+	case TYPEK_U32: *static_cast<u32 *>(pVRet) = - *static_cast<const u32 *>(pV); return;
+	case TYPEK_U64: *static_cast<u64 *>(pVRet) = - *static_cast<const u64 *>(pV); return;
+	case TYPEK_Float: *static_cast<float *>(pVRet) = - *static_cast<const float *>(pV); return;
+	case TYPEK_Double: *static_cast<double *>(pVRet) = - *static_cast<const double *>(pV); return;
+	default: ASSERT(false); return;
+	}
+}
+
+bool FTryEvalCastScalar(TYPEK typekSrc, const void * pVSrc, TYPEK typekDst, void * pVRet)
+{
+	if (FIsInt(typekSrc))
+	{
+		s64 n;
+		switch (typekSrc)
+		{
+		case TYPEK_S8: n = *static_cast<const s8 *>(pVSrc); break;
+		case TYPEK_S16: n = *static_cast<const s16 *>(pVSrc); break;
+		case TYPEK_S32: n = *static_cast<const s32 *>(pVSrc); break;
+		case TYPEK_S64: n = *static_cast<const s64 *>(pVSrc); break;
+		case TYPEK_U8: n = *static_cast<const u8 *>(pVSrc); break;
+		case TYPEK_U16: n = *static_cast<const u16 *>(pVSrc); break;
+		case TYPEK_U32: n = *static_cast<const u32 *>(pVSrc); break;
+		case TYPEK_U64: n = *static_cast<const u64 *>(pVSrc); break;
+		default: ASSERT(false); n = 0; break;
+		}
+
+		switch (typekDst)
+		{
+		case TYPEK_S8: *static_cast<s8 *>(pVRet) = n; return true;
+		case TYPEK_S16: *static_cast<s16 *>(pVRet) = n; return true;
+		case TYPEK_S32: *static_cast<s32 *>(pVRet) = n; return true;
+		case TYPEK_S64: *static_cast<s64 *>(pVRet) = n; return true;
+		case TYPEK_U8: *static_cast<u8 *>(pVRet) = n; return true;
+		case TYPEK_U16: *static_cast<u16 *>(pVRet) = n; return true;
+		case TYPEK_U32: *static_cast<u32 *>(pVRet) = n; return true;
+		case TYPEK_U64: *static_cast<u64 *>(pVRet) = n; return true;
+		case TYPEK_Float: *static_cast<float *>(pVRet) = n; return true;
+		case TYPEK_Double: *static_cast<double *>(pVRet) = n; return true;
+		default: ASSERT(false); return true;
+		}
+	}
+	else if (FIsFloat(typekSrc))
+	{
+		double g;
+		switch (typekSrc)
+		{
+		case TYPEK_Float: g = *static_cast<const float *>(pVSrc); break;
+		case TYPEK_Double: g = *static_cast<const double *>(pVSrc); break;
+		default: ASSERT(false); g = 0; break;
+		}
+
+		switch (typekDst)
+		{
+		case TYPEK_S8: *static_cast<s8 *>(pVRet) = g; return true;
+		case TYPEK_S16: *static_cast<s16 *>(pVRet) = g; return true;
+		case TYPEK_S32: *static_cast<s32 *>(pVRet) = g; return true;
+		case TYPEK_S64: *static_cast<s64 *>(pVRet) = g; return true;
+		case TYPEK_U8: *static_cast<u8 *>(pVRet) = g; return true;
+		case TYPEK_U16: *static_cast<u16 *>(pVRet) = g; return true;
+		case TYPEK_U32: *static_cast<u32 *>(pVRet) = g; return true;
+		case TYPEK_U64: *static_cast<u64 *>(pVRet) = g; return true;
+		case TYPEK_Float: *static_cast<float *>(pVRet) = g; return true;
+		case TYPEK_Double: *static_cast<double *>(pVRet) = g; return true;
+		default: ASSERT(false); return true;
+		}
+	}
+	else if (typekSrc == TYPEK_Pointer && typekDst == TYPEK_Pointer)
+	{
+		*static_cast<void **>(pVRet) = *static_cast<void * const *>(pVSrc);
+		return true;
+	}
+
+	return false;
+}
+
 void EvalCode(SEvalCtx * pEval, SAst * pAst, void * pVRet)
 {
 	SWorkspace * pWork = pEval->pWork;
@@ -9087,7 +11641,7 @@ void EvalCode(SEvalCtx * pEval, SAst * pAst, void * pVRet)
 
 	case ASTK_Null:
 		{
-			ASSERT(pAst->tid.pType->typek == TYPEK_Pointer);
+			ASSERT(FIsPointerOrProcedure(pAst->tid.pType->typek));
 			*static_cast<void **>(pVRet) = nullptr;
 			return;
 		}
@@ -9102,9 +11656,7 @@ void EvalCode(SEvalCtx * pEval, SAst * pAst, void * pVRet)
 			auto pAstdecl = pResdecl->pDecl->pAstdecl;
 			if (pAstdecl->fIsConstant)
 			{
-				// BB (adrianb) Does it make sense to evaluate a new constant here?
-
-				EvalCode(pEval, pAstdecl->pAstValue, pVRet);
+				EvalConstDecl(pWork, pAstdecl, pVRet);
 				return;
 			}
 
@@ -9117,12 +11669,13 @@ void EvalCode(SEvalCtx * pEval, SAst * pAst, void * pVRet)
 			}
 
 			memcpy(pVRet, static_cast<const void *>(*ppV), CbSizeOf(pAstdecl->tid));
+			return;
 		}
 
 	case ASTK_Operator:
 		{
 			auto pAstop = PastCast<SAstOperator>(pAst);
-			auto pChzOp = pAstop->pChzOp;
+			auto op = pAstop->op;
 
 			// BB (adrianb) Table drive these or it will get insane!
 
@@ -9131,27 +11684,27 @@ void EvalCode(SEvalCtx * pEval, SAst * pAst, void * pVRet)
 				auto pAstRight = pAstop->pAstRight;
 				auto tidRight = pAstRight->tid;
 
-				if (strcmp(pChzOp, "-") == 0)
+				if (op == OP_Sub)
 				{
 					void * pVRight = alloca(CbSizeOf(tidRight));
 					EvalCode(pEval, pAstRight, pVRight);
 
-					switch (pAst->tid.pType->typek)
+					if (FIsVector(tidRight))
 					{
-					case TYPEK_S8: *static_cast<s8 *>(pVRet) = - *static_cast<s8 *>(pVRight); return;
-					case TYPEK_S16: *static_cast<s16 *>(pVRet) = - *static_cast<s16 *>(pVRight); return;
-					case TYPEK_S32: *static_cast<s32 *>(pVRet) = - *static_cast<s32 *>(pVRight); return;
-					case TYPEK_S64: *static_cast<s64 *>(pVRet) = - *static_cast<s64 *>(pVRight); return;
-					case TYPEK_U8: *static_cast<u8 *>(pVRet) = - *static_cast<u8 *>(pVRight); return;
-					case TYPEK_U16: *static_cast<u16 *>(pVRet) = - *static_cast<u16 *>(pVRight); return;
-					case TYPEK_U32: *static_cast<u32 *>(pVRet) = - *static_cast<u32 *>(pVRight); return;
-					case TYPEK_U64: *static_cast<u64 *>(pVRet) = - *static_cast<u64 *>(pVRight); return;
-					case TYPEK_Float: *static_cast<float *>(pVRet) = - *static_cast<float *>(pVRight); return;
-					case TYPEK_Double: *static_cast<double *>(pVRet) = - *static_cast<double *>(pVRight); return;
-					default: ASSERT(false); return;
+						auto pTypevec = PtypeCast<STypeVector>(tidRight.pType);
+						u32 cBElement = CbSizeOf(pTypevec->tidElement);
+						for (int iElement : IterCount(pTypevec->cElement))
+						{
+							EvalNegate(pTypevec->tidElement.pType->typek, static_cast<u8 *>(pVRight) + iElement * cBElement, 
+									   static_cast<u8 *>(pVRet) + iElement * cBElement);
+						}
+						return;
 					}
+
+					EvalNegate(pAst->tid.pType->typek, pVRight, pVRet);
+					return;
 				}
-				else if (strcmp(pChzOp, "!") == 0)
+				else if (op == OP_Not)
 				{
 					void * pVRight = alloca(CbSizeOf(tidRight));
 					EvalCode(pEval, pAstRight, pVRight);
@@ -9159,9 +11712,23 @@ void EvalCode(SEvalCtx * pEval, SAst * pAst, void * pVRet)
 					ASSERT(pAst->tid.pType->typek == TYPEK_Bool);
 					*static_cast<bool *>(pVRet) = ! *static_cast<bool *>(pVRight); return;
 				}
+				else if (op == OP_BitNot)
+				{
+					// Flipping every byte flips every bit of each integer, vector or not
+
+					u32 cB = CbSizeOf(tidRight);
+					u8 * pBRight = static_cast<u8 *>(alloca(cB));
+					EvalCode(pEval, pAstRight, pBRight);
+
+					for (u32 iB : IterCount(cB))
+					{
+						static_cast<u8 *>(pVRet)[iB] = u8(~pBRight[iB]);
+					}
+					return;
+				}
 				
 				ShowErr(pAstop->errinfo, "Unary operator %s constant with type %s NYI", 
-						pChzOp, StrPrintType(tidRight).Pchz());
+						PchzFromOp(op), StrPrintType(tidRight).Pchz());
 				return;
 			}
 			else
@@ -9169,20 +11736,17 @@ void EvalCode(SEvalCtx * pEval, SAst * pAst, void * pVRet)
 				auto pAstLeft = pAstop->pAstLeft;
 				auto pAstRight = pAstop->pAstRight;
 
-				for (const auto & ecbop : s_aEcbop)
+				if (const SEvalConstBinaryOperator * pEcbop = s_optableEcbop.PtLookup(op))
 				{
-					if (strcmp(ecbop.pChzOp, pChzOp) == 0)
+					if (!FTryEvalBinaryOperator(pEval, *pEcbop, pAstLeft, pAstRight, pAst->tid, pVRet))
 					{
-						if (!FTryEvalBinaryOperator(pEval, ecbop, pAstLeft, pAstRight, pAst->tid, pVRet))
-						{
-							ShowErr(pAstop->errinfo, "Don't know how to perform constant operator for types %s and %s",
-									StrPrintType(pAstLeft->tid).Pchz(), StrPrintType(pAstRight->tid).Pchz());
-						}
-						return;
+						ShowErr(pAstop->errinfo, "Don't know how to perform constant operator for types %s and %s",
+								StrPrintType(pAstLeft->tid).Pchz(), StrPrintType(pAstRight->tid).Pchz());
 					}
+					return;
 				}
 
-				if (strcmp(pChzOp, "and") == 0)
+				if (op == OP_And)
 				{
 					void * pVLeft = alloca(CbSizeOf(pAstLeft->tid));
 					EvalCode(pEval, pAstLeft, pVLeft);
@@ -9195,7 +11759,7 @@ void EvalCode(SEvalCtx * pEval, SAst * pAst, void * pVRet)
 					EvalCode(pEval, pAstRight, pVRet);
 					return;
 				}
-				else if (strcmp(pChzOp, "or") == 0)
+				else if (op == OP_Or)
 				{
 					void * pVLeft = alloca(CbSizeOf(pAstLeft->tid));
 					EvalCode(pEval, pAstLeft, pVLeft);
@@ -9209,7 +11773,24 @@ void EvalCode(SEvalCtx * pEval, SAst * pAst, void * pVRet)
 					return;
 				}
 
-				if (strcmp(pChzOp, ".") == 0)
+				if (op == OP_Dot && FIsVector(pAstLeft->tid))
+				{
+					auto pTypevec = PtypeCast<STypeVector>(pAstLeft->tid.pType);
+					void * pVLeft = alloca(CbSizeOf(pAstLeft->tid));
+					EvalCode(pEval, pAstLeft, pVLeft);
+
+					int aiElement[4];
+					int cElement = CElementSwizzle(PastCast<SAstIdentifier>(pAstRight)->pChz, pTypevec->cElement, aiElement);
+					u32 cBElement = CbSizeOf(pTypevec->tidElement);
+					for (int iElement : IterCount(cElement))
+					{
+						memcpy(static_cast<u8 *>(pVRet) + iElement * cBElement, 
+								static_cast<u8 *>(pVLeft) + aiElement[iElement] * cBElement, cBElement);
+					}
+					return;
+				}
+
+				if (op == OP_Dot)
 				{
 					// BB (adrianb) Support using for this case?
 					STypeId tidStruct = pAstLeft->tid;
@@ -9224,14 +11805,14 @@ void EvalCode(SEvalCtx * pEval, SAst * pAst, void * pVRet)
 							auto pResdecl = PresdeclResolved(pWork, pAstident);
 							ASSERT(pResdecl);
 
-							EvalCode(pEval, pResdecl->pDecl->pAstdecl->pAstValue, pVRet);
+							EvalConstDecl(pWork, pResdecl->pDecl->pAstdecl, pVRet);
 							return;
 						}
 					}
 				}
 
 				ShowErr(pAstop->errinfo, "Operator %s constant eval with types %s and %s NYI", 
-						pChzOp, StrPrintType(pAstLeft->tid.pType).Pchz(), StrPrintType(pAstRight->tid.pType).Pchz());
+						PchzFromOp(op), StrPrintType(pAstLeft->tid.pType).Pchz(), StrPrintType(pAstRight->tid.pType).Pchz());
 				return;
 			}
 		}
@@ -9256,72 +11837,29 @@ void EvalCode(SEvalCtx * pEval, SAst * pAst, void * pVRet)
 			TYPEK typekSrc = tidSrc.pType->typek;
 			TYPEK typekDst = tidDst.pType->typek;
 
-			if (FIsInt(typekSrc))
-			{
-				s64 n;
-				switch (typekSrc)
-				{
-				case TYPEK_S8: n = *static_cast<s8 *>(pVExpr); break;
-				case TYPEK_S16: n = *static_cast<s16 *>(pVExpr); break;
-				case TYPEK_S32: n = *static_cast<s32 *>(pVExpr); break;
-				case TYPEK_S64: n = *static_cast<s64 *>(pVExpr); break;
-				case TYPEK_U8: n = *static_cast<u8 *>(pVExpr); break;
-				case TYPEK_U16: n = *static_cast<u16 *>(pVExpr); break;
-				case TYPEK_U32: n = *static_cast<u32 *>(pVExpr); break;
-				case TYPEK_U64: n = *static_cast<u64 *>(pVExpr); break;
-				default: ASSERT(false); n = 0; break;
-				}
-
-				switch (typekDst)
-				{
-				case TYPEK_S8: *static_cast<s8 *>(pVRet) = n; return;
-				case TYPEK_S16: *static_cast<s16 *>(pVRet) = n; return;
-				case TYPEK_S32: *static_cast<s32 *>(pVRet) = n; return;
-				case TYPEK_S64: *static_cast<s64 *>(pVRet) = n; return;
-				case TYPEK_U8: *static_cast<u8 *>(pVRet) = n; return;
-				case TYPEK_U16: *static_cast<u16 *>(pVRet) = n; return;
-				case TYPEK_U32: *static_cast<u32 *>(pVRet) = n; return;
-				case TYPEK_U64: *static_cast<u64 *>(pVRet) = n; return;
-				case TYPEK_Float: *static_cast<float *>(pVRet) = n; return;
-				case TYPEK_Double: *static_cast<double *>(pVRet) = n; return;
-				default: ASSERT(false); return;
-				}
-			}
-			else if (FIsFloat(typekSrc))
+			if (typekDst == TYPEK_Vector)
 			{
-				double g;
-				switch (typekSrc)
-				{
-				case TYPEK_Float: g = *static_cast<float *>(pVExpr); break;
-				case TYPEK_Double: g = *static_cast<double *>(pVExpr); break;
-				default: ASSERT(false); g = 0; break;
-				}
+				// Scalars (already the element type) splat, vectors convert elementwise
 
-				switch (typekDst)
-				{
-				case TYPEK_S8: *static_cast<s8 *>(pVRet) = g; return;
-				case TYPEK_S16: *static_cast<s16 *>(pVRet) = g; return;
-				case TYPEK_S32: *static_cast<s32 *>(pVRet) = g; return;
-				case TYPEK_S64: *static_cast<s64 *>(pVRet) = g; return;
-				case TYPEK_U8: *static_cast<u8 *>(pVRet) = g; return;
-				case TYPEK_U16: *static_cast<u16 *>(pVRet) = g; return;
-				case TYPEK_U32: *static_cast<u32 *>(pVRet) = g; return;
-				case TYPEK_U64: *static_cast<u64 *>(pVRet) = g; return;
-				case TYPEK_Float: *static_cast<float *>(pVRet) = g; return;
-				case TYPEK_Double: *static_cast<double *>(pVRet) = g; return;
-				default: ASSERT(false); return;
-				}
-			}
-			else if (typekSrc == TYPEK_Pointer)
-			{
-				void * pV = *static_cast<void **>(pVExpr);
-				if (typekDst == TYPEK_Pointer)
+				auto pTypevecDst = PtypeCast<STypeVector>(tidDst.pType);
+				STypeId tidElementSrc = (typekSrc == TYPEK_Vector) ? 
+											PtypeCast<STypeVector>(tidSrc.pType)->tidElement : 
+											tidSrc;
+				u32 cBElementSrc = (typekSrc == TYPEK_Vector) ? CbSizeOf(tidElementSrc) : 0;
+				u32 cBElementDst = CbSizeOf(pTypevecDst->tidElement);
+
+				for (int iElement : IterCount(pTypevecDst->cElement))
 				{
-					*static_cast<void **>(pVRet) = pV;
-					return;
+					(void) FTryEvalCastScalar(tidElementSrc.pType->typek, static_cast<u8 *>(pVExpr) + iElement * cBElementSrc,
+												pTypevecDst->tidElement.pType->typek, 
+												static_cast<u8 *>(pVRet) + iElement * cBElementDst);
 				}
+				return;
 			}
 
+			if (FTryEvalCastScalar(typekSrc, pVExpr, typekDst, pVRet))
+				return;
+
 			ShowErr(pAst->errinfo, "Cannot cast between %s and %s", StrPrintType(tidSrc.pType).Pchz(), 
 					StrPrintType(tidDst.pType).Pchz());
 			return;
@@ -9337,1676 +11875,4791 @@ void EvalCode(SEvalCtx * pEval, SAst * pAst, void * pVRet)
 	}
 }
 
-struct SGenerateCtx
-{
-	struct SScope
-	{
-		int ipAstDeferMic;
-		LLVMOpaqueBasicBlock * pLblockLoopContinue;	// BB (adrianb) Could add a loop label here to break out arbitrarily
-		LLVMOpaqueBasicBlock * pLblockLoopBreak;
-	};
-
-	SWorkspace * pWork;
-
-	SArray<SAst *> arypAstDefer; // Defer instructions per scope
-	SArray<SScope> aryScope;	// Scopes
-	bool fScopeTerminated;			// Have we returned?
-	bool fInProcedure;			// Are we inside a procedure
-
-	// Code generation Move to SGenerateCtx?
-	
-	LLVMOpaqueBuilder * pLbuilderAlloc;
-	LLVMOpaqueBuilder * pLbuilder;
-	LLVMOpaqueContext * pLctx;
-	LLVMOpaqueModule * pLmod;
-
-	SHash<STypeStruct *, LLVMOpaqueType *> hashPtypestructPltype;
-	//SArray<LLVMOpaqueValue *> arypLvalGlobal;
-
-#if 0
-	SArray<SGlobal> aryGlobal;
-#endif
-	SHash<SAstDeclareSingle *, SStorage> hashPastdeclStorage; // 
-	SHash<SAstProcedure *, LLVMOpaqueValue *> hashPastprocPlval; // Procedures started
-};
-
-void Reset(SGenerateCtx * pGenx)
-{
-	ASSERT(pGenx->arypAstDefer.c == 0);
-	ASSERT(!pGenx->fInProcedure);
-	pGenx->fScopeTerminated = false;
-}
+// Constant folding and dead branch elimination, run on procedure bodies after type checking so code generation
+//  sees literals instead of arithmetic on literals and constants.
 
-#if 0
-void AddReferenced(SGenerateCtx * pGenx, SAst * pAst)
+inline bool FIsFoldableType(STypeId tid)
 {
-	if (pGenx->parypAstReferenced == nullptr)
-		return;
+	if (tid.pType == nullptr)
+		return false;
 
-	ASSERT(pAst->astk == ASTK_Procedure || pAst->astk == ASTK_DeclareSingle);
-	Append(pGenx->parypAstReferenced, pAst);
+	TYPEK typek = tid.pType->typek;
+	return typek == TYPEK_Bool || FIsInt(typek) || FIsFloat(typek);
 }
-#endif
 
-const char * PchzBuild(SWorkspace * pWork)
+SAstLiteral * PastlitFromValue(SWorkspace * pWork, SAst * pAstOrig, const void * pV)
 {
-	for (const auto & module : pWork->aryModule)
+	auto pAstlit = PastCreateManual<SAstLiteral>(pWork, ASTK_Literal, pAstOrig->errinfo);
+	pAstlit->tid = pAstOrig->tid;
+
+	TYPEK typek = pAstOrig->tid.pType->typek;
+	if (typek == TYPEK_Bool)
 	{
-		if (module.fBuiltIn)
-			continue;
-		return module.pChzFile;
+		pAstlit->lit.litk = LITK_Bool;
+		pAstlit->lit.n = *static_cast<const bool *>(pV);
 	}
-
-	ASSERT(false);
-	return "<Unknown>";
-}
-
-void Init(SGenerateCtx * pGenx, SWorkspace * pWork)
-{
-	pGenx->pWork = pWork;
-	pGenx->pLctx = LLVMContextCreate();
-	pGenx->pLbuilder = LLVMCreateBuilderInContext(pGenx->pLctx);
-	pGenx->pLbuilderAlloc = LLVMCreateBuilderInContext(pGenx->pLctx);
-	pGenx->pLmod = LLVMModuleCreateWithNameInContext(PchzBuild(pWork), pGenx->pLctx);
-
-	// BB (adrianb) How do I get this string from arbitrary platform? Also C generates a target data layout.
-	//  Apparently the default target triple is wrong for some reason :/.
+	else if (FIsInt(typek))
+	{
+		pAstlit->lit.litk = LITK_Int;
+		(void) FTryEvalCastScalar(typek, pV, TYPEK_S64, &pAstlit->lit.n);
+		pAstlit->lit.fUnsigned = typek == TYPEK_U64 && pAstlit->lit.n < 0;
+	}
+	else
 	{
-		auto pChzTriple = "x86_64-apple-macosx10.11.0"; // LLVMGetDefaultTargetTriple();
-		LLVMSetTarget(pGenx->pLmod, pChzTriple);
-		//LLVMDisposeMessage(pChzTriple);
+		pAstlit->lit.litk = LITK_Float;
+		(void) FTryEvalCastScalar(typek, pV, TYPEK_Double, &pAstlit->lit.g);
 	}
 
+	return pAstlit;
 }
 
-void Destroy(SGenerateCtx * pGenx)
+void FoldToLiteral(SWorkspace * pWork, SAst ** ppAst)
 {
-	Destroy(&pGenx->arypAstDefer);
-	Destroy(&pGenx->aryScope);
-	
-	Destroy(&pGenx->hashPtypestructPltype);
+	u8 aB[8] = {};
+	ASSERT(CbSizeOf((*ppAst)->tid) <= sizeof(aB));
+	EvalConst(pWork, *ppAst, aB);
+	*ppAst = PastlitFromValue(pWork, *ppAst, aB);
+	++pWork->cFoldConst;
+}
 
-	Destroy(&pGenx->hashPastprocPlval);
-	Destroy(&pGenx->hashPastdeclStorage);
+bool FCanFoldBinaryOperator(SWorkspace * pWork, OP op, SAst * pAstLeft, SAst * pAstRight)
+{
+	// Leave integer division by zero (or the overflowing min / -1) and out of range shifts to run time instead of
+	//  evaluating them in the compiler.
 
-	LLVMDisposeBuilder(pGenx->pLbuilder);
-	LLVMDisposeBuilder(pGenx->pLbuilderAlloc);
+	TYPEK typekLeft = pAstLeft->tid.pType->typek;
+	TYPEK typekRight = pAstRight->tid.pType->typek;
+	if (!FIsInt(typekLeft) || !FIsInt(typekRight))
+		return true;
 
-	if (pGenx->pLmod)
-		LLVMDisposeModule(pGenx->pLmod);
-	
-	if (pGenx->pLctx)
-		LLVMContextDispose(pGenx->pLctx);
+	if (op != OP_Div && op != OP_Rem && op != OP_ShiftLeft && op != OP_ShiftRight)
+		return true;
 
-	ClearStruct(pGenx);
-}
+	u8 aB[8] = {};
+	EvalConst(pWork, pAstRight, aB);
+	s64 n;
+	(void) FTryEvalCastScalar(typekRight, aB, TYPEK_S64, &n);
 
-struct SScopeCtx
-{
-	int iScope;
-};
+	if (op == OP_ShiftLeft || op == OP_ShiftRight)
+		return n >= 0 && n < CBit(typekLeft);
 
-SScopeCtx ScopectxPush(SGenerateCtx * pGenx, LLVMOpaqueBasicBlock * pLblockLoopContinue = nullptr, 
-						LLVMOpaqueBasicBlock * pLblockLoopBreak = nullptr)
-{
-	ASSERT((pLblockLoopContinue == nullptr) == (pLblockLoopBreak == nullptr));
-	Append(&pGenx->aryScope, SGenerateCtx::SScope{ pGenx->arypAstDefer.c, pLblockLoopContinue, pLblockLoopBreak });
-	return { pGenx->aryScope.c - 1 };
+	return n != 0 && !(n == -1 && FSigned(typekRight));
 }
 
-struct SStorage
-{
-	LLVMValueRef pLvalPtr; // Address where variable is stored
-};
-
-bool FIsKeyEqual(const void * pV0, const void * pV1)
-{
-	return pV0 == pV1;
-}
+bool FFoldRecursive(SWorkspace * pWork, SAst ** ppAst);
 
-SStorage * PstorageLookup(SGenerateCtx * pGenx, SAstDeclareSingle * pAstdecl)
+void FoldChildren(SWorkspace * pWork, SArray<SAst *> * parypAst)
 {
-	auto hv = HvFromKey(reinterpret_cast<u64>(pAstdecl));
-	return PtLookupImpl(&pGenx->hashPastdeclStorage, hv, pAstdecl);
+	for (SAst ** ppAst : IterPointer(*parypAst))
+	{
+		(void) FFoldRecursive(pWork, ppAst);
+	}
 }
 
-void RegisterStorage(SGenerateCtx * pGenx, SAstDeclareSingle * pAstdecl, LLVMValueRef pLvalPtr)
+SAst * PastEmptyStatement(SWorkspace * pWork, SAst * pAstOrig)
 {
-	ASSERTCHZ(PstorageLookup(pGenx, pAstdecl) == nullptr, 
-			  "Found duplicate storage for declaration %s", pAstdecl->pChzName);
-	auto hv = HvFromKey(reinterpret_cast<u64>(pAstdecl));
-	
-	Add(&pGenx->hashPastdeclStorage, hv, pAstdecl, {pLvalPtr});
+	++pWork->cFoldBranch;
+	auto pAst = PastCreateManual<SAst>(pWork, ASTK_EmptyStatement, pAstOrig->errinfo);
+	pAst->tid = pWork->tidVoid;
+	return pAst;
 }
 
-LLVMOpaqueType * PltypeLookupStruct(SGenerateCtx * pGenx, const STypeStruct * pTypestruct)
+bool FFoldRecursive(SWorkspace * pWork, SAst ** ppAst)
 {
-	auto hv = HvFromKey(reinterpret_cast<u64>(pTypestruct));
-	auto ppLtype = PtLookupImpl(&pGenx->hashPtypestructPltype, hv, pTypestruct);
-	ASSERTCHZ(ppLtype, "Can't find llvm struct for %s", pTypestruct->pChzName);
-	return *ppLtype;
-}
+	// Folds constant subexpressions of *ppAst in place, returns whether *ppAst itself is a constant that can be
+	//  folded (literals and constant identifiers are left as they are, there's nothing to gain replacing them).
 
-LLVMOpaqueType * PltypeEnsureStruct(SGenerateCtx * pGenx, const STypeStruct * pTypestruct)
-{
-	auto hv = HvFromKey(reinterpret_cast<u64>(pTypestruct));
-	auto ppLtype = PtLookupImpl(&pGenx->hashPtypestructPltype, hv, pTypestruct);
-	ASSERTCHZ(ppLtype, "Can't find llvm struct for %s", pTypestruct->pChzName);
-	return *ppLtype;
-}
+	SAst * pAst = *ppAst;
+	if (!pAst)
+		return false;
 
-LLVMOpaqueType * PltypeGenerate(SGenerateCtx * pGenx, STypeId tid)
-{
-	auto pWork = pGenx->pWork;
-	auto pType = tid.pType;
-	if (pType == nullptr)
-		return {};
+	switch (pAst->astk)
+	{
+	case ASTK_Literal:
+		return FIsFoldableType(pAst->tid) && PastCast<SAstLiteral>(pAst)->lit.litk != LITK_String;
 
-	// BB (adrianb) Need to branch for foreign function signature vs internal function signature.
-	//  E.g. vararg, 
+	case ASTK_Identifier:
+		{
+			if (!FIsFoldableType(pAst->tid))
+				return false;
 
-	auto pLctx = pGenx->pLctx;
+			auto pResdecl = PresdeclResolved(pWork, pAst);
+			return pResdecl && pResdecl->pDecl->pAstdecl->fIsConstant;
+		}
 
-	TYPEK typek = pType->typek;
-	switch (typek)
-	{
-	case TYPEK_Void: return LLVMVoidTypeInContext(pLctx);
-	case TYPEK_Bool: return LLVMInt1TypeInContext(pLctx); // Bool is just int1 in llvm
-	case TYPEK_S8: return LLVMInt8TypeInContext(pLctx);
-	case TYPEK_S16: return LLVMInt16TypeInContext(pLctx);
-	case TYPEK_S32: return LLVMInt32TypeInContext(pLctx);
-	case TYPEK_S64: return LLVMInt64TypeInContext(pLctx);
-	case TYPEK_U8: return LLVMInt8TypeInContext(pLctx); // Unsigned is not part of LLVM (must sext/zext explicitly)
-	case TYPEK_U16: return LLVMInt16TypeInContext(pLctx);
-	case TYPEK_U32: return LLVMInt32TypeInContext(pLctx);
-	case TYPEK_U64: return LLVMInt64TypeInContext(pLctx);
-	case TYPEK_Float: return LLVMFloatTypeInContext(pLctx);
-	case TYPEK_Double: return LLVMDoubleTypeInContext(pLctx);
-
-	case TYPEK_Pointer: 
+	case ASTK_Operator:
 		{
-			auto pTypeptr = PtypeCast<STypePointer>(pType);
-			ASSERT(!pTypeptr->fSoa);
-			if (pTypeptr->tidPointedTo.pType->typek == TYPEK_Void)
-				return LLVMPointerType(LLVMInt8TypeInContext(pLctx), 0);
-			return LLVMPointerType(PltypeGenerate(pGenx, pTypeptr->tidPointedTo), 0);
-		}
-            
-	case TYPEK_String:
-	case TYPEK_Struct:
-		return PltypeLookupStruct(pGenx, Ptypestruct(pType));
+			auto pAstop = PastCast<SAstOperator>(pAst);
+			OP op = pAstop->op;
 
-	case TYPEK_Array:
-		{
-			// BB (adrianb) Have non-anonymous struct for an array type?
+			if (op == OP_Dot)
+			{
+				(void) FFoldRecursive(pWork, &pAstop->pAstLeft);
+				return false;
+			}
 
-			auto pTypearray = PtypeCast<STypeArray>(pType);
-			if (pTypearray->cSizeFixed >= 0)
+			bool fConstLeft = FFoldRecursive(pWork, &pAstop->pAstLeft);
+			bool fConstRight = FFoldRecursive(pWork, &pAstop->pAstRight);
+			if (!FIsFoldableType(pAst->tid))
+				return false;
+
+			if (!pAstop->pAstLeft)
 			{
-				ASSERT(!pTypearray->fSoa && !pTypearray->fDynamicallySized);
-				return LLVMArrayType(PltypeGenerate(pGenx, pTypearray->tidElement), pTypearray->cSizeFixed);
+				if (!fConstRight || (op != OP_Sub && op != OP_Not && op != OP_BitNot))
+					return false;
 			}
-			else if (pTypearray->fDynamicallySized)
+			else if (op == OP_And || op == OP_Or)
 			{
-				auto pLtypePtr = PltypeGenerate(pGenx, TidPointer(pWork, pTypearray->tidElement));
-				LLVMOpaqueType * apLtype[] = { pLtypePtr, LLVMInt32TypeInContext(pGenx->pLctx), LLVMInt32TypeInContext(pGenx->pLctx) };
-				return LLVMStructTypeInContext(pGenx->pLctx, apLtype, DIM(apLtype), false);
+				// A constant left side decides the result or leaves just the right side
+
+				if (!fConstLeft)
+					return false;
+
+				if (!fConstRight)
+				{
+					bool fLeft;
+					EvalConst(pWork, pAstop->pAstLeft, &fLeft);
+					if (fLeft == (op == OP_Or))
+					{
+						*ppAst = PastlitFromValue(pWork, pAst, &fLeft);
+						++pWork->cFoldConst;
+						return true;
+					}
+
+					*ppAst = pAstop->pAstRight;
+					return false;
+				}
 			}
 			else
 			{
-				auto pLtypePtr = PltypeGenerate(pGenx, TidPointer(pWork, pTypearray->tidElement));
-				LLVMOpaqueType * apLtype[] = { pLtypePtr, LLVMInt32TypeInContext(pGenx->pLctx) };
-				return LLVMStructTypeInContext(pGenx->pLctx, apLtype, DIM(apLtype), false);
+				if (!fConstLeft || !fConstRight || !s_optableEcbop.PtLookup(op))
+					return false;
+
+				if (!FCanFoldBinaryOperator(pWork, op, pAstop->pAstLeft, pAstop->pAstRight))
+					return false;
 			}
+
+			FoldToLiteral(pWork, ppAst);
+			return true;
 		}
 
-	case TYPEK_Procedure:
+	case ASTK_Cast:
 		{
-			// BB (adrianb) For foreign functions need to support varargs differently.
+			auto pAstcast = PastCast<SAstCast>(pAst);
+			if (!FFoldRecursive(pWork, &pAstcast->pAstExpr) || !FIsFoldableType(pAst->tid))
+				return false;
 
-			auto pTypeproc = PtypeCast<STypeProcedure>(pType);
+			FoldToLiteral(pWork, ppAst);
+			return true;
+		}
 
-			STypeId tidRet = pWork->tidVoid;
-			if (pTypeproc->cTidRet != 0)
+	case ASTK_Call:
+		{
+			auto pAstcall = PastCast<SAstCall>(pAst);
+			if (pAstcall->pAstFunc->astk == ASTK_Identifier)
 			{
-				ASSERT(pTypeproc->cTidRet == 1);
-				tidRet = pTypeproc->aTidRet[0];
-			}
+				auto pChzIdent = PastCast<SAstIdentifier>(pAstcall->pAstFunc)->pChz;
+				bool fIsSizeOf = strcmp(pChzIdent, "sizeof") == 0;
+				if (fIsSizeOf || strcmp(pChzIdent, "alignof") == 0)
+				{
+					STypeId tid = pAstcall->arypAstArgs[0]->tid;
+					if (tid.pType->typek == TYPEK_TypeOf)
+						tid = PtypeCast<STypeTypeOf>(tid.pType)->tid;
 
-			int cArg = pTypeproc->cTidArg;
-			LLVMTypeRef * aTyperefArg = static_cast<LLVMTypeRef *>(alloca(sizeof(LLVMTypeRef) * cArg));
-			for (int iTid : IterCount(cArg))
+					u64 cB = (fIsSizeOf) ? CbSizeOf(tid) : CbAlignOf(tid);
+					*ppAst = PastlitFromValue(pWork, pAst, &cB);
+					++pWork->cFoldConst;
+					return true;
+				}
+			}
+			else
 			{
-				aTyperefArg[iTid] = PltypeGenerate(pGenx, pTypeproc->aTidArg[iTid]);
+				(void) FFoldRecursive(pWork, &pAstcall->pAstFunc);
 			}
 
-			return LLVMFunctionType(PltypeGenerate(pGenx, tidRet), aTyperefArg, cArg, pTypeproc->fUsesCVararg);
+			FoldChildren(pWork, &pAstcall->arypAstArgs);
+			return false;
 		}
 
-	case TYPEK_Enum:
-		return PltypeGenerate(pGenx, PtypeCast<STypeEnum>(pType)->tidInternal);
+	case ASTK_If:
+		{
+			// Only the branch taken by a constant condition is kept, in place of the if
 
-	case TYPEK_Any:
-	case TYPEK_TypeOf:
-	case TYPEK_Vararg:
-	case TYPEK_Max:
-	// default:
-		ASSERTCHZ(false, "Type generation for %s(%d) NYI", PchzFromTypek(typek), typek);
-		return LLVMTypeRef{};
-	}
-}
+			auto pAstif = PastCast<SAstIf>(pAst);
+			if (!FFoldRecursive(pWork, &pAstif->pAstCondition))
+			{
+				(void) FFoldRecursive(pWork, &pAstif->pAstPass);
+				(void) FFoldRecursive(pWork, &pAstif->pAstElse);
+				return false;
+			}
 
-SGlobal * PglobalAdd(SWorkspace * pWork, SAst * pAstSource, STypeId tid);
+			if (pAstif->pAstCondition->astk != ASTK_Literal)
+				FoldToLiteral(pWork, &pAstif->pAstCondition);
 
-#if 0
-SProcedure * PprocEnsure(SWorkspace * pWork, SAstProcedure * pAstproc)
-{
-	auto hv = HvFromKey(reinterpret_cast<u64>(pAstproc));
-	auto ppProc = PtLookupImpl(&pWork->hashPastprocPproc, hv, pAstproc);
-	if (ppProc)
-		return *ppProc;
+			if (PastCast<SAstLiteral>(pAstif->pAstCondition)->lit.n)
+			{
+				(void) FFoldRecursive(pWork, &pAstif->pAstPass);
+				if (pAstif->pAstElse)
+					++pWork->cFoldBranch;
+				*ppAst = pAstif->pAstPass;
+			}
+			else if (pAstif->pAstElse)
+			{
+				(void) FFoldRecursive(pWork, &pAstif->pAstElse);
+				++pWork->cFoldBranch;
+				*ppAst = pAstif->pAstElse;
+			}
+			else
+			{
+				*ppAst = PastEmptyStatement(pWork, pAst);
+			}
+			return false;
+		}
 
-	auto pProc = PtAlloc<SProcedure>(&pWork->pagealloc);
-	pProc->pAstproc = pAstproc;
-	auto pGlobal = PglobalAdd(pWork, pAstproc, pAstproc->tid);
-	pGlobal->fProcedure = true;
-	pGlobal->pProc = pProc;
+	case ASTK_While:
+		{
+			auto pAstwhile = PastCast<SAstWhile>(pAst);
+			if (FFoldRecursive(pWork, &pAstwhile->pAstCondition))
+			{
+				if (pAstwhile->pAstCondition->astk != ASTK_Literal)
+					FoldToLiteral(pWork, &pAstwhile->pAstCondition);
 
-	pProc->reg = pGlobal->reg;
+				if (!PastCast<SAstLiteral>(pAstwhile->pAstCondition)->lit.n)
+				{
+					*ppAst = PastEmptyStatement(pWork, pAst);
+					return false;
+				}
+			}
 
-	Add(&pWork->hashPastprocPproc, hv, pAstproc, pProc);
+			(void) FFoldRecursive(pWork, &pAstwhile->pAstLoop);
+			return false;
+		}
 
-	return pProc;
-}
-#endif
+	case ASTK_For:
+		{
+			auto pAstfor = PastCast<SAstFor>(pAst);
+			(void) FFoldRecursive(pWork, &pAstfor->pAstIterRight);
+			(void) FFoldRecursive(pWork, &pAstfor->pAstRangeEnd);
+			(void) FFoldRecursive(pWork, &pAstfor->pAstLoop);
+			return false;
+		}
 
-LLVMOpaqueValue * PlvalConstS32(SGenerateCtx * pGenx, int n)
-{
-	return LLVMConstInt(LLVMInt32TypeInContext(pGenx->pLctx), n, true);
-}
+	case ASTK_Block:
+		FoldChildren(pWork, &PastCast<SAstBlock>(pAst)->arypAst);
+		return false;
 
-LLVMOpaqueValue * PlvalConstU32(SGenerateCtx * pGenx, u32 n)
-{
-	return LLVMConstInt(LLVMInt32TypeInContext(pGenx->pLctx), n, false);
-}
+	case ASTK_PushContext:
+		FoldChildren(pWork, &PastCast<SAstPushContext>(pAst)->pAstblock->arypAst);
+		return false;
 
-LLVMOpaqueValue * PlvalConstU64(SGenerateCtx * pGenx, u64 n)
-{
-	return LLVMConstInt(LLVMInt64TypeInContext(pGenx->pLctx), n, false);
-}
+	case ASTK_Return:
+		FoldChildren(pWork, &PastCast<SAstReturn>(pAst)->arypAstRet);
+		return false;
 
-LLVMOpaqueValue * PlvalBuildStruct(SGenerateCtx * pGenx, LLVMOpaqueType * pLtype, LLVMOpaqueValue ** apLval, int cpLval)
-{
-	// BB (adrianb) Clang treats structs somewhat differently. It builds this by storing values into a stack location.
-	//  It initializes constants by storing in a global and calling @llvm.memcpy.p0i8.p0i8.i64 or so.
-	//  Similarly struct assignment runs through @llvm.memcpy.p0i8.p0i8.i64.
-	// !!! (adrianb) Clang has BIZARRE behavior wrt returning structs:
-	//  return a Vector{float x; floaty;} -> return <2 x float>
-	//  return a Vector{float x; int y;} -> cast to i64* and return i64!?
-	//  return a Vector{float x; float y; int z;} -> return { <float x 2>, i32 }
-	//  This is totally arcane even for optimization purposes.
+	case ASTK_AssignMulti:
+		(void) FFoldRecursive(pWork, &PastCast<SAstAssignMulti>(pAst)->pAstValue);
+		return false;
 
-	LLVMOpaqueValue * pLvalStruct = LLVMGetUndef(pLtype);
-	ASSERT(LLVMCountStructElementTypes(pLtype) == u32(cpLval));
-	for (int ipLval : IterCount(cpLval))
-	{
-		pLvalStruct = LLVMBuildInsertValue(pGenx->pLbuilder, pLvalStruct, apLval[ipLval], ipLval, "");
-	}
-	return pLvalStruct;
-}
+	case ASTK_ArrayIndex:
+		{
+			auto pAstarrayindex = PastCast<SAstArrayIndex>(pAst);
+			(void) FFoldRecursive(pWork, &pAstarrayindex->pAstArray);
+			(void) FFoldRecursive(pWork, &pAstarrayindex->pAstIndex);
+			return false;
+		}
 
-void GetMemberAddress(SGenerateCtx * pGenx, const char * pChzName, 
-						LLVMOpaqueValue ** ppLvalPtr, STypeId * pTidPointedTo, SAst * pAstErr)
-{
-	auto pLbuilder = pGenx->pLbuilder;
+	case ASTK_Delete:
+		(void) FFoldRecursive(pWork, &PastCast<SAstDelete>(pAst)->pAstExpr);
+		return false;
 
-	if (pTidPointedTo->pType->typek == TYPEK_Pointer)
-	{
-		*ppLvalPtr = LLVMBuildLoad(pLbuilder, *ppLvalPtr, "");
-		*pTidPointedTo = PtypeCast<STypePointer>(pTidPointedTo->pType)->tidPointedTo;
-	}
+	case ASTK_Defer:
+		(void) FFoldRecursive(pWork, &PastCast<SAstDefer>(pAst)->pAstStmt);
+		return false;
 
-	const STypeStruct * pTypestruct = Ptypestruct(pTidPointedTo->pType);
+	case ASTK_Inline:
+		(void) FFoldRecursive(pWork, &PastCast<SAstInline>(pAst)->pAstExpr);
+		return false;
 
-	if (pTidPointedTo->pType->typek == TYPEK_Array)
-	{
-		auto pTypearray = PtypeCast<STypeArray>(pTidPointedTo->pType);
-        if (pTypearray->cSizeFixed >= 0)
+	case ASTK_DeclareSingle:
 		{
-			ASSERT(strcmp(pChzName, "a") == 0);
-			*ppLvalPtr = LLVMBuildStructGEP(pLbuilder, *ppLvalPtr, 0, "");
-			*pTidPointedTo = pTypearray->tidElement;
-			return;
-		}
-	}
+			// Constant declarations are evaluated once where they're referenced (see PvEvalConstDecl)
 
-	EnsureTypeSize(pTypestruct);
+			auto pAstdecl = PastCast<SAstDeclareSingle>(pAst);
+			if (!pAstdecl->fIsConstant)
+				(void) FFoldRecursive(pWork, &pAstdecl->pAstValue);
+			return false;
+		}
 
-	for (int iMember = 0;; ++iMember)
-	{
-		if (iMember >= pTypestruct->cMember)
-            break;
+	case ASTK_DeclareMulti:
+		(void) FFoldRecursive(pWork, &PastCast<SAstDeclareMulti>(pAst)->pAstValue);
+		return false;
 
-		auto pAstdeclMember = pTypestruct->aMember[iMember].pAstdecl;
-		if (strcmp(pChzName, pAstdeclMember->pChzName) != 0)
-			continue;
+	// Nested procedures are folded on their own, run directives are evaluated by the compiler anyways, types
+	//  and the rest have nothing to fold.
 
-		*ppLvalPtr = LLVMBuildStructGEP(pLbuilder, *ppLvalPtr, iMember, "");
-		*pTidPointedTo = pTypestruct->aMember[iMember].pAstdecl->tid;
-        return;
+	default:
+		return false;
 	}
+}
 
-	ShowErr(pAstErr->errinfo, "Couldn't find member %s of %s", pChzName, StrPrintType(pTypestruct).Pchz());
-	*ppLvalPtr = nullptr;
-	*pTidPointedTo = {};
+void FoldConstants(SWorkspace * pWork)
+{
+	for (auto pModule : IterPointer(pWork->aryModule))
+	{
+		for (auto pAstproc : pModule->arypAstprocGen)
+		{
+			if (pAstproc->pAstblock)
+				FoldChildren(pWork, &pAstproc->pAstblock->arypAst);
+		}
+	}
 }
 
-LLVMOpaqueValue * PlvalEnsureProcedure(SGenerateCtx * pGenx, SAstProcedure * pAstproc)
+struct SGenerateCtx
 {
-	auto hv = HvFromKey(reinterpret_cast<u64>(pAstproc));
-	LLVMOpaqueValue ** ppLval = PtLookupImpl(&pGenx->hashPastprocPlval, hv, pAstproc);
-	if (ppLval)
-		return *ppLval;
+	struct SScope
+	{
+		int ipAstDeferMic;
+		LLVMOpaqueBasicBlock * pLblockLoopContinue;	// BB (adrianb) Could add a loop label here to break out arbitrarily
+		LLVMOpaqueBasicBlock * pLblockLoopBreak;
+	};
 
-	ASSERT(pAstproc->tid.pType && pAstproc->tid.pType->typek == TYPEK_Procedure);
-	LLVMOpaqueType * pLtypeProc = PltypeGenerate(pGenx, pAstproc->tid);
+	struct SInline
+	{
+		SAstProcedure * pAstproc;
+		int iScope;								// Scope of the body, returns pop defers down to it
+		LLVMOpaqueBasicBlock * pLblockReturn;	// Returns branch here
+		LLVMOpaqueValue * pLvalRetAddr;			// Returns store here, null if returning void
+	};
 
-	auto pLvalProc = LLVMAddFunction(pGenx->pLmod, pAstproc->pChzName, pLtypeProc);
-	
-	// BB (adrianb) If it comes from a separate module mark as external?
-	//  Or just emit all bitcode into one translation unit? Doesn't seem like there's any advantage to
-	//  separate modules with typechecking walking all over the place.
-
-	if (pAstproc->fIsForeign)
-		LLVMSetLinkage(pLvalProc, LLVMExternalLinkage);
-
-	Add(&pGenx->hashPastprocPlval, hv, pAstproc, pLvalProc);
-	return pLvalProc;
-}
+	SWorkspace * pWork;
 
-LLVMOpaqueValue * PlvalGenerateRecursive(SGenerateCtx * pGenx, SAst * pAst);
+	int iPartition;				// Generate every cPartition-th procedure starting at iPartition (see GenerateAllParallel)
+	int cPartition;				//  ...
+	int iThreadTrace;			// Thread --trace spans are shown on
+	SAstProcedure * pAstprocOnly;	// Only generate this procedure, globals are external (see GenerateCached)
+	bool fGlobalsOnly;			// Define all globals and generate no procedures (see GenerateCached)
 
-LLVMOpaqueValue * PlvalGetLoadStoreAddress(SGenerateCtx * pGenx, SAst * pAst)
-{
-	auto pWork = pGenx->pWork;
-	auto pLbuilder = pGenx->pLbuilder;
+	SArray<SAst *> arypAstDefer; // Defer instructions per scope
+	SArray<SScope> aryScope;	// Scopes
+	bool fScopeTerminated;			// Have we returned?
+	bool fInProcedure;			// Are we inside a procedure
+	SArray<SInline> aryInline;	// Procedure bodies being generated in place of a call, see PlvalGenerateInline
 
-	ASTK astk = pAst->astk;
-	switch (astk)
-	{
-	case ASTK_Operator:
-		{
-			auto pAstop = PastCast<SAstOperator>(pAst);
-			auto pAstLeft = pAstop->pAstLeft;
-			auto pAstRight = pAstop->pAstRight;
-			if (pAstLeft == nullptr)
-			{
-				if (strcmp(pAstop->pChzOp, "<<") == 0)
-				{
-					return PlvalGenerateRecursive(pGenx, pAstop->pAstRight);
-				}
-			}
-			else
-			{
-				if (strcmp(pAstop->pChzOp, ".") == 0)
-				{
-					// Get a pointer to the thing we want to get a member out of
+	// Code generation Move to SGenerateCtx?
+	
+	LLVMOpaqueBuilder * pLbuilderAlloc;
+	LLVMOpaqueBuilder * pLbuilder;
+	LLVMOpaqueContext * pLctx;
+	LLVMOpaqueModule * pLmod;
+	LLVMOpaqueTargetMachine * pLtm;	// Optimizes and emits pLmod, one per context since emitting isn't thread safe
 
-					LLVMOpaqueValue * pLvalPtr;
-					STypeId tidPointedTo;
-					if (pAstLeft->tid.pType->typek == TYPEK_Pointer)
-					{
-						pLvalPtr = PlvalGenerateRecursive(pGenx, pAstLeft);
-						tidPointedTo = PtypeCast<STypePointer>(pAstLeft->tid.pType)->tidPointedTo;
-					}
-					else
-					{
-						ASSERT(pAstLeft->tid.pType->typek != TYPEK_Array || 
-								PtypeCast<STypeArray>(pAstLeft->tid.pType)->cSizeFixed < 0);
+	SHash<STypeStruct *, LLVMOpaqueType *> hashPtypestructPltype;
+	//SArray<LLVMOpaqueValue *> arypLvalGlobal;
 
-						pLvalPtr = PlvalGetLoadStoreAddress(pGenx, pAstLeft);
-						tidPointedTo = pAstLeft->tid;
-					}
+#if 0
+	SArray<SGlobal> aryGlobal;
+#endif
+	SHash<SAstDeclareSingle *, SStorage> hashPastdeclStorage; // 
+	SSet<SAstDeclareSingle *> setPastdeclGlobal; // Top level variables, generated the first time they're referenced
+	SHash<SAstProcedure *, LLVMOpaqueValue *> hashPastprocPlval; // Procedures started
+	SHash<const SType *, LLVMOpaqueValue *> hashPtypePlvalDefault; // See GenerateDefaultValueStore
+};
 
-					auto pResdecl = PresdeclResolved(pWork, pAstRight);
+void Reset(SGenerateCtx * pGenx)
+{
+	ASSERT(pGenx->arypAstDefer.c == 0);
+	ASSERT(!pGenx->fInProcedure);
+	pGenx->fScopeTerminated = false;
+}
 
-					for (int ipDecl = 0; ipDecl <= pResdecl->arypDeclUsingPath.c; ++ipDecl)
-					{
-						auto pDecl = (ipDecl == pResdecl->arypDeclUsingPath.c) ?
-										pResdecl->pDecl :
-										pResdecl->arypDeclUsingPath[ipDecl];
+#if 0
+void AddReferenced(SGenerateCtx * pGenx, SAst * pAst)
+{
+	if (pGenx->parypAstReferenced == nullptr)
+		return;
 
-						GetMemberAddress(pGenx, pDecl->pChzName, &pLvalPtr, &tidPointedTo, pAstop);
-					}
+	ASSERT(pAst->astk == ASTK_Procedure || pAst->astk == ASTK_DeclareSingle);
+	Append(pGenx->parypAstReferenced, pAst);
+}
+#endif
 
-					return pLvalPtr;
-				}
-			}
-		}
-		break;
+const char * PchzBuild(SWorkspace * pWork)
+{
+	for (const auto & module : pWork->aryModule)
+	{
+		if (module.fBuiltIn)
+			continue;
+		return module.pChzFile;
+	}
 
-	case ASTK_Identifier:
-		{
-			auto pResdecl = PresdeclResolved(pWork, pAst);
-			ASSERT(pResdecl);
-			if (pResdecl->arypDeclUsingPath.c > 0)
-			{
-				// BB (adrianb) This initial lookup and starting at path decl 1 is the only difference
-				//  with member declaration lookup.
+	ASSERT(false);
+	return "<Unknown>";
+}
 
-				auto pDecl0 = pResdecl->arypDeclUsingPath[0];
-				auto pAstdecl0 = pDecl0->pAstdecl;
-				auto pStorage0 = PstorageLookup(pGenx, pAstdecl0);
-				
-				auto pLvalPtr  = pStorage0->pLvalPtr;
-				auto tidPointedTo = pAstdecl0->tid;
+// BB (adrianb) How do I get this string from arbitrary platform? Also C generates a target data layout.
+//  Apparently the default target triple is wrong for some reason :/.
+static const char * s_pChzTargetTriple = "x86_64-apple-macosx10.11.0"; // LLVMGetDefaultTargetTriple();
 
-				for (int ipDecl = 1; ipDecl <= pResdecl->arypDeclUsingPath.c; ++ipDecl)
-				{
-					auto pDecl = (ipDecl == pResdecl->arypDeclUsingPath.c) ?
-									pResdecl->pDecl : 
-									pResdecl->arypDeclUsingPath[ipDecl];
+void Init(SGenerateCtx * pGenx, SWorkspace * pWork, int iPartition = 0, int cPartition = 1)
+{
+	ASSERT(iPartition >= 0 && iPartition < cPartition);
 
-					GetMemberAddress(pGenx, pDecl->pChzName, &pLvalPtr, &tidPointedTo, pAst);
-				}
+	pGenx->pWork = pWork;
+	pGenx->iPartition = iPartition;
+	pGenx->cPartition = cPartition;
+	pGenx->iThreadTrace = iPartition;
+	pGenx->pLctx = LLVMContextCreate();
+	pGenx->pLbuilder = LLVMCreateBuilderInContext(pGenx->pLctx);
+	pGenx->pLbuilderAlloc = LLVMCreateBuilderInContext(pGenx->pLctx);
+	pGenx->pLmod = LLVMModuleCreateWithNameInContext(PchzBuild(pWork), pGenx->pLctx);
 
-				return pLvalPtr;
-			}
-			else
-			{
-				auto pAstdecl = pResdecl->pDecl->pAstdecl;
-				ASSERT(!pAstdecl->fIsConstant);
-				auto pStorage = PstorageLookup(pGenx, pAstdecl);
-				return pStorage->pLvalPtr;
-			}
-		}
-		break;
+	LLVMSetTarget(pGenx->pLmod, s_pChzTargetTriple);
 
-	case ASTK_ArrayIndex:
-		{
-			auto pAstarrayindex = PastCast<SAstArrayIndex>(pAst);
+	// BB (adrianb) The native target only matches s_pChzTargetTriple on x86-64 hosts.
 
-			auto pType = pAstarrayindex->pAstArray->tid.pType;
-			auto typek = pType->typek;
-			if (typek == TYPEK_Pointer)
-			{
-				auto pLvalAddr = PlvalGenerateRecursive(pGenx, pAstarrayindex->pAstArray);
-				auto pLvalIndex = PlvalGenerateRecursive(pGenx, pAstarrayindex->pAstIndex);
-				return LLVMBuildGEP(pLbuilder, pLvalAddr, &pLvalIndex, 1, "");
-			}
-			else if (typek == TYPEK_Array)
-			{
-				auto pTypearray = PtypeCast<STypeArray>(pType);
+	static bool s_fInitTarget = (LLVMInitializeNativeTarget(), LLVMInitializeNativeAsmPrinter(), true);
+	(void) s_fInitTarget;
 
-				if (pTypearray->cSizeFixed >= 0)
-				{
-					auto pLvalArrayAddr = PlvalGetLoadStoreAddress(pGenx, pAstarrayindex->pAstArray);
-					auto pLvalIndex = PlvalGenerateRecursive(pGenx, pAstarrayindex->pAstIndex);
+	LLVMTarget * pLtarget = nullptr;
+	char * pChzError = nullptr;
+	if (LLVMGetTargetFromTriple(s_pChzTargetTriple, &pLtarget, &pChzError) != 0)
+	{
+		ShowErrRaw("Can't find target %s: %s", s_pChzTargetTriple, pChzError);
+	}
 
-					LLVMOpaqueValue * apLvalGEP[] = { PlvalConstS32(pGenx, 0), pLvalIndex };
-					return LLVMBuildGEP(pGenx->pLbuilder, pLvalArrayAddr, apLvalGEP, DIM(apLvalGEP), "");
-				}
-				else
-				{
-					auto pLvalArrayAddr = PlvalGetLoadStoreAddress(pGenx, pAstarrayindex->pAstArray);
-					auto pLvalPtrA = LLVMBuildStructGEP(pLbuilder, pLvalArrayAddr, 0, ""); // getting a from {a,c}
-					auto pLvalA = LLVMBuildLoad(pLbuilder, pLvalPtrA, "");
+	static const LLVMCodeGenOptLevel s_mpNOptLevelLcgol[] = 
+		{ LLVMCodeGenLevelNone, LLVMCodeGenLevelLess, LLVMCodeGenLevelDefault, LLVMCodeGenLevelAggressive };
+	pGenx->pLtm = LLVMCreateTargetMachine(pLtarget, s_pChzTargetTriple, "", "", 
+										  s_mpNOptLevelLcgol[pWork->nOptLevel], LLVMRelocDefault, LLVMCodeModelDefault);
 
-					auto pLvalIndex = PlvalGenerateRecursive(pGenx, pAstarrayindex->pAstIndex);
-					return LLVMBuildGEP(pLbuilder, pLvalA, &pLvalIndex, 1, "");
-				}
-			}
-			
-			ShowErr(pAst->errinfo, "Don't know how to array index type %s", StrPrintType(pType).Pchz());
-			return nullptr;
-		}
-		break;
+	// The target's own data layout, which has to match the struct layout of EnsureTypeSize (e.g. 8 byte aligned 
+	//  i64) so ABI coercion and byval copies line up
 
-	default:
-		break;
+	if (pGenx->pLtm)
+	{
+		LLVMOpaqueTargetData * pLtd = LLVMCreateTargetDataLayout(pGenx->pLtm);
+		char * pChzLayout = LLVMCopyStringRepOfTargetData(pLtd);
+		LLVMSetDataLayout(pGenx->pLmod, pChzLayout);
+		LLVMDisposeMessage(pChzLayout);
+		LLVMDisposeTargetData(pLtd);
 	}
+}
 
-	// Implicitly create temporary local
-	// BB (adrianb) Disallow implictly storing some operators?
-	//  Are there any cases where we'll infinitely recurse?
+void Destroy(SGenerateCtx * pGenx)
+{
+	Destroy(&pGenx->arypAstDefer);
+	Destroy(&pGenx->aryScope);
+	Destroy(&pGenx->aryInline);
+	
+	Destroy(&pGenx->hashPtypestructPltype);
 
-	auto pLvalAddr = LLVMBuildAlloca(pGenx->pLbuilderAlloc, PltypeGenerate(pGenx, pAst->tid), "_tempAddr");
-	auto pLval = PlvalGenerateRecursive(pGenx, pAst);
-	LLVMBuildStore(pLbuilder, pLval, pLvalAddr);
+	Destroy(&pGenx->hashPastprocPlval);
+	Destroy(&pGenx->hashPtypePlvalDefault);
+	Destroy(&pGenx->hashPastdeclStorage);
+	Destroy(&pGenx->setPastdeclGlobal);
 
-	return pLvalAddr;
-}
+	LLVMDisposeBuilder(pGenx->pLbuilder);
+	LLVMDisposeBuilder(pGenx->pLbuilderAlloc);
 
-using PFNGENBINOP = LLVMOpaqueValue * (*)(LLVMOpaqueBuilder * pLbuilder, LLVMOpaqueValue * pLvalLeft, 
-											LLVMOpaqueValue * pLvalRight, const char * pChz);
+	if (pGenx->pLmod)
+		LLVMDisposeModule(pGenx->pLmod);
+	
+	if (pGenx->pLctx)
+		LLVMContextDispose(pGenx->pLctx);
 
-struct SGenerateBinaryOperator
-{
-	const char * pChzOp;
+	if (pGenx->pLtm)
+		LLVMDisposeTargetMachine(pGenx->pLtm);
 
-	PFNGENBINOP pfngbopInt;
-	PFNGENBINOP pfngbopIntUnsigned;
-	PFNGENBINOP pfngbopFloat;
-	PFNGENBINOP pfngbopPointerAndInt;
-	PFNGENBINOP pfngbopPointer;
+	ClearStruct(pGenx);
+}
 
-	// bools?
+struct SScopeCtx
+{
+	int iScope;
 };
 
-template <LLVMIntPredicate lintpred>
-LLVMOpaqueValue * GenCmpInt(LLVMOpaqueBuilder * pLbuilder, LLVMOpaqueValue * pLvalLeft, LLVMOpaqueValue * pLvalRight, const char * pChz)
+SScopeCtx ScopectxPush(SGenerateCtx * pGenx, LLVMOpaqueBasicBlock * pLblockLoopContinue = nullptr, 
+						LLVMOpaqueBasicBlock * pLblockLoopBreak = nullptr)
 {
-	auto pChzLeftType = LLVMPrintTypeToString(LLVMTypeOf(pLvalLeft));
-	auto pChzRightType = LLVMPrintTypeToString(LLVMTypeOf(pLvalRight));
-	defer { LLVMDisposeMessage(pChzLeftType); LLVMDisposeMessage(pChzRightType); };
-
-	return LLVMBuildICmp(pLbuilder, lintpred, pLvalLeft, pLvalRight, pChz);
+	ASSERT((pLblockLoopContinue == nullptr) == (pLblockLoopBreak == nullptr));
+	Append(&pGenx->aryScope, SGenerateCtx::SScope{ pGenx->arypAstDefer.c, pLblockLoopContinue, pLblockLoopBreak });
+	return { pGenx->aryScope.c - 1 };
 }
 
-template <LLVMRealPredicate lrealpred>
-LLVMValueRef GenCmpFloat(LLVMOpaqueBuilder * pLbuilder, LLVMOpaqueValue * pLvalLeft, LLVMOpaqueValue * pLvalRight, const char * pChz)
+struct SStorage
 {
-	return LLVMBuildFCmp(pLbuilder, lrealpred, pLvalLeft, pLvalRight, pChz);
+	LLVMValueRef pLvalPtr; // Address where variable is stored
+	LLVMValueRef pLvalValue; // Or its value, for locals that are never modified (see FIsSsaLocal)
+};
+
+bool FIsKeyEqual(const void * pV0, const void * pV1)
+{
+	return pV0 == pV1;
 }
 
-LLVMOpaqueValue * PlvalAddPtrInt(LLVMOpaqueBuilder * pLbuilder, LLVMOpaqueValue * pLvalLeft, LLVMOpaqueValue * pLvalRight, const char * pChz)
+void GenerateGlobal(SGenerateCtx * pGenx, SAstDeclareSingle * pAstdecl);
+
+SStorage * PstorageLookup(SGenerateCtx * pGenx, SAstDeclareSingle * pAstdecl)
 {
-	LLVMOpaqueValue * apLvalIndex[] = 
-	{
-		pLvalRight
-	};
+	auto hv = HvFromKey(reinterpret_cast<u64>(pAstdecl));
+	SStorage * pStorage = PtLookupImpl(&pGenx->hashPastdeclStorage, hv, pAstdecl);
+	if (pStorage)
+		return pStorage;
 
-	return LLVMBuildGEP(pLbuilder, pLvalLeft, apLvalIndex, DIM(apLvalIndex), pChz);
+	// Globals are generated on demand so unreferenced ones cost nothing
+
+	if (!PtLookupImpl(&pGenx->setPastdeclGlobal, hv, pAstdecl))
+		return nullptr;
+
+	GenerateGlobal(pGenx, pAstdecl);
+	return PtLookupImpl(&pGenx->hashPastdeclStorage, hv, pAstdecl);
 }
 
-LLVMOpaqueValue * PlvalSubPtrInt(LLVMOpaqueBuilder * pLbuilder, LLVMOpaqueValue * pLvalLeft, LLVMOpaqueValue * pLvalRight, const char * pChz)
+void RegisterStorage(SGenerateCtx * pGenx, SAstDeclareSingle * pAstdecl, LLVMValueRef pLvalPtr, 
+					 LLVMValueRef pLvalValue = nullptr)
 {
-	LLVMOpaqueValue * apLvalIndex[] = 
-	{
-		LLVMBuildNeg(pLbuilder, pLvalRight, "")
-	};
+	auto hv = HvFromKey(reinterpret_cast<u64>(pAstdecl));
 
-	return LLVMBuildGEP(pLbuilder, pLvalLeft, apLvalIndex, DIM(apLvalIndex), pChz);
+	// Locals get new storage each time their body is generated, inlined procedures generate theirs more than once
+
+	if (SStorage * pStorage = PtLookupImpl(&pGenx->hashPastdeclStorage, hv, pAstdecl))
+	{
+		ASSERTCHZ(!PtLookupImpl(&pGenx->setPastdeclGlobal, hv, pAstdecl), 
+				  "Found duplicate storage for declaration %s", pAstdecl->pChzName);
+		*pStorage = {pLvalPtr, pLvalValue};
+		return;
+	}
+	
+	Add(&pGenx->hashPastdeclStorage, hv, pAstdecl, {pLvalPtr, pLvalValue});
 }
 
-LLVMOpaqueValue * PlvalSubPtr(LLVMOpaqueBuilder * pLbuilder, LLVMOpaqueValue * pLvalLeft, LLVMOpaqueValue * pLvalRight, const char * pChz)
+LLVMOpaqueType * PltypeLookupStruct(SGenerateCtx * pGenx, const STypeStruct * pTypestruct)
 {
-	ASSERT(false);
-	return nullptr;
+	auto hv = HvFromKey(reinterpret_cast<u64>(pTypestruct));
+	auto ppLtype = PtLookupImpl(&pGenx->hashPtypestructPltype, hv, pTypestruct);
+	ASSERTCHZ(ppLtype, "Can't find llvm struct for %s", pTypestruct->pChzName);
+	return *ppLtype;
 }
 
-static const SGenerateBinaryOperator s_aGbop[] =
+LLVMOpaqueType * PltypeEnsureStruct(SGenerateCtx * pGenx, const STypeStruct * pTypestruct)
 {
-	// BB (adrianb) Unordered (either arg NaN) vs Ordered. Which to choose?
-	// BB (adrianb) Pointer operations right?
-	{ "<", GenCmpInt<LLVMIntSLT>, GenCmpInt<LLVMIntULT>, GenCmpFloat<LLVMRealOLT>, nullptr, GenCmpInt<LLVMIntULT> },
-	{ ">", GenCmpInt<LLVMIntSGT>, GenCmpInt<LLVMIntUGT>, GenCmpFloat<LLVMRealOGT>, nullptr, GenCmpInt<LLVMIntUGT> },
-
-	{ "==", GenCmpInt<LLVMIntEQ>, nullptr, GenCmpFloat<LLVMRealOEQ>, nullptr, GenCmpInt<LLVMIntEQ> },
-	{ "!=", GenCmpInt<LLVMIntNE>, nullptr, GenCmpFloat<LLVMRealONE>, nullptr, GenCmpInt<LLVMIntNE> },
+	auto hv = HvFromKey(reinterpret_cast<u64>(pTypestruct));
+	auto ppLtype = PtLookupImpl(&pGenx->hashPtypestructPltype, hv, pTypestruct);
+	ASSERTCHZ(ppLtype, "Can't find llvm struct for %s", pTypestruct->pChzName);
+	return *ppLtype;
+}
 
-	{ "+", LLVMBuildAdd, nullptr, LLVMBuildFAdd, PlvalAddPtrInt, nullptr },
-	{ "-", LLVMBuildSub, nullptr, LLVMBuildFSub, PlvalSubPtrInt, PlvalSubPtr },
-	{ "*", LLVMBuildMul, nullptr, LLVMBuildFMul, nullptr, nullptr },
-	{ "/", LLVMBuildSDiv, LLVMBuildUDiv, LLVMBuildFDiv, nullptr, nullptr },
-	{ "%", LLVMBuildSRem, LLVMBuildURem, nullptr, nullptr, nullptr }, // FRem?
-};
+LLVMOpaqueType * PltypeGenerate(SGenerateCtx * pGenx, STypeId tid);
 
-LLVMOpaqueValue * PlvalGenerateBinaryOperator(SGenerateCtx * pGenx, const SGenerateBinaryOperator & gbop, 
-											   SAst * pAstLeft, LLVMOpaqueValue * pLvalLeft, 
-											   SAst * pAstRight, LLVMOpaqueValue * pLvalRight)
+LLVMOpaqueType * PltypeGenerateSoa(SGenerateCtx * pGenx, const SType * pTypeSoa, s64 cColumn, int cCount = 0)
 {
-	auto pLbuilder = pGenx->pLbuilder;
+	// Struct with a column per member of the SOA element struct, see EnsureTypeSize. Each column is an array of 
+	//  cColumn members, or a pointer to members if cColumn < 0, followed by cCount s64 counts.
 
-	TYPEK typekLeft = pAstLeft->tid.pType->typek;
-	TYPEK typekRight = pAstRight->tid.pType->typek;
-	
-	if (gbop.pfngbopPointerAndInt && ((typekLeft == TYPEK_Pointer && typekRight == TYPEK_S64) || 
-									  (typekRight == TYPEK_Pointer && typekLeft == TYPEK_S64)))
-	{
-		if (typekRight == TYPEK_Pointer)
-			Swap(pLvalLeft, pLvalRight);
+	auto pTypestruct = PtypestructSoa(pTypeSoa);
+	int cMember = pTypestruct->cMember;
+	auto apLtype = static_cast<LLVMOpaqueType **>(alloca(sizeof(LLVMOpaqueType *) * (cMember + cCount)));
 
-		return gbop.pfngbopPointerAndInt(pLbuilder, pLvalLeft, pLvalRight, "");
-	}
-	else if (gbop.pfngbopPointer && (typekLeft == TYPEK_Pointer && typekRight == TYPEK_Pointer))
-	{
-		return gbop.pfngbopPointer(pLbuilder, pLvalLeft, pLvalRight, "");
-	}
-	else if (gbop.pfngbopInt && FIsInt(typekLeft))
+	for (int iMember : IterCount(cMember))
 	{
-		if (gbop.pfngbopIntUnsigned && !FSigned(typekLeft))
-		{
-			return gbop.pfngbopIntUnsigned(pLbuilder, pLvalLeft, pLvalRight, "");
-		}
-		else
-		{
-			return gbop.pfngbopInt(pLbuilder, pLvalLeft, pLvalRight, "");
-		}
+		auto pLtypeMember = PltypeGenerate(pGenx, pTypestruct->aMember[iMember].pAstdecl->tid);
+		apLtype[iMember] = (cColumn >= 0) ? LLVMArrayType(pLtypeMember, cColumn) : LLVMPointerType(pLtypeMember, 0);
 	}
-	else if (gbop.pfngbopFloat && FIsFloat(typekLeft))
+
+	for (int iCount : IterCount(cCount))
 	{
-		return gbop.pfngbopFloat(pLbuilder, pLvalLeft, pLvalRight, "");
+		apLtype[cMember + iCount] = LLVMInt64TypeInContext(pGenx->pLctx);
 	}
 
-	return nullptr;
+	return LLVMStructTypeInContext(pGenx->pLctx, apLtype, cMember + cCount, false);
 }
 
-LLVMOpaqueValue * PlvalGenerateBinaryOperator(SGenerateCtx * pGenx, const SGenerateBinaryOperator & gbop, 
-										   SAst * pAstLeft, SAst * pAstRight)
-{
-	auto pLvalLeft = PlvalGenerateRecursive(pGenx, pAstLeft);
-	auto pLvalRight = PlvalGenerateRecursive(pGenx, pAstRight);
-
-	auto pLval = PlvalGenerateBinaryOperator(pGenx, gbop, pAstLeft, pLvalLeft, pAstRight, pLvalRight);
+// Procedures follow the SysV x86-64 C calling convention of s_pChzTargetTriple. Internal procedures use it too so
+//  #foreign procedures and procedure values stay interchangeable. Aggregates up to 16 bytes are split into one or two
+//  eightbyte sized scalars passed in registers, bigger ones go through memory: arguments as byval copies and returns
+//  through an sret pointer the callee stores to. Internal procedures that are only called directly take memory
+//  arguments by reference or as llvm values instead of as byval copies, see ArgpassCompute.
+// BB (adrianb) Win64 passes aggregates that aren't 1, 2, 4 or 8 bytes by reference instead, handle it with other targets.
 
-	ASSERTCHZ(pLval, "Operator %s can't be generated with types %s and %s NYI", 
-			  gbop.pChzOp, StrPrintType(pAstLeft->tid.pType).Pchz(), StrPrintType(pAstRight->tid.pType).Pchz());
+enum ABIK
+{
+	ABIK_Direct,	// Scalars passed as their own llvm type
+	ABIK_Coerce,	// Aggregate passed as eightbyte sized scalars (apLtypeCoerce)
+	ABIK_Memory,	// Aggregate passed by pointer, byval for arguments and sret for returns
+	ABIK_Ignore,	// Nothing passed, i.e. void returns
 
-	return pLval;
-}
+	ABIK_Max,
+	ABIK_Nil = -1,
+};
 
-static const SGenerateBinaryOperator s_aGbopAssign[] =
+enum ABICLS	// Class of one eightbyte of an aggregate
 {
-	// BB (adrianb) Other types?
-	{ "+=", LLVMBuildAdd, nullptr, LLVMBuildFAdd, PlvalAddPtrInt },
-	{ "-=", LLVMBuildSub, nullptr, LLVMBuildFSub },
-	{ "*=", LLVMBuildMul, nullptr, LLVMBuildFMul },
-	{ "/=", LLVMBuildSDiv, LLVMBuildUDiv, LLVMBuildFDiv },
-	{ "%=", LLVMBuildSRem, LLVMBuildURem, nullptr }, // FRem?
+	ABICLS_None,
+	ABICLS_Sse,
+	ABICLS_Integer,	// Wins over sse when an eightbyte holds both
+
+	ABICLS_Max,
+	ABICLS_Nil = -1,
 };
 
-void GenerateBinaryAssignOperator(SGenerateCtx * pGenx, const SGenerateBinaryOperator & gbop, 
-									SAst * pAstLeft, SAst * pAstRight)
+enum ARGPASS	// How an argument the C ABI passes in memory goes to an internal procedure, see ArgpassCompute
 {
-	auto pLbuilder = pGenx->pLbuilder;
-	auto pLvalAddr = PlvalGetLoadStoreAddress(pGenx, pAstLeft);
-	auto pLvalRight = PlvalGenerateRecursive(pGenx, pAstRight);
-	auto pLvalLeft = LLVMBuildLoad(pLbuilder, pLvalAddr, "");
-
-	auto pLvalOp = PlvalGenerateBinaryOperator(pGenx, gbop, pAstLeft, pLvalLeft, pAstRight, pLvalRight);
+	ARGPASS_Byval,				// Byval copy made by the call, as C expects
+	ARGPASS_Reference,			// Pointer to the caller's value, which the callee only reads
+	ARGPASS_CopiedReference,	// Pointer to the caller's value, which the callee copies to a local on entry
+	ARGPASS_Value,				// Llvm value, which llvm passes member by member in registers and on the stack
 
-	ASSERTCHZ(pLvalOp, "Operator %s can't be generated with types %s and %s. NYI?", 
-			  gbop.pChzOp, StrPrintType(pAstLeft->tid.pType).Pchz(), StrPrintType(pAstRight->tid.pType).Pchz());
+	ARGPASS_Max,
+	ARGPASS_Nil = -1,
+};
 
-	LLVMBuildStore(pLbuilder, pLvalOp, pLvalAddr);
-}
+struct SAbiValue
+{
+	ABIK abik;
+	LLVMOpaqueType * pLtype;			// Type of the value itself
+	LLVMOpaqueType * apLtypeCoerce[2];	// ABIK_Coerce scalars, one per eightbyte
+	int cLtypeCoerce;
+	const char * pChzAttrExt;			// ABIK_Direct small integers get signext or zeroext
+	bool fByReference;					// ABIK_Memory argument passed as a plain pointer instead of a byval copy
+	bool fCopiedByCallee;				// fByReference argument the callee modifies, so copies on entry
+};
 
-LLVMOpaqueValue * PlvalConst(SGenerateCtx * pGenx, STypeId tid, const void * pV);
+struct SAbiProc
+{
+	SAbiValue abivalRet;
+	SArray<SAbiValue> aryAbivalArg;
+	int cLtypeParam;				// Parameters of the lowered llvm function, including the sret pointer
+};
 
-LLVMOpaqueValue * PlvalConstStruct(SGenerateCtx * pGenx, const STypeStruct * pTypestruct, LLVMOpaqueType * pLtype, 
-									const u8 * pB)
+LLVMOpaqueType * PltypeGenerateValues(SGenerateCtx * pGenx, const STypeId * aTid, int cTid)
 {
-	auto cMember = pTypestruct->cMember;
-	auto apLvalMember = static_cast<LLVMOpaqueValue **>(alloca(sizeof(LLVMOpaqueValue *) * cMember));
+	// Multiple values (e.g. returns) are one literal struct
 
-	for (int iMember : IterCount(cMember))
+	if (cTid == 0)
+		return LLVMVoidTypeInContext(pGenx->pLctx);
+	if (cTid == 1)
+		return PltypeGenerate(pGenx, aTid[0]);
+
+	auto apLtype = static_cast<LLVMOpaqueType **>(alloca(sizeof(LLVMOpaqueType *) * cTid));
+	for (int iTid : IterCount(cTid))
 	{
-		auto pMember = &pTypestruct->aMember[iMember];
-		apLvalMember[iMember] = PlvalConst(pGenx, pMember->pAstdecl->tid, pB + pMember->iBOffset);
+		apLtype[iTid] = PltypeGenerate(pGenx, aTid[iTid]);
 	}
 
-	return LLVMConstNamedStruct(pLtype, apLvalMember, cMember);
+	return LLVMStructTypeInContext(pGenx->pLctx, apLtype, cTid, false);
 }
 
-LLVMOpaqueValue * PlvalConstStringPtr(SGenerateCtx * pGenx, const char * pChz)
+struct SEightbyte
 {
-    if (pChz == nullptr)
-        return LLVMConstPointerNull(PltypeGenerate(pGenx, TidPointer(pGenx->pWork, pGenx->pWork->tidU8)));
+	ABICLS abicls;
+	u32 iBEnd;		// End of the data in this eightbyte
+	bool fFloat;	// Holds a float, sse eightbytes are a double otherwise
+};
 
-	// Unwrapping LLVMBuildGlobalStringPtr with nothing builder specific so it can be run at global scope
+void ClassifyEightbytes(STypeId tid, u32 iB, SEightbyte * aEightbyte)
+{
+	// Merge the classes of everything in tid (placed at iB) into the eightbytes it overlaps
 
-	// IRBuilder::CreateGlobalString
+	auto pType = tid.pType;
+	ABICLS abicls = ABICLS_Integer;
+	bool fFloat = pType->typek == TYPEK_Float;
+	switch (pType->typek)
+	{
+	case TYPEK_Float:
+	case TYPEK_Double:
+		abicls = ABICLS_Sse;
+		break;
 
-	auto pLvalConstStrData = LLVMConstStringInContext(pGenx->pLctx, pChz, strlen(pChz), false);
-	auto pLvalStrGlobal = LLVMAddGlobal(pGenx->pLmod, LLVMTypeOf(pLvalConstStrData), ".str");
-	LLVMSetGlobalConstant(pLvalStrGlobal, true);
-	LLVMSetLinkage(pLvalStrGlobal, LLVMPrivateLinkage);
-	LLVMSetInitializer(pLvalStrGlobal, pLvalConstStrData);
-	LLVMSetUnnamedAddr(pLvalStrGlobal, true);
+	case TYPEK_Vector:
+		{
+			// BB (adrianb) SSEUP isn't modeled, a 16 byte vector in a struct takes two sse registers instead of one
 
-	// Rest of GlobaStringPtr
+			abicls = ABICLS_Sse;
+			fFloat = PtypeCast<STypeVector>(pType)->tidElement.pType->typek == TYPEK_Float;
+		}
+		break;
 
-	auto pLvalZero = LLVMConstInt(LLVMInt32TypeInContext(pGenx->pLctx), 0, false);
-	LLVMOpaqueValue * apLval[] = { pLvalZero, pLvalZero };
-	return LLVMConstInBoundsGEP(pLvalStrGlobal, apLval, DIM(apLval));
-}
+	case TYPEK_Enum:
+		ClassifyEightbytes(PtypeCast<STypeEnum>(pType)->tidInternal, iB, aEightbyte);
+		return;
 
-LLVMOpaqueValue * PlvalConst(SGenerateCtx * pGenx, STypeId tid, const void * pV)
-{
-	auto pB = static_cast<const u8 *>(pV);
-	TYPEK typek = tid.pType->typek;
-	auto pLtype = PltypeGenerate(pGenx, tid);
-	switch (typek)
-	{
-	case TYPEK_Bool: return LLVMConstInt(pLtype, *static_cast<const bool *>(pV), false);
-	case TYPEK_S8: return LLVMConstInt(pLtype, *static_cast<const s8 *>(pV), true);
-	case TYPEK_S16: return LLVMConstInt(pLtype, *static_cast<const s16 *>(pV), true);
-	case TYPEK_S32: return LLVMConstInt(pLtype, *static_cast<const s32 *>(pV), true);
-	case TYPEK_S64: return LLVMConstInt(pLtype, *static_cast<const s64 *>(pV), true);
-	case TYPEK_U8: return LLVMConstInt(pLtype, *static_cast<const u8 *>(pV), false);
-	case TYPEK_U16: return LLVMConstInt(pLtype, *static_cast<const u16 *>(pV), false);
-	case TYPEK_U32: return LLVMConstInt(pLtype, *static_cast<const u32 *>(pV), false);
-	case TYPEK_U64: return LLVMConstInt(pLtype, *static_cast<const u64 *>(pV), false);
-	case TYPEK_Float: return LLVMConstReal(pLtype, *static_cast<const float *>(pV));
-	case TYPEK_Double: return LLVMConstReal(pLtype, *static_cast<const double *>(pV));
-	
-	case TYPEK_Pointer:
-		if (PtypeCast<STypePointer>(tid.pType)->tidPointedTo.pType->typek == TYPEK_U8)
+	case TYPEK_String:
+	case TYPEK_Struct:
 		{
-			return PlvalConstStringPtr(pGenx, *static_cast<char * const *>(pV));
+			auto pTypestruct = Ptypestruct(pType);
+			for (int iMember : IterCount(pTypestruct->cMember))
+			{
+				auto pMember = &pTypestruct->aMember[iMember];
+				ClassifyEightbytes(pMember->pAstdecl->tid, iB + pMember->iBOffset, aEightbyte);
+			}
+			return;
 		}
-		return LLVMConstPointerNull(pLtype);
-	
+
 	case TYPEK_Array:
 		{
-			// BB (adrianb) This could get ridiculous for large arrays. Initialize those with functionssomehow?
-
-			auto pTypearray = PtypeCast<STypeArray>(tid.pType);
-			if (pTypearray->cSizeFixed < 0)
-				goto LStruct;
+			// Slices, dynamic and SOA arrays are just pointers and counts
 
-			auto cElement = pTypearray->cSizeFixed;
-			auto apLvalElement = static_cast<LLVMOpaqueValue **>(alloca(sizeof(LLVMOpaqueValue *) * cElement));
+			auto pTypearray = PtypeCast<STypeArray>(pType);
+			if (pTypearray->fSoa || pTypearray->cSizeFixed < 0)
+				break;
 
-			int cBElement = CbSizeOf(pTypearray->tidElement);
-			for (int iElement : IterCount(cElement))
+			u32 cBElement = CbSizeOf(pTypearray->tidElement);
+			for (int iElement : IterCount(int(pTypearray->cSizeFixed)))
 			{
-				apLvalElement[iElement] = PlvalConst(pGenx, pTypearray->tidElement, pB + iElement * cBElement);
+				ClassifyEightbytes(pTypearray->tidElement, iB + iElement * cBElement, aEightbyte);
 			}
-
-			return LLVMConstArray(PltypeGenerate(pGenx, pTypearray->tidElement), apLvalElement, cElement);
+			return;
 		}
-		break;
-
-	case TYPEK_String:	
-	case TYPEK_Struct:
-LStruct:
-		return PlvalConstStruct(pGenx, Ptypestruct(tid.pType), pLtype, pB);
 
-	case TYPEK_Enum:
-		return PlvalConst(pGenx, PtypeCast<STypeEnum>(tid.pType)->tidInternal, pB);
+	default:
+		break;
+	}
 
-	case TYPEK_Any:
-	case TYPEK_Void:
-	case TYPEK_Procedure:
-	case TYPEK_TypeOf:
-	case TYPEK_Vararg:
-	case TYPEK_Max:
-	
-	//default:
-		ASSERTCHZ(false, "Can't build constant for %s", StrPrintType(tid).Pchz());
-		return nullptr;
+	u32 iBEnd = iB + CbSizeOf(tid);
+	for (u32 iEightbyte = iB / 8; iEightbyte * 8 < iBEnd; ++iEightbyte)
+	{
+		auto pEightbyte = &aEightbyte[iEightbyte];
+		pEightbyte->abicls = max(pEightbyte->abicls, abicls);
+		pEightbyte->iBEnd = max(pEightbyte->iBEnd, iBEnd - iEightbyte * 8);
+		pEightbyte->fFloat |= fFloat;
 	}
 }
 
-LLVMOpaqueValue * PlvalLoadConst(SGenerateCtx * pGenx, SAst * pAst)
+SAbiValue AbivalCompute(SGenerateCtx * pGenx, const STypeId * aTid, int cTid)
 {
-	void * pVValue = alloca(CbSizeOf(pAst->tid));
-	EvalConst(pGenx->pWork, pAst, pVValue);
-	return PlvalConst(pGenx, pAst->tid, pVValue);
-}
-
+	auto pLctx = pGenx->pLctx;
 
+	SAbiValue abival = {};
+	abival.pLtype = PltypeGenerateValues(pGenx, aTid, cTid);
 
-void MarkScopeTerminated(SGenerateCtx * pGenx)
-{
-	pGenx->fScopeTerminated = true;
-}
+	LLVMTypeKind ltypek = LLVMGetTypeKind(abival.pLtype);
+	if (ltypek == LLVMVoidTypeKind)
+	{
+		abival.abik = ABIK_Ignore;
+		return abival;
+	}
 
-// BB (adrianb) Want a way to detect if we emit any instructions after a return in a basic block so we can error on
-//  said expression. Maybe do an expression level detection? Does that make sense?
+	if (ltypek == LLVMVectorTypeKind && CbSizeOf(aTid[0]) > 16)
+	{
+		// Without avx wider vectors go in memory, same as C's __m256 and __m512
 
-void Branch(SGenerateCtx * pGenx, LLVMOpaqueBasicBlock * pLblock, SAst * pAst)
-{
-	// Don't branch if we've returned or it will count as terminator in middle of basic block
-	// BB (adrianb) Should we be handling this outside branch?
+		abival.abik = ABIK_Memory;
+		return abival;
+	}
 
-	if (pGenx->fScopeTerminated)
+	if (ltypek != LLVMStructTypeKind && ltypek != LLVMArrayTypeKind)
 	{
-		pGenx->fScopeTerminated = false;
-		return;
+		abival.abik = ABIK_Direct;
+
+		STypeId tid = aTid[0];
+		if (tid.pType->typek == TYPEK_Enum)
+			tid = PtypeCast<STypeEnum>(tid.pType)->tidInternal;
+
+		switch (tid.pType->typek)
+		{
+		case TYPEK_S8:
+		case TYPEK_S16:
+			abival.pChzAttrExt = "signext";
+			break;
+
+		case TYPEK_Bool:
+		case TYPEK_U8:
+		case TYPEK_U16:
+			abival.pChzAttrExt = "zeroext";
+			break;
+
+		default:
+			break;
+		}
+
+		return abival;
 	}
 
-	LLVMBuildBr(pGenx->pLbuilder, pLblock);
-}
+	// Lay multiple values out like a struct of them
 
-void PopScope(SGenerateCtx * pGenx, const SScopeCtx & scopectx)
-{
-	ASSERT(scopectx.iScope == pGenx->aryScope.c - 1);
-	auto scope = Tail(&pGenx->aryScope);
-	while (pGenx->arypAstDefer.c > scope.ipAstDeferMic)
+	auto aiB = static_cast<u32 *>(alloca(sizeof(u32) * cTid));
+	u32 cB = 0;
+	u32 cBAlignMax = 1;
+	for (int iTid : IterCount(cTid))
 	{
-		auto pAstDefer = Tail(&pGenx->arypAstDefer);
-		Pop(&pGenx->arypAstDefer);
-		(void) PlvalGenerateRecursive(pGenx, pAstDefer);
+		u32 cBAlign = CbAlignOf(aTid[iTid]);
+		cBAlignMax = max(cBAlignMax, cBAlign);
+		cB = CbAlign(cB, cBAlign);
+		aiB[iTid] = cB;
+		cB += CbSizeOf(aTid[iTid]);
 	}
-	Pop(&pGenx->aryScope);
-}
+	cB = CbAlign(cB, cBAlignMax);
 
-void EarlyPopScopes(SGenerateCtx * pGenx, int iScope)
-{
-	int ipAstMic = (iScope >= 0) ? pGenx->aryScope[iScope].ipAstDeferMic : 0;
+	if (cB == 0 || cB > 16)
+	{
+		abival.abik = ABIK_Memory;
+		return abival;
+	}
 
-	for (int ipAst : IterCount(pGenx->arypAstDefer.c - ipAstMic))
+	SEightbyte aEightbyte[2] = {};
+	for (int iTid : IterCount(cTid))
 	{
-		auto pAstDefer = Tail(&pGenx->arypAstDefer, ipAst);
-		(void) PlvalGenerateRecursive(pGenx, pAstDefer);
+		ClassifyEightbytes(aTid[iTid], aiB[iTid], aEightbyte);
 	}
-}
 
-void EarlyReturnPopScopes(SGenerateCtx * pGenx)
-{
-	EarlyPopScopes(pGenx, -1);
-}
+	// Integer eightbytes are integers up to the end of the aggregate, sse ones are a double, two floats or one float
 
-LLVMOpaqueValue * PlvalGenerateConstant(SGenerateCtx * pGenx, SAst * pAst)
-{
-	ASTK astk = pAst->astk;
-	switch (astk)
+	abival.abik = ABIK_Coerce;
+	abival.cLtypeCoerce = (cB + 7) / 8;
+	for (int iEightbyte : IterCount(abival.cLtypeCoerce))
+	{
+		auto pEightbyte = &aEightbyte[iEightbyte];
+		LLVMOpaqueType * pLtypeCoerce;
+		if (pEightbyte->abicls == ABICLS_Sse && pEightbyte->iBEnd <= 4)
+		{
+			pLtypeCoerce = LLVMFloatTypeInContext(pLctx);
+		}
+		else if (pEightbyte->abicls == ABICLS_Sse && pEightbyte->fFloat)
+		{
+			pLtypeCoerce = LLVMVectorType(LLVMFloatTypeInContext(pLctx), 2);
+		}
+		else if (pEightbyte->abicls == ABICLS_Sse)
+		{
+			pLtypeCoerce = LLVMDoubleTypeInContext(pLctx);
+		}
+		else
+		{
+			u32 cBInt = cB - iEightbyte * 8;
+			pLtypeCoerce = LLVMIntTypeInContext(pLctx, ((cBInt < 8) ? cBInt : 8) * 8);
+		}
+
+		abival.apLtypeCoerce[iEightbyte] = pLtypeCoerce;
+	}
+
+	return abival;
+}
+
+ARGPASS ArgpassCompute(const SAstProcedure * pAstproc, int iArg)
+{
+	// Byval copies are only needed for procedures called through procedure values or from C. Internal procedures
+	//  that are always called directly take arguments they only read by reference (like a const reference in C++).
+	//  Arguments they modify (like returning an updated copy of it) need a copy of their own: small ones are passed as
+	//  llvm values like before the C ABI lowering, since the callee can then keep them in registers, bigger ones are
+	//  copied by the callee where llvm would pass every member separately.
+
+	static const u32 s_cBArgValueMax = 64;
+
+	if (!pAstproc || pAstproc->fIsForeign || pAstproc->fIsValue || iArg >= pAstproc->arypAstDeclArg.c)
+		return ARGPASS_Byval;
+
+	auto pAstdecl = PastCast<SAstDeclareSingle>(pAstproc->arypAstDeclArg[iArg]);
+	if (!pAstdecl->tid.pType || pAstdecl->tid.pType->typek == TYPEK_Vararg)
+		return ARGPASS_Byval;
+
+	if (!pAstdecl->fIsModified)
+		return ARGPASS_Reference;
+
+	return (CbSizeOf(pAstdecl->tid) <= s_cBArgValueMax) ? ARGPASS_Value : ARGPASS_CopiedReference;
+}
+
+u64 GrfArgReference(const SAstProcedure * pAstproc)
+{
+	// ARGPASS of each argument (two bits each), for codegen cache keys since callers depend on it too
+
+	u64 grf = 0;
+	for (int iArg = 0; iArg < pAstproc->arypAstDeclArg.c && iArg < 32; ++iArg)
+	{
+		grf |= u64(ArgpassCompute(pAstproc, iArg)) << (iArg * 2);
+	}
+
+	return grf;
+}
+
+void ComputeAbiproc(SGenerateCtx * pGenx, const STypeProcedure * pTypeproc, const STypeId * aTidArg, int cTidArg, 
+					SAbiProc * pAbiproc, const SAstProcedure * pAstproc = nullptr)
+{
+	// aTidArg can have more arguments than pTypeproc for calls to C vararg procedures. pAstproc is the procedure when
+	//  it's known (its definition or a direct call), see ArgpassCompute.
+
+	pAbiproc->abivalRet = AbivalCompute(pGenx, pTypeproc->aTidRet, pTypeproc->cTidRet);
+	pAbiproc->cLtypeParam = (pAbiproc->abivalRet.abik == ABIK_Memory);
+
+	// Aggregates only use registers if all their eightbytes fit, otherwise they're passed in memory
+
+	int cGprFree = 6 - pAbiproc->cLtypeParam;
+	int cSseFree = 8;
+
+	for (int iTid : IterCount(cTidArg))
+	{
+		auto pAbival = PtAppendNew(&pAbiproc->aryAbivalArg);
+		*pAbival = AbivalCompute(pGenx, &aTidArg[iTid], 1);
+
+		int cGpr = 0;
+		int cSse = 0;
+		if (pAbival->abik == ABIK_Direct)
+		{
+			LLVMTypeKind ltypek = LLVMGetTypeKind(pAbival->pLtype);
+			if (ltypek == LLVMFloatTypeKind || ltypek == LLVMDoubleTypeKind || ltypek == LLVMVectorTypeKind)
+				++cSse;
+			else
+				++cGpr;
+		}
+		else if (pAbival->abik == ABIK_Coerce)
+		{
+			for (int iLtype : IterCount(pAbival->cLtypeCoerce))
+			{
+				if (LLVMGetTypeKind(pAbival->apLtypeCoerce[iLtype]) == LLVMIntegerTypeKind)
+					++cGpr;
+				else
+					++cSse;
+			}
+
+			if (cGpr > cGprFree || cSse > cSseFree)
+			{
+				pAbival->abik = ABIK_Memory;
+				cGpr = cSse = 0;
+			}
+		}
+
+		cGprFree = max(0, cGprFree - cGpr);
+		cSseFree = max(0, cSseFree - cSse);
+		pAbiproc->cLtypeParam += (pAbival->abik == ABIK_Coerce) ? pAbival->cLtypeCoerce : 1;
+
+		if (pAbival->abik != ABIK_Memory)
+			continue;
+
+		switch (ArgpassCompute(pAstproc, iTid))
+		{
+		case ARGPASS_Reference:
+			pAbival->fByReference = true;
+			break;
+
+		case ARGPASS_CopiedReference:
+			pAbival->fByReference = true;
+			pAbival->fCopiedByCallee = true;
+			break;
+
+		case ARGPASS_Value:
+			pAbival->abik = ABIK_Direct;
+			break;
+
+		default:
+			break;
+		}
+	}
+}
+
+void Destroy(SAbiProc * pAbiproc)
+{
+	Destroy(&pAbiproc->aryAbivalArg);
+}
+
+LLVMOpaqueType * PltypeCoerced(SGenerateCtx * pGenx, const SAbiValue * pAbival)
+{
+	ASSERT(pAbival->abik == ABIK_Coerce);
+	if (pAbival->cLtypeCoerce == 1)
+		return pAbival->apLtypeCoerce[0];
+
+	auto apLtype = const_cast<LLVMOpaqueType **>(pAbival->apLtypeCoerce);
+	return LLVMStructTypeInContext(pGenx->pLctx, apLtype, pAbival->cLtypeCoerce, false);
+}
+
+LLVMOpaqueType * PltypeLowerProcedure(SGenerateCtx * pGenx, const STypeProcedure * pTypeproc, const SAbiProc * pAbiproc)
+{
+	auto pAbivalRet = &pAbiproc->abivalRet;
+	LLVMOpaqueType * pLtypeRet;
+	switch (pAbivalRet->abik)
+	{
+	case ABIK_Direct: pLtypeRet = pAbivalRet->pLtype; break;
+	case ABIK_Coerce: pLtypeRet = PltypeCoerced(pGenx, pAbivalRet); break;
+	default: pLtypeRet = LLVMVoidTypeInContext(pGenx->pLctx); break;
+	}
+
+	auto apLtypeParam = static_cast<LLVMOpaqueType **>(alloca(sizeof(LLVMOpaqueType *) * pAbiproc->cLtypeParam));
+	int cLtypeParam = 0;
+	if (pAbivalRet->abik == ABIK_Memory)
+		apLtypeParam[cLtypeParam++] = LLVMPointerType(pAbivalRet->pLtype, 0);
+
+	for (const SAbiValue & abival : pAbiproc->aryAbivalArg)
+	{
+		switch (abival.abik)
+		{
+		case ABIK_Direct:
+			apLtypeParam[cLtypeParam++] = abival.pLtype;
+			break;
+
+		case ABIK_Coerce:
+			for (int iLtype : IterCount(abival.cLtypeCoerce))
+			{
+				apLtypeParam[cLtypeParam++] = abival.apLtypeCoerce[iLtype];
+			}
+			break;
+
+		default:
+			apLtypeParam[cLtypeParam++] = LLVMPointerType(abival.pLtype, 0);
+			break;
+		}
+	}
+
+	ASSERT(cLtypeParam == pAbiproc->cLtypeParam);
+	return LLVMFunctionType(pLtypeRet, apLtypeParam, cLtypeParam, pTypeproc->fUsesCVararg);
+}
+
+LLVMOpaqueType * PltypeGenerate(SGenerateCtx * pGenx, STypeId tid)
+{
+	auto pWork = pGenx->pWork;
+	auto pType = tid.pType;
+	if (pType == nullptr)
+		return {};
+
+	auto pLctx = pGenx->pLctx;
+
+	TYPEK typek = pType->typek;
+	switch (typek)
+	{
+	case TYPEK_Void: return LLVMVoidTypeInContext(pLctx);
+	case TYPEK_Bool: return LLVMInt1TypeInContext(pLctx); // Bool is just int1 in llvm
+	case TYPEK_S8: return LLVMInt8TypeInContext(pLctx);
+	case TYPEK_S16: return LLVMInt16TypeInContext(pLctx);
+	case TYPEK_S32: return LLVMInt32TypeInContext(pLctx);
+	case TYPEK_S64: return LLVMInt64TypeInContext(pLctx);
+	case TYPEK_U8: return LLVMInt8TypeInContext(pLctx); // Unsigned is not part of LLVM (must sext/zext explicitly)
+	case TYPEK_U16: return LLVMInt16TypeInContext(pLctx);
+	case TYPEK_U32: return LLVMInt32TypeInContext(pLctx);
+	case TYPEK_U64: return LLVMInt64TypeInContext(pLctx);
+	case TYPEK_Float: return LLVMFloatTypeInContext(pLctx);
+	case TYPEK_Double: return LLVMDoubleTypeInContext(pLctx);
+
+	case TYPEK_Pointer: 
+		{
+			auto pTypeptr = PtypeCast<STypePointer>(pType);
+			if (pTypeptr->fSoa)
+				return PltypeGenerateSoa(pGenx, pTypeptr, -1);
+
+			if (pTypeptr->tidPointedTo.pType->typek == TYPEK_Void)
+				return LLVMPointerType(LLVMInt8TypeInContext(pLctx), 0);
+			return LLVMPointerType(PltypeGenerate(pGenx, pTypeptr->tidPointedTo), 0);
+		}
+            
+	case TYPEK_String:
+	case TYPEK_Struct:
+		return PltypeLookupStruct(pGenx, Ptypestruct(pType));
+
+	case TYPEK_Array:
+		{
+			// BB (adrianb) Have non-anonymous struct for an array type?
+
+			auto pTypearray = PtypeCast<STypeArray>(pType);
+			if (pTypearray->fSoa)
+			{
+				if (pTypearray->cSizeFixed >= 0)
+				{
+					auto pLtypeChunk = PltypeGenerateSoa(pGenx, pTypearray, CSoaChunk(pTypearray));
+					return LLVMArrayType(pLtypeChunk, CChunkSoa(pTypearray));
+				}
+
+				return PltypeGenerateSoa(pGenx, pTypearray, -1, (pTypearray->fDynamicallySized) ? 2 : 1);
+			}
+			else if (pTypearray->cSizeFixed >= 0)
+			{
+				ASSERT(!pTypearray->fDynamicallySized);
+				return LLVMArrayType(PltypeGenerate(pGenx, pTypearray->tidElement), pTypearray->cSizeFixed);
+			}
+			else if (pTypearray->fDynamicallySized)
+			{
+				auto pLtypePtr = PltypeGenerate(pGenx, TidPointer(pWork, pTypearray->tidElement));
+				LLVMOpaqueType * apLtype[] = { pLtypePtr, LLVMInt64TypeInContext(pGenx->pLctx), LLVMInt64TypeInContext(pGenx->pLctx) };
+				return LLVMStructTypeInContext(pGenx->pLctx, apLtype, DIM(apLtype), false);
+			}
+			else
+			{
+				auto pLtypePtr = PltypeGenerate(pGenx, TidPointer(pWork, pTypearray->tidElement));
+				LLVMOpaqueType * apLtype[] = { pLtypePtr, LLVMInt64TypeInContext(pGenx->pLctx) };
+				return LLVMStructTypeInContext(pGenx->pLctx, apLtype, DIM(apLtype), false);
+			}
+		}
+
+	case TYPEK_Procedure:
+		{
+			// Functions take and return their values lowered to the C ABI (see ComputeAbiproc)
+
+			auto pTypeproc = PtypeCast<STypeProcedure>(pType);
+
+			SAbiProc abiproc = {};
+			defer { Destroy(&abiproc); };
+			ComputeAbiproc(pGenx, pTypeproc, pTypeproc->aTidArg, pTypeproc->cTidArg, &abiproc);
+
+			// Procedure values are function pointers, see PlvalEnsureProcedure for the functions themselves
+
+			auto pLtypeFunc = PltypeLowerProcedure(pGenx, pTypeproc, &abiproc);
+			return LLVMPointerType(pLtypeFunc, 0);
+		}
+
+	case TYPEK_Enum:
+		return PltypeGenerate(pGenx, PtypeCast<STypeEnum>(pType)->tidInternal);
+
+	case TYPEK_Vector:
+		{
+			auto pTypevec = PtypeCast<STypeVector>(pType);
+			return LLVMVectorType(PltypeGenerate(pGenx, pTypevec->tidElement), pTypevec->cElement);
+		}
+
+	case TYPEK_Any:
+	case TYPEK_TypeOf:
+	case TYPEK_Vararg:
+	case TYPEK_Nil:
+	case TYPEK_Max:
+	// default:
+		ASSERTCHZ(false, "Type generation for %s(%d) NYI", PchzFromTypek(typek), typek);
+		return LLVMTypeRef{};
+	}
+}
+
+SGlobal * PglobalAdd(SWorkspace * pWork, SAst * pAstSource, STypeId tid);
+
+#if 0
+SProcedure * PprocEnsure(SWorkspace * pWork, SAstProcedure * pAstproc)
+{
+	auto hv = HvFromKey(reinterpret_cast<u64>(pAstproc));
+	auto ppProc = PtLookupImpl(&pWork->hashPastprocPproc, hv, pAstproc);
+	if (ppProc)
+		return *ppProc;
+
+	auto pProc = PtAlloc<SProcedure>(&pWork->pagealloc);
+	pProc->pAstproc = pAstproc;
+	auto pGlobal = PglobalAdd(pWork, pAstproc, pAstproc->tid);
+	pGlobal->fProcedure = true;
+	pGlobal->pProc = pProc;
+
+	pProc->reg = pGlobal->reg;
+
+	Add(&pWork->hashPastprocPproc, hv, pAstproc, pProc);
+
+	return pProc;
+}
+#endif
+
+LLVMOpaqueValue * PlvalConstS32(SGenerateCtx * pGenx, int n)
+{
+	return LLVMConstInt(LLVMInt32TypeInContext(pGenx->pLctx), n, true);
+}
+
+LLVMOpaqueValue * PlvalConstU32(SGenerateCtx * pGenx, u32 n)
+{
+	return LLVMConstInt(LLVMInt32TypeInContext(pGenx->pLctx), n, false);
+}
+
+LLVMOpaqueValue * PlvalConstS64(SGenerateCtx * pGenx, s64 n)
+{
+	return LLVMConstInt(LLVMInt64TypeInContext(pGenx->pLctx), n, true);
+}
+
+LLVMOpaqueValue * PlvalConstU64(SGenerateCtx * pGenx, u64 n)
+{
+	return LLVMConstInt(LLVMInt64TypeInContext(pGenx->pLctx), n, false);
+}
+
+LLVMOpaqueValue * PlvalBuildStruct(SGenerateCtx * pGenx, LLVMOpaqueType * pLtype, LLVMOpaqueValue ** apLval, int cpLval)
+{
+	// BB (adrianb) Clang treats structs somewhat differently. It builds this by storing values into a stack location.
+	//  It initializes constants by storing in a global and calling @llvm.memcpy.p0i8.p0i8.i64 or so.
+	//  Similarly struct assignment runs through @llvm.memcpy.p0i8.p0i8.i64.
+	// !!! (adrianb) Clang has BIZARRE behavior wrt returning structs:
+	//  return a Vector{float x; floaty;} -> return <2 x float>
+	//  return a Vector{float x; int y;} -> cast to i64* and return i64!?
+	//  return a Vector{float x; float y; int z;} -> return { <float x 2>, i32 }
+	//  This is totally arcane even for optimization purposes.
+
+	LLVMOpaqueValue * pLvalStruct = LLVMGetUndef(pLtype);
+	ASSERT(LLVMCountStructElementTypes(pLtype) == u32(cpLval));
+	for (int ipLval : IterCount(cpLval))
+	{
+		pLvalStruct = LLVMBuildInsertValue(pGenx->pLbuilder, pLvalStruct, apLval[ipLval], ipLval, "");
+	}
+	return pLvalStruct;
+}
+
+void GetMemberAddress(SGenerateCtx * pGenx, const char * pChzName, 
+						LLVMOpaqueValue ** ppLvalPtr, STypeId * pTidPointedTo, SAst * pAstErr)
+{
+	auto pLbuilder = pGenx->pLbuilder;
+
+	if (pTidPointedTo->pType->typek == TYPEK_Pointer)
+	{
+		*ppLvalPtr = LLVMBuildLoad(pLbuilder, *ppLvalPtr, "");
+		*pTidPointedTo = PtypeCast<STypePointer>(pTidPointedTo->pType)->tidPointedTo;
+	}
+
+	const STypeStruct * pTypestruct = Ptypestruct(pTidPointedTo->pType);
+
+	if (pTidPointedTo->pType->typek == TYPEK_Array)
+	{
+		auto pTypearray = PtypeCast<STypeArray>(pTidPointedTo->pType);
+		if (pTypearray->fSoa && pTypearray->cSizeFixed < 0)
+		{
+			// Counts follow the column pointers
+
+			bool fIsCMax = strcmp(pChzName, "cMax") == 0;
+			ASSERT(fIsCMax || strcmp(pChzName, "c") == 0);
+			*ppLvalPtr = LLVMBuildStructGEP(pLbuilder, *ppLvalPtr, PtypestructSoa(pTypearray)->cMember + fIsCMax, "");
+			*pTidPointedTo = pGenx->pWork->tidS64;
+			return;
+		}
+
+        if (pTypearray->cSizeFixed >= 0)
+		{
+			ASSERT(strcmp(pChzName, "a") == 0);
+			*ppLvalPtr = LLVMBuildStructGEP(pLbuilder, *ppLvalPtr, 0, "");
+			*pTidPointedTo = pTypearray->tidElement;
+			return;
+		}
+	}
+
+	EnsureTypeSize(pTypestruct);
+
+	for (int iMember = 0;; ++iMember)
+	{
+		if (iMember >= pTypestruct->cMember)
+            break;
+
+		auto pAstdeclMember = pTypestruct->aMember[iMember].pAstdecl;
+		if (strcmp(pChzName, pAstdeclMember->pChzName) != 0)
+			continue;
+
+		*ppLvalPtr = LLVMBuildStructGEP(pLbuilder, *ppLvalPtr, iMember, "");
+		*pTidPointedTo = pTypestruct->aMember[iMember].pAstdecl->tid;
+        return;
+	}
+
+	ShowErr(pAstErr->errinfo, "Couldn't find member %s of %s", pChzName, StrPrintType(pTypestruct).Pchz());
+	*ppLvalPtr = nullptr;
+	*pTidPointedTo = {};
+}
+
+LLVMOpaqueAttributeRef * PlattrEnum(SGenerateCtx * pGenx, const char * pChzAttr)
+{
+	unsigned nKind = LLVMGetEnumAttributeKindForName(pChzAttr, strlen(pChzAttr));
+	ASSERTCHZ(nKind != 0, "Unknown llvm attribute %s", pChzAttr);
+	return LLVMCreateEnumAttribute(pGenx->pLctx, nKind, 0);
+}
+
+void AddAbiAttribute(SGenerateCtx * pGenx, LLVMOpaqueValue * pLval, unsigned iLattr, LLVMOpaqueAttributeRef * pLattr)
+{
+	// pLval is a function or a call to one
+
+	if (LLVMIsACallInst(pLval))
+		LLVMAddCallSiteAttribute(pLval, iLattr, pLattr);
+	else
+		LLVMAddAttributeAtIndex(pLval, iLattr, pLattr);
+}
+
+void AddAbiAttributes(SGenerateCtx * pGenx, const SAbiProc * pAbiproc, LLVMOpaqueValue * pLval)
+{
+	auto pLctx = pGenx->pLctx;
+	auto pAbivalRet = &pAbiproc->abivalRet;
+	if (pAbivalRet->pChzAttrExt)
+		AddAbiAttribute(pGenx, pLval, LLVMAttributeReturnIndex, PlattrEnum(pGenx, pAbivalRet->pChzAttrExt));
+
+	// Parameter attributes are numbered from 1
+
+	unsigned iLattr = 1;
+	if (pAbivalRet->abik == ABIK_Memory)
+	{
+		unsigned nKindSret = LLVMGetEnumAttributeKindForName("sret", 4);
+		AddAbiAttribute(pGenx, pLval, iLattr, LLVMCreateTypeAttribute(pLctx, nKindSret, pAbivalRet->pLtype));
+		AddAbiAttribute(pGenx, pLval, iLattr, PlattrEnum(pGenx, "noalias"));
+		++iLattr;
+	}
+
+	for (const SAbiValue & abival : pAbiproc->aryAbivalArg)
+	{
+		switch (abival.abik)
+		{
+		case ABIK_Direct:
+			if (abival.pChzAttrExt)
+				AddAbiAttribute(pGenx, pLval, iLattr, PlattrEnum(pGenx, abival.pChzAttrExt));
+			++iLattr;
+			break;
+
+		case ABIK_Coerce:
+			iLattr += abival.cLtypeCoerce;
+			break;
+
+		default:
+			if (abival.fByReference)
+			{
+				++iLattr;
+			}
+			else
+			{
+				// Byval copies live on the stack, which is 8 byte aligned
+
+				unsigned nKindByval = LLVMGetEnumAttributeKindForName("byval", 5);
+				unsigned nKindAlign = LLVMGetEnumAttributeKindForName("align", 5);
+				AddAbiAttribute(pGenx, pLval, iLattr, LLVMCreateTypeAttribute(pLctx, nKindByval, abival.pLtype));
+				AddAbiAttribute(pGenx, pLval, iLattr, LLVMCreateEnumAttribute(pLctx, nKindAlign, 8));
+				++iLattr;
+			}
+			break;
+		}
+	}
+}
+
+LLVMOpaqueValue * PlvalEnsureProcedure(SGenerateCtx * pGenx, SAstProcedure * pAstproc)
+{
+	auto hv = HvFromKey(reinterpret_cast<u64>(pAstproc));
+	LLVMOpaqueValue ** ppLval = PtLookupImpl(&pGenx->hashPastprocPlval, hv, pAstproc);
+	if (ppLval)
+		return *ppLval;
+
+	ASSERT(pAstproc->tid.pType && pAstproc->tid.pType->typek == TYPEK_Procedure);
+
+	// Lowered from the procedure itself rather than its type, since arguments passed as values change the signature 
+	//  (see ArgpassCompute)
+
+	auto pTypeproc = PtypeCast<STypeProcedure>(pAstproc->tid.pType);
+	SAbiProc abiproc = {};
+	defer { Destroy(&abiproc); };
+	ComputeAbiproc(pGenx, pTypeproc, pTypeproc->aTidArg, pTypeproc->cTidArg, &abiproc, pAstproc);
+	LLVMOpaqueType * pLtypeProc = PltypeLowerProcedure(pGenx, pTypeproc, &abiproc);
+
+	auto pChzName = (pAstproc->pChzLink) ? pAstproc->pChzLink : pAstproc->pChzName;
+
+	// Foreign procedures may already be declared (e.g. realloc for dynamic arrays), possibly with other types
+
+	auto pLvalProcPrev = (pAstproc->fIsForeign) ? LLVMGetNamedFunction(pGenx->pLmod, pChzName) : nullptr;
+	if (pLvalProcPrev)
+	{
+		if (LLVMGetElementType(LLVMTypeOf(pLvalProcPrev)) != pLtypeProc)
+			pLvalProcPrev = LLVMConstBitCast(pLvalProcPrev, LLVMPointerType(pLtypeProc, 0));
+
+		Add(&pGenx->hashPastprocPlval, hv, pAstproc, pLvalProcPrev);
+		return pLvalProcPrev;
+	}
+
+	auto pLvalProc = LLVMAddFunction(pGenx->pLmod, pChzName, pLtypeProc);
+	AddAbiAttributes(pGenx, &abiproc, pLvalProc);
+	
+	// BB (adrianb) If it comes from a separate module mark as external?
+	//  Or just emit all bitcode into one translation unit? Doesn't seem like there's any advantage to
+	//  separate modules with typechecking walking all over the place.
+
+	if (pAstproc->fIsForeign)
+		LLVMSetLinkage(pLvalProc, LLVMExternalLinkage);
+
+	if (pAstproc->fIsInline || pAstproc->fIsNoInline)
+	{
+		auto pChzAttr = (pAstproc->fIsInline) ? "alwaysinline" : "noinline";
+		LLVMAddAttributeAtIndex(pLvalProc, LLVMAttributeFunctionIndex, PlattrEnum(pGenx, pChzAttr));
+	}
+
+	Add(&pGenx->hashPastprocPlval, hv, pAstproc, pLvalProc);
+	return pLvalProc;
+}
+
+LLVMOpaqueValue * PlvalCoercedAddress(SGenerateCtx * pGenx, const SAbiValue * pAbival, LLVMOpaqueValue * pLvalPtr)
+{
+	// Address of a value (of its own type) as the struct of its eightbyte scalars
+
+	auto apLtype = const_cast<LLVMOpaqueType **>(pAbival->apLtypeCoerce);
+	auto pLtypeCoerce = LLVMStructTypeInContext(pGenx->pLctx, apLtype, pAbival->cLtypeCoerce, false);
+	return LLVMBuildBitCast(pGenx->pLbuilder, pLvalPtr, LLVMPointerType(pLtypeCoerce, 0), "");
+}
+
+void LoadCoerced(SGenerateCtx * pGenx, const SAbiValue * pAbival, LLVMOpaqueValue * pLvalPtr, LLVMOpaqueValue ** apLval)
+{
+	auto pLvalCoerce = PlvalCoercedAddress(pGenx, pAbival, pLvalPtr);
+	for (int iLval : IterCount(pAbival->cLtypeCoerce))
+	{
+		auto pLvalPiece = LLVMBuildStructGEP(pGenx->pLbuilder, pLvalCoerce, iLval, "");
+		apLval[iLval] = LLVMBuildLoad(pGenx->pLbuilder, pLvalPiece, "");
+	}
+}
+
+void StoreCoerced(SGenerateCtx * pGenx, const SAbiValue * pAbival, LLVMOpaqueValue ** apLval, LLVMOpaqueValue * pLvalPtr)
+{
+	auto pLvalCoerce = PlvalCoercedAddress(pGenx, pAbival, pLvalPtr);
+	for (int iLval : IterCount(pAbival->cLtypeCoerce))
+	{
+		auto pLvalPiece = LLVMBuildStructGEP(pGenx->pLbuilder, pLvalCoerce, iLval, "");
+		LLVMBuildStore(pGenx->pLbuilder, apLval[iLval], pLvalPiece);
+	}
+}
+
+LLVMOpaqueValue * PlvalGetLoadStoreAddress(SGenerateCtx * pGenx, SAst * pAst);
+
+LLVMOpaqueValue * PlvalVariableAddress(SGenerateCtx * pGenx, SAst * pAst)
+{
+	// Address of a variable, so aggregates passed in memory can be copied from it directly instead of loaded and 
+	//  stored again (llvm splits those per element). Null for anything else.
+
+	if (pAst->astk != ASTK_Identifier || PresdeclResolved(pGenx->pWork, pAst)->pDecl->pAstdecl->fIsConstant)
+		return nullptr;
+
+	return PlvalGetLoadStoreAddress(pGenx, pAst);
+}
+
+bool FIsUnaliasedLocal(SGenerateCtx * pGenx, SAst * pAstIdent)
+{
+	// Locals (arguments too) whose address is never taken can only change by name, so not during a call
+
+	auto pResdecl = PresdeclResolved(pGenx->pWork, pAstIdent);
+	if (!pResdecl || pResdecl->arypDeclUsingPath.c)
+		return false;
+
+	auto pAstdecl = pResdecl->pDecl->pAstdecl;
+	if (!pAstdecl || pAstdecl->fIsAddressed)
+		return false;
+
+	auto hv = HvFromKey(reinterpret_cast<u64>(pAstdecl));
+	return !PtLookupImpl(&pGenx->setPastdeclGlobal, hv, pAstdecl);
+}
+
+LLVMOpaqueValue * PlvalAbiTemp(SGenerateCtx * pGenx, const SAbiValue * pAbival, const char * pChzName)
+{
+	// Stack copy of a value passed through memory or coerced, aligned for byval
+
+	auto pLvalPtr = LLVMBuildAlloca(pGenx->pLbuilderAlloc, pAbival->pLtype, pChzName);
+	LLVMSetAlignment(pLvalPtr, max(8u, LLVMGetAlignment(pLvalPtr)));
+	return pLvalPtr;
+}
+
+bool FIsSsaLocal(SGenerateCtx * pGenx, SAstDeclareSingle * pAstdecl)
+{
+	// Scalars and vectors that are never modified or addressed are just their initial value, they need no alloca,
+	//  stores or loads (which mem2reg would only clean up with optimizations on)
+
+	if (pAstdecl->fIsModified || pAstdecl->fUsing)
+		return false;
+
+	switch (LLVMGetTypeKind(PltypeGenerate(pGenx, pAstdecl->tid)))
+	{
+	case LLVMIntegerTypeKind:
+	case LLVMFloatTypeKind:
+	case LLVMDoubleTypeKind:
+	case LLVMPointerTypeKind:
+	case LLVMVectorTypeKind:
+		return true;
+
+	default:
+		return false;
+	}
+}
+
+void GenerateLocal(SGenerateCtx * pGenx, SAstDeclareSingle * pAstdecl, LLVMValueRef pLvalInitial)
+{
+	if (FIsSsaLocal(pGenx, pAstdecl))
+	{
+		size_t cCh;
+		if (LLVMIsAInstruction(pLvalInitial) && *LLVMGetValueName2(pLvalInitial, &cCh) == '\0')
+			LLVMSetValueName2(pLvalInitial, pAstdecl->pChzName, strlen(pAstdecl->pChzName));
+
+		RegisterStorage(pGenx, pAstdecl, nullptr, pLvalInitial);
+		return;
+	}
+
+	auto pLvalPtr = LLVMBuildAlloca(pGenx->pLbuilderAlloc, PltypeGenerate(pGenx, pAstdecl->tid), pAstdecl->pChzName);
+	LLVMBuildStore(pGenx->pLbuilder, pLvalInitial, pLvalPtr);
+	RegisterStorage(pGenx, pAstdecl, pLvalPtr);
+}
+
+LLVMOpaqueValue * PlvalGenerateRecursive(SGenerateCtx * pGenx, SAst * pAst);
+
+void GenerateSoaArrayAddresses(SGenerateCtx * pGenx, const STypeArray * pTypearray, LLVMOpaqueValue * pLvalArray, 
+								LLVMOpaqueValue * pLvalIndex, LLVMOpaqueValue ** apLvalAddr, int iMemberOnly = -1)
+{
+	// pLvalArray is the address of fixed size arrays, or the loaded column pointers otherwise
+
+	auto pLbuilder = pGenx->pLbuilder;
+
+	// Fixed size arrays split the index into a chunk and an index in the chunk's columns
+
+	LLVMOpaqueValue * pLvalChunk = PlvalConstU64(pGenx, 0);
+	LLVMOpaqueValue * pLvalInChunk = pLvalIndex;
+	if (pTypearray->cSizeFixed >= 0 && pTypearray->cSoaChunk > 0)
+	{
+		auto pLvalSoaChunk = PlvalConstU64(pGenx, pTypearray->cSoaChunk);
+		pLvalChunk = LLVMBuildUDiv(pLbuilder, pLvalIndex, pLvalSoaChunk, "");
+		pLvalInChunk = LLVMBuildURem(pLbuilder, pLvalIndex, pLvalSoaChunk, "");
+	}
+
+	for (int iMember : IterCount(PtypestructSoa(pTypearray)->cMember))
+	{
+		if (iMemberOnly >= 0 && iMember != iMemberOnly)
+			continue;
+
+		if (pTypearray->cSizeFixed >= 0)
+		{
+			LLVMOpaqueValue * apLvalGEP[] = 
+				{ PlvalConstS32(pGenx, 0), pLvalChunk, PlvalConstS32(pGenx, iMember), pLvalInChunk };
+			apLvalAddr[iMember] = LLVMBuildGEP(pLbuilder, pLvalArray, apLvalGEP, DIM(apLvalGEP), "");
+		}
+		else
+		{
+			auto pLvalColumn = LLVMBuildExtractValue(pLbuilder, pLvalArray, iMember, "");
+			apLvalAddr[iMember] = LLVMBuildGEP(pLbuilder, pLvalColumn, &pLvalIndex, 1, "");
+		}
+	}
+}
+
+void GenerateSoaMemberAddresses(SGenerateCtx * pGenx, SAst * pAstSoa, LLVMOpaqueValue ** apLvalAddr, 
+								int iMemberOnly = -1)
+{
+	// Member addresses of an SOA element (see FIsSoaElement) or of what an SOA pointer points to. Fills in every 
+	//  member, or just iMemberOnly if it's >= 0.
+
+	auto pLbuilder = pGenx->pLbuilder;
+
+	if (!FIsSoaPointer(pAstSoa->tid) && pAstSoa->astk == ASTK_Operator)
+	{
+		ASSERT(PastCast<SAstOperator>(pAstSoa)->op == OP_ShiftLeft);
+		pAstSoa = PastCast<SAstOperator>(pAstSoa)->pAstRight;
+	}
+
+	if (FIsSoaPointer(pAstSoa->tid))
+	{
+		auto pLvalPtr = PlvalGenerateRecursive(pGenx, pAstSoa);
+		for (int iMember : IterCount(PtypestructSoa(pAstSoa->tid.pType)->cMember))
+		{
+			if (iMemberOnly < 0 || iMember == iMemberOnly)
+				apLvalAddr[iMember] = LLVMBuildExtractValue(pLbuilder, pLvalPtr, iMember, "");
+		}
+		return;
+	}
+
+	auto pAstarrayindex = PastCast<SAstArrayIndex>(pAstSoa);
+	auto pTypearray = PtypeCast<STypeArray>(pAstarrayindex->pAstArray->tid.pType);
+	auto pLvalArray = PlvalGetLoadStoreAddress(pGenx, pAstarrayindex->pAstArray);
+	if (pTypearray->cSizeFixed < 0)
+		pLvalArray = LLVMBuildLoad(pLbuilder, pLvalArray, "");
+
+	auto pLvalIndex = PlvalGenerateRecursive(pGenx, pAstarrayindex->pAstIndex);
+	GenerateSoaArrayAddresses(pGenx, pTypearray, pLvalArray, pLvalIndex, apLvalAddr, iMemberOnly);
+}
+
+LLVMOpaqueValue * PlvalGenerateSoaLoad(SGenerateCtx * pGenx, SAst * pAstSoa)
+{
+	// Gather the members into a struct value
+
+	int cMember = PtypeCast<STypeStruct>(pAstSoa->tid.pType)->cMember;
+	auto apLval = static_cast<LLVMOpaqueValue **>(alloca(sizeof(LLVMOpaqueValue *) * cMember));
+	GenerateSoaMemberAddresses(pGenx, pAstSoa, apLval);
+
+	for (int iMember : IterCount(cMember))
+	{
+		apLval[iMember] = LLVMBuildLoad(pGenx->pLbuilder, apLval[iMember], "");
+	}
+
+	return PlvalBuildStruct(pGenx, PltypeGenerate(pGenx, pAstSoa->tid), apLval, cMember);
+}
+
+void GenerateSoaStore(SGenerateCtx * pGenx, SAst * pAstSoa, SAst * pAstValue)
+{
+	// Scatter the members of a struct value into their columns
+
+	int cMember = PtypeCast<STypeStruct>(pAstSoa->tid.pType)->cMember;
+	auto apLvalAddr = static_cast<LLVMOpaqueValue **>(alloca(sizeof(LLVMOpaqueValue *) * cMember));
+	GenerateSoaMemberAddresses(pGenx, pAstSoa, apLvalAddr);
+
+	auto pLvalValue = PlvalGenerateRecursive(pGenx, pAstValue);
+	for (int iMember : IterCount(cMember))
+	{
+		auto pLvalMember = LLVMBuildExtractValue(pGenx->pLbuilder, pLvalValue, iMember, "");
+		LLVMBuildStore(pGenx->pLbuilder, pLvalMember, apLvalAddr[iMember]);
+	}
+}
+
+LLVMOpaqueValue * PlvalVectorElementAddress(SGenerateCtx * pGenx, LLVMOpaqueValue * pLvalVectorAddr, 
+											 LLVMOpaqueValue * pLvalIndex)
+{
+	// Vectors are laid out like arrays of their elements, index from a pointer to the first one
+
+	auto pLtypeElement = LLVMGetElementType(LLVMGetElementType(LLVMTypeOf(pLvalVectorAddr)));
+	auto pLvalElementAddr = LLVMBuildBitCast(pGenx->pLbuilder, pLvalVectorAddr, LLVMPointerType(pLtypeElement, 0), "");
+	return LLVMBuildGEP(pGenx->pLbuilder, pLvalElementAddr, &pLvalIndex, 1, "");
+}
+
+LLVMOpaqueValue * PlvalGenerateSwizzle(SGenerateCtx * pGenx, SAstOperator * pAstop)
+{
+	auto pLbuilder = pGenx->pLbuilder;
+	auto pAstLeft = pAstop->pAstLeft;
+
+	auto pLvalVector = PlvalGenerateRecursive(pGenx, pAstLeft);
+	if (pAstLeft->tid.pType->typek == TYPEK_Pointer)
+		pLvalVector = LLVMBuildLoad(pLbuilder, pLvalVector, "");
+
+	int aiElement[4];
+	int cElement = CElementSwizzle(PastCast<SAstIdentifier>(pAstop->pAstRight)->pChz, 
+									PtypevecSwizzled(pAstop)->cElement, aiElement);
+	if (cElement == 1)
+		return LLVMBuildExtractElement(pLbuilder, pLvalVector, PlvalConstS32(pGenx, aiElement[0]), "");
+
+	LLVMOpaqueValue * apLvalMask[4];
+	for (int iElement : IterCount(cElement))
+	{
+		apLvalMask[iElement] = PlvalConstS32(pGenx, aiElement[iElement]);
+	}
+
+	return LLVMBuildShuffleVector(pLbuilder, pLvalVector, LLVMGetUndef(LLVMTypeOf(pLvalVector)), 
+								  LLVMConstVector(apLvalMask, cElement), "");
+}
+
+LLVMOpaqueValue * PlvalGetLoadStoreAddress(SGenerateCtx * pGenx, SAst * pAst)
+{
+	auto pWork = pGenx->pWork;
+	auto pLbuilder = pGenx->pLbuilder;
+
+	ASTK astk = pAst->astk;
+	switch (astk)
+	{
+	case ASTK_Operator:
+		{
+			auto pAstop = PastCast<SAstOperator>(pAst);
+			auto pAstLeft = pAstop->pAstLeft;
+			auto pAstRight = pAstop->pAstRight;
+			if (pAstLeft == nullptr)
+			{
+				if (pAstop->op == OP_ShiftLeft && !FIsSoaPointer(pAstRight->tid))
+				{
+					return PlvalGenerateRecursive(pGenx, pAstop->pAstRight);
+				}
+			}
+			else
+			{
+				if (pAstop->op == OP_Dot && PtypevecSwizzled(pAstop))
+				{
+					// Only single element swizzles have an address (see FCanGetAddress), others get a temporary below
+
+					int aiElement[4];
+					int cElement = CElementSwizzle(PastCast<SAstIdentifier>(pAstRight)->pChz, 
+													PtypevecSwizzled(pAstop)->cElement, aiElement);
+					if (cElement != 1)
+						break;
+
+					auto pLvalVectorAddr = (pAstLeft->tid.pType->typek == TYPEK_Pointer) ? 
+												PlvalGenerateRecursive(pGenx, pAstLeft) : 
+												PlvalGetLoadStoreAddress(pGenx, pAstLeft);
+					return PlvalVectorElementAddress(pGenx, pLvalVectorAddr, PlvalConstS32(pGenx, aiElement[0]));
+				}
+				else if (pAstop->op == OP_Dot)
+				{
+					// Get a pointer to the thing we want to get a member out of
+
+					LLVMOpaqueValue * pLvalPtr;
+					STypeId tidPointedTo;
+					auto pResdecl = PresdeclResolved(pWork, pAstRight);
+					int ipDeclMin = 0;
+
+					if (FIsSoaElement(pAstLeft) || FIsSoaPointer(pAstLeft->tid))
+					{
+						// SOA members are stored in their own columns, the first member in the path picks the column
+
+						STypeId tidStruct = (FIsSoaPointer(pAstLeft->tid)) ? 
+												PtypeCast<STypePointer>(pAstLeft->tid.pType)->tidPointedTo : 
+												pAstLeft->tid;
+						auto pTypestruct = PtypeCast<STypeStruct>(tidStruct.pType);
+						auto pDecl0 = (pResdecl->arypDeclUsingPath.c) ? pResdecl->arypDeclUsingPath[0] : pResdecl->pDecl;
+
+						int iMember = 0;
+						while (iMember < pTypestruct->cMember && 
+								strcmp(pTypestruct->aMember[iMember].pAstdecl->pChzName, pDecl0->pChzName) != 0)
+						{
+							++iMember;
+						}
+						ASSERT(iMember < pTypestruct->cMember);
+
+						auto apLvalAddr = static_cast<LLVMOpaqueValue **>(
+											alloca(sizeof(LLVMOpaqueValue *) * pTypestruct->cMember));
+						GenerateSoaMemberAddresses(pGenx, pAstLeft, apLvalAddr, iMember);
+
+						pLvalPtr = apLvalAddr[iMember];
+						tidPointedTo = pTypestruct->aMember[iMember].pAstdecl->tid;
+						ipDeclMin = 1;
+					}
+					else if (pAstLeft->tid.pType->typek == TYPEK_Pointer)
+					{
+						pLvalPtr = PlvalGenerateRecursive(pGenx, pAstLeft);
+						tidPointedTo = PtypeCast<STypePointer>(pAstLeft->tid.pType)->tidPointedTo;
+					}
+					else
+					{
+						ASSERT(pAstLeft->tid.pType->typek != TYPEK_Array || 
+								PtypeCast<STypeArray>(pAstLeft->tid.pType)->cSizeFixed < 0);
+
+						pLvalPtr = PlvalGetLoadStoreAddress(pGenx, pAstLeft);
+						tidPointedTo = pAstLeft->tid;
+					}
+
+					for (int ipDecl = ipDeclMin; ipDecl <= pResdecl->arypDeclUsingPath.c; ++ipDecl)
+					{
+						auto pDecl = (ipDecl == pResdecl->arypDeclUsingPath.c) ?
+										pResdecl->pDecl :
+										pResdecl->arypDeclUsingPath[ipDecl];
+
+						GetMemberAddress(pGenx, pDecl->pChzName, &pLvalPtr, &tidPointedTo, pAstop);
+					}
+
+					return pLvalPtr;
+				}
+			}
+		}
+		break;
+
+	case ASTK_Identifier:
+		{
+			auto pResdecl = PresdeclResolved(pWork, pAst);
+			ASSERT(pResdecl);
+			if (pResdecl->arypDeclUsingPath.c > 0)
+			{
+				// BB (adrianb) This initial lookup and starting at path decl 1 is the only difference
+				//  with member declaration lookup.
+
+				auto pDecl0 = pResdecl->arypDeclUsingPath[0];
+				auto pAstdecl0 = pDecl0->pAstdecl;
+				auto pStorage0 = PstorageLookup(pGenx, pAstdecl0);
+				
+				auto pLvalPtr  = pStorage0->pLvalPtr;
+				auto tidPointedTo = pAstdecl0->tid;
+
+				for (int ipDecl = 1; ipDecl <= pResdecl->arypDeclUsingPath.c; ++ipDecl)
+				{
+					auto pDecl = (ipDecl == pResdecl->arypDeclUsingPath.c) ?
+									pResdecl->pDecl : 
+									pResdecl->arypDeclUsingPath[ipDecl];
+
+					GetMemberAddress(pGenx, pDecl->pChzName, &pLvalPtr, &tidPointedTo, pAst);
+				}
+
+				return pLvalPtr;
+			}
+			else
+			{
+				auto pAstdecl = pResdecl->pDecl->pAstdecl;
+				ASSERT(!pAstdecl->fIsConstant);
+				auto pStorage = PstorageLookup(pGenx, pAstdecl);
+				if (pStorage->pLvalPtr)
+					return pStorage->pLvalPtr;
+
+				// Locals without storage are never modified, reads that need an address get a temporary below
+			}
+		}
+		break;
+
+	case ASTK_ArrayIndex:
+		{
+			// SOA elements have no single address, gather them into a temporary below
+
+			if (FIsSoaElement(pAst))
+				break;
+
+			auto pAstarrayindex = PastCast<SAstArrayIndex>(pAst);
+
+			auto pType = pAstarrayindex->pAstArray->tid.pType;
+			auto typek = pType->typek;
+			if (typek == TYPEK_Vector)
+			{
+				auto pLvalVectorAddr = PlvalGetLoadStoreAddress(pGenx, pAstarrayindex->pAstArray);
+				auto pLvalIndex = PlvalGenerateRecursive(pGenx, pAstarrayindex->pAstIndex);
+				return PlvalVectorElementAddress(pGenx, pLvalVectorAddr, pLvalIndex);
+			}
+			else if (typek == TYPEK_Pointer)
+			{
+				auto pLvalAddr = PlvalGenerateRecursive(pGenx, pAstarrayindex->pAstArray);
+				auto pLvalIndex = PlvalGenerateRecursive(pGenx, pAstarrayindex->pAstIndex);
+				return LLVMBuildGEP(pLbuilder, pLvalAddr, &pLvalIndex, 1, "");
+			}
+			else if (typek == TYPEK_Array)
+			{
+				auto pTypearray = PtypeCast<STypeArray>(pType);
+
+				if (pTypearray->cSizeFixed >= 0)
+				{
+					auto pLvalArrayAddr = PlvalGetLoadStoreAddress(pGenx, pAstarrayindex->pAstArray);
+					auto pLvalIndex = PlvalGenerateRecursive(pGenx, pAstarrayindex->pAstIndex);
+
+					LLVMOpaqueValue * apLvalGEP[] = { PlvalConstS32(pGenx, 0), pLvalIndex };
+					return LLVMBuildGEP(pGenx->pLbuilder, pLvalArrayAddr, apLvalGEP, DIM(apLvalGEP), "");
+				}
+				else
+				{
+					auto pLvalArrayAddr = PlvalGetLoadStoreAddress(pGenx, pAstarrayindex->pAstArray);
+					auto pLvalPtrA = LLVMBuildStructGEP(pLbuilder, pLvalArrayAddr, 0, ""); // getting a from {a,c}
+					auto pLvalA = LLVMBuildLoad(pLbuilder, pLvalPtrA, "");
+
+					auto pLvalIndex = PlvalGenerateRecursive(pGenx, pAstarrayindex->pAstIndex);
+					return LLVMBuildGEP(pLbuilder, pLvalA, &pLvalIndex, 1, "");
+				}
+			}
+			
+			ShowErr(pAst->errinfo, "Don't know how to array index type %s", StrPrintType(pType).Pchz());
+			return nullptr;
+		}
+		break;
+
+	default:
+		break;
+	}
+
+	// Implicitly create temporary local
+	// BB (adrianb) Disallow implictly storing some operators?
+	//  Are there any cases where we'll infinitely recurse?
+
+	auto pLvalAddr = LLVMBuildAlloca(pGenx->pLbuilderAlloc, PltypeGenerate(pGenx, pAst->tid), "_tempAddr");
+	auto pLval = PlvalGenerateRecursive(pGenx, pAst);
+	LLVMBuildStore(pLbuilder, pLval, pLvalAddr);
+
+	return pLvalAddr;
+}
+
+using PFNGENBINOP = LLVMOpaqueValue * (*)(LLVMOpaqueBuilder * pLbuilder, LLVMOpaqueValue * pLvalLeft, 
+											LLVMOpaqueValue * pLvalRight, const char * pChz);
+
+struct SGenerateBinaryOperator
+{
+	OP op;
+
+	PFNGENBINOP pfngbopInt;
+	PFNGENBINOP pfngbopIntUnsigned;
+	PFNGENBINOP pfngbopFloat;
+	PFNGENBINOP pfngbopPointerAndInt;
+	PFNGENBINOP pfngbopPointer;
+
+	// bools?
+};
+
+template <LLVMIntPredicate lintpred>
+LLVMOpaqueValue * GenCmpInt(LLVMOpaqueBuilder * pLbuilder, LLVMOpaqueValue * pLvalLeft, LLVMOpaqueValue * pLvalRight, const char * pChz)
+{
+	auto pChzLeftType = LLVMPrintTypeToString(LLVMTypeOf(pLvalLeft));
+	auto pChzRightType = LLVMPrintTypeToString(LLVMTypeOf(pLvalRight));
+	defer { LLVMDisposeMessage(pChzLeftType); LLVMDisposeMessage(pChzRightType); };
+
+	return LLVMBuildICmp(pLbuilder, lintpred, pLvalLeft, pLvalRight, pChz);
+}
+
+template <LLVMRealPredicate lrealpred>
+LLVMValueRef GenCmpFloat(LLVMOpaqueBuilder * pLbuilder, LLVMOpaqueValue * pLvalLeft, LLVMOpaqueValue * pLvalRight, const char * pChz)
+{
+	return LLVMBuildFCmp(pLbuilder, lrealpred, pLvalLeft, pLvalRight, pChz);
+}
+
+LLVMOpaqueValue * PlvalAddPtrInt(LLVMOpaqueBuilder * pLbuilder, LLVMOpaqueValue * pLvalLeft, LLVMOpaqueValue * pLvalRight, const char * pChz)
+{
+	LLVMOpaqueValue * apLvalIndex[] = 
+	{
+		pLvalRight
+	};
+
+	return LLVMBuildGEP(pLbuilder, pLvalLeft, apLvalIndex, DIM(apLvalIndex), pChz);
+}
+
+LLVMOpaqueValue * PlvalSubPtrInt(LLVMOpaqueBuilder * pLbuilder, LLVMOpaqueValue * pLvalLeft, LLVMOpaqueValue * pLvalRight, const char * pChz)
+{
+	LLVMOpaqueValue * apLvalIndex[] = 
+	{
+		LLVMBuildNeg(pLbuilder, pLvalRight, "")
+	};
+
+	return LLVMBuildGEP(pLbuilder, pLvalLeft, apLvalIndex, DIM(apLvalIndex), pChz);
+}
+
+LLVMOpaqueValue * PlvalSubPtr(LLVMOpaqueBuilder * pLbuilder, LLVMOpaqueValue * pLvalLeft, LLVMOpaqueValue * pLvalRight, const char * pChz)
+{
+	ASSERT(false);
+	return nullptr;
+}
+
+static const SGenerateBinaryOperator s_aGbop[] =
+{
+	// BB (adrianb) Unordered (either arg NaN) vs Ordered. Which to choose?
+	// BB (adrianb) Pointer operations right?
+	{ OP_Less, GenCmpInt<LLVMIntSLT>, GenCmpInt<LLVMIntULT>, GenCmpFloat<LLVMRealOLT>, nullptr, GenCmpInt<LLVMIntULT> },
+	{ OP_Greater, GenCmpInt<LLVMIntSGT>, GenCmpInt<LLVMIntUGT>, GenCmpFloat<LLVMRealOGT>, nullptr, GenCmpInt<LLVMIntUGT> },
+	{ OP_LessEqual, GenCmpInt<LLVMIntSLE>, GenCmpInt<LLVMIntULE>, GenCmpFloat<LLVMRealOLE>, nullptr, GenCmpInt<LLVMIntULE> },
+	{ OP_GreaterEqual, GenCmpInt<LLVMIntSGE>, GenCmpInt<LLVMIntUGE>, GenCmpFloat<LLVMRealOGE>, nullptr, GenCmpInt<LLVMIntUGE> },
+
+	{ OP_Equal, GenCmpInt<LLVMIntEQ>, nullptr, GenCmpFloat<LLVMRealOEQ>, nullptr, GenCmpInt<LLVMIntEQ> },
+	{ OP_NotEqual, GenCmpInt<LLVMIntNE>, nullptr, GenCmpFloat<LLVMRealONE>, nullptr, GenCmpInt<LLVMIntNE> },
+
+	{ OP_Add, LLVMBuildAdd, nullptr, LLVMBuildFAdd, PlvalAddPtrInt, nullptr },
+	{ OP_Sub, LLVMBuildSub, nullptr, LLVMBuildFSub, PlvalSubPtrInt, PlvalSubPtr },
+	{ OP_Mul, LLVMBuildMul, nullptr, LLVMBuildFMul, nullptr, nullptr },
+	{ OP_Div, LLVMBuildSDiv, LLVMBuildUDiv, LLVMBuildFDiv, nullptr, nullptr },
+	{ OP_Rem, LLVMBuildSRem, LLVMBuildURem, nullptr, nullptr, nullptr }, // FRem?
+
+	{ OP_BitAnd, LLVMBuildAnd, nullptr, nullptr, nullptr, nullptr },
+	{ OP_BitOr, LLVMBuildOr, nullptr, nullptr, nullptr, nullptr },
+	{ OP_BitXor, LLVMBuildXor, nullptr, nullptr, nullptr, nullptr },
+	{ OP_ShiftLeft, LLVMBuildShl, nullptr, nullptr, nullptr, nullptr },
+	{ OP_ShiftRight, LLVMBuildAShr, LLVMBuildLShr, nullptr, nullptr, nullptr },
+};
+
+static const SOperatorTable<SGenerateBinaryOperator> s_optableGbop(s_aGbop);
+
+LLVMOpaqueValue * PlvalGenerateBinaryOperator(SGenerateCtx * pGenx, const SGenerateBinaryOperator & gbop, 
+											   SAst * pAstLeft, LLVMOpaqueValue * pLvalLeft, 
+											   SAst * pAstRight, LLVMOpaqueValue * pLvalRight)
+{
+	auto pLbuilder = pGenx->pLbuilder;
+
+	TYPEK typekLeft = pAstLeft->tid.pType->typek;
+	TYPEK typekRight = pAstRight->tid.pType->typek;
+
+	// LLVM's instructions work elementwise on vectors, pick them by the element type
+
+	bool fVector = typekLeft == TYPEK_Vector;
+	if (fVector)
+		typekLeft = typekRight = PtypeCast<STypeVector>(pAstLeft->tid.pType)->tidElement.pType->typek;
+	
+	LLVMOpaqueValue * pLval = nullptr;
+	if (gbop.pfngbopPointerAndInt && ((typekLeft == TYPEK_Pointer && typekRight == TYPEK_S64) || 
+									  (typekRight == TYPEK_Pointer && typekLeft == TYPEK_S64)))
+	{
+		if (typekRight == TYPEK_Pointer)
+			Swap(pLvalLeft, pLvalRight);
+
+		return gbop.pfngbopPointerAndInt(pLbuilder, pLvalLeft, pLvalRight, "");
+	}
+	else if (gbop.pfngbopPointer && FIsPointerOrProcedure(typekLeft) && FIsPointerOrProcedure(typekRight))
+	{
+		return gbop.pfngbopPointer(pLbuilder, pLvalLeft, pLvalRight, "");
+	}
+	else if (gbop.pfngbopInt && FIsInt(typekLeft))
+	{
+		if (gbop.pfngbopIntUnsigned && !FSigned(typekLeft))
+		{
+			pLval = gbop.pfngbopIntUnsigned(pLbuilder, pLvalLeft, pLvalRight, "");
+		}
+		else
+		{
+			pLval = gbop.pfngbopInt(pLbuilder, pLvalLeft, pLvalRight, "");
+		}
+	}
+	else if (gbop.pfngbopFloat && FIsFloat(typekLeft))
+	{
+		pLval = gbop.pfngbopFloat(pLbuilder, pLvalLeft, pLvalRight, "");
+	}
+
+	// Vector comparisons give <n x i1>, widen them to the mask type (see TidVectorMask)
+
+	if (pLval && fVector && LLVMTypeOf(pLval) != LLVMTypeOf(pLvalLeft))
+	{
+		auto pLtypeMask = PltypeGenerate(pGenx, TidVectorMask(pGenx->pWork, pAstLeft->tid));
+		pLval = LLVMBuildSExt(pLbuilder, pLval, pLtypeMask, "");
+	}
+
+	return pLval;
+}
+
+LLVMOpaqueValue * PlvalGenerateBinaryOperator(SGenerateCtx * pGenx, const SGenerateBinaryOperator & gbop, 
+										   SAst * pAstLeft, SAst * pAstRight)
+{
+	auto pLvalLeft = PlvalGenerateRecursive(pGenx, pAstLeft);
+	auto pLvalRight = PlvalGenerateRecursive(pGenx, pAstRight);
+
+	auto pLval = PlvalGenerateBinaryOperator(pGenx, gbop, pAstLeft, pLvalLeft, pAstRight, pLvalRight);
+
+	ASSERTCHZ(pLval, "Operator %s can't be generated with types %s and %s NYI", 
+			  PchzFromOp(gbop.op), StrPrintType(pAstLeft->tid.pType).Pchz(), StrPrintType(pAstRight->tid.pType).Pchz());
+
+	return pLval;
+}
+
+static const SGenerateBinaryOperator s_aGbopAssign[] =
+{
+	// BB (adrianb) Other types?
+	{ OP_AddAssign, LLVMBuildAdd, nullptr, LLVMBuildFAdd, PlvalAddPtrInt },
+	{ OP_SubAssign, LLVMBuildSub, nullptr, LLVMBuildFSub },
+	{ OP_MulAssign, LLVMBuildMul, nullptr, LLVMBuildFMul },
+	{ OP_DivAssign, LLVMBuildSDiv, LLVMBuildUDiv, LLVMBuildFDiv },
+	{ OP_RemAssign, LLVMBuildSRem, LLVMBuildURem, nullptr }, // FRem?
+	{ OP_BitAndAssign, LLVMBuildAnd, nullptr, nullptr },
+	{ OP_BitOrAssign, LLVMBuildOr, nullptr, nullptr },
+	{ OP_BitXorAssign, LLVMBuildXor, nullptr, nullptr },
+	{ OP_ShiftLeftAssign, LLVMBuildShl, nullptr, nullptr },
+	{ OP_ShiftRightAssign, LLVMBuildAShr, LLVMBuildLShr, nullptr },
+};
+
+static const SOperatorTable<SGenerateBinaryOperator> s_optableGbopAssign(s_aGbopAssign);
+
+void GenerateBinaryAssignOperator(SGenerateCtx * pGenx, const SGenerateBinaryOperator & gbop, 
+									SAst * pAstLeft, SAst * pAstRight)
+{
+	auto pLbuilder = pGenx->pLbuilder;
+	auto pLvalAddr = PlvalGetLoadStoreAddress(pGenx, pAstLeft);
+	auto pLvalRight = PlvalGenerateRecursive(pGenx, pAstRight);
+	auto pLvalLeft = LLVMBuildLoad(pLbuilder, pLvalAddr, "");
+
+	auto pLvalOp = PlvalGenerateBinaryOperator(pGenx, gbop, pAstLeft, pLvalLeft, pAstRight, pLvalRight);
+
+	ASSERTCHZ(pLvalOp, "Operator %s can't be generated with types %s and %s. NYI?", 
+			  PchzFromOp(gbop.op), StrPrintType(pAstLeft->tid.pType).Pchz(), StrPrintType(pAstRight->tid.pType).Pchz());
+
+	LLVMBuildStore(pLbuilder, pLvalOp, pLvalAddr);
+}
+
+LLVMOpaqueValue * PlvalConst(SGenerateCtx * pGenx, STypeId tid, const void * pV);
+
+LLVMOpaqueValue * PlvalConstStruct(SGenerateCtx * pGenx, const STypeStruct * pTypestruct, LLVMOpaqueType * pLtype, 
+									const u8 * pB)
+{
+	auto cMember = pTypestruct->cMember;
+	auto apLvalMember = static_cast<LLVMOpaqueValue **>(alloca(sizeof(LLVMOpaqueValue *) * cMember));
+
+	for (int iMember : IterCount(cMember))
+	{
+		auto pMember = &pTypestruct->aMember[iMember];
+		apLvalMember[iMember] = PlvalConst(pGenx, pMember->pAstdecl->tid, pB + pMember->iBOffset);
+	}
+
+	return LLVMConstNamedStruct(pLtype, apLvalMember, cMember);
+}
+
+LLVMOpaqueValue * PlvalConstStringPtr(SGenerateCtx * pGenx, const char * pChz)
+{
+    if (pChz == nullptr)
+        return LLVMConstPointerNull(PltypeGenerate(pGenx, TidPointer(pGenx->pWork, pGenx->pWork->tidU8)));
+
+	// Unwrapping LLVMBuildGlobalStringPtr with nothing builder specific so it can be run at global scope
+
+	// IRBuilder::CreateGlobalString
+
+	auto pLvalConstStrData = LLVMConstStringInContext(pGenx->pLctx, pChz, strlen(pChz), false);
+	auto pLvalStrGlobal = LLVMAddGlobal(pGenx->pLmod, LLVMTypeOf(pLvalConstStrData), ".str");
+	LLVMSetGlobalConstant(pLvalStrGlobal, true);
+	LLVMSetLinkage(pLvalStrGlobal, LLVMPrivateLinkage);
+	LLVMSetInitializer(pLvalStrGlobal, pLvalConstStrData);
+	LLVMSetUnnamedAddr(pLvalStrGlobal, true);
+
+	// Rest of GlobaStringPtr
+
+	auto pLvalZero = LLVMConstInt(LLVMInt32TypeInContext(pGenx->pLctx), 0, false);
+	LLVMOpaqueValue * apLval[] = { pLvalZero, pLvalZero };
+	return LLVMConstInBoundsGEP(pLvalStrGlobal, apLval, DIM(apLval));
+}
+
+bool FIsZeroMemory(const u8 * pB, size_t cB)
+{
+	for (size_t iB = 0; iB < cB; ++iB)
+	{
+		if (pB[iB] != 0)
+			return false;
+	}
+
+	return true;
+}
+
+LLVMOpaqueValue * PlvalConstSoa(SGenerateCtx * pGenx, const STypeArray * pTypearray, LLVMOpaqueType * pLtype, 
+								const u8 * pB)
+{
+	if (FIsZeroMemory(pB, pTypearray->cB))
+		return LLVMConstNull(pLtype);
+
+	auto pTypestruct = PtypestructSoa(pTypearray);
+	int cMember = pTypestruct->cMember;
+	auto apLvalColumn = static_cast<LLVMOpaqueValue **>(alloca(sizeof(LLVMOpaqueValue *) * (cMember + 2)));
+
+	if (pTypearray->cSizeFixed < 0)
+	{
+		// Column pointers can't be constant (same as other pointers), only the counts carry over
+
+		int cCount = (pTypearray->fDynamicallySized) ? 2 : 1;
+		const u8 * pBCount = pB + cMember * CbBasicSize(TYPEK_Pointer);
+		for (int iMember : IterCount(cMember))
+		{
+			apLvalColumn[iMember] = LLVMConstNull(LLVMStructGetTypeAtIndex(pLtype, iMember));
+		}
+
+		for (int iCount : IterCount(cCount))
+		{
+			apLvalColumn[cMember + iCount] = PlvalConst(pGenx, pGenx->pWork->tidS64, pBCount + iCount * sizeof(s64));
+		}
+
+		return LLVMConstStructInContext(pGenx->pLctx, apLvalColumn, cMember + cCount, false);
+	}
+
+	s64 cSoaChunk = CSoaChunk(pTypearray);
+	s64 cChunk = CChunkSoa(pTypearray);
+	u32 cBChunk = IBSoaColumn(pTypearray, cMember);
+
+	auto apLvalChunk = static_cast<LLVMOpaqueValue **>(malloc(sizeof(LLVMOpaqueValue *) * cChunk));
+	auto apLvalElement = static_cast<LLVMOpaqueValue **>(malloc(sizeof(LLVMOpaqueValue *) * cSoaChunk));
+	defer { free(apLvalChunk); free(apLvalElement); };
+
+	for (s64 iChunk = 0; iChunk < cChunk; ++iChunk)
+	{
+		for (int iMember : IterCount(cMember))
+		{
+			STypeId tidMember = pTypestruct->aMember[iMember].pAstdecl->tid;
+			size_t cBMember = CbSizeOf(tidMember);
+			const u8 * pBColumn = pB + iChunk * cBChunk + IBSoaColumn(pTypearray, iMember);
+
+			for (s64 iElement = 0; iElement < cSoaChunk; ++iElement)
+			{
+				const u8 * pBElement = pBColumn + iElement * cBMember;
+				if (iElement > 0 && memcmp(pBElement, pBElement - cBMember, cBMember) == 0)
+					apLvalElement[iElement] = apLvalElement[iElement - 1];
+				else
+					apLvalElement[iElement] = PlvalConst(pGenx, tidMember, pBElement);
+			}
+
+			apLvalColumn[iMember] = LLVMConstArray(PltypeGenerate(pGenx, tidMember), apLvalElement, cSoaChunk);
+		}
+
+		apLvalChunk[iChunk] = LLVMConstStructInContext(pGenx->pLctx, apLvalColumn, cMember, false);
+	}
+
+	return LLVMConstArray(LLVMGetElementType(pLtype), apLvalChunk, cChunk);
+}
+
+LLVMOpaqueValue * PlvalConst(SGenerateCtx * pGenx, STypeId tid, const void * pV)
+{
+	auto pB = static_cast<const u8 *>(pV);
+	TYPEK typek = tid.pType->typek;
+	auto pLtype = PltypeGenerate(pGenx, tid);
+	switch (typek)
+	{
+	case TYPEK_Bool: return LLVMConstInt(pLtype, *static_cast<const bool *>(pV), false);
+	case TYPEK_S8: return LLVMConstInt(pLtype, *static_cast<const s8 *>(pV), true);
+	case TYPEK_S16: return LLVMConstInt(pLtype, *static_cast<const s16 *>(pV), true);
+	case TYPEK_S32: return LLVMConstInt(pLtype, *static_cast<const s32 *>(pV), true);
+	case TYPEK_S64: return LLVMConstInt(pLtype, *static_cast<const s64 *>(pV), true);
+	case TYPEK_U8: return LLVMConstInt(pLtype, *static_cast<const u8 *>(pV), false);
+	case TYPEK_U16: return LLVMConstInt(pLtype, *static_cast<const u16 *>(pV), false);
+	case TYPEK_U32: return LLVMConstInt(pLtype, *static_cast<const u32 *>(pV), false);
+	case TYPEK_U64: return LLVMConstInt(pLtype, *static_cast<const u64 *>(pV), false);
+	case TYPEK_Float: return LLVMConstReal(pLtype, *static_cast<const float *>(pV));
+	case TYPEK_Double: return LLVMConstReal(pLtype, *static_cast<const double *>(pV));
+	
+	case TYPEK_Pointer:
+		if (PtypeCast<STypePointer>(tid.pType)->fSoa)
+		{
+			return LLVMConstNull(pLtype);
+		}
+		else if (PtypeCast<STypePointer>(tid.pType)->tidPointedTo.pType->typek == TYPEK_U8)
+		{
+			return PlvalConstStringPtr(pGenx, *static_cast<char * const *>(pV));
+		}
+		return LLVMConstPointerNull(pLtype);
+	
+	case TYPEK_Array:
+		{
+			auto pTypearray = PtypeCast<STypeArray>(tid.pType);
+			if (pTypearray->fSoa)
+				return PlvalConstSoa(pGenx, pTypearray, pLtype, pB);
+
+			if (pTypearray->cSizeFixed < 0)
+				goto LStruct;
+
+			// Default initialized tables are usually all zero, which llvm can store as a zeroinitializer
+
+			auto cElement = pTypearray->cSizeFixed;
+			size_t cBElement = CbSizeOf(pTypearray->tidElement);
+			if (FIsZeroMemory(pB, cBElement * cElement))
+				return LLVMConstNull(pLtype);
+
+			// Reuse the constant for runs of identical elements rather than rebuilding each one.
+			//  LLVM turns arrays of simple scalars into constant data arrays.
+
+			auto apLvalElement = static_cast<LLVMOpaqueValue **>(malloc(sizeof(LLVMOpaqueValue *) * cElement));
+			defer { free(apLvalElement); };
+
+			for (int iElement : IterCount(cElement))
+			{
+				const u8 * pBElement = pB + iElement * cBElement;
+				if (iElement > 0 && memcmp(pBElement, pBElement - cBElement, cBElement) == 0)
+					apLvalElement[iElement] = apLvalElement[iElement - 1];
+				else
+					apLvalElement[iElement] = PlvalConst(pGenx, pTypearray->tidElement, pBElement);
+			}
+
+			return LLVMConstArray(PltypeGenerate(pGenx, pTypearray->tidElement), apLvalElement, cElement);
+		}
+		break;
+
+	case TYPEK_String:	
+	case TYPEK_Struct:
+LStruct:
+		if (FIsZeroMemory(pB, CbSizeOf(tid)))
+			return LLVMConstNull(pLtype);
+
+		return PlvalConstStruct(pGenx, Ptypestruct(tid.pType), pLtype, pB);
+
+	case TYPEK_Enum:
+		return PlvalConst(pGenx, PtypeCast<STypeEnum>(tid.pType)->tidInternal, pB);
+
+	case TYPEK_Procedure:
+		// Like pointers, procedure values are only ever null at compile time
+
+		return LLVMConstPointerNull(pLtype);
+
+	case TYPEK_Vector:
+		{
+			if (FIsZeroMemory(pB, CbSizeOf(tid)))
+				return LLVMConstNull(pLtype);
+
+			auto pTypevec = PtypeCast<STypeVector>(tid.pType);
+			auto apLvalElement = static_cast<LLVMOpaqueValue **>(alloca(sizeof(LLVMOpaqueValue *) * pTypevec->cElement));
+			u32 cBElement = CbSizeOf(pTypevec->tidElement);
+			for (int iElement : IterCount(pTypevec->cElement))
+			{
+				apLvalElement[iElement] = PlvalConst(pGenx, pTypevec->tidElement, pB + iElement * cBElement);
+			}
+
+			return LLVMConstVector(apLvalElement, pTypevec->cElement);
+		}
+
+	case TYPEK_Any:
+	case TYPEK_Void:
+	case TYPEK_TypeOf:
+	case TYPEK_Vararg:
+	case TYPEK_Nil:
+	case TYPEK_Max:
+	
+	//default:
+		ASSERTCHZ(false, "Can't build constant for %s", StrPrintType(tid).Pchz());
+		return nullptr;
+	}
+}
+
+LLVMOpaqueValue * PlvalLoadConst(SGenerateCtx * pGenx, SAst * pAst)
+{
+	void * pVValue = alloca(CbSizeOf(pAst->tid));
+	EvalConst(pGenx->pWork, pAst, pVValue);
+	return PlvalConst(pGenx, pAst->tid, pVValue);
+}
+
+LLVMOpaqueValue * PlvalGenerateConstant(SGenerateCtx * pGenx, SAst * pAst);
+
+LLVMOpaqueValue * PlvalLoadConst(SGenerateCtx * pGenx, SAstDeclareSingle * pAstdecl)
+{
+	// Use the cached value for the declaration instead of reevaluating it at each reference
+
+	ASSERT(pAstdecl->fIsConstant);
+	auto pAstValue = pAstdecl->pAstValue;
+	if (pAstValue->astk == ASTK_Procedure)
+		return PlvalGenerateConstant(pGenx, pAstValue);
+
+	return PlvalConst(pGenx, pAstValue->tid, PvEvalConstDecl(pGenx->pWork, pAstdecl));
+}
+
+
+
+void MarkScopeTerminated(SGenerateCtx * pGenx)
+{
+	pGenx->fScopeTerminated = true;
+}
+
+// BB (adrianb) Want a way to detect if we emit any instructions after a return in a basic block so we can error on
+//  said expression. Maybe do an expression level detection? Does that make sense?
+
+LLVMOpaqueValue * PlvalLoopMetadata(SGenerateCtx * pGenx)
+{
+	// Distinct self referencing loop id (via a temporary) marking for loops as making progress
+	// NOTE (adrianb) Don't force llvm.loop.vectorize.enable. It lets the vectorizer reorder float reductions, so
+	//  optimized results would differ. The cost model still vectorizes loops where that's legal.
+
+	auto pLctx = pGenx->pLctx;
+	auto pLmdTemp = LLVMTemporaryMDNode(pLctx, nullptr, 0);
+
+	const char * pChzProgress = "llvm.loop.mustprogress";
+	LLVMMetadataRef apLmdProgress[] = { LLVMMDStringInContext2(pLctx, pChzProgress, strlen(pChzProgress)) };
+
+	LLVMMetadataRef apLmdLoop[] = 
+	{
+		pLmdTemp,
+		LLVMMDNodeInContext2(pLctx, apLmdProgress, DIM(apLmdProgress)),
+	};
+	auto pLmdLoop = LLVMMDNodeInContext2(pLctx, apLmdLoop, DIM(apLmdLoop));
+	LLVMMetadataReplaceAllUsesWith(pLmdTemp, pLmdLoop);
+
+	return LLVMMetadataAsValue(pLctx, pLmdLoop);
+}
+
+void Branch(SGenerateCtx * pGenx, LLVMOpaqueBasicBlock * pLblock, SAst * pAst)
+{
+	// Don't branch if we've returned or it will count as terminator in middle of basic block
+	// BB (adrianb) Should we be handling this outside branch?
+
+	if (pGenx->fScopeTerminated)
+	{
+		pGenx->fScopeTerminated = false;
+		return;
+	}
+
+	LLVMBuildBr(pGenx->pLbuilder, pLblock);
+}
+
+void PopScope(SGenerateCtx * pGenx, const SScopeCtx & scopectx)
+{
+	ASSERT(scopectx.iScope == pGenx->aryScope.c - 1);
+	auto scope = Tail(&pGenx->aryScope);
+
+	// A return, break or continue already generated this scope's defers
+
+	if (pGenx->fScopeTerminated)
+		pGenx->arypAstDefer.c = scope.ipAstDeferMic;
+
+	while (pGenx->arypAstDefer.c > scope.ipAstDeferMic)
+	{
+		auto pAstDefer = Tail(&pGenx->arypAstDefer);
+		Pop(&pGenx->arypAstDefer);
+		(void) PlvalGenerateRecursive(pGenx, pAstDefer);
+	}
+	Pop(&pGenx->aryScope);
+}
+
+void EarlyPopScopes(SGenerateCtx * pGenx, int iScope)
+{
+	int ipAstMic = (iScope >= 0) ? pGenx->aryScope[iScope].ipAstDeferMic : 0;
+
+	for (int ipAst : IterCount(pGenx->arypAstDefer.c - ipAstMic))
+	{
+		auto pAstDefer = Tail(&pGenx->arypAstDefer, ipAst);
+		(void) PlvalGenerateRecursive(pGenx, pAstDefer);
+	}
+}
+
+void EarlyReturnPopScopes(SGenerateCtx * pGenx)
+{
+	EarlyPopScopes(pGenx, -1);
+}
+
+SAstProcedure * PastprocCalled(SWorkspace * pWork, SAstCall * pAstcall)
+{
+	// Procedure a call goes to, if it's known up front (a constant procedure declaration)
+
+	if (pAstcall->pAstFunc->astk != ASTK_Identifier)
+		return nullptr;
+
+	auto pResdecl = PresdeclResolved(pWork, pAstcall->pAstFunc);
+	auto pAstdecl = (pResdecl) ? pResdecl->pDecl->pAstdecl : nullptr;
+	if (!pAstdecl || !pAstdecl->fIsConstant || !pAstdecl->pAstValue || pAstdecl->pAstValue->astk != ASTK_Procedure)
+		return nullptr;
+
+	return PastCast<SAstProcedure>(pAstdecl->pAstValue);
+}
+
+SAstDeclareSingle * PastdeclContext(SWorkspace * pWork)
+{
+	// The builtin module's context global, missing unless the program imports it. A context declared by the
+	//  program itself is just another variable.
+
+	auto pResdecl = PresdeclLookup(&pWork->symtRoot, "context", 0, {});
+	auto pAstdecl = (pResdecl) ? pResdecl->pDecl->pAstdecl : nullptr;
+	if (!pAstdecl || pAstdecl->fIsConstant || pAstdecl->errinfo.pChzFile != s_pChzModuleContext)
+		return nullptr;
+
+	return pAstdecl;
+}
+
+bool FCanInline(SGenerateCtx * pGenx, SAstCall * pAstcall, SAstProcedure * pAstproc)
+{
+	if (pAstproc->fIsForeign || pAstproc->pAstblock == nullptr)
+		return false;
+
+	if (PtypeCast<STypeProcedure>(pAstproc->tid.pType)->fUsesCVararg || 
+		pAstproc->arypAstDeclArg.c != pAstcall->arypAstArgs.c)
+	{
+		return false;
+	}
+
+	for (auto pAstdeclArg : pAstproc->arypAstDeclArg)
+	{
+		if (pAstdeclArg->tid.pType->typek == TYPEK_TypeOf)
+			return false;
+	}
+
+	// Recursive procedures are called normally once we're inside them
+
+	for (const auto & inl : pGenx->aryInline)
+	{
+		if (inl.pAstproc == pAstproc)
+			return false;
+	}
+
+	return true;
+}
+
+LLVMOpaqueValue * PlvalGenerateInline(SGenerateCtx * pGenx, SAstCall * pAstcall, SAstProcedure * pAstproc)
+{
+	// Generate the procedure's body in place of the call: arguments are stored to the argument declarations' 
+	//  storage, returns store the result and branch to the block after the body.
+
+	auto pLbuilder = pGenx->pLbuilder;
+
+	int cArg = pAstcall->arypAstArgs.c;
+	auto apLvalArg = static_cast<LLVMOpaqueValue **>(alloca(sizeof(LLVMOpaqueValue *) * cArg));
+	for (int iArg : IterCount(cArg))
+	{
+		apLvalArg[iArg] = PlvalGenerateRecursive(pGenx, pAstcall->arypAstArgs[iArg]);
+	}
+
+	for (int iArg : IterCount(cArg))
+	{
+		GenerateLocal(pGenx, PastCast<SAstDeclareSingle>(pAstproc->arypAstDeclArg[iArg]), apLvalArg[iArg]);
+	}
+
+	auto pLvalFunc = LLVMGetBasicBlockParent(LLVMGetInsertBlock(pLbuilder));
+
+	SGenerateCtx::SInline inl = {};
+	inl.pAstproc = pAstproc;
+	inl.pLblockReturn = LLVMAppendBasicBlockInContext(pGenx->pLctx, pLvalFunc, pAstproc->pChzName);
+	auto pTypeproc = PtypeCast<STypeProcedure>(pAstproc->tid.pType);
+	auto pLtypeRet = PltypeGenerateValues(pGenx, pTypeproc->aTidRet, pTypeproc->cTidRet);
+	if (LLVMGetTypeKind(pLtypeRet) != LLVMVoidTypeKind)
+		inl.pLvalRetAddr = LLVMBuildAlloca(pGenx->pLbuilderAlloc, pLtypeRet, "_inlineRet");
+
+	SScopeCtx scopectx = ScopectxPush(pGenx);
+	inl.iScope = scopectx.iScope;
+	Append(&pGenx->aryInline, inl);
+
+	auto pAstblock = pAstproc->pAstblock;
+	(void) PlvalGenerateRecursive(pGenx, pAstblock);
+
+	if (pAstblock->arypAst.c == 0 || Tail(&pAstblock->arypAst)->astk != ASTK_Return)
+	{
+		PopScope(pGenx, scopectx);
+		Branch(pGenx, inl.pLblockReturn, pAstcall);
+	}
+	else
+	{
+		// The return already performed defer operations, just reset scopes here
+
+		ASSERT(pGenx->aryScope.c == scopectx.iScope + 1);
+		pGenx->arypAstDefer.c = pGenx->aryScope[scopectx.iScope].ipAstDeferMic;
+		Pop(&pGenx->aryScope);
+		pGenx->fScopeTerminated = false;
+	}
+
+	Pop(&pGenx->aryInline);
+	LLVMPositionBuilderAtEnd(pLbuilder, inl.pLblockReturn);
+
+	if (!inl.pLvalRetAddr)
+		return nullptr;
+
+	return LLVMBuildLoad(pLbuilder, inl.pLvalRetAddr, "");
+}
+
+LLVMOpaqueValue * PlvalCProcedure(SGenerateCtx * pGenx, const char * pChzName, LLVMOpaqueType * pLtypeFunc)
+{
+	// Reuse the program's #foreign declaration if it has one, casting it if the types differ
+
+	auto pLvalProc = LLVMGetNamedFunction(pGenx->pLmod, pChzName);
+	if (!pLvalProc)
+		return LLVMAddFunction(pGenx->pLmod, pChzName, pLtypeFunc);
+
+	if (LLVMGetElementType(LLVMTypeOf(pLvalProc)) != pLtypeFunc)
+		return LLVMConstBitCast(pLvalProc, LLVMPointerType(pLtypeFunc, 0));
+
+	return pLvalProc;
+}
+
+LLVMOpaqueValue * PlvalGenerateHeapAllocate(SGenerateCtx * pGenx, LLVMOpaqueValue * pLvalV, LLVMOpaqueValue * pLvalCBNew)
+{
+	// C heap fallback: realloc(pV, cBNew), or just free(pV) when we know nothing is left
+
+	auto pLbuilder = pGenx->pLbuilder;
+	auto pLtypePV = LLVMPointerType(LLVMInt8TypeInContext(pGenx->pLctx), 0);
+
+	if (LLVMIsAConstantInt(pLvalCBNew) && LLVMConstIntGetZExtValue(pLvalCBNew) == 0)
+	{
+		auto pLtypeFree = LLVMFunctionType(LLVMVoidTypeInContext(pGenx->pLctx), &pLtypePV, 1, false);
+		(void) LLVMBuildCall(pLbuilder, PlvalCProcedure(pGenx, "free", pLtypeFree), &pLvalV, 1, "");
+		return LLVMConstPointerNull(pLtypePV);
+	}
+
+	LLVMOpaqueType * apLtypeArg[] = { pLtypePV, LLVMInt64TypeInContext(pGenx->pLctx) };
+	auto pLtypeRealloc = LLVMFunctionType(pLtypePV, apLtypeArg, DIM(apLtypeArg), false);
+	LLVMOpaqueValue * apLvalArg[] = { pLvalV, pLvalCBNew };
+	return LLVMBuildCall(pLbuilder, PlvalCProcedure(pGenx, "realloc", pLtypeRealloc), apLvalArg, DIM(apLvalArg), "");
+}
+
+LLVMOpaqueValue * PlvalGenerateAllocate(SGenerateCtx * pGenx, LLVMOpaqueValue * pLvalV, 
+										LLVMOpaqueValue * pLvalCBOld, LLVMOpaqueValue * pLvalCBNew)
+{
+	// new, delete and dynamic arrays all allocate through context.allocator.proc(pData, pV, cBOld, cBNew).
+	//  pV is null for new allocations and cBNew is zero to free. A null proc (the default) is the C heap.
+
+	auto pAstdeclContext = PastdeclContext(pGenx->pWork);
+	if (!pAstdeclContext)
+		return PlvalGenerateHeapAllocate(pGenx, pLvalV, pLvalCBNew);
+
+	auto pLbuilder = pGenx->pLbuilder;
+
+	LLVMOpaqueValue * pLvalAllocator = PstorageLookup(pGenx, pAstdeclContext)->pLvalPtr;
+	STypeId tidAllocator = pAstdeclContext->tid;
+	GetMemberAddress(pGenx, "allocator", &pLvalAllocator, &tidAllocator, pAstdeclContext);
+
+	LLVMOpaqueValue * pLvalProcAddr = pLvalAllocator;
+	STypeId tidProc = tidAllocator;
+	GetMemberAddress(pGenx, "proc", &pLvalProcAddr, &tidProc, pAstdeclContext);
+
+	LLVMOpaqueValue * pLvalDataAddr = pLvalAllocator;
+	STypeId tidData = tidAllocator;
+	GetMemberAddress(pGenx, "pData", &pLvalDataAddr, &tidData, pAstdeclContext);
+
+	auto pLvalProc = LLVMBuildLoad(pLbuilder, pLvalProcAddr, "");
+
+	auto pLvalFunc = LLVMGetBasicBlockParent(LLVMGetInsertBlock(pLbuilder));
+	auto pLblockProc = LLVMAppendBasicBlockInContext(pGenx->pLctx, pLvalFunc, "allocproc");
+	auto pLblockHeap = LLVMAppendBasicBlockInContext(pGenx->pLctx, pLvalFunc, "allocheap");
+	auto pLblockDone = LLVMAppendBasicBlockInContext(pGenx->pLctx, pLvalFunc, "allocdone");
+
+	(void) LLVMBuildCondBr(pLbuilder, LLVMBuildIsNull(pLbuilder, pLvalProc, ""), pLblockHeap, pLblockProc);
+
+	LLVMPositionBuilderAtEnd(pLbuilder, pLblockProc);
+	LLVMOpaqueValue * apLvalArg[] = { LLVMBuildLoad(pLbuilder, pLvalDataAddr, ""), pLvalV, pLvalCBOld, pLvalCBNew };
+	auto pLvalProcResult = LLVMBuildCall(pLbuilder, pLvalProc, apLvalArg, DIM(apLvalArg), "");
+	(void) LLVMBuildBr(pLbuilder, pLblockDone);
+	auto pLblockProcEnd = LLVMGetInsertBlock(pLbuilder);
+
+	LLVMPositionBuilderAtEnd(pLbuilder, pLblockHeap);
+	auto pLvalHeapResult = PlvalGenerateHeapAllocate(pGenx, pLvalV, pLvalCBNew);
+	(void) LLVMBuildBr(pLbuilder, pLblockDone);
+	auto pLblockHeapEnd = LLVMGetInsertBlock(pLbuilder);
+
+	LLVMPositionBuilderAtEnd(pLbuilder, pLblockDone);
+	auto pLvalPhi = LLVMBuildPhi(pLbuilder, LLVMTypeOf(pLvalProcResult), "");
+	LLVMOpaqueValue * apLvalIncoming[] = { pLvalProcResult, pLvalHeapResult };
+	LLVMBasicBlockRef apLblockIncoming[] = { pLblockProcEnd, pLblockHeapEnd };
+	LLVMAddIncoming(pLvalPhi, apLvalIncoming, apLblockIncoming, DIM(apLvalIncoming));
+
+	return pLvalPhi;
+}
+
+LLVMOpaqueValue * PlvalUnlikelyMetadata(SGenerateCtx * pGenx)
+{
+	// Branch weights for a conditional branch whose true side is rarely taken
+
+	auto pLctx = pGenx->pLctx;
+	const char * pChzWeights = "branch_weights";
+	LLVMMetadataRef apLmd[] = 
+	{ 
+		LLVMMDStringInContext2(pLctx, pChzWeights, strlen(pChzWeights)), 
+		LLVMValueAsMetadata(LLVMConstInt(LLVMInt32TypeInContext(pLctx), 1, false)),
+		LLVMValueAsMetadata(LLVMConstInt(LLVMInt32TypeInContext(pLctx), 2000, false)),
+	};
+
+	return LLVMMetadataAsValue(pLctx, LLVMMDNodeInContext2(pLctx, apLmd, DIM(apLmd)));
+}
+
+STypeId TidArrayColumn(const STypeArray * pTypearray, int iColumn)
+{
+	// SOA dynamic arrays have a column pointer per member, others just the one
+
+	if (!pTypearray->fSoa)
+		return pTypearray->tidElement;
+
+	return PtypestructSoa(pTypearray)->aMember[iColumn].pAstdecl->tid;
+}
+
+void GenerateArrayReserve(SGenerateCtx * pGenx, const STypeArray * pTypearray, LLVMOpaqueValue * pLvalAry, 
+							LLVMOpaqueValue * pLvalCMin)
+{
+	// Fast path is one compare against cMax. Otherwise grow every column to max(cMin, 2 * cMax, 8) elements.
+
+	auto pLbuilder = pGenx->pLbuilder;
+	int cColumn = (pTypearray->fSoa) ? PtypestructSoa(pTypearray)->cMember : 1;
+
+	auto pLvalCMaxAddr = LLVMBuildStructGEP(pLbuilder, pLvalAry, cColumn + 1, "");
+	auto pLvalCMax = LLVMBuildLoad(pLbuilder, pLvalCMaxAddr, "");
+
+	auto pLvalFunc = LLVMGetBasicBlockParent(LLVMGetInsertBlock(pLbuilder));
+	auto pLblockGrow = LLVMAppendBasicBlockInContext(pGenx->pLctx, pLvalFunc, "arraygrow");
+	auto pLblockGrown = LLVMAppendBasicBlockInContext(pGenx->pLctx, pLvalFunc, "arraygrown");
+
+	auto pLvalTest = LLVMBuildICmp(pLbuilder, LLVMIntSGT, pLvalCMin, pLvalCMax, "");
+	auto pLvalBranch = LLVMBuildCondBr(pLbuilder, pLvalTest, pLblockGrow, pLblockGrown);
+	LLVMSetMetadata(pLvalBranch, LLVMGetMDKindIDInContext(pGenx->pLctx, "prof", 4), PlvalUnlikelyMetadata(pGenx));
+
+	LLVMPositionBuilderAtEnd(pLbuilder, pLblockGrow);
+
+	auto pLvalCNew = LLVMBuildMul(pLbuilder, pLvalCMax, PlvalConstS64(pGenx, 2), "");
+	auto pLvalCFloor = PlvalConstS64(pGenx, 8);
+	pLvalCNew = LLVMBuildSelect(pLbuilder, LLVMBuildICmp(pLbuilder, LLVMIntSLT, pLvalCNew, pLvalCFloor, ""), 
+								pLvalCFloor, pLvalCNew, "");
+	pLvalCNew = LLVMBuildSelect(pLbuilder, LLVMBuildICmp(pLbuilder, LLVMIntSLT, pLvalCNew, pLvalCMin, ""), 
+								pLvalCMin, pLvalCNew, "");
+
+	auto pLtypePV = LLVMPointerType(LLVMInt8TypeInContext(pGenx->pLctx), 0);
+	for (int iColumn : IterCount(cColumn))
+	{
+		auto pLvalColumnAddr = LLVMBuildStructGEP(pLbuilder, pLvalAry, iColumn, "");
+		auto pLvalColumn = LLVMBuildLoad(pLbuilder, pLvalColumnAddr, "");
+		auto pLvalCBElement = PlvalConstS64(pGenx, CbSizeOf(TidArrayColumn(pTypearray, iColumn)));
+		auto pLvalCBOld = LLVMBuildMul(pLbuilder, pLvalCMax, pLvalCBElement, "");
+		auto pLvalCBNew = LLVMBuildMul(pLbuilder, pLvalCNew, pLvalCBElement, "");
+
+		auto pLvalColumnNew = PlvalGenerateAllocate(pGenx, LLVMBuildBitCast(pLbuilder, pLvalColumn, pLtypePV, ""), 
+													pLvalCBOld, pLvalCBNew);
+		LLVMBuildStore(pLbuilder, LLVMBuildBitCast(pLbuilder, pLvalColumnNew, LLVMTypeOf(pLvalColumn), ""), 
+						pLvalColumnAddr);
+	}
+
+	LLVMBuildStore(pLbuilder, pLvalCNew, pLvalCMaxAddr);
+	LLVMBuildBr(pLbuilder, pLblockGrown);
+
+	LLVMPositionBuilderAtEnd(pLbuilder, pLblockGrown);
+}
+
+void GenerateArrayElementAddresses(SGenerateCtx * pGenx, const STypeArray * pTypearray, LLVMOpaqueValue * pLvalAry, 
+									LLVMOpaqueValue * pLvalIndex, LLVMOpaqueValue ** apLvalAddr)
+{
+	// One address per column (see TidArrayColumn), columns are reloaded since they move when the array grows
+
+	auto pLbuilder = pGenx->pLbuilder;
+	if (pTypearray->fSoa)
+	{
+		GenerateSoaArrayAddresses(pGenx, pTypearray, LLVMBuildLoad(pLbuilder, pLvalAry, ""), pLvalIndex, apLvalAddr);
+		return;
+	}
+
+	auto pLvalA = LLVMBuildLoad(pLbuilder, LLVMBuildStructGEP(pLbuilder, pLvalAry, 0, ""), "");
+	apLvalAddr[0] = LLVMBuildGEP(pLbuilder, pLvalA, &pLvalIndex, 1, "");
+}
+
+LLVMOpaqueValue * PlvalLoadArrayElement(SGenerateCtx * pGenx, const STypeArray * pTypearray, 
+										LLVMOpaqueValue * pLvalAry, LLVMOpaqueValue * pLvalIndex)
+{
+	int cColumn = (pTypearray->fSoa) ? PtypestructSoa(pTypearray)->cMember : 1;
+	auto apLval = static_cast<LLVMOpaqueValue **>(alloca(sizeof(LLVMOpaqueValue *) * cColumn));
+	GenerateArrayElementAddresses(pGenx, pTypearray, pLvalAry, pLvalIndex, apLval);
+
+	for (int iColumn : IterCount(cColumn))
+	{
+		apLval[iColumn] = LLVMBuildLoad(pGenx->pLbuilder, apLval[iColumn], "");
+	}
+
+	if (!pTypearray->fSoa)
+		return apLval[0];
+
+	return PlvalBuildStruct(pGenx, PltypeGenerate(pGenx, pTypearray->tidElement), apLval, cColumn);
+}
+
+void StoreArrayElement(SGenerateCtx * pGenx, const STypeArray * pTypearray, LLVMOpaqueValue * pLvalAry, 
+						LLVMOpaqueValue * pLvalIndex, LLVMOpaqueValue * pLvalValue)
+{
+	int cColumn = (pTypearray->fSoa) ? PtypestructSoa(pTypearray)->cMember : 1;
+	auto apLvalAddr = static_cast<LLVMOpaqueValue **>(alloca(sizeof(LLVMOpaqueValue *) * cColumn));
+	GenerateArrayElementAddresses(pGenx, pTypearray, pLvalAry, pLvalIndex, apLvalAddr);
+
+	if (!pTypearray->fSoa)
+	{
+		LLVMBuildStore(pGenx->pLbuilder, pLvalValue, apLvalAddr[0]);
+		return;
+	}
+
+	for (int iColumn : IterCount(cColumn))
+	{
+		auto pLvalMember = LLVMBuildExtractValue(pGenx->pLbuilder, pLvalValue, iColumn, "");
+		LLVMBuildStore(pGenx->pLbuilder, pLvalMember, apLvalAddr[iColumn]);
+	}
+}
+
+LLVMOpaqueValue * PlvalGenerateDefaultValue(SGenerateCtx * pGenx, STypeId tid, LLVMOpaqueType * pLtype);
+
+LLVMOpaqueValue * PlvalGenerateAryop(SGenerateCtx * pGenx, SAstCall * pAstcall, ARYOP aryop)
+{
+	// Dynamic array operations are generated in place, there's no runtime library behind them
+
+	auto pLbuilder = pGenx->pLbuilder;
+	auto pAstAry = pAstcall->arypAstArgs[0];
+	auto pTypearray = PtypearrayFromAryopArg(pAstAry->tid);
+	int cColumn = (pTypearray->fSoa) ? PtypestructSoa(pTypearray)->cMember : 1;
+
+	auto pLvalAry = PlvalGenerateRecursive(pGenx, pAstAry);
+	auto pLvalArg = (pAstcall->arypAstArgs.c > 1) ? PlvalGenerateRecursive(pGenx, pAstcall->arypAstArgs[1]) : nullptr;
+
+	auto pLvalCAddr = LLVMBuildStructGEP(pLbuilder, pLvalAry, cColumn, "");
+	auto pLvalC = LLVMBuildLoad(pLbuilder, pLvalCAddr, "");
+
+	switch (aryop)
+	{
+	case ARYOP_Add:
+		{
+			auto pLvalCNew = LLVMBuildAdd(pLbuilder, pLvalC, PlvalConstS64(pGenx, 1), "");
+			GenerateArrayReserve(pGenx, pTypearray, pLvalAry, pLvalCNew);
+			StoreArrayElement(pGenx, pTypearray, pLvalAry, pLvalC, pLvalArg);
+			LLVMBuildStore(pLbuilder, pLvalCNew, pLvalCAddr);
+			return nullptr;
+		}
+
+	case ARYOP_Reserve:
+		GenerateArrayReserve(pGenx, pTypearray, pLvalAry, pLvalArg);
+		return nullptr;
+
+	case ARYOP_Resize:
+		{
+			// Elements past the old count get their default value, shrinking only changes the count
+
+			GenerateArrayReserve(pGenx, pTypearray, pLvalAry, pLvalArg);
+
+			auto pLtypeIndex = LLVMInt64TypeInContext(pGenx->pLctx);
+			auto pLvalIndexAddr = LLVMBuildAlloca(pGenx->pLbuilderAlloc, pLtypeIndex, "");
+			LLVMBuildStore(pLbuilder, pLvalC, pLvalIndexAddr);
+
+			auto pLvalFunc = LLVMGetBasicBlockParent(LLVMGetInsertBlock(pLbuilder));
+			auto pLblockTest = LLVMAppendBasicBlockInContext(pGenx->pLctx, pLvalFunc, "arrayfilltest");
+			auto pLblockFill = LLVMAppendBasicBlockInContext(pGenx->pLctx, pLvalFunc, "arrayfill");
+			auto pLblockFilled = LLVMAppendBasicBlockInContext(pGenx->pLctx, pLvalFunc, "arrayfilled");
+
+			LLVMBuildBr(pLbuilder, pLblockTest);
+			LLVMPositionBuilderAtEnd(pLbuilder, pLblockTest);
+
+			auto pLvalIndex = LLVMBuildLoad(pLbuilder, pLvalIndexAddr, "");
+			LLVMBuildCondBr(pLbuilder, LLVMBuildICmp(pLbuilder, LLVMIntSLT, pLvalIndex, pLvalArg, ""), 
+							pLblockFill, pLblockFilled);
+			LLVMPositionBuilderAtEnd(pLbuilder, pLblockFill);
+
+			auto pLvalDefault = PlvalGenerateDefaultValue(pGenx, pTypearray->tidElement, 
+															PltypeGenerate(pGenx, pTypearray->tidElement));
+			StoreArrayElement(pGenx, pTypearray, pLvalAry, pLvalIndex, pLvalDefault);
+			LLVMBuildStore(pLbuilder, LLVMBuildAdd(pLbuilder, pLvalIndex, PlvalConstS64(pGenx, 1), ""), pLvalIndexAddr);
+			LLVMBuildBr(pLbuilder, pLblockTest);
+
+			LLVMPositionBuilderAtEnd(pLbuilder, pLblockFilled);
+			LLVMBuildStore(pLbuilder, pLvalArg, pLvalCAddr);
+			return nullptr;
+		}
+
+	case ARYOP_UnorderedRemove:
+		{
+			auto pLvalCNew = LLVMBuildSub(pLbuilder, pLvalC, PlvalConstS64(pGenx, 1), "");
+			auto pLvalLast = PlvalLoadArrayElement(pGenx, pTypearray, pLvalAry, pLvalCNew);
+			StoreArrayElement(pGenx, pTypearray, pLvalAry, pLvalArg, pLvalLast);
+			LLVMBuildStore(pLbuilder, pLvalCNew, pLvalCAddr);
+			return nullptr;
+		}
+
+	case ARYOP_Pop:
+		{
+			auto pLvalCNew = LLVMBuildSub(pLbuilder, pLvalC, PlvalConstS64(pGenx, 1), "");
+			auto pLvalLast = PlvalLoadArrayElement(pGenx, pTypearray, pLvalAry, pLvalCNew);
+			LLVMBuildStore(pLbuilder, pLvalCNew, pLvalCAddr);
+			return pLvalLast;
+		}
+
+	case ARYOP_Free:
+		{
+			// Reallocating to zero bytes frees
+
+			auto pLvalCMax = LLVMBuildLoad(pLbuilder, LLVMBuildStructGEP(pLbuilder, pLvalAry, cColumn + 1, ""), "");
+			auto pLtypePV = LLVMPointerType(LLVMInt8TypeInContext(pGenx->pLctx), 0);
+			for (int iColumn : IterCount(cColumn))
+			{
+				auto pLvalColumnAddr = LLVMBuildStructGEP(pLbuilder, pLvalAry, iColumn, "");
+				auto pLvalColumn = LLVMBuildLoad(pLbuilder, pLvalColumnAddr, "");
+				auto pLvalCBOld = LLVMBuildMul(pLbuilder, pLvalCMax, 
+												PlvalConstS64(pGenx, CbSizeOf(TidArrayColumn(pTypearray, iColumn))), "");
+
+				(void) PlvalGenerateAllocate(pGenx, LLVMBuildBitCast(pLbuilder, pLvalColumn, pLtypePV, ""), 
+											 pLvalCBOld, PlvalConstS64(pGenx, 0));
+				LLVMBuildStore(pLbuilder, LLVMConstNull(LLVMTypeOf(pLvalColumn)), pLvalColumnAddr);
+			}
+
+			LLVMBuildStore(pLbuilder, PlvalConstS64(pGenx, 0), pLvalCAddr);
+			LLVMBuildStore(pLbuilder, PlvalConstS64(pGenx, 0), LLVMBuildStructGEP(pLbuilder, pLvalAry, cColumn + 1, ""));
+			return nullptr;
+		}
+
+	default:
+		ASSERT(false);
+		return nullptr;
+	}
+}
+
+LLVMOpaqueValue * PlvalSplat(SGenerateCtx * pGenx, LLVMOpaqueValue * pLvalElement, LLVMOpaqueType * pLtypeVector)
+{
+	auto pLbuilder = pGenx->pLbuilder;
+	auto pLvalInsert = LLVMBuildInsertElement(pLbuilder, LLVMGetUndef(pLtypeVector), pLvalElement, 
+											  PlvalConstS32(pGenx, 0), "");
+	auto pLtypeMask = LLVMVectorType(LLVMInt32TypeInContext(pGenx->pLctx), LLVMGetVectorSize(pLtypeVector));
+	return LLVMBuildShuffleVector(pLbuilder, pLvalInsert, LLVMGetUndef(pLtypeVector), LLVMConstNull(pLtypeMask), "");
+}
+
+LLVMOpaqueValue * PlvalGenerateVecop(SGenerateCtx * pGenx, SAstCall * pAstcall, VECOP vecop)
+{
+	auto pLbuilder = pGenx->pLbuilder;
+	auto pWork = pGenx->pWork;
+	auto & arypAstArgs = pAstcall->arypAstArgs;
+
+	switch (vecop)
+	{
+	case VECOP_Shuffle:
+		{
+			auto pLvalA = PlvalGenerateRecursive(pGenx, arypAstArgs[0]);
+			auto pLvalB = PlvalGenerateRecursive(pGenx, arypAstArgs[1]);
+
+			int cIndex = arypAstArgs.c - 2;
+			auto apLvalMask = static_cast<LLVMOpaqueValue **>(alloca(sizeof(LLVMOpaqueValue *) * cIndex));
+			for (int iIndex : IterCount(cIndex))
+			{
+				apLvalMask[iIndex] = PlvalConstS32(pGenx, IElementShuffle(pWork, arypAstArgs[iIndex + 2]));
+			}
+
+			return LLVMBuildShuffleVector(pLbuilder, pLvalA, pLvalB, LLVMConstVector(apLvalMask, cIndex), "");
+		}
+
+	case VECOP_Select:
+		{
+			// Lanes with any bit set in the mask take a, like the masks comparisons produce
+
+			auto pLvalMask = PlvalGenerateRecursive(pGenx, arypAstArgs[0]);
+			auto pLvalA = PlvalGenerateRecursive(pGenx, arypAstArgs[1]);
+			auto pLvalB = PlvalGenerateRecursive(pGenx, arypAstArgs[2]);
+
+			auto pLvalCond = LLVMBuildICmp(pLbuilder, LLVMIntNE, pLvalMask, LLVMConstNull(LLVMTypeOf(pLvalMask)), "");
+			return LLVMBuildSelect(pLbuilder, pLvalCond, pLvalA, pLvalB, "");
+		}
+
+	case VECOP_ReduceAdd:
+	case VECOP_ReduceMul:
+	case VECOP_ReduceMin:
+	case VECOP_ReduceMax:
+		{
+			auto pAstVector = arypAstArgs[0];
+			auto pTypevec = PtypeCast<STypeVector>(pAstVector->tid.pType);
+			TYPEK typekElement = pTypevec->tidElement.pType->typek;
+			bool fFloat = FIsFloat(typekElement);
+			bool fSigned = !fFloat && FSigned(typekElement);
+
+			// BB (adrianb) Float add/mul reductions are ordered (a start value and no reassoc flag), the C api 
+			//  can't set fast math flags. Still one call instead of a chain of extracts.
+
+			const char * pChzIntrinsic = nullptr;
+			switch (vecop)
+			{
+			case VECOP_ReduceAdd: pChzIntrinsic = (fFloat) ? "llvm.vector.reduce.fadd" : "llvm.vector.reduce.add"; break;
+			case VECOP_ReduceMul: pChzIntrinsic = (fFloat) ? "llvm.vector.reduce.fmul" : "llvm.vector.reduce.mul"; break;
+			case VECOP_ReduceMin: 
+				pChzIntrinsic = (fFloat) ? "llvm.vector.reduce.fmin" : 
+								(fSigned) ? "llvm.vector.reduce.smin" : "llvm.vector.reduce.umin";
+				break;
+			case VECOP_ReduceMax: 
+				pChzIntrinsic = (fFloat) ? "llvm.vector.reduce.fmax" : 
+								(fSigned) ? "llvm.vector.reduce.smax" : "llvm.vector.reduce.umax";
+				break;
+			default: ASSERT(false); break;
+			}
+
+			auto pLvalVector = PlvalGenerateRecursive(pGenx, pAstVector);
+			auto pLtypeVector = LLVMTypeOf(pLvalVector);
+			unsigned idIntrinsic = LLVMLookupIntrinsicID(pChzIntrinsic, strlen(pChzIntrinsic));
+			ASSERT(idIntrinsic != 0);
+			auto pLvalIntrinsic = LLVMGetIntrinsicDeclaration(pGenx->pLmod, idIntrinsic, &pLtypeVector, 1);
+
+			LLVMOpaqueValue * apLvalArgs[2];
+			int cArg = 0;
+			if (fFloat && (vecop == VECOP_ReduceAdd || vecop == VECOP_ReduceMul))
+				apLvalArgs[cArg++] = LLVMConstReal(LLVMGetElementType(pLtypeVector), (vecop == VECOP_ReduceAdd) ? 0.0 : 1.0);
+			apLvalArgs[cArg++] = pLvalVector;
+
+			return LLVMBuildCall(pLbuilder, pLvalIntrinsic, apLvalArgs, cArg, "");
+		}
+
+	default:
+		ASSERT(false);
+		return nullptr;
+	}
+}
+
+LLVMOpaqueValue * PlvalGenerateCall(SGenerateCtx * pGenx, SAstCall * pAstcall, bool fNoInline = false)
+{
+	auto pLbuilder = pGenx->pLbuilder;
+
+	// BB (adrianb) Handle vararg [] Any case. C vararg case.
+
+	// BB (adrianb) Creating extern function:
+	// Function *F = Function::Create(FT, Function::ExternalLinkage, Name, TheModule);
+	// Do this for all functions? E.g. so out of order will work? Or just start the function
+	// and continue filling it later.
+
+	if (pAstcall->pAstFunc->astk == ASTK_Identifier)
+	{
+		auto pChzIdent = PastCast<SAstIdentifier>(pAstcall->pAstFunc)->pChz;
+		bool fIsSizeOf = strcmp(pChzIdent, "sizeof") == 0;
+		if (fIsSizeOf || strcmp(pChzIdent, "alignof") == 0)
+		{
+			STypeId tid = pAstcall->arypAstArgs[0]->tid;
+			if (tid.pType->typek == TYPEK_TypeOf)
+				tid = PtypeCast<STypeTypeOf>(tid.pType)->tid;
+			return PlvalConstU64(pGenx, (fIsSizeOf) ? CbSizeOf(tid) : CbAlignOf(tid));
+		}
+
+		// Builtin calls never resolve their identifier, user procedures with the same name do (see TypeCheck)
+
+		bool fIsBuiltin = pAstcall->pAstFunc->tid.pType == nullptr;
+
+		ARYOP aryop = AryopFromPchz(pChzIdent);
+		if (fIsBuiltin && aryop != ARYOP_Nil)
+			return PlvalGenerateAryop(pGenx, pAstcall, aryop);
+
+		VECOP vecop = VecopFromPchz(pChzIdent);
+		if (fIsBuiltin && vecop != VECOP_Nil)
+			return PlvalGenerateVecop(pGenx, pAstcall, vecop);
+	}
+
+	// Calls to inline procedures generate their body here unless the call site says noinline
+
+	auto pAstprocCalled = PastprocCalled(pGenx->pWork, pAstcall);
+	if (!fNoInline && pAstprocCalled && pAstprocCalled->fIsInline && FCanInline(pGenx, pAstcall, pAstprocCalled))
+		return PlvalGenerateInline(pGenx, pAstcall, pAstprocCalled);
+
+	auto pLvalProc = PlvalGenerateRecursive(pGenx, pAstcall->pAstFunc);
+
+	// Lower arguments to the C ABI, including extra C vararg arguments (see ComputeAbiproc)
+
+	auto pTypeproc = PtypeCast<STypeProcedure>(pAstcall->pAstFunc->tid.pType);
+	int cArg = pAstcall->arypAstArgs.c;
+	auto aTidArg = static_cast<STypeId *>(alloca(sizeof(STypeId) * cArg));
+	for (int iArg : IterCount(cArg))
+	{
+		aTidArg[iArg] = (iArg < pTypeproc->cTidArg) ? pTypeproc->aTidArg[iArg] : pAstcall->arypAstArgs[iArg]->tid;
+	}
+
+	SAbiProc abiproc = {};
+	defer { Destroy(&abiproc); };
+	ComputeAbiproc(pGenx, pTypeproc, aTidArg, cArg, &abiproc, pAstprocCalled);
+
+	auto apLvalParam = static_cast<LLVMOpaqueValue **>(alloca(sizeof(LLVMOpaqueValue *) * abiproc.cLtypeParam));
+	int cLvalParam = 0;
+
+	auto pAbivalRet = &abiproc.abivalRet;
+	LLVMOpaqueValue * pLvalRetAddr = nullptr;
+	if (pAbivalRet->abik == ABIK_Memory)
+	{
+		pLvalRetAddr = PlvalAbiTemp(pGenx, pAbivalRet, "sret");
+		apLvalParam[cLvalParam++] = pLvalRetAddr;
+	}
+
+	for (int iArg : IterCount(cArg))
+	{
+		auto pAbival = &abiproc.aryAbivalArg[iArg];
+		auto pAstArg = pAstcall->arypAstArgs[iArg];
+
+		// Byval and callees that copy references make their own copy of variables before anything can change them. 
+		//  Other references must not change during the call, so only locals nothing points at are passed in place, 
+		//  anything else is copied to a temporary first.
+
+		if (pAbival->abik == ABIK_Memory)
+		{
+			auto pLvalAddr = PlvalVariableAddress(pGenx, pAstArg);
+			if (pLvalAddr && 
+				(!pAbival->fByReference || pAbival->fCopiedByCallee || FIsUnaliasedLocal(pGenx, pAstArg)))
+			{
+				apLvalParam[cLvalParam++] = pLvalAddr;
+				continue;
+			}
+		}
+
+		auto pLvalArg = PlvalGenerateRecursive(pGenx, pAstArg);
+		if (pAbival->abik == ABIK_Direct)
+		{
+			apLvalParam[cLvalParam++] = pLvalArg;
+			continue;
+		}
+
+		auto pLvalPtr = PlvalAbiTemp(pGenx, pAbival, "arg");
+		LLVMBuildStore(pLbuilder, pLvalArg, pLvalPtr);
+
+		if (pAbival->abik == ABIK_Memory)
+		{
+			apLvalParam[cLvalParam++] = pLvalPtr;
+		}
+		else
+		{
+			LoadCoerced(pGenx, pAbival, pLvalPtr, &apLvalParam[cLvalParam]);
+			cLvalParam += pAbival->cLtypeCoerce;
+		}
+	}
+
+	ASSERT(cLvalParam == abiproc.cLtypeParam);
+
+	auto pLvalCall = LLVMBuildCall(pLbuilder, pLvalProc, apLvalParam, cLvalParam, "");
+	AddAbiAttributes(pGenx, &abiproc, pLvalCall);
+	if (fNoInline)
+		LLVMAddCallSiteAttribute(pLvalCall, LLVMAttributeFunctionIndex, PlattrEnum(pGenx, "noinline"));
+
+	switch (pAbivalRet->abik)
+	{
+	case ABIK_Direct:
+		return pLvalCall;
+
+	case ABIK_Memory:
+		return LLVMBuildLoad(pLbuilder, pLvalRetAddr, "");
+
+	case ABIK_Coerce:
+		{
+			LLVMOpaqueValue * apLvalRet[2] = { pLvalCall, nullptr };
+			if (pAbivalRet->cLtypeCoerce > 1)
+			{
+				for (int iLval : IterCount(pAbivalRet->cLtypeCoerce))
+				{
+					apLvalRet[iLval] = LLVMBuildExtractValue(pLbuilder, pLvalCall, iLval, "");
+				}
+			}
+
+			auto pLvalPtr = PlvalAbiTemp(pGenx, pAbivalRet, "ret");
+			StoreCoerced(pGenx, pAbivalRet, apLvalRet, pLvalPtr);
+			return LLVMBuildLoad(pLbuilder, pLvalPtr, "");
+		}
+
+	default:
+		return nullptr;
+	}
+}
+
+LLVMOpaqueValue * PlvalGenerateConstant(SGenerateCtx * pGenx, SAst * pAst)
+{
+	ASTK astk = pAst->astk;
+	switch (astk)
+	{
+	case ASTK_Literal:
+		{
+			auto pAstlit = PastCast<SAstLiteral>(pAst);
+			const SLiteral & lit = pAstlit->lit;
+			if (lit.litk == LITK_String && pAst->tid.pType->typek == TYPEK_Pointer)
+			{
+				ASSERT(PtypeCast<STypePointer>(pAst->tid.pType)->tidPointedTo.pType->typek == TYPEK_U8);
+
+				// BB (adrianb) String or StringPtr? Do we need to pool these manually?
+				// BB (adrianb) LLVMConstString instead?
+				return LLVMBuildGlobalStringPtr(pGenx->pLbuilder, lit.pChz, "stringptr");
+			}
+
+			return PlvalLoadConst(pGenx, pAst);
+		}
+
+	case ASTK_Null:
+	case ASTK_Cast:
+	case ASTK_Operator:
+	case ASTK_Identifier:
+	case ASTK_RunDirective:
+		return PlvalLoadConst(pGenx, pAst);
+
+	case ASTK_Procedure:
+		{
+			// Identifier reference to procedure
+
+			//AddReferenced(pGenx, pAst);
+			return PlvalEnsureProcedure(pGenx, PastCast<SAstProcedure>(pAst));
+		}
+
+	default:
+		ShowErr(pAst->errinfo, "Can't generate constant for ast %s(%d)", PchzFromAstk(astk), astk);
+		return nullptr;
+	}
+}
+
+LLVMOpaqueValue * PlvalGenerateDefaultValue(SGenerateCtx * pGenx, STypeId tid, LLVMOpaqueType * pLtype)
+{
+	// NOTE (adrianb) Fixed arrays can be too big for the stack.
+
+	auto pVVal = malloc(max(CbSizeOf(tid), 1u));
+	defer { free(pVVal); };
+
+	EvalDefaultValue(pGenx->pWork, tid, static_cast<u8*>(pVVal));
+
+	return PlvalConst(pGenx, tid, pVVal);
+}
+
+void GenerateDefaultValueStore(SGenerateCtx * pGenx, STypeId tid, LLVMOpaqueValue * pLvalAddr)
+{
+	// Aggregates bigger than two registers are cleared with memset or copied from a constant global like clang does,
+	//  rather than storing a constant llvm splits per element. The global (null if all zeroes) is made once per type.
+
+	auto pLbuilder = pGenx->pLbuilder;
+	auto pLtype = PltypeGenerate(pGenx, tid);
+	LLVMTypeKind ltypek = LLVMGetTypeKind(pLtype);
+	u32 cB = CbSizeOf(tid);
+	if ((ltypek != LLVMStructTypeKind && ltypek != LLVMArrayTypeKind) || cB <= 16)
+	{
+		LLVMBuildStore(pLbuilder, PlvalGenerateDefaultValue(pGenx, tid, pLtype), pLvalAddr);
+		return;
+	}
+
+	auto hv = HvFromKey(reinterpret_cast<u64>(tid.pType));
+	LLVMOpaqueValue * pLvalGlobal = nullptr;
+	if (LLVMOpaqueValue ** ppLvalGlobal = PtLookupImpl(&pGenx->hashPtypePlvalDefault, hv, tid.pType))
+	{
+		pLvalGlobal = *ppLvalGlobal;
+	}
+	else
+	{
+		auto pBVal = static_cast<u8 *>(malloc(cB));
+		defer { free(pBVal); };
+
+		EvalDefaultValue(pGenx->pWork, tid, pBVal);
+
+		for (u32 iB : IterCount(cB))
+		{
+			if (pBVal[iB] == 0)
+				continue;
+
+			pLvalGlobal = LLVMAddGlobal(pGenx->pLmod, pLtype, "default");
+			LLVMSetGlobalConstant(pLvalGlobal, true);
+			LLVMSetLinkage(pLvalGlobal, LLVMPrivateLinkage);
+			LLVMSetInitializer(pLvalGlobal, PlvalConst(pGenx, tid, pBVal));
+			LLVMSetUnnamedAddr(pLvalGlobal, true);
+			LLVMSetAlignment(pLvalGlobal, CbAlignOf(tid));
+			break;
+		}
+
+		Add(&pGenx->hashPtypePlvalDefault, hv, tid.pType, pLvalGlobal);
+	}
+
+	auto pLtypePV = LLVMPointerType(LLVMInt8TypeInContext(pGenx->pLctx), 0);
+	auto pLvalV = LLVMBuildBitCast(pLbuilder, pLvalAddr, pLtypePV, "");
+	auto pLvalCB = PlvalConstU64(pGenx, cB);
+	if (pLvalGlobal)
+	{
+		auto pLvalVGlobal = LLVMBuildBitCast(pLbuilder, pLvalGlobal, pLtypePV, "");
+		(void) LLVMBuildMemCpy(pLbuilder, pLvalV, CbAlignOf(tid), pLvalVGlobal, CbAlignOf(tid), pLvalCB);
+	}
+	else
+	{
+		auto pLvalZero = LLVMConstInt(LLVMInt8TypeInContext(pGenx->pLctx), 0, false);
+		(void) LLVMBuildMemSet(pLbuilder, pLvalV, pLvalZero, pLvalCB, CbAlignOf(tid));
+	}
+}
+
+LLVMOpaqueValue * PlvalGenerateInlineCall(SGenerateCtx * pGenx, SAstInline * pAstinline)
+{
+	auto pLbuilder = pGenx->pLbuilder;
+	auto pAstcall = PastCast<SAstCall>(pAstinline->pAstExpr);
+	auto pAstprocCalled = PastprocCalled(pGenx->pWork, pAstcall);
+
+	if (pAstinline->fNoInline)
+		return PlvalGenerateCall(pGenx, pAstcall, true);
+
+	if (pAstprocCalled && FCanInline(pGenx, pAstcall, pAstprocCalled))
+		return PlvalGenerateInline(pGenx, pAstcall, pAstprocCalled);
+
+	// Otherwise (calls through pointers, foreign procedures, recursion) leave it to llvm
+
+	auto pLvalRet = PlvalGenerateCall(pGenx, pAstcall);
+	auto pLvalCall = (pLvalRet) ? pLvalRet : LLVMGetLastInstruction(LLVMGetInsertBlock(pLbuilder));
+	if (pLvalCall && LLVMIsACallInst(pLvalCall))
+		LLVMAddCallSiteAttribute(pLvalCall, LLVMAttributeFunctionIndex, PlattrEnum(pGenx, "alwaysinline"));
+
+	return pLvalRet;
+}
+
+LLVMOpaqueValue * PlvalGenerateMultiValue(SGenerateCtx * pGenx, SAst * pAstValue)
+{
+	// All the values a call returns, packed in a literal struct when there's more than one
+
+	if (pAstValue->astk == ASTK_Inline)
+		return PlvalGenerateInlineCall(pGenx, PastCast<SAstInline>(pAstValue));
+
+	return PlvalGenerateCall(pGenx, PastCast<SAstCall>(pAstValue));
+}
+
+LLVMOpaqueValue * PlvalUnpackValue(SGenerateCtx * pGenx, SAst * pAstValue, LLVMOpaqueValue * pLvalValues, int iValue)
+{
+	auto pTypeproc = PtypeprocMultiValue(pAstValue);
+	if (!pTypeproc || pTypeproc->cTidRet < 2)
+	{
+		ASSERT(iValue == 0);
+		return pLvalValues;
+	}
+
+	return LLVMBuildExtractValue(pGenx->pLbuilder, pLvalValues, iValue, "");
+}
+
+LLVMOpaqueValue * PlvalFirstValue(SGenerateCtx * pGenx, SAst * pAstValue, LLVMOpaqueValue * pLvalValues)
+{
+	// Expressions only see the first of multiple return values
+
+	if (!pLvalValues)
+		return nullptr;
+
+	return PlvalUnpackValue(pGenx, pAstValue, pLvalValues, 0);
+}
+
+LLVMOpaqueValue * PlvalGenerateRecursive(SGenerateCtx * pGenx, SAst * pAst)
+{
+	auto pWork = pGenx->pWork;
+	auto pLbuilder = pGenx->pLbuilder;
+
+	switch (pAst->astk)
 	{
 	case ASTK_Literal:
+	case ASTK_Null:
+		return PlvalGenerateConstant(pGenx, pAst);
+
+	// ASTK_UninitializedValue
+
+	case ASTK_Block:
+		{
+			SScopeCtx scopectx = ScopectxPush(pGenx);
+			auto pAstblock = PastCast<SAstBlock>(pAst);
+			for (int ipAst : IterCount(pAstblock->arypAst.c))
+			{
+				(void) PlvalGenerateRecursive(pGenx, pAstblock->arypAst[ipAst]);
+
+				// Statements after a nested block that returned (e.g. the branch kept from a folded if) are 
+				//  unreachable, they go in their own block like the code after an if that returns on both sides
+
+				if (pGenx->fScopeTerminated && ipAst + 1 < pAstblock->arypAst.c)
+				{
+					pGenx->fScopeTerminated = false;
+					auto pLvalFunc = LLVMGetBasicBlockParent(LLVMGetInsertBlock(pLbuilder));
+					LLVMPositionBuilderAtEnd(pLbuilder, LLVMAppendBasicBlockInContext(pGenx->pLctx, pLvalFunc, "dead"));
+				}
+			}
+			PopScope(pGenx, scopectx);
+			return nullptr;
+		}
+
+	case ASTK_EmptyStatement:
+		return nullptr;
+
+	case ASTK_Identifier:
+		{
+			// If we are a constant, just go directly to constant evaluation
+
+			auto pResdecl = PresdeclResolved(pWork, pAst);
+			auto pAstdecl = pResdecl->pDecl->pAstdecl;
+			if (pAstdecl->fIsConstant)
+			{
+				return PlvalLoadConst(pGenx, pAstdecl);
+			}
+			else
+			{
+				if (pResdecl->arypDeclUsingPath.c == 0)
+				{
+					auto pStorage = PstorageLookup(pGenx, pAstdecl);
+					if (pStorage->pLvalValue)
+						return pStorage->pLvalValue;
+				}
+
+				auto pLvalAddr = PlvalGetLoadStoreAddress(pGenx, pAst);
+				return LLVMBuildLoad(pLbuilder, pLvalAddr, "");
+			}
+		}
+		break;
+
+	case ASTK_Operator:
+		{
+			auto pAstop = PastCast<SAstOperator>(pAst);
+			auto op = pAstop->op;
+
+			// BB (adrianb) Table drive these or it will get insane!
+
+			if (pAstop->pAstLeft == nullptr)
+			{
+				auto pAstRight = pAstop->pAstRight;
+				TYPEK typekRight = pAstRight->tid.pType->typek;
+
+				if (op == OP_Sub)
+				{
+					auto pLval = PlvalGenerateRecursive(pGenx, pAstRight);
+
+					if (typekRight == TYPEK_Vector)
+						typekRight = PtypeCast<STypeVector>(pAstRight->tid.pType)->tidElement.pType->typek;
+
+					if (FIsInt(typekRight))
+						return LLVMBuildNeg(pLbuilder, pLval, "");
+					else if (FIsFloat(typekRight))
+						return LLVMBuildFNeg(pLbuilder, pLval, "");
+				}
+				else if (op == OP_Not || op == OP_BitNot)
+				{
+					auto pLval = PlvalGenerateRecursive(pGenx, pAstRight);
+					return LLVMBuildNot(pLbuilder, pLval, "");
+				}
+				else if (op == OP_Increment)
+				{
+					ASSERT(FIsInt(typekRight));
+					auto pLvalAddr = PlvalGetLoadStoreAddress(pGenx, pAstRight);
+					auto pLvalOrig = LLVMBuildLoad(pLbuilder, pLvalAddr, "");
+					auto pLvalOne = LLVMConstInt(PltypeGenerate(pGenx, pAstRight->tid), 1, false);
+					auto pLvalInc = LLVMBuildAdd(pLbuilder, pLvalOrig, pLvalOne, "");
+					LLVMBuildStore(pLbuilder, pLvalInc, pLvalAddr);
+					return pLvalInc;
+				}
+				else if (op == OP_Mul)
+				{
+					if (FIsSoaElement(pAstRight))
+					{
+						// SOA pointers are the addresses of each member
+
+						int cMember = PtypeCast<STypeStruct>(pAstRight->tid.pType)->cMember;
+						auto apLvalAddr = static_cast<LLVMOpaqueValue **>(alloca(sizeof(LLVMOpaqueValue *) * cMember));
+						GenerateSoaMemberAddresses(pGenx, pAstRight, apLvalAddr);
+						return PlvalBuildStruct(pGenx, PltypeGenerate(pGenx, pAst->tid), apLvalAddr, cMember);
+					}
+
+					return PlvalGetLoadStoreAddress(pGenx, pAstRight);
+				}
+				else if (op == OP_ShiftLeft)
+				{
+					if (FIsSoaPointer(pAstRight->tid))
+						return PlvalGenerateSoaLoad(pGenx, pAst);
+
+					auto pLvalRight = PlvalGenerateRecursive(pGenx, pAstRight);
+					return LLVMBuildLoad(pLbuilder, pLvalRight, "");
+				}
+
+				ASSERTCHZ(false, "Unary operator %s generation with type %s NYI", 
+						  PchzFromOp(op), StrPrintType(pAstRight->tid.pType).Pchz());
+			}
+			else
+			{
+				auto pAstLeft = pAstop->pAstLeft;
+				auto pAstRight = pAstop->pAstRight;
+
+				if (const SGenerateBinaryOperator * pGbop = s_optableGbop.PtLookup(op))
+				{
+					return PlvalGenerateBinaryOperator(pGenx, *pGbop, pAstLeft, pAstRight);
+				}
+
+				if (const SGenerateBinaryOperator * pGbop = s_optableGbopAssign.PtLookup(op))
+				{
+					GenerateBinaryAssignOperator(pGenx, *pGbop, pAstLeft, pAstRight);
+					return nullptr;
+				}
+
+				bool fIsOrOp = op == OP_Or;
+				if (fIsOrOp || op == OP_And)
+				{
+					// Eval left, branch on it, eval right, branch to done, done phi based on first and 2nd branch
+
+					// BB (adrianb) Could chain ands and ors together for less branching. This is entirely
+					//  local which is nice.
+
+					auto pLvalTest = PlvalGenerateRecursive(pGenx, pAstLeft);
+
+					auto pLblockStart = LLVMGetInsertBlock(pLbuilder);
+					auto pLvalFunc = LLVMGetBasicBlockParent(pLblockStart);
+					auto pLblockRight = LLVMAppendBasicBlockInContext(pGenx->pLctx, pLvalFunc, 
+																		(fIsOrOp) ? "orright" : "andright");
+					auto pLblockDone = LLVMAppendBasicBlockInContext(pGenx->pLctx, pLvalFunc, 
+																		(fIsOrOp) ? "ordone" : "anddone");
+					
+					if (fIsOrOp)
+						LLVMBuildCondBr(pLbuilder, pLvalTest, pLblockDone, pLblockRight);
+					else
+						LLVMBuildCondBr(pLbuilder, pLvalTest, pLblockRight, pLblockDone);
+					
+					LLVMPositionBuilderAtEnd(pLbuilder, pLblockRight);
+
+					auto pLvalRight = PlvalGenerateRecursive(pGenx, pAstRight);
+                    auto pLblockLast = LLVMGetInsertBlock(pLbuilder);
+					Branch(pGenx, pLblockDone, pAst);
+					
+					LLVMPositionBuilderAtEnd(pLbuilder, pLblockDone);
+
+					ASSERT(pAst->tid.pType->typek == TYPEK_Bool);
+					auto pLvalLeftResult = LLVMConstInt(PltypeGenerate(pGenx, pWork->tidBool), fIsOrOp, false);
+
+					auto pLvalPhi = LLVMBuildPhi(pLbuilder, PltypeGenerate(pGenx, pWork->tidBool), "");
+					
+					LLVMOpaqueValue * apLval [] = { pLvalLeftResult, pLvalRight };
+					LLVMOpaqueBasicBlock * apLblock [] = { pLblockStart, pLblockLast };
+					CASSERT(DIM(apLval) == DIM(apLblock));
+
+					LLVMAddIncoming(pLvalPhi, apLval, apLblock, DIM(apLval));
+					return pLvalPhi;
+				}
+				else if (op == OP_Dot && PtypevecSwizzled(pAstop))
+				{
+					return PlvalGenerateSwizzle(pGenx, pAstop);
+				}
+				else if (op == OP_Dot)
+				{
+					auto pResdecl = PresdeclResolved(pWork, pAstop->pAstRight);
+					auto pAstdecl = pResdecl->pDecl->pAstdecl;
+
+					if (pAstdecl->fIsConstant)
+					{
+						// BB (adrianb) If there's executable code down this path somewhere should we always be 
+						//  executing it? It could be either an identifier or a dot. We could try and generate the dot
+						//  case?
+
+						if (pAstLeft->tid.pType->typek != TYPEK_TypeOf)
+						{
+							(void) PlvalGetLoadStoreAddress(pGenx, pAstLeft);
+						}
+
+						return PlvalLoadConst(pGenx, pAstdecl);
+					}
+					else if (pAstop->pAstLeft->tid.pType->typek == TYPEK_Array &&
+								PtypeCast<STypeArray>(pAstop->pAstLeft->tid.pType)->cSizeFixed >= 0)
+					{
+						ASSERT(pAstop->pAstRight->astk == ASTK_Identifier && 
+								strcmp(PastCast<SAstIdentifier>(pAstop->pAstRight)->pChz, "a") == 0);
+
+						auto pLvalArray = PlvalGetLoadStoreAddress(pGenx, pAstop->pAstLeft);
+						auto pLvalZero = PlvalConstS32(pGenx, 0);
+						LLVMOpaqueValue * apLvalGEP[] = { pLvalZero, pLvalZero };
+						return LLVMBuildGEP(pLbuilder, pLvalArray, apLvalGEP, DIM(apLvalGEP), "");
+					}
+					else
+					{
+						auto pLvalAddr = PlvalGetLoadStoreAddress(pGenx, pAstop);
+						return LLVMBuildLoad(pLbuilder, pLvalAddr, "");
+					}
+				}
+
+				if (op == OP_Assign)
+				{
+					if (FIsSoaElement(pAstLeft))
+					{
+						GenerateSoaStore(pGenx, pAstLeft, pAstRight);
+						return nullptr;
+					}
+
+					auto pLvalAddr = PlvalGetLoadStoreAddress(pGenx, pAstLeft);
+					auto pLvalValue = PlvalGenerateRecursive(pGenx, pAstRight);
+					LLVMBuildStore(pLbuilder, pLvalValue, pLvalAddr);
+					return nullptr;
+				}
+
+				ASSERTCHZ(false, "Operator %s generation with types %s and %s NYI", 
+						  PchzFromOp(op), StrPrintType(pAstLeft->tid.pType).Pchz(), StrPrintType(pAstRight->tid.pType).Pchz());
+
+				return nullptr;
+			}
+		}
+		break;
+
+	case ASTK_If:
 		{
-			auto pAstlit = PastCast<SAstLiteral>(pAst);
-			const SLiteral & lit = pAstlit->lit;
-			if (lit.litk == LITK_String && pAst->tid.pType->typek == TYPEK_Pointer)
+			// Construct a test basic block and jump to it, fill into that block
+			// Run while loop body and jump to test basic block
+
+			// BB (adrianb) Scope for if pass or else?
+
+			auto pAstif = PastCast<SAstIf>(pAst);
+			auto pLvalTest = PlvalGenerateRecursive(pGenx, pAstif->pAstCondition);
+
+			// BB (adrianb) Clearer output if we emit blocks first and append branches later.
+
+			auto pLvalFunc = LLVMGetBasicBlockParent(LLVMGetInsertBlock(pLbuilder));
+			auto pLblockIfPass = LLVMAppendBasicBlockInContext(pGenx->pLctx, pLvalFunc, "ifpass");
+			auto pLblockIfExit = LLVMAppendBasicBlockInContext(pGenx->pLctx, pLvalFunc, "ifexit");
+
+			auto pLblockIfElse = pLblockIfExit;
+			if (pAstif->pAstElse)
+				pLblockIfElse = LLVMAppendBasicBlockInContext(pGenx->pLctx, pLvalFunc, "ifelse");
+
+			LLVMBuildCondBr(pLbuilder, pLvalTest, pLblockIfPass, pLblockIfElse);
+			LLVMPositionBuilderAtEnd(pLbuilder, pLblockIfPass);
+
+			VERIFY(PlvalGenerateRecursive(pGenx, pAstif->pAstPass) == nullptr);
+			Branch(pGenx, pLblockIfExit, pAst);
+			LLVMPositionBuilderAtEnd(pLbuilder, pLblockIfElse);
+
+			if (pAstif->pAstElse)
+			{
+				VERIFY(PlvalGenerateRecursive(pGenx, pAstif->pAstElse) == nullptr);
+				Branch(pGenx, pLblockIfExit, pAst);
+				LLVMPositionBuilderAtEnd(pLbuilder, pLblockIfExit);
+			}
+			else
+			{
+				ASSERT(pLblockIfElse == pLblockIfExit);
+			}
+
+			// Continue with code after if in the exit basic block
+		}
+		break;
+
+	case ASTK_While:
+		{
+			// Construct a test basic block and jump to it, fill into that block
+			// Run while loop body and jump to test basic block
+
+			auto pAstwhile = PastCast<SAstWhile>(pAst);
+
+			// BB (adrianb) Pack these into genx so continue/break can jump to necessary spots if need be.
+
+			auto pLvalFunc = LLVMGetBasicBlockParent(LLVMGetInsertBlock(pLbuilder));
+			auto pLblockTest = LLVMAppendBasicBlockInContext(pGenx->pLctx, pLvalFunc, "whiletest");
+			auto pLblockBody = LLVMAppendBasicBlockInContext(pGenx->pLctx, pLvalFunc, "whilepass");
+			auto pLblockExit = LLVMAppendBasicBlockInContext(pGenx->pLctx, pLvalFunc, "whileexit");
+
+			Branch(pGenx, pLblockTest, pAst);
+			LLVMPositionBuilderAtEnd(pLbuilder, pLblockTest);
+
+			auto pLvalTest = PlvalGenerateRecursive(pGenx, pAstwhile->pAstCondition);
+
+			LLVMBuildCondBr(pLbuilder, pLvalTest, pLblockBody, pLblockExit);
+			LLVMPositionBuilderAtEnd(pLbuilder, pLblockBody);
+
+			SScopeCtx scopectx = ScopectxPush(pGenx, pLblockTest, pLblockExit);
+			VERIFY(PlvalGenerateRecursive(pGenx, pAstwhile->pAstLoop) == nullptr);
+			PopScope(pGenx, scopectx);
+
+			Branch(pGenx, pLblockTest, pAst);
+			LLVMPositionBuilderAtEnd(pLbuilder, pLblockExit);
+
+			// Continue with code after while loop in the exit basic block
+		}
+		break;
+
+	case ASTK_For:
+		{
+			// The count and the array's data are computed once before the loop. it_index counts up from 0 and it is 
+			//  loaded from the array (or offset from the range start) at the top of each iteration.
+
+			auto pAstfor = PastCast<SAstFor>(pAst);
+			auto pAstdeclIt = pAstfor->pAstdeclIt;
+			auto pAstdeclItIndex = pAstfor->pAstdeclItIndex;
+			auto pLtypeIt = PltypeGenerate(pGenx, pAstdeclIt->tid);
+			auto pLtypeIndex = PltypeGenerate(pGenx, pAstdeclItIndex->tid);
+
+			const STypeArray * pTypearray = nullptr;
+			LLVMOpaqueValue * pLvalStart; // Range start or array data
+			LLVMOpaqueValue * pLvalCount;
+
+			if (pAstfor->pAstRangeEnd)
+			{
+				bool fSigned = FSigned(pAstdeclIt->tid.pType->typek);
+				pLvalStart = PlvalGenerateRecursive(pGenx, pAstfor->pAstIterRight);
+				auto pLvalEnd = PlvalGenerateRecursive(pGenx, pAstfor->pAstRangeEnd);
+				auto pLvalStartIndex = LLVMBuildIntCast2(pLbuilder, pLvalStart, pLtypeIndex, fSigned, "");
+				auto pLvalEndIndex = LLVMBuildIntCast2(pLbuilder, pLvalEnd, pLtypeIndex, fSigned, "");
+				pLvalCount = LLVMBuildAdd(pLbuilder, LLVMBuildSub(pLbuilder, pLvalEndIndex, pLvalStartIndex, ""), 
+											LLVMConstInt(pLtypeIndex, 1, false), "");
+			}
+			else
+			{
+				pTypearray = PtypeCast<STypeArray>(pAstfor->pAstIterRight->tid.pType);
+				auto pLvalArray = PlvalGetLoadStoreAddress(pGenx, pAstfor->pAstIterRight);
+				if (pTypearray->cSizeFixed >= 0)
+				{
+					pLvalStart = pLvalArray;
+					pLvalCount = LLVMConstInt(pLtypeIndex, pTypearray->cSizeFixed, false);
+				}
+				else
+				{
+					int iC = (pTypearray->fSoa) ? PtypestructSoa(pTypearray)->cMember : 1;
+					pLvalStart = (pTypearray->fSoa) ? 
+									LLVMBuildLoad(pLbuilder, pLvalArray, "") : 
+									LLVMBuildLoad(pLbuilder, LLVMBuildStructGEP(pLbuilder, pLvalArray, 0, ""), "");
+					pLvalCount = LLVMBuildLoad(pLbuilder, LLVMBuildStructGEP(pLbuilder, pLvalArray, iC, ""), "");
+				}
+			}
+
+			auto pLvalIndexAddr = LLVMBuildAlloca(pGenx->pLbuilderAlloc, pLtypeIndex, pAstdeclItIndex->pChzName);
+			auto pLvalItAddr = LLVMBuildAlloca(pGenx->pLbuilderAlloc, pLtypeIt, pAstdeclIt->pChzName);
+			RegisterStorage(pGenx, pAstdeclItIndex, pLvalIndexAddr);
+			RegisterStorage(pGenx, pAstdeclIt, pLvalItAddr);
+			LLVMBuildStore(pLbuilder, LLVMConstInt(pLtypeIndex, 0, false), pLvalIndexAddr);
+
+			auto pLvalFunc = LLVMGetBasicBlockParent(LLVMGetInsertBlock(pLbuilder));
+			auto pLblockTest = LLVMAppendBasicBlockInContext(pGenx->pLctx, pLvalFunc, "fortest");
+			auto pLblockBody = LLVMAppendBasicBlockInContext(pGenx->pLctx, pLvalFunc, "forpass");
+			auto pLblockNext = LLVMAppendBasicBlockInContext(pGenx->pLctx, pLvalFunc, "fornext");
+			auto pLblockExit = LLVMAppendBasicBlockInContext(pGenx->pLctx, pLvalFunc, "forexit");
+
+			Branch(pGenx, pLblockTest, pAst);
+			LLVMPositionBuilderAtEnd(pLbuilder, pLblockTest);
+
+			auto pLvalIndex = LLVMBuildLoad(pLbuilder, pLvalIndexAddr, "");
+			auto pLvalTest = LLVMBuildICmp(pLbuilder, LLVMIntSLT, pLvalIndex, pLvalCount, "");
+			LLVMBuildCondBr(pLbuilder, pLvalTest, pLblockBody, pLblockExit);
+			LLVMPositionBuilderAtEnd(pLbuilder, pLblockBody);
+
+			LLVMOpaqueValue * pLvalIt;
+			if (pAstfor->pAstRangeEnd)
+			{
+				pLvalIt = LLVMBuildAdd(pLbuilder, pLvalStart, LLVMBuildTrunc(pLbuilder, pLvalIndex, pLtypeIt, ""), "");
+			}
+			else if (pTypearray->fSoa)
+			{
+				int cMember = PtypestructSoa(pTypearray)->cMember;
+				auto apLvalAddr = static_cast<LLVMOpaqueValue **>(alloca(sizeof(LLVMOpaqueValue *) * cMember));
+				GenerateSoaArrayAddresses(pGenx, pTypearray, pLvalStart, pLvalIndex, apLvalAddr);
+
+				if (!pAstfor->fTakesPointer)
+				{
+					for (int iMember : IterCount(cMember))
+					{
+						apLvalAddr[iMember] = LLVMBuildLoad(pLbuilder, apLvalAddr[iMember], "");
+					}
+				}
+
+				pLvalIt = PlvalBuildStruct(pGenx, pLtypeIt, apLvalAddr, cMember);
+			}
+			else
+			{
+				if (pTypearray->cSizeFixed >= 0)
+				{
+					LLVMOpaqueValue * apLvalGEP[] = { PlvalConstS32(pGenx, 0), pLvalIndex };
+					pLvalIt = LLVMBuildGEP(pLbuilder, pLvalStart, apLvalGEP, DIM(apLvalGEP), "");
+				}
+				else
+				{
+					pLvalIt = LLVMBuildGEP(pLbuilder, pLvalStart, &pLvalIndex, 1, "");
+				}
+
+				if (!pAstfor->fTakesPointer)
+					pLvalIt = LLVMBuildLoad(pLbuilder, pLvalIt, "");
+			}
+
+			LLVMBuildStore(pLbuilder, pLvalIt, pLvalItAddr);
+
+			SScopeCtx scopectx = ScopectxPush(pGenx, pLblockNext, pLblockExit);
+			VERIFY(PlvalGenerateRecursive(pGenx, pAstfor->pAstLoop) == nullptr);
+			PopScope(pGenx, scopectx);
+
+			Branch(pGenx, pLblockNext, pAst);
+			LLVMPositionBuilderAtEnd(pLbuilder, pLblockNext);
+
+			pLvalIndex = LLVMBuildLoad(pLbuilder, pLvalIndexAddr, "");
+			LLVMBuildStore(pLbuilder, LLVMBuildAdd(pLbuilder, pLvalIndex, LLVMConstInt(pLtypeIndex, 1, false), ""), 
+							pLvalIndexAddr);
+
+			auto pLvalBranch = LLVMBuildBr(pLbuilder, pLblockTest);
+			LLVMSetMetadata(pLvalBranch, LLVMGetMDKindIDInContext(pGenx->pLctx, "llvm.loop", 9), 
+							PlvalLoopMetadata(pGenx));
+
+			LLVMPositionBuilderAtEnd(pLbuilder, pLblockExit);
+
+			// Continue with code after for loop in the exit basic block
+		}
+		break;
+
+	case ASTK_LoopControl:
+		{
+			auto pAstloopctrl = PastCast<SAstLoopControl>(pAst);
+			for (int iScope = pGenx->aryScope.c - 1; iScope >= 0; --iScope)
+			{
+				const auto & scope = pGenx->aryScope[iScope];
+				auto pLblockLoop = (pAstloopctrl->fContinue) ? scope.pLblockLoopContinue : scope.pLblockLoopBreak;
+				if (pLblockLoop)
+				{
+					EarlyPopScopes(pGenx, iScope);
+					LLVMBuildBr(pLbuilder, pLblockLoop);
+					MarkScopeTerminated(pGenx);
+					break;
+				}
+			}
+		}
+		break;
+
+	// ASTK_Using
+
+	case ASTK_Cast:
+		{
+			auto pAstcast = PastCast<SAstCast>(pAst);
+
+			STypeId tidSrc = pAstcast->pAstExpr->tid;
+			STypeId tidDst = pAstcast->tid;
+
+			TYPEK typekSrc = tidSrc.pType->typek;
+			TYPEK typekDst = tidDst.pType->typek;
+
+			if (tidSrc == tidDst)
+			{
+				return PlvalGenerateRecursive(pGenx, pAstcast->pAstExpr);
+			}
+
+			if (typekDst == TYPEK_Array && typekSrc == TYPEK_Array)
+			{
+				auto pTypearraySrc = PtypeCast<STypeArray>(tidSrc.pType);
+				
+				if (pTypearraySrc->fDynamicallySized)
+				{
+					ASSERT(false);
+					return nullptr;
+				}
+				else
+				{
+					// Build nameless array struct type (GetElementPtr(00), const int count or dynamic sized count);
+
+					auto pLtypeArray = PltypeGenerate(pGenx, tidDst);
+					auto pLvalPtrArray = PlvalGetLoadStoreAddress(pGenx, pAstcast->pAstExpr);
+
+					if (pTypearraySrc->fSoa)
+					{
+						// Plain SOA arrays are one chunk, so each column starts at the first element of its member array
+
+						ASSERT(pTypearraySrc->cSoaChunk == 0);
+						int cMember = PtypestructSoa(pTypearraySrc)->cMember;
+						auto apLval = static_cast<LLVMOpaqueValue **>(alloca(sizeof(LLVMOpaqueValue *) * (cMember + 1)));
+						for (int iMember : IterCount(cMember))
+						{
+							LLVMOpaqueValue * apLvalGEP[] = 
+								{ PlvalConstS32(pGenx, 0), PlvalConstS32(pGenx, 0), PlvalConstS32(pGenx, iMember), PlvalConstS32(pGenx, 0) };
+							apLval[iMember] = LLVMBuildGEP(pGenx->pLbuilder, pLvalPtrArray, apLvalGEP, DIM(apLvalGEP), "");
+						}
+
+						apLval[cMember] = PlvalConstS64(pGenx, pTypearraySrc->cSizeFixed);
+						return PlvalBuildStruct(pGenx, pLtypeArray, apLval, cMember + 1);
+					}
+
+					LLVMOpaqueValue * apLvalGEP[] = { PlvalConstS32(pGenx, 0), PlvalConstS32(pGenx, 0) };
+					auto pLvalA = LLVMBuildGEP(pGenx->pLbuilder, pLvalPtrArray, apLvalGEP, DIM(apLvalGEP), "");
+					auto pLvalC = PlvalConstS64(pGenx, pTypearraySrc->cSizeFixed);
+					LLVMOpaqueValue * apLvalAry[] = { pLvalA, pLvalC };
+					return PlvalBuildStruct(pGenx, pLtypeArray, apLvalAry, DIM(apLvalAry));
+				}
+			}
+
+			// BB (adrianb) Just do this branch in evaluator?
+
+			auto pLvalExpr = PlvalGenerateRecursive(pGenx, pAstcast->pAstExpr);
+			auto pLtypeDst = PltypeGenerate(pGenx, tidDst);
+
+			if (typekDst == TYPEK_Vector)
+			{
+				// Scalars were already cast to the element type by the type checker, splat them across every lane.
+				//  Vector to vector casts convert each element with the same instructions as scalars.
+
+				if (typekSrc != TYPEK_Vector)
+					return PlvalSplat(pGenx, pLvalExpr, pLtypeDst);
+
+				typekSrc = PtypeCast<STypeVector>(tidSrc.pType)->tidElement.pType->typek;
+				typekDst = PtypeCast<STypeVector>(tidDst.pType)->tidElement.pType->typek;
+			}
+
+			if (FIsInt(typekSrc))
+			{
+				if (FIsInt(typekDst))
+				{
+					// sext or zext when up casting in bitcount
+
+					if (CBit(typekSrc) > CBit(typekDst))
+					{
+						return LLVMBuildTrunc(pLbuilder, pLvalExpr, pLtypeDst, "");
+					}
+					else
+					{
+						// BB (adrianb) Zext is faster than sext. Should we emit zext more often?
+						//  Default to unsigned more often?
+
+						if (FSigned(typekSrc))
+							return LLVMBuildSExt(pLbuilder, pLvalExpr, pLtypeDst, "");
+						else
+							return LLVMBuildZExt(pLbuilder, pLvalExpr, pLtypeDst, "");
+					}
+				}
+				else if (FIsFloat(typekDst))
+				{
+					if (FSigned(typekSrc))
+						return LLVMBuildSIToFP(pLbuilder, pLvalExpr, pLtypeDst, "");
+					else
+						return LLVMBuildUIToFP(pLbuilder, pLvalExpr, pLtypeDst, "");
+				}
+			}
+			else if (FIsFloat(typekSrc))
+			{
+				if (FIsFloat(typekDst))
+				{
+					if (CBit(typekSrc) > CBit(typekDst))
+						return LLVMBuildFPTrunc(pLbuilder, pLvalExpr, pLtypeDst, "");
+					else
+						return LLVMBuildFPExt(pLbuilder, pLvalExpr, pLtypeDst, "");
+				}
+				else if (FIsInt(typekDst))
+				{
+					if (FSigned(typekDst))
+						return LLVMBuildFPToSI(pLbuilder, pLvalExpr, pLtypeDst, "");
+					else
+						return LLVMBuildFPToUI(pLbuilder, pLvalExpr, pLtypeDst, "");
+				}
+			}
+			else if (typekSrc == TYPEK_Pointer)
 			{
-				ASSERT(PtypeCast<STypePointer>(pAst->tid.pType)->tidPointedTo.pType->typek == TYPEK_U8);
+				return LLVMBuildBitCast(pLbuilder, pLvalExpr, pLtypeDst, "");
 
-				// BB (adrianb) String or StringPtr? Do we need to pool these manually?
-				// BB (adrianb) LLVMConstString instead?
-				return LLVMBuildGlobalStringPtr(pGenx->pLbuilder, lit.pChz, "stringptr");
 			}
 
-			return PlvalLoadConst(pGenx, pAst);
+			ASSERTCHZ(false, "Cannot cast between %s and %s", StrPrintType(tidSrc.pType).Pchz(), 
+					  StrPrintType(tidDst.pType).Pchz());
 		}
+		break;
 
-	case ASTK_Null:
-	case ASTK_Cast:
-	case ASTK_Operator:
-	case ASTK_Identifier:
-	case ASTK_RunDirective:
-		return PlvalLoadConst(pGenx, pAst);
-
-	case ASTK_Procedure:
+	case ASTK_New:
 		{
-			// Identifier reference to procedure
+			STypeId tidPointedTo = PtypeCast<STypePointer>(pAst->tid.pType)->tidPointedTo;
+			auto pLtypePV = LLVMPointerType(LLVMInt8TypeInContext(pGenx->pLctx), 0);
+			auto pLvalV = PlvalGenerateAllocate(pGenx, LLVMConstPointerNull(pLtypePV), PlvalConstS64(pGenx, 0), 
+												PlvalConstS64(pGenx, CbSizeOf(tidPointedTo)));
 
-			//AddReferenced(pGenx, pAst);
-			return PlvalEnsureProcedure(pGenx, PastCast<SAstProcedure>(pAst));
-		}
+			auto pLtypePointedTo = PltypeGenerate(pGenx, tidPointedTo);
+			auto pLvalPtr = LLVMBuildBitCast(pLbuilder, pLvalV, LLVMPointerType(pLtypePointedTo, 0), "");
 
-	default:
-		ShowErr(pAst->errinfo, "Can't generate constant for ast %s(%d)", PchzFromAstk(astk), astk);
-		return nullptr;
-	}
-}
+			// Allocators return null when they're out of memory (e.g. a full arena), new returns it uninitialized
 
-LLVMOpaqueValue * PlvalGenerateDefaultValue(SGenerateCtx * pGenx, STypeId tid, LLVMOpaqueType * pLtype)
-{
-	auto pVVal = alloca(CbSizeOf(tid));
+			auto pLvalFunc = LLVMGetBasicBlockParent(LLVMGetInsertBlock(pLbuilder));
+			auto pLblockInit = LLVMAppendBasicBlockInContext(pGenx->pLctx, pLvalFunc, "newinit");
+			auto pLblockDone = LLVMAppendBasicBlockInContext(pGenx->pLctx, pLvalFunc, "newdone");
 
-	EvalDefaultValue(pGenx->pWork, tid, static_cast<u8*>(pVVal));
+			auto pLvalBranch = LLVMBuildCondBr(pLbuilder, LLVMBuildIsNull(pLbuilder, pLvalV, ""), pLblockDone, pLblockInit);
+			LLVMSetMetadata(pLvalBranch, LLVMGetMDKindIDInContext(pGenx->pLctx, "prof", 4), PlvalUnlikelyMetadata(pGenx));
 
-	return PlvalConst(pGenx, tid, pVVal);
-}
+			LLVMPositionBuilderAtEnd(pLbuilder, pLblockInit);
+			GenerateDefaultValueStore(pGenx, tidPointedTo, pLvalPtr);
+			(void) LLVMBuildBr(pLbuilder, pLblockDone);
 
-LLVMOpaqueValue * PlvalGenerateRecursive(SGenerateCtx * pGenx, SAst * pAst)
-{
-	auto pWork = pGenx->pWork;
-	auto pLbuilder = pGenx->pLbuilder;
+			LLVMPositionBuilderAtEnd(pLbuilder, pLblockDone);
+			return pLvalPtr;
+		}
+		break;
 
-	switch (pAst->astk)
-	{
-	case ASTK_Literal:
-	case ASTK_Null:
-		return PlvalGenerateConstant(pGenx, pAst);
+	case ASTK_Delete:
+		{
+			auto pAstExpr = PastCast<SAstDelete>(pAst)->pAstExpr;
+			STypeId tidPointedTo = PtypeCast<STypePointer>(pAstExpr->tid.pType)->tidPointedTo;
+			auto pLtypePV = LLVMPointerType(LLVMInt8TypeInContext(pGenx->pLctx), 0);
+			auto pLvalV = LLVMBuildBitCast(pLbuilder, PlvalGenerateRecursive(pGenx, pAstExpr), pLtypePV, "");
+			(void) PlvalGenerateAllocate(pGenx, pLvalV, PlvalConstS64(pGenx, CbSizeOf(tidPointedTo)), 
+										 PlvalConstS64(pGenx, 0));
+			return nullptr;
+		}
+		break;
 
-	// ASTK_UninitializedValue
+#if 0
+	ASTK_Remove, // yuck, use #remove instead? Not compile time...
+#endif
 
-	case ASTK_Block:
+	case ASTK_Defer:
 		{
-			SScopeCtx scopectx = ScopectxPush(pGenx);
-			for (auto pAst : PastCast<SAstBlock>(pAst)->arypAst)
-			{
-				(void) PlvalGenerateRecursive(pGenx, pAst);
-			}
-			PopScope(pGenx, scopectx);
-			return nullptr;
+			Append(&pGenx->arypAstDefer, PastCast<SAstDefer>(pAst)->pAstStmt);
 		}
+		break;
 
-	case ASTK_EmptyStatement:
-		return nullptr;
+	case ASTK_Inline:
+		return PlvalFirstValue(pGenx, pAst, PlvalGenerateInlineCall(pGenx, PastCast<SAstInline>(pAst)));
 
-	case ASTK_Identifier:
+	case ASTK_PushContext:
 		{
-			// If we are a constant, just go directly to constant evaluation
+			// Parser expanded this into a block that saves, swaps and defers restoring the context
 
-			auto pResdecl = PresdeclResolved(pWork, pAst);
-			auto pAstdecl = pResdecl->pDecl->pAstdecl;
-			if (pAstdecl->fIsConstant)
-			{
-				return PlvalGenerateConstant(pGenx, pAstdecl->pAstValue);
-			}
-			else
-			{
-				auto pLvalAddr = PlvalGetLoadStoreAddress(pGenx, pAst);
-				return LLVMBuildLoad(pLbuilder, pLvalAddr, "");
-			}
+			return PlvalGenerateRecursive(pGenx, PastCast<SAstPushContext>(pAst)->pAstblock);
 		}
 		break;
 
-	case ASTK_Operator:
+	case ASTK_ArrayIndex:
 		{
-			auto pAstop = PastCast<SAstOperator>(pAst);
-			auto pChzOp = pAstop->pChzOp;
-
-			// BB (adrianb) Table drive these or it will get insane!
+			if (FIsSoaElement(pAst))
+				return PlvalGenerateSoaLoad(pGenx, pAst);
 
-			if (pAstop->pAstLeft == nullptr)
+			auto pAstarrayindex = PastCast<SAstArrayIndex>(pAst);
+			if (FIsVector(pAstarrayindex->pAstArray->tid))
 			{
-				auto pAstRight = pAstop->pAstRight;
-				TYPEK typekRight = pAstRight->tid.pType->typek;
+				auto pLvalVector = PlvalGenerateRecursive(pGenx, pAstarrayindex->pAstArray);
+				auto pLvalIndex = PlvalGenerateRecursive(pGenx, pAstarrayindex->pAstIndex);
+				return LLVMBuildExtractElement(pLbuilder, pLvalVector, pLvalIndex, "");
+			}
 
-				if (strcmp(pChzOp, "-") == 0)
-				{
-					auto pLval = PlvalGenerateRecursive(pGenx, pAstRight);
+			auto pLvalAddr = PlvalGetLoadStoreAddress(pGenx, pAst);
+			return LLVMBuildLoad(pLbuilder, pLvalAddr, "");
+		}
+		break;
 
-					if (FIsInt(typekRight))
-						return LLVMBuildNeg(pLbuilder, pLval, "");
-					else if (FIsFloat(typekRight))
-						return LLVMBuildFNeg(pLbuilder, pLval, "");
-				}
-				else if (strcmp(pChzOp, "!") == 0)
-				{
-					auto pLval = PlvalGenerateRecursive(pGenx, pAstRight);
-					return LLVMBuildNot(pLbuilder, pLval, "");
-				}
-				else if (strcmp(pChzOp, "++") == 0)
-				{
-					ASSERT(FIsInt(typekRight));
-					auto pLvalAddr = PlvalGetLoadStoreAddress(pGenx, pAstRight);
-					auto pLvalOrig = LLVMBuildLoad(pLbuilder, pLvalAddr, "");
-					auto pLvalOne = LLVMConstInt(PltypeGenerate(pGenx, pAstRight->tid), 1, false);
-					auto pLvalInc = LLVMBuildAdd(pLbuilder, pLvalOrig, pLvalOne, "");
-					LLVMBuildStore(pLbuilder, pLvalInc, pLvalAddr);
-					return pLvalInc;
-				}
-				else if (strcmp(pChzOp, "*") == 0)
-				{
-					return PlvalGetLoadStoreAddress(pGenx, pAstRight);
-				}
-				else if (strcmp(pChzOp, "<<") == 0)
-				{
-					auto pLvalRight = PlvalGenerateRecursive(pGenx, pAstRight);
-					return LLVMBuildLoad(pLbuilder, pLvalRight, "");
-				}
+	case ASTK_Call:
+		return PlvalFirstValue(pGenx, pAst, PlvalGenerateCall(pGenx, PastCast<SAstCall>(pAst)));
 
-				ASSERTCHZ(false, "Unary operator %s generation with type %s NYI", 
-						  pChzOp, StrPrintType(pAstRight->tid.pType).Pchz());
+	case ASTK_Return:
+		{
+			auto pAstret = PastCast<SAstReturn>(pAst);
+
+			LLVMOpaqueValue * pLvalRet = nullptr;
+			if (pAstret->arypAstRet.c == 1)
+			{
+				pLvalRet = PlvalGenerateRecursive(pGenx, pAstret->arypAstRet[0]);
 			}
-			else
+			else if (pAstret->arypAstRet.c > 1)
 			{
-				auto pAstLeft = pAstop->pAstLeft;
-				auto pAstRight = pAstop->pAstRight;
+				// Multiple values are packed into the literal struct procedures return (see PltypeGenerate)
 
-				for (const auto & gbop : s_aGbop)
+				int cLvalRet = pAstret->arypAstRet.c;
+				auto apLvalRet = static_cast<LLVMOpaqueValue **>(alloca(sizeof(LLVMOpaqueValue *) * cLvalRet));
+				auto apLtypeRet = static_cast<LLVMOpaqueType **>(alloca(sizeof(LLVMOpaqueType *) * cLvalRet));
+				for (int iLval : IterCount(cLvalRet))
 				{
-					if (strcmp(gbop.pChzOp, pChzOp) == 0)
-					{
-						return PlvalGenerateBinaryOperator(pGenx, gbop, pAstLeft, pAstRight);
-					}
+					apLvalRet[iLval] = PlvalGenerateRecursive(pGenx, pAstret->arypAstRet[iLval]);
+					apLtypeRet[iLval] = LLVMTypeOf(apLvalRet[iLval]);
 				}
 
-				for (const auto & gbop : s_aGbopAssign)
+				pLvalRet = LLVMGetUndef(LLVMStructTypeInContext(pGenx->pLctx, apLtypeRet, cLvalRet, false));
+				for (int iLval : IterCount(cLvalRet))
 				{
-					if (strcmp(gbop.pChzOp, pChzOp) == 0)
-					{
-						GenerateBinaryAssignOperator(pGenx, gbop, pAstLeft, pAstRight);
-						return nullptr;
-					}
+					pLvalRet = LLVMBuildInsertValue(pLbuilder, pLvalRet, apLvalRet[iLval], iLval, "");
 				}
+			}
 
-				bool fIsOrOp = strcmp(pChzOp, "or") == 0;
-				if (fIsOrOp || strcmp(pChzOp, "and") == 0)
-				{
-					// Eval left, branch on it, eval right, branch to done, done phi based on first and 2nd branch
-
-					// BB (adrianb) Could chain ands and ors together for less branching. This is entirely
-					//  local which is nice.
+			if (pGenx->aryInline.c)
+			{
+				// Returning from a body generated in place of a call
 
-					auto pLvalTest = PlvalGenerateRecursive(pGenx, pAstLeft);
+				auto pInline = &Tail(&pGenx->aryInline);
+				if (pLvalRet)
+					LLVMBuildStore(pLbuilder, pLvalRet, pInline->pLvalRetAddr);
 
-					auto pLblockStart = LLVMGetInsertBlock(pLbuilder);
-					auto pLvalFunc = LLVMGetBasicBlockParent(pLblockStart);
-					auto pLblockRight = LLVMAppendBasicBlockInContext(pGenx->pLctx, pLvalFunc, 
-																		(fIsOrOp) ? "orright" : "andright");
-					auto pLblockDone = LLVMAppendBasicBlockInContext(pGenx->pLctx, pLvalFunc, 
-																		(fIsOrOp) ? "ordone" : "anddone");
-					
-					if (fIsOrOp)
-						LLVMBuildCondBr(pLbuilder, pLvalTest, pLblockDone, pLblockRight);
-					else
-						LLVMBuildCondBr(pLbuilder, pLvalTest, pLblockRight, pLblockDone);
-					
-					LLVMPositionBuilderAtEnd(pLbuilder, pLblockRight);
+				MarkScopeTerminated(pGenx);
+				EarlyPopScopes(pGenx, pInline->iScope);
+				LLVMBuildBr(pLbuilder, pInline->pLblockReturn);
+				return nullptr;
+			}
 
-					auto pLvalRight = PlvalGenerateRecursive(pGenx, pAstRight);
-                    auto pLblockLast = LLVMGetInsertBlock(pLbuilder);
-					Branch(pGenx, pLblockDone, pAst);
-					
-					LLVMPositionBuilderAtEnd(pLbuilder, pLblockDone);
+			// Lower the return value to the C ABI (see ComputeAbiproc)
 
-					ASSERT(pAst->tid.pType->typek == TYPEK_Bool);
-					auto pLvalLeftResult = LLVMConstInt(PltypeGenerate(pGenx, pWork->tidBool), fIsOrOp, false);
+			int cTidRet = pAstret->arypAstRet.c;
+			auto aTidRet = static_cast<STypeId *>(alloca(sizeof(STypeId) * cTidRet));
+			for (int iTid : IterCount(cTidRet))
+			{
+				aTidRet[iTid] = pAstret->arypAstRet[iTid]->tid;
+			}
 
-					auto pLvalPhi = LLVMBuildPhi(pLbuilder, PltypeGenerate(pGenx, pWork->tidBool), "");
-					
-					LLVMOpaqueValue * apLval [] = { pLvalLeftResult, pLvalRight };
-					LLVMOpaqueBasicBlock * apLblock [] = { pLblockStart, pLblockLast };
-					CASSERT(DIM(apLval) == DIM(apLblock));
+			SAbiValue abivalRet = AbivalCompute(pGenx, aTidRet, cTidRet);
+			if (abivalRet.abik == ABIK_Memory)
+			{
+				// Fill in the sret pointer before defers run, they could change a returned variable
 
-					LLVMAddIncoming(pLvalPhi, apLval, apLblock, DIM(apLval));
-					return pLvalPhi;
+				auto pLvalFunc = LLVMGetBasicBlockParent(LLVMGetInsertBlock(pLbuilder));
+				auto pLvalSret = LLVMGetParam(pLvalFunc, 0);
+				auto pLvalAddr = (cTidRet == 1) ? PlvalVariableAddress(pGenx, pAstret->arypAstRet[0]) : nullptr;
+				if (pLvalAddr)
+				{
+					u32 cBAlign = CbAlignOf(aTidRet[0]);
+					(void) LLVMBuildMemCpy(pLbuilder, pLvalSret, cBAlign, pLvalAddr, cBAlign, LLVMSizeOf(abivalRet.pLtype));
 				}
-				else if (strcmp(pChzOp, ".") == 0)
+				else
 				{
-					auto pResdecl = PresdeclResolved(pWork, pAstop->pAstRight);
-					auto pAstdecl = pResdecl->pDecl->pAstdecl;
+					LLVMBuildStore(pLbuilder, pLvalRet, pLvalSret);
+				}
+			}
 
-					if (pAstdecl->fIsConstant)
-					{
-						// BB (adrianb) If there's executable code down this path somewhere should we always be 
-						//  executing it? It could be either an identifier or a dot. We could try and generate the dot
-						//  case?
+			MarkScopeTerminated(pGenx);
+			EarlyReturnPopScopes(pGenx);
 
-						if (pAstop->tid.pType->typek != TYPEK_TypeOf)
-						{
-							(void) PlvalGetLoadStoreAddress(pGenx, pAstLeft);
-						}
+			switch (abivalRet.abik)
+			{
+			case ABIK_Direct:
+				(void) LLVMBuildRet(pLbuilder, pLvalRet);
+				break;
 
-						return PlvalGenerateConstant(pGenx, pAstdecl->pAstValue);
-					}
-					else if (pAstop->pAstLeft->tid.pType->typek == TYPEK_Array &&
-								PtypeCast<STypeArray>(pAstop->pAstLeft->tid.pType)->cSizeFixed >= 0)
-					{
-						ASSERT(pAstop->pAstRight->astk == ASTK_Identifier && 
-								strcmp(PastCast<SAstIdentifier>(pAstop->pAstRight)->pChz, "a") == 0);
+			case ABIK_Memory:
+				(void) LLVMBuildRetVoid(pLbuilder);
+				break;
 
-						auto pLvalArray = PlvalGetLoadStoreAddress(pGenx, pAstop->pAstLeft);
-						auto pLvalZero = PlvalConstS32(pGenx, 0);
-						LLVMOpaqueValue * apLvalGEP[] = { pLvalZero, pLvalZero };
-						return LLVMBuildGEP(pLbuilder, pLvalArray, apLvalGEP, DIM(apLvalGEP), "");
+			case ABIK_Coerce:
+				{
+					auto pLvalPtr = PlvalAbiTemp(pGenx, &abivalRet, "ret");
+					LLVMBuildStore(pLbuilder, pLvalRet, pLvalPtr);
+
+					LLVMOpaqueValue * apLvalRet[2];
+					LoadCoerced(pGenx, &abivalRet, pLvalPtr, apLvalRet);
+					if (abivalRet.cLtypeCoerce > 1)
+					{
+						(void) LLVMBuildAggregateRet(pLbuilder, apLvalRet, abivalRet.cLtypeCoerce);
 					}
 					else
 					{
-						auto pLvalAddr = PlvalGetLoadStoreAddress(pGenx, pAstop);
-						return LLVMBuildLoad(pLbuilder, pLvalAddr, "");
+						(void) LLVMBuildRet(pLbuilder, apLvalRet[0]);
 					}
 				}
+				break;
 
-				if (strcmp(pChzOp, "=") == 0)
-				{
-					auto pLvalAddr = PlvalGetLoadStoreAddress(pGenx, pAstLeft);
-					auto pLvalValue = PlvalGenerateRecursive(pGenx, pAstRight);
-					LLVMBuildStore(pLbuilder, pLvalValue, pLvalAddr);
-					return nullptr;
-				}
-
-				ASSERTCHZ(false, "Operator %s generation with types %s and %s NYI", 
-						  pChzOp, StrPrintType(pAstLeft->tid.pType).Pchz(), StrPrintType(pAstRight->tid.pType).Pchz());
-
-				return nullptr;
+			default:
+				(void) LLVMBuildRetVoid(pLbuilder);
+				break;
 			}
+            
+            return nullptr;
 		}
 		break;
 
-	case ASTK_If:
-		{
-			// Construct a test basic block and jump to it, fill into that block
-			// Run while loop body and jump to test basic block
-
-			// BB (adrianb) Scope for if pass or else?
-
-			auto pAstif = PastCast<SAstIf>(pAst);
-			
-			auto pLvalTest = PlvalGenerateRecursive(pGenx, pAstif->pAstCondition);
-
-			// BB (adrianb) Clearer output if we emit blocks first and append branches later.
-
-			auto pLvalFunc = LLVMGetBasicBlockParent(LLVMGetInsertBlock(pLbuilder));
-			auto pLblockIfPass = LLVMAppendBasicBlockInContext(pGenx->pLctx, pLvalFunc, "ifpass");
-			auto pLblockIfExit = LLVMAppendBasicBlockInContext(pGenx->pLctx, pLvalFunc, "ifexit");
+	case ASTK_DeclareSingle:
+		{
+			auto pAstdecl = PastCast<SAstDeclareSingle>(pAst);
 
-			auto pLblockIfElse = pLblockIfExit;
-			if (pAstif->pAstElse)
-				pLblockIfElse = LLVMAppendBasicBlockInContext(pGenx->pLctx, pLvalFunc, "ifelse");
+			if (pAstdecl->fIsConstant)
+				return nullptr;
 
-			LLVMBuildCondBr(pLbuilder, pLvalTest, pLblockIfPass, pLblockIfElse);
-			LLVMPositionBuilderAtEnd(pLbuilder, pLblockIfPass);
+			// Allocas all go in the entry block (see ASTK_Procedure) per
+			//  http://llvm.org/docs/Frontend/PerformanceTips.html#use-of-allocas
 
-			VERIFY(PlvalGenerateRecursive(pGenx, pAstif->pAstPass) == nullptr);
-			Branch(pGenx, pLblockIfExit, pAst);
-			LLVMPositionBuilderAtEnd(pLbuilder, pLblockIfElse);
+			auto pLtype = PltypeGenerate(pGenx, pAstdecl->tid);
+			if (pAstdecl->pAstValue)
+			{
+				// BB (adrianb) Anything special to do if this will evaluate to a constant?
 
-			if (pAstif->pAstElse)
+				GenerateLocal(pGenx, pAstdecl, PlvalGenerateRecursive(pGenx, pAstdecl->pAstValue));
+			}
+			else if (FIsSsaLocal(pGenx, pAstdecl))
 			{
-				VERIFY(PlvalGenerateRecursive(pGenx, pAstif->pAstElse) == nullptr);
-				Branch(pGenx, pLblockIfExit, pAst);
-				LLVMPositionBuilderAtEnd(pLbuilder, pLblockIfExit);
+				GenerateLocal(pGenx, pAstdecl, PlvalGenerateDefaultValue(pGenx, pAstdecl->tid, pLtype));
 			}
 			else
 			{
-				ASSERT(pLblockIfElse == pLblockIfExit);
-			}
+				// BB (adrianb) Support ASTK_UninitializedValue.
 
-			// Continue with code after if in the exit basic block
+				auto pLvalAddr = LLVMBuildAlloca(pGenx->pLbuilderAlloc, pLtype, pAstdecl->pChzName);
+				GenerateDefaultValueStore(pGenx, pAstdecl->tid, pLvalAddr);
+				RegisterStorage(pGenx, pAstdecl, pLvalAddr);
+			}
 		}
 		break;
 
-	case ASTK_While:
+	case ASTK_DeclareMulti:
 		{
-			// Construct a test basic block and jump to it, fill into that block
-			// Run while loop body and jump to test basic block
-
-			auto pAstwhile = PastCast<SAstWhile>(pAst);
+			// Values go straight from the returned struct into the new variables
 
-			// BB (adrianb) Pack these into genx so continue/break can jump to necessary spots if need be.
-
-			auto pLvalFunc = LLVMGetBasicBlockParent(LLVMGetInsertBlock(pLbuilder));
-			auto pLblockTest = LLVMAppendBasicBlockInContext(pGenx->pLctx, pLvalFunc, "whiletest");
-			auto pLblockBody = LLVMAppendBasicBlockInContext(pGenx->pLctx, pLvalFunc, "whilepass");
-			auto pLblockExit = LLVMAppendBasicBlockInContext(pGenx->pLctx, pLvalFunc, "whileexit");
-
-			Branch(pGenx, pLblockTest, pAst);
-			LLVMPositionBuilderAtEnd(pLbuilder, pLblockTest);
-
-			auto pLvalTest = PlvalGenerateRecursive(pGenx, pAstwhile->pAstCondition);
-
-			LLVMBuildCondBr(pLbuilder, pLvalTest, pLblockBody, pLblockExit);
-			LLVMPositionBuilderAtEnd(pLbuilder, pLblockBody);
-
-			SScopeCtx scopectx = ScopectxPush(pGenx, pLblockTest, pLblockExit);
-			VERIFY(PlvalGenerateRecursive(pGenx, pAstwhile->pAstLoop) == nullptr);
-			PopScope(pGenx, scopectx);
+			auto pAstdecmul = PastCast<SAstDeclareMulti>(pAst);
+			auto pAstValue = pAstdecmul->pAstValue;
+			auto pLvalValues = (pAstValue) ? PlvalGenerateMultiValue(pGenx, pAstValue) : nullptr;
 
-			Branch(pGenx, pLblockTest, pAst);
-			LLVMPositionBuilderAtEnd(pLbuilder, pLblockExit);
+			for (int ipAstdecl : IterCount(pAstdecmul->arypAstdecl.c))
+			{
+				auto pAstdecl = pAstdecmul->arypAstdecl[ipAstdecl];
+				auto pLvalInitial = (pAstValue) ? 
+										PlvalUnpackValue(pGenx, pAstValue, pLvalValues, ipAstdecl) :
+										PlvalGenerateDefaultValue(pGenx, pAstdecl->tid, PltypeGenerate(pGenx, pAstdecl->tid));
 
-			// Continue with code after while loop in the exit basic block
+				GenerateLocal(pGenx, pAstdecl, pLvalInitial);
+			}
 		}
 		break;
 
-#if 0
-	ASTK_For,
-#endif
-
-	case ASTK_LoopControl:
+	case ASTK_AssignMulti:
 		{
-			auto pAstloopctrl = PastCast<SAstLoopControl>(pAst);
-			for (int iScope = pGenx->aryScope.c - 1; iScope >= 0; --iScope)
+			auto pAstassignmul = PastCast<SAstAssignMulti>(pAst);
+			auto pLvalValues = PlvalGenerateMultiValue(pGenx, pAstassignmul->pAstValue);
+
+			for (int ipAst : IterCount(pAstassignmul->arypAstName.c))
 			{
-				const auto & scope = pGenx->aryScope[iScope];
-				auto pLblockLoop = (pAstloopctrl->fContinue) ? scope.pLblockLoopContinue : scope.pLblockLoopBreak;
-				if (pLblockLoop)
-				{
-					EarlyPopScopes(pGenx, iScope);
-					LLVMBuildBr(pLbuilder, pLblockLoop);
-					MarkScopeTerminated(pGenx);
-					break;
-				}
+				auto pLvalAddr = PlvalGetLoadStoreAddress(pGenx, pAstassignmul->arypAstName[ipAst]);
+				LLVMBuildStore(pLbuilder, PlvalUnpackValue(pGenx, pAstassignmul->pAstValue, pLvalValues, ipAst), 
+								pLvalAddr);
 			}
 		}
 		break;
 
-	// ASTK_Using
+	// ASTK_Struct
+	// ASTK_Enum
 
-	case ASTK_Cast:
+	case ASTK_Procedure:
 		{
-			auto pAstcast = PastCast<SAstCast>(pAst);
+			auto pAstproc = PastCast<SAstProcedure>(pAst);
 
-			STypeId tidSrc = pAstcast->pAstExpr->tid;
-			STypeId tidDst = pAstcast->tid;
+			ASSERT(!pGenx->fInProcedure && pGenx->arypAstDefer.c == 0);
 
-			TYPEK typekSrc = tidSrc.pType->typek;
-			TYPEK typekDst = tidDst.pType->typek;
+			// Start basic block for the procedure
 
-			if (tidSrc == tidDst)
-			{
-				return PlvalGenerateRecursive(pGenx, pAstcast->pAstExpr);
-			}
+			auto pLvalProc = PlvalEnsureProcedure(pGenx, pAstproc);
+			auto pLblockEntry = LLVMAppendBasicBlockInContext(pGenx->pLctx, pLvalProc, "entry");
+			LLVMPositionBuilderAtEnd(pLbuilder, pLblockEntry);
 
-			if (typekDst == TYPEK_Array && typekSrc == TYPEK_Array)
-			{
-				auto pTypearraySrc = PtypeCast<STypeArray>(tidSrc.pType);
-				
-				if (pTypearraySrc->fDynamicallySized)
-				{
-					ASSERT(false);
-					return nullptr;
-				}
-				else
-				{
-					// Build nameless array struct type (GetElementPtr(00), const int count or dynamic sized count);
+			// Allocas go before a placeholder at the top of the entry block, like clang's allocapt
 
-					auto pLtypeArray = PltypeGenerate(pGenx, tidDst);
-					auto pLvalPtrArray = PlvalGetLoadStoreAddress(pGenx, pAstcast->pAstExpr);
+			auto pLvalAllocaPoint = LLVMBuildAlloca(pLbuilder, LLVMInt8TypeInContext(pGenx->pLctx), "allocapt");
+			LLVMPositionBuilderBefore(pGenx->pLbuilderAlloc, pLvalAllocaPoint);
 
-					LLVMOpaqueValue * apLvalGEP[] = { PlvalConstS32(pGenx, 0), PlvalConstS32(pGenx, 0) };
-					auto pLvalA = LLVMBuildGEP(pGenx->pLbuilder, pLvalPtrArray, apLvalGEP, DIM(apLvalGEP), "");
-					auto pLvalC = PlvalConstU32(pGenx, pTypearraySrc->cSizeFixed);
-					LLVMOpaqueValue * apLvalAry[] = { pLvalA, pLvalC };
-					return PlvalBuildStruct(pGenx, pLtypeArray, apLvalAry, DIM(apLvalAry));
-				}
-			}
+			// Add storage for arguments
 
-			// BB (adrianb) Just do this branch in evaluator?
+			// BB (adrianb) Varargs.
 
-			auto pLvalExpr = PlvalGenerateRecursive(pGenx, pAstcast->pAstExpr);
-			auto pLtypeDst = PltypeGenerate(pGenx, tidDst);
+			auto pTypeproc = PtypeCast<STypeProcedure>(pAstproc->tid.pType);
+			SAbiProc abiproc = {};
+			defer { Destroy(&abiproc); };
+			ComputeAbiproc(pGenx, pTypeproc, pTypeproc->aTidArg, pTypeproc->cTidArg, &abiproc, pAstproc);
 
-			if (FIsInt(typekSrc))
-			{
-				if (FIsInt(typekDst))
-				{
-					// sext or zext when up casting in bitcount
+			// Skip the sret pointer, returns store to it
 
-					if (CBit(typekSrc) > CBit(typekDst))
+			unsigned iLvalParam = (abiproc.abivalRet.abik == ABIK_Memory);
+			for (int iArg : IterCount(pTypeproc->cTidArg))
+            {
+            	auto pAstdecl = PastCast<SAstDeclareSingle>(pAstproc->arypAstDeclArg[iArg]);
+				auto pAbival = &abiproc.aryAbivalArg[iArg];
+
+				// Byval arguments are already a copy owned by this procedure, references it modifies are copied here
+				//  (which optimizations usually turn into loads of just the members it uses)
+
+				if (pAbival->abik == ABIK_Memory)
+				{
+					auto pLvalParam = LLVMGetParam(pLvalProc, iLvalParam++);
+					if (pAbival->fCopiedByCallee)
 					{
-						return LLVMBuildTrunc(pLbuilder, pLvalExpr, pLtypeDst, "");
+						unsigned cBAlign = CbAlignOf(pAstdecl->tid);
+						auto pLvalCopy = LLVMBuildAlloca(pGenx->pLbuilderAlloc, pAbival->pLtype, pAstdecl->pChzName);
+						LLVMSetAlignment(pLvalCopy, cBAlign);
+						(void) LLVMBuildMemCpy(pLbuilder, pLvalCopy, cBAlign, pLvalParam, cBAlign, LLVMSizeOf(pAbival->pLtype));
+						RegisterStorage(pGenx, pAstdecl, pLvalCopy);
+						continue;
 					}
-					else
-					{
-						// BB (adrianb) Zext is faster than sext. Should we emit zext more often?
-						//  Default to unsigned more often?
 
-						if (FSigned(typekSrc))
-							return LLVMBuildSExt(pLbuilder, pLvalExpr, pLtypeDst, "");
-						else
-							return LLVMBuildZExt(pLbuilder, pLvalExpr, pLtypeDst, "");
-					}
+					LLVMSetValueName(pLvalParam, pAstdecl->pChzName);
+					RegisterStorage(pGenx, pAstdecl, pLvalParam);
+					continue;
 				}
-				else if (FIsFloat(typekDst))
+
+				if (pAbival->abik == ABIK_Direct)
 				{
-					if (FSigned(typekSrc))
-						return LLVMBuildSIToFP(pLbuilder, pLvalExpr, pLtypeDst, "");
-					else
-						return LLVMBuildUIToFP(pLbuilder, pLvalExpr, pLtypeDst, "");
+					GenerateLocal(pGenx, pAstdecl, LLVMGetParam(pLvalProc, iLvalParam++));
+					continue;
 				}
-			}
-			else if (FIsFloat(typekSrc))
+
+            	auto pLvalPtr = LLVMBuildAlloca(pGenx->pLbuilderAlloc, PltypeGenerate(pGenx, pAstdecl->tid), pAstdecl->pChzName);
+				LLVMOpaqueValue * apLvalParam[2];
+				for (int iLval : IterCount(pAbival->cLtypeCoerce))
+				{
+					apLvalParam[iLval] = LLVMGetParam(pLvalProc, iLvalParam++);
+				}
+
+				StoreCoerced(pGenx, pAbival, apLvalParam, pLvalPtr);
+				RegisterStorage(pGenx, pAstdecl, pLvalPtr);
+            }
+
+			// BB (adrianb) Need implicit return?			
+
+			auto pAstblock = pAstproc->pAstblock;
+			if (pAstblock)
 			{
-				if (FIsFloat(typekDst))
+				SScopeCtx scopectx = ScopectxPush(pGenx);
+
+				(void) PlvalGenerateRecursive(pGenx, pAstblock);
+
+				if (pAstblock->arypAst.c == 0 || Tail(&pAstblock->arypAst)->astk != ASTK_Return)
 				{
-					if (CBit(typekSrc) > CBit(typekDst))
-						return LLVMBuildFPTrunc(pLbuilder, pLvalExpr, pLtypeDst, "");
+					if (pAstproc->arypAstDeclRet.c != 0)
+					{
+						ShowErr(pAstproc->errinfo, "Procedure didn't return a value");
+					}
+
+					PopScope(pGenx, scopectx);
+
+					// Nothing to return from if the body ended in a block that returned
+
+					if (pGenx->fScopeTerminated)
+						pGenx->fScopeTerminated = false;
 					else
-						return LLVMBuildFPExt(pLbuilder, pLvalExpr, pLtypeDst, "");
+						LLVMBuildRetVoid(pLbuilder);
 				}
-				else if (FIsInt(typekDst))
+				else
 				{
-					if (FSigned(typekDst))
-						return LLVMBuildFPToSI(pLbuilder, pLvalExpr, pLtypeDst, "");
-					else
-						return LLVMBuildFPToUI(pLbuilder, pLvalExpr, pLtypeDst, "");
+					// Assuming someone else has already returned and performed defer operations, 
+					//  just reset scopes here.
+
+					// BB (adrianb) Code might be simpler if we did store return value.
+
+					ASSERT(pGenx->aryScope.c == 1);
+
+					pGenx->aryScope.c = 0;
+					pGenx->arypAstDefer.c = 0;
 				}
 			}
-			else if (typekSrc == TYPEK_Pointer)
-			{
-				return LLVMBuildBitCast(pLbuilder, pLvalExpr, pLtypeDst, "");
 
-			}
+			LLVMInstructionEraseFromParent(pLvalAllocaPoint);
 
-			ASSERTCHZ(false, "Cannot cast between %s and %s", StrPrintType(tidSrc.pType).Pchz(), 
-					  StrPrintType(tidDst.pType).Pchz());
+			pGenx->fInProcedure = false;
 		}
 		break;
 
-#if 0
-	ASTK_New,
-	ASTK_Delete,
-	ASTK_Remove, // yuck, use #remove instead? Not compile time...
-#endif
+	// ASTK_TypeDefinition
 
-	case ASTK_Defer:
-		{
-			Append(&pGenx->arypAstDefer, PastCast<SAstDefer>(pAst)->pAstStmt);
-		}
+	// ASTK_TypePointer
+	// ASTK_TypeArray
+	// ASTK_TypeProcedure
+	// ASTK_TypePolymorphic
+	// ASTK_TypeVararg
+
+	// ASTK_ImportDirective
+
+	case ASTK_RunDirective:
+		return PlvalGenerateConstant(pGenx, pAst);
+
+	// ASTK_ForeignLibraryDirective
+
+	default:
+		ASSERTCHZ(false, "Generate for astk %s(%d) NYI", PchzFromAstk(pAst->astk), pAst->astk);
 		break;
+	}
 
-#if 0
-	ASTK_Inline,
-	ASTK_PushContext, // BB (adrianb) unconvinced about this.  Is it thread safe?
-#endif
+	return nullptr;
+}
+
+void GenerateGlobal(SGenerateCtx * pGenx, SAstDeclareSingle * pAstdecl)
+{
+	auto pWork = pGenx->pWork;
+
+	// BB (adrianb) Need to generate unique name?
+
+	auto pLtype = PltypeGenerate(pGenx, pAstdecl->tid);
+	auto pLvalGlobal = LLVMAddGlobal(pGenx->pLmod, pLtype, pAstdecl->pChzName);
+	RegisterStorage(pGenx, pAstdecl, pLvalGlobal);
+
+	// Each thread has its own context so push_context on one doesn't affect the others
+
+	if (pAstdecl == PastdeclContext(pWork))
+		LLVMSetThreadLocal(pLvalGlobal, true);
+
+	// Only the first partition defines globals, the rest reference them externally
+
+	if (pGenx->iPartition != 0 || pGenx->pAstprocOnly)
+		return;
+
+	// BB (adrianb) Setup global storage so compile time code can modify?
+	// BB (adrianb) If marked as uninitialized just init to zero? Does that happen by default?
+	// NOTE (adrianb) Global tables can be too big for the stack.
+
+	auto pV = malloc(max(CbSizeOf(pAstdecl->tid), 1u));
+	defer { free(pV); };
+
+	if (pAstdecl->pAstValue)
+	{
+		EvalConst(pWork, pAstdecl->pAstValue, pV);
+	}
+	else
+	{
+		EvalDefaultValue(pWork, pAstdecl->tid, static_cast<u8 *>(pV));
+	}
+
+	// Marshall instance data into LLVM constant value
+
+	LLVMSetInitializer(pLvalGlobal, PlvalConst(pGenx, pAstdecl->tid, pV));
+}
 
-	case ASTK_ArrayIndex:
-		{
-			auto pLvalAddr = PlvalGetLoadStoreAddress(pGenx, pAst);
-			return LLVMBuildLoad(pLbuilder, pLvalAddr, "");
-		}
-		break;
+void AssignLinkNames(SWorkspace * pWork)
+{
+	// Overloads and specializations share names, and each module generated in parallel must agree on which
+	//  symbol is which, so give every generated procedure a unique name up front in declaration order.
 
-	case ASTK_Call:
-		{
-			auto pAstcall = PastCast<SAstCall>(pAst);
+	if (pWork->fAssignedLinkNames)
+		return;
 
-			// BB (adrianb) Handle vararg [] Any case. C vararg case.
+	pWork->fAssignedLinkNames = true;
 
-			// BB (adrianb) Creating extern function:
-			// Function *F = Function::Create(FT, Function::ExternalLinkage, Name, TheModule);
-			// Do this for all functions? E.g. so out of order will work? Or just start the function
-			// and continue filling it later.
+	SSet<const char *> setpChzUsed = {};
+	defer { Destroy(&setpChzUsed); };
 
-			if (pAstcall->pAstFunc->astk == ASTK_Identifier)
+	for (auto pModule : IterPointer(pWork->aryModule))
+	{
+		for (auto pAstproc : pModule->arypAstprocGen)
+		{
+			const char * pChzLink = pAstproc->pChzName;
+			for (int iSuffix = 1;; ++iSuffix)
 			{
-				auto pChzIdent = PastCast<SAstIdentifier>(pAstcall->pAstFunc)->pChz;
-				bool fIsSizeOf = strcmp(pChzIdent, "sizeof") == 0;
-				if (fIsSizeOf || strcmp(pChzIdent, "alignof") == 0)
+				SStringWithLength strwl = { pChzLink, int(strlen(pChzLink)) };
+				u32 hv = HvFromKey(strwl.pCh, strwl.cCh);
+				if (!PtLookupImpl(&setpChzUsed, hv, strwl))
 				{
-					STypeId tid = pAstcall->arypAstArgs[0]->tid;
-					if (tid.pType->typek == TYPEK_TypeOf)
-						tid = PtypeCast<STypeTypeOf>(tid.pType)->tid;
-					return PlvalConstU64(pGenx, (fIsSizeOf) ? CbSizeOf(tid) : CbAlignOf(tid));
+					Add<const char *>(&setpChzUsed, hv, pChzLink);
+					break;
 				}
+
+				SStringBuilder strb = SStringBuilder("%s.%d", pAstproc->pChzName, iSuffix);
+				pChzLink = PchzCopy(pWork, strb.aChz, strb.cCh);
 			}
 
-			auto pLvalProc = PlvalGenerateRecursive(pGenx, pAstcall->pAstFunc);
+			pAstproc->pChzLink = pChzLink;
+		}
+	}
+}
 
-			int cArg = pAstcall->arypAstArgs.c;
-			auto apLvalArg = static_cast<LLVMOpaqueValue **>(alloca(sizeof(LLVMOpaqueValue *) * cArg));
+void GenerateAll(SGenerateCtx * pGenx)
+{
+	auto pWork = pGenx->pWork;
+	if (pWork->aryModule.c == 0)
+		return;
 
-			for (int iArg : IterCount(cArg))
-			{
-				apLvalArg[iArg] = PlvalGenerateRecursive(pGenx, pAstcall->arypAstArgs[iArg]);
-			}
+	if (pGenx->cPartition == 1)
+		AssignLinkNames(pWork);
 
-			auto pLvalRet = LLVMBuildCall(pLbuilder, pLvalProc, apLvalArg, cArg, "");
-			if (pAstcall->tid.pType->typek == TYPEK_Void)
-				return nullptr;
-			return pLvalRet;
-		}
-		break;
+	ASSERT(pWork->fAssignedLinkNames);
 
-	case ASTK_Return:
-		{
-			// BB (adrianb) Detect multiple returns. We get a useless llvm error right now.
+	// Create names for all the structures, including locally defined ones
+	// BB (adrianb) Should we name locally defined ones specially to avoid name conflicts?
 
-			auto pAstret = PastCast<SAstReturn>(pAst);
+	for (auto pTypestruct : pWork->arypTypestruct)
+	{
+		auto pLtypeStruct = LLVMStructCreateNamed(pGenx->pLctx, pTypestruct->pChzName);
+		auto hv = HvFromKey(reinterpret_cast<u64>(pTypestruct));
+		Add(&pGenx->hashPtypestructPltype, hv, pTypestruct, pLtypeStruct);
+	}
 
-			LLVMOpaqueValue * pLvalRet = nullptr;
-			if (pAst->tid.pType->typek != TYPEK_Void)
-			{
-				ASSERT(pAstret->arypAstRet.c == 1);
-				pLvalRet = PlvalGenerateRecursive(pGenx, pAstret->arypAstRet[0]);
-			}
+	// Fill in all the structures
 
-			MarkScopeTerminated(pGenx);
-			EarlyReturnPopScopes(pGenx);
+	for (auto pTypestruct : pWork->arypTypestruct)
+	{
+		auto pLtypeStruct = PltypeLookupStruct(pGenx, pTypestruct);
 
-			// LLVMValueRef LLVMBuildAggregateRet(LLVMBuilderRef, LLVMValueRef *RetVals, unsigned N);
+		int cMember = pTypestruct->cMember;
+		auto apLtype = static_cast<LLVMOpaqueType **>(alloca(sizeof(LLVMOpaqueType *) * cMember));
 
-			if (pLvalRet == nullptr)
-			{
-				(void) LLVMBuildRetVoid(pLbuilder);
-			}
-			else
-			{
-				(void) LLVMBuildRet(pLbuilder, pLvalRet);
-			}
-            
-            return nullptr;
+		for (int iMember : IterCount(cMember))
+		{
+			auto pAstdecl = pTypestruct->aMember[iMember].pAstdecl;
+			apLtype[iMember] = PltypeGenerate(pGenx, pAstdecl->tid);
 		}
-		break;
 
-	case ASTK_DeclareSingle:
+		LLVMBool fPacked = false; // BB (adrianb) Care about packed?
+		LLVMStructSetBody(pLtypeStruct, apLtype, cMember, fPacked);
+	}
+
+	// Register globals, they are generated when first referenced (see PstorageLookup)
+
+	for (auto pModule : IterPointer(pWork->aryModule))
+	{
+		for (auto pAst : pModule->pAstblockRoot->arypAst)
 		{
-			auto pAstdecl = PastCast<SAstDeclareSingle>(pAst);
+			if (pAst->astk != ASTK_DeclareSingle)
+				continue;
 
+			// BB (adrianb) Keep storage for constants when they are things like strings or structs or whatnot? 
+			auto pAstdecl = PastCast<SAstDeclareSingle>(pAst);
 			if (pAstdecl->fIsConstant)
-				return nullptr;
+				continue;
 
-			// BB (adrianb) We need to do this in the entry block for all normal variables per
-			//  http://llvm.org/docs/Frontend/PerformanceTips.html#use-of-allocas
+			Add(&pGenx->setPastdeclGlobal, HvFromKey(reinterpret_cast<u64>(pAstdecl)), pAstdecl);
 
-			auto pLtype = PltypeGenerate(pGenx, pAstdecl->tid);
-			auto pLbuilderAlloc = pGenx->pLbuilderAlloc;
-			auto pLvalAddr = LLVMBuildAlloca(pLbuilderAlloc, pLtype, pAstdecl->pChzName);
+			// Cached procedures don't tell us which globals they use, so define all of them
 
-			// BB (adrianb) Struct/array initialization using a copy ala clang?
+			if (pGenx->fGlobalsOnly)
+				(void) PstorageLookup(pGenx, pAstdecl);
+		}
+	}
 
-			LLVMOpaqueValue * pLvalInitial;
-			if (pAstdecl->pAstValue)
-			{
-				// BB (adrianb) Anything special to do if this will evaluate to a constant?
+	int iProc = 0;
+	for (auto pModule : IterPointer(pWork->aryModule))
+	{
+		// Generate code for functions in this module
 
-				pLvalInitial = PlvalGenerateRecursive(pGenx, pAstdecl->pAstValue);
-			}
-			else
-			{
-				// BB (adrianb) Support ASTK_UninitializedValue. For complex structs run a function to initialize.
-				//  E.g. big structs, or with uninitialized members. Also could memcpy from a global like clang does
-				//  for C++ structs.
+		u64 nsModule = NsNow();
+		int cProcGenerated = 0;
+		for (auto pAstproc : pModule->arypAstprocGen)
+		{
+			if (iProc++ % pGenx->cPartition != pGenx->iPartition)
+				continue;
 
-				pLvalInitial = PlvalGenerateDefaultValue(pGenx, pAstdecl->tid, pLtype);
-			}
+			if (pGenx->fGlobalsOnly || (pGenx->pAstprocOnly && pAstproc != pGenx->pAstprocOnly))
+				continue;
 
-			// BB (adrianb) Return value? Or register it against this AST node?
-			
-			LLVMBuildStore(pLbuilder, pLvalInitial, pLvalAddr);
-			RegisterStorage(pGenx, pAstdecl, pLvalAddr);
+			u64 nsProc = NsNow();
+			(void) PlvalGenerateRecursive(pGenx, pAstproc);
+
+			Reset(pGenx);
+			AddTraceSpan(pWork, "generate", pAstproc->pChzLink, nsProc, pGenx->iThreadTrace);
+			++cProcGenerated;
 		}
-		break;
 
-#if 0
-	ASTK_DeclareMulti,
-	ASTK_AssignMulti,
-#endif
+		if (cProcGenerated > 0)
+			AddTraceSpan(pWork, "module", pModule->pChzFile, nsModule, pGenx->iThreadTrace);
+	}
 
-	// ASTK_Struct
-	// ASTK_Enum
+	// Just create one bitcode file named after the root file
+	// BB (adrianb) Is this ok for debugging?
 
-	case ASTK_Procedure:
+	{
+		char * pChzError = nullptr;
+		if (LLVMVerifyModule(pGenx->pLmod, LLVMReturnStatusAction, &pChzError))
 		{
-			auto pAstproc = PastCast<SAstProcedure>(pAst);
+			SStringBuilder strbLl = SStringBuilder("%s", PchzBaseName(PchzBuild(pWork)));
+			PatchExt(&strbLl, ".ll");
+			char * pChzErrWrite = nullptr;
+			LLVMPrintModuleToFile(pGenx->pLmod, strbLl.aChz, &pChzErrWrite);
+			ShowErrRaw("Found error in module %s:\n%s", strbLl.aChz, pChzError);
+		}
+		LLVMDisposeMessage(pChzError);
+	}
 
-			ASSERT(!pGenx->fInProcedure && pGenx->arypAstDefer.c == 0);
+	s64 cInstruction = 0;
+	for (auto pLvalFunc = LLVMGetFirstFunction(pGenx->pLmod); pLvalFunc; pLvalFunc = LLVMGetNextFunction(pLvalFunc))
+	{
+		for (auto pLblock = LLVMGetFirstBasicBlock(pLvalFunc); pLblock; pLblock = LLVMGetNextBasicBlock(pLblock))
+		{
+			for (auto pLval = LLVMGetFirstInstruction(pLblock); pLval; pLval = LLVMGetNextInstruction(pLval))
+				++cInstruction;
+		}
+	}
 
-			// Start basic block for the procedure
+	std::lock_guard<std::recursive_mutex> lock(*pWork->pMutex);
+	pWork->cLlvmInstruction += cInstruction;
+}
 
-			auto pLvalProc = PlvalEnsureProcedure(pGenx, pAstproc);
-			auto pLblockAlloca = LLVMAppendBasicBlockInContext(pGenx->pLctx, pLvalProc, "entry");
-			auto pLblockEntry = LLVMAppendBasicBlockInContext(pGenx->pLctx, pLvalProc, "entry");
-			
-			LLVMPositionBuilderAtEnd(pGenx->pLbuilderAlloc, pLblockAlloca);
-			LLVMPositionBuilderAtEnd(pLbuilder, pLblockEntry);
+void GenerateAllParallel(SGenerateCtx * aGenx, int cGenx)
+{
+	// Each context has its own llvm context and module, so all of them can generate at once. The result is
+	//  deterministic, procedures are assigned round robin in declaration order.
 
-			// Add storage for arguments
+	ASSERT(cGenx > 0);
+	auto pWork = aGenx[0].pWork;
+	AssignLinkNames(pWork);
 
-			// BB (adrianb) Varargs.
-			
-			for (u32 iArg : IterCount(LLVMCountParams(pLvalProc)))
-            {
-            	auto pAstdecl = PastCast<SAstDeclareSingle>(pAstproc->arypAstDeclArg[iArg]);
-            	auto pLvalPtr = LLVMBuildAlloca(pGenx->pLbuilderAlloc, PltypeGenerate(pGenx, pAstdecl->tid), pAstdecl->pChzName);
-			
-				LLVMBuildStore(pLbuilder, LLVMGetParam(pLvalProc, iArg), pLvalPtr);
-				RegisterStorage(pGenx, pAstdecl, pLvalPtr);
-            }
+	if (cGenx == 1)
+	{
+		GenerateAll(&aGenx[0]);
+		return;
+	}
 
-			// BB (adrianb) Need implicit return?			
+	auto aThread = new std::thread[cGenx - 1];
+	for (int iGenx = 1; iGenx < cGenx; ++iGenx)
+	{
+		ASSERT(aGenx[iGenx].iPartition == iGenx && aGenx[iGenx].cPartition == cGenx);
+		aThread[iGenx - 1] = std::thread(GenerateAll, &aGenx[iGenx]);
+	}
 
-			auto pAstblock = pAstproc->pAstblock;
-			if (pAstblock)
-			{
-				SScopeCtx scopectx = ScopectxPush(pGenx);
+	GenerateAll(&aGenx[0]);
 
-				(void) PlvalGenerateRecursive(pGenx, pAstblock);
+	for (int iThread : IterCount(cGenx - 1))
+	{
+		aThread[iThread].join();
+	}
+	delete [] aThread;
 
-				if (pAstblock->arypAst.c == 0 || Tail(&pAstblock->arypAst)->astk != ASTK_Return)
-				{
-					if (pAstproc->arypAstDeclRet.c != 0)
-					{
-						ShowErr(pAstproc->errinfo, "Procedure didn't return a value");
-					}
+	// Define globals that were only referenced from other partitions, in declaration order
 
-					PopScope(pGenx, scopectx);
+	for (auto pModule : IterPointer(pWork->aryModule))
+	{
+		for (auto pAst : pModule->pAstblockRoot->arypAst)
+		{
+			if (pAst->astk != ASTK_DeclareSingle)
+				continue;
 
-					LLVMBuildRetVoid(pLbuilder);
-				}
-				else
+			auto pAstdecl = PastCast<SAstDeclareSingle>(pAst);
+			auto hv = HvFromKey(reinterpret_cast<u64>(pAstdecl));
+			if (!PtLookupImpl(&aGenx[0].setPastdeclGlobal, hv, pAstdecl))
+				continue;
+
+			for (int iGenx = 1; iGenx < cGenx; ++iGenx)
+			{
+				if (PtLookupImpl(&aGenx[iGenx].hashPastdeclStorage, hv, pAstdecl))
 				{
-					// Assuming someone else has already returned and performed defer operations, 
-					//  just reset scopes here.
+					(void) PstorageLookup(&aGenx[0], pAstdecl);
+					break;
+				}
+			}
+		}
+	}
+}
 
-					// BB (adrianb) Code might be simpler if we did store return value.
+void OptimizeModule(SGenerateCtx * pGenx)
+{
+	// llvm's standard pipeline for the -O level, the same one clang runs
 
-					ASSERT(pGenx->aryScope.c == 1);
+	int nOptLevel = pGenx->pWork->nOptLevel;
+	if (nOptLevel == 0)
+		return;
 
-					pGenx->aryScope.c = 0;
-					pGenx->arypAstDefer.c = 0;
-				}
-			}
+	SStringBuilder strbPasses = SStringBuilder("default<O%d>", nOptLevel);
+	auto pLpbo = LLVMCreatePassBuilderOptions();
+	defer { LLVMDisposePassBuilderOptions(pLpbo); };
 
-			// Stitch alloc block to entry block
-			LLVMBuildBr(pGenx->pLbuilderAlloc, pLblockEntry);
+	if (LLVMErrorRef pLerr = LLVMRunPasses(pGenx->pLmod, strbPasses.aChz, pGenx->pLtm, pLpbo))
+	{
+		char * pChzError = LLVMGetErrorMessage(pLerr);
+		ShowErrRaw("Failed to optimize module: %s", pChzError);
+		LLVMDisposeErrorMessage(pChzError);
+	}
+}
 
-			pGenx->fInProcedure = false;
-		}
-		break;
+bool FEmitObject(SGenerateCtx * pGenx, const char * pChzFile)
+{
+	char * pChzError = nullptr;
+	if (LLVMTargetMachineEmitToFile(pGenx->pLtm, pGenx->pLmod, const_cast<char *>(pChzFile), LLVMObjectFile, 
+									&pChzError) != 0)
+	{
+		printf("Failed to write object file %s\n  %s\n", pChzFile, pChzError);
+		LLVMDisposeMessage(pChzError);
+		return false;
+	}
 
-	// ASTK_TypeDefinition
+	return true;
+}
 
-	// ASTK_TypePointer
-	// ASTK_TypeArray
-	// ASTK_TypeProcedure
-	// ASTK_TypePolymorphic
-	// ASTK_TypeVararg
+template <typename FN>
+void ForEachGenxParallel(SGenerateCtx * aGenx, int cGenx, FN fn)
+{
+	// Runs fn on every context on its own thread, contexts share no llvm state
+
+	auto aThread = new std::thread[cGenx - 1];
+	for (int iGenx = 1; iGenx < cGenx; ++iGenx)
+	{
+		aThread[iGenx - 1] = std::thread(fn, &aGenx[iGenx]);
+	}
+
+	fn(&aGenx[0]);
+
+	for (int iThread : IterCount(cGenx - 1))
+	{
+		aThread[iThread].join();
+	}
+	delete [] aThread;
+}
+
+void PrintToHash(u64 * pHv, const char * pChzFmt, va_list vargs)
+{
+	SStringBuilder strb;
+	PrintV(&strb, pChzFmt, vargs);
+	*pHv = HvAccum(*pHv, strb.aChz, strb.cCh);
+}
+
+u64 HvCodegenKey(SWorkspace * pWork, SAstProcedure * pAstproc)
+{
+	// Hash everything generating the procedure reads: syntax with resolved identifiers, types with struct layouts,
+	//  its link name and the compiler build, target and optimization level. Any change to those misses the cache.
+
+	static const char s_aChzCompiler[] = __DATE__ " " __TIME__;
+
+	u64 hv = s_nFNVOffsetBasis;
+	hv = HvAccum(hv, s_aChzCompiler, sizeof(s_aChzCompiler));
+	hv = HvAccum(hv, s_pChzTargetTriple, strlen(s_pChzTargetTriple));
+	hv = HvAccum(hv, pWork->nOptLevel);
+	hv = HvAccum(hv, pAstproc->pChzLink, strlen(pAstproc->pChzLink));
+	hv = HvAccum(hv, pAstproc->fIsInline);
+	hv = HvAccum(hv, pAstproc->fIsNoInline);
+	hv = HvAccum(hv, GrfArgReference(pAstproc));
+
+	SAstCtx acx = {};
+	InitPrint(&acx.print, PrintToHash, &hv);
+	acx.pWorkResolve = pWork;
+	defer { Destroy(&acx.arypTypestructPrinted); Destroy(&acx.arypAstprocPrinted); };
+
+	Append(&acx.arypAstprocPrinted, static_cast<const SAstProcedure *>(pAstproc));
+	PrintSchemeAst(&acx, pAstproc);
+
+	acx.fPrintedAnything = false;
+	acx.fPrintType = true;
+	acx.arypAstprocPrinted.c = 1;
+	PrintSchemeAst(&acx, pAstproc);
+
+	return hv;
+}
+
+struct SCodegenCacheMiss
+{
+	SAstProcedure * pAstproc;
+	const char * pChzObj;
+};
+
+void GenerateCacheMisses(SWorkspace * pWork, const SArray<SCodegenCacheMiss> * paryMiss, int iJob, int cJob)
+{
+	for (int iMiss = iJob; iMiss < paryMiss->c; iMiss += cJob)
+	{
+		const SCodegenCacheMiss & miss = (*paryMiss)[iMiss];
 
-	// ASTK_ImportDirective
+		SGenerateCtx genx = {};
+		Init(&genx, pWork);
+		defer { Destroy(&genx); };
 
-	case ASTK_RunDirective:
-		return PlvalGenerateConstant(pGenx, pAst);
+		genx.pAstprocOnly = miss.pAstproc;
+		genx.iThreadTrace = iJob;
+		GenerateAll(&genx);
+		OptimizeModule(&genx);
 
-	// ASTK_ForeignLibraryDirective
+		// Write then rename so an interrupted compile never leaves a truncated entry behind
 
-	default:
-		ASSERTCHZ(false, "Generate for astk %s(%d) NYI", PchzFromAstk(pAst->astk), pAst->astk);
-		break;
+		SStringBuilder strbTmp = SStringBuilder("%s.%d.tmp", miss.pChzObj, iJob);
+		if (!FEmitObject(&genx, strbTmp.aChz) || rename(strbTmp.aChz, miss.pChzObj) != 0)
+		{
+			ShowErrRaw("Failed to write cached object %s (err %d)", miss.pChzObj, errno);
+		}
 	}
-
-	return nullptr;
 }
 
-void GenerateAll(SGenerateCtx * pGenx)
+void EvictCache(const char * pChzDirCache)
 {
-	auto pWork = pGenx->pWork;
-	if (pWork->aryModule.c == 0)
-		return;
-
-	// Create names for all the structures, including locally defined ones
-	// BB (adrianb) Should we name locally defined ones specially to avoid name conflicts?
+	// Entries are touched when they're used, so delete ones nothing has used for a while. Only our own files (objects
+	//  and temporaries left by interrupted compiles) in case the directory is shared.
 
-	for (auto pTypestruct : pWork->arypTypestruct)
-	{
-		auto pLtypeStruct = LLVMStructCreateNamed(pGenx->pLctx, pTypestruct->pChzName);
-		auto hv = HvFromKey(reinterpret_cast<u64>(pTypestruct));
-		Add(&pGenx->hashPtypestructPltype, hv, pTypestruct, pLtypeStruct);
-	}
+	static const time_t s_cSecondKeep = 30 * 24 * 60 * 60;
 
-	// Fill in all the structures
+	DIR * pDir = opendir(pChzDirCache);
+	if (!pDir)
+		return;
 
-	for (auto pTypestruct : pWork->arypTypestruct)
+	time_t timeNow = time(nullptr);
+	while (struct dirent * pDirent = readdir(pDir))
 	{
-		auto pLtypeStruct = PltypeLookupStruct(pGenx, pTypestruct);
-
-		int cMember = pTypestruct->cMember;
-		auto apLtype = static_cast<LLVMOpaqueType **>(alloca(sizeof(LLVMOpaqueType *) * cMember));
+		int cCh = int(strlen(pDirent->d_name));
+		bool fObj = cCh > 2 && strcmp(pDirent->d_name + cCh - 2, ".o") == 0;
+		bool fTmp = cCh > 4 && strcmp(pDirent->d_name + cCh - 4, ".tmp") == 0;
+		if (!fObj && !fTmp)
+			continue;
 
-		for (int iMember : IterCount(cMember))
+		SStringBuilder strbFile = SStringBuilder("%s/%s", pChzDirCache, pDirent->d_name);
+		struct stat statFile;
+		if (stat(strbFile.aChz, &statFile) == 0 && timeNow - statFile.st_mtime > s_cSecondKeep)
 		{
-			auto pAstdecl = pTypestruct->aMember[iMember].pAstdecl;
-			apLtype[iMember] = PltypeGenerate(pGenx, pAstdecl->tid);
+			(void) unlink(strbFile.aChz);
 		}
+	}
 
-		LLVMBool fPacked = false; // BB (adrianb) Care about packed?
-		LLVMStructSetBody(pLtypeStruct, apLtype, cMember, fPacked);
+	closedir(pDir);
+}
+
+void GenerateCached(SGenerateCtx * pGenx, const char * pChzDirCache, int cJob, SArray<const char *> * parypChzObj)
+{
+	// Each procedure gets its own optimized object file in the cache directory named by HvCodegenKey, so unchanged
+	//  procedures are reused from earlier compiles and only the misses are generated, optimized and emitted (on cJob
+	//  threads, counted as generate time). pGenx only gets globals.
+	// BB (adrianb) Entries are separate modules, so llvm can't inline across them. Procedures marked inline are
+	//  generated in place by us and still inline. Emitting bitcode for a thin LTO link would fix the rest.
+
+	auto pWork = pGenx->pWork;
+	ASSERT(pGenx->cPartition == 1);
+	AssignLinkNames(pWork);
+
+	if (mkdir(pChzDirCache, 0755) != 0 && errno != EEXIST)
+	{
+		ShowErrRaw("Can't create cache directory '%s' (err %d)", pChzDirCache, errno);
 	}
 
-	// Register and initialize globals
-	// BB (adrianb) Do this on demand as they are used?
+	pGenx->fGlobalsOnly = true;
+	GenerateAll(pGenx);
+
+	SArray<SCodegenCacheMiss> aryMiss = {};
+	defer { Destroy(&aryMiss); };
 
 	for (auto pModule : IterPointer(pWork->aryModule))
 	{
-		for (auto pAst : pModule->pAstblockRoot->arypAst)
+		for (auto pAstproc : pModule->arypAstprocGen)
 		{
-			if (pAst->astk != ASTK_DeclareSingle)
+			// Foreign procedures have no body, they're declared wherever they're called
+
+			if (pAstproc->fIsForeign)
 				continue;
 
-			// BB (adrianb) Keep storage for constants when they are things like strings or structs or whatnot? 
-			auto pAstdecl = PastCast<SAstDeclareSingle>(pAst);
-			if (pAstdecl->fIsConstant)
+			u64 hv = HvCodegenKey(pWork, pAstproc);
+			SStringBuilder strbObj = SStringBuilder("%s/%s-%016llx.o", pChzDirCache, pAstproc->pChzLink, hv);
+			auto pChzObj = PchzCopy(pWork, strbObj.aChz, strbObj.cCh);
+			Append(parypChzObj, pChzObj);
+
+			// Touch hits so EvictCache keeps them
+
+			if (utimes(pChzObj, nullptr) == 0)
+			{
+				pWork->cCodegenCacheHit++;
 				continue;
+			}
 
-			// BB (adrianb) Need to generate unique name?
+			pWork->cCodegenCacheMiss++;
+			Append(&aryMiss, SCodegenCacheMiss{pAstproc, pChzObj});
+		}
+	}
 
-			auto pLtype = PltypeGenerate(pGenx, pAstdecl->tid);
-			auto pLvalGlobal = LLVMAddGlobal(pGenx->pLmod, pLtype, pAstdecl->pChzName);
-			RegisterStorage(pGenx, pAstdecl, pLvalGlobal);
+	cJob = max(1, min(cJob, aryMiss.c));
+	auto aThread = new std::thread[cJob - 1];
+	for (int iJob = 1; iJob < cJob; ++iJob)
+	{
+		aThread[iJob - 1] = std::thread(GenerateCacheMisses, pWork, &aryMiss, iJob, cJob);
+	}
+
+	GenerateCacheMisses(pWork, &aryMiss, 0, cJob);
+
+	for (int iThread : IterCount(cJob - 1))
+	{
+		aThread[iThread].join();
+	}
+	delete [] aThread;
 
-			// BB (adrianb) Need to generate unique name?
-			// BB (adrianb) Setup global storage so compile time code can modify?
-			// BB (adrianb) If marked as uninitialized just init to zero? Does that happen by default?
+	EvictCache(pChzDirCache);
+}
 
-			auto pV = alloca(CbSizeOf(pAstdecl->tid));
+float RPercent(int cPart, int cTotal)
+{
+	return (cTotal > 0) ? 100.0f * cPart / cTotal : 0.0f;
+}
 
-			if (pAstdecl->pAstValue)
-			{
-				EvalConst(pGenx->pWork, pAstdecl->pAstValue, pV);
-			}
-			else
-			{
-				EvalDefaultValue(pWork, pAstdecl->tid, static_cast<u8 *>(pV));
-			}
+s64 CKbPeakMemory()
+{
+	struct rusage rusage;
+	if (getrusage(RUSAGE_SELF, &rusage) != 0)
+		return 0;
+
+	// NOTE (adrianb) ru_maxrss is in bytes on OSX and kilobytes on linux.
 
-			// ValGenerateConstant either inline or memory for struct.
-			//  Then just need to marshal value into llvm.
-			//  #run just copies value to storage.
+#if PLATFORM_OSX
+	return s64(rusage.ru_maxrss) / 1024;
+#else
+	return s64(rusage.ru_maxrss);
+#endif
+}
 
-			// Marshall instance data into LLVM constant value
+void PrintStats(const SWorkspace * pWork)
+{
+	printf("Compile stats:\n");
 
+	u64 nsTotal = 0;
+	for (int phase : IterCount(PHASE_Max))
+	{
+		nsTotal += pWork->mpPhaseNs[phase];
+	}
 
-			LLVMSetInitializer(pLvalGlobal, PlvalConst(pGenx, pAstdecl->tid, pV));
+	printf("  Phase times:           %.2f ms total\n", nsTotal / 1e6);
+	for (int phase : IterCount(PHASE_Max))
+	{
+		u64 ns = pWork->mpPhaseNs[phase];
+		printf("    %-20s %8.2f ms (%.1f%%)\n", PchzFromPhase(PHASE(phase)), ns / 1e6, 
+				RPercent(int(ns / 1000), int(nsTotal / 1000)));
+	}
 
-			Reset(pGenx);
+	int cSpecproc = 0;
+	for (auto pSymt : pWork->arypSymtAll)
+	{
+		for (const auto & polyproc : pSymt->aryPolyproc)
+		{
+			cSpecproc += polyproc.arySpecproc.c;
 		}
 	}
 
-	for (auto pModule : IterPointer(pWork->aryModule))
+	printf("  Counts:                %d tokens, %d ast nodes, %d strings, %d types\n", 
+			pWork->cToken, pWork->arypAstAll.c, pWork->setpChz.c, pWork->setTid.c);
+	printf("                         %d symbol lookups, %d type check suspends, %d specializations\n", 
+			pWork->cSymbolLookup, pWork->cTypeCheckSuspend, cSpecproc);
+	printf("                         %lld llvm instructions\n", (long long) pWork->cLlvmInstruction);
+	printf("  Peak memory:           %lld KB\n", (long long) CKbPeakMemory());
+
+	int cEvalConst = pWork->cEvalConstHit + pWork->cEvalConstMiss;
+	printf("  Constant eval cache:   %d lookups, %d hits (%.1f%%), %d evaluated\n", 
+			cEvalConst, pWork->cEvalConstHit, RPercent(pWork->cEvalConstHit, cEvalConst), pWork->cEvalConstMiss);
+
+	if (pWork->cFoldConst > 0 || pWork->cFoldBranch > 0)
 	{
-		// Generate code for functions in this module
+		printf("  Constant folding:      %d expressions folded, %d dead branches removed\n", 
+				pWork->cFoldConst, pWork->cFoldBranch);
+	}
 
-		for (auto pAstproc : pModule->arypAstprocGen)
-		{
-			(void) PlvalGenerateRecursive(pGenx, pAstproc);
+	int cCodegenCache = pWork->cCodegenCacheHit + pWork->cCodegenCacheMiss;
+	if (cCodegenCache > 0)
+	{
+		printf("  Codegen cache:         %d procedures, %d hits (%.1f%%), %d generated\n",
+				cCodegenCache, pWork->cCodegenCacheHit, RPercent(pWork->cCodegenCacheHit, cCodegenCache), 
+				pWork->cCodegenCacheMiss);
+	}
 
-			Reset(pGenx);
-		}
+	if (pWork->cUsingResolve > 0)
+	{
+		printf("  Using resolution:      %d lookups, %d skipped (%.1f%%), %d scopes walked\n",
+				pWork->cUsingResolve, pWork->cUsingResolveSkip, RPercent(pWork->cUsingResolveSkip, pWork->cUsingResolve),
+				pWork->cUsingScopeVisit);
 	}
 
-	// Just create one bitcode file named after the root file
-	// BB (adrianb) Is this ok for debugging?
+	if (pWork->cOverloadLookup > 0)
+	{
+		printf("  Overload match cache:  %d lookups, %d hits (%.1f%%)\n",
+				pWork->cOverloadLookup, pWork->cOverloadHit, RPercent(pWork->cOverloadHit, pWork->cOverloadLookup));
+	}
 
+	if (pWork->cPolyLookup > 0 || pWork->cPolyCallMemoHit > 0)
 	{
-		char * pChzError = nullptr;
-		if (LLVMVerifyModule(pGenx->pLmod, LLVMReturnStatusAction, &pChzError))
+		int cPolyproc = 0;
+		const SPolymorphicProc * pPolyprocMost = nullptr;
+		for (auto pSymt : pWork->arypSymtAll)
 		{
-			SStringBuilder strbLl = SStringBuilder("%s", PchzBaseName(PchzBuild(pWork)));
-			PatchExt(&strbLl, ".ll");
-			char * pChzErrWrite = nullptr;
-			LLVMPrintModuleToFile(pGenx->pLmod, strbLl.aChz, &pChzErrWrite);
-			ShowErrRaw("Found error in module %s:\n%s", strbLl.aChz, pChzError);
+			for (const auto & polyproc : pSymt->aryPolyproc)
+			{
+				if (polyproc.arySpecproc.c == 0)
+					continue;
+
+				++cPolyproc;
+				if (!pPolyprocMost || polyproc.arySpecproc.c > pPolyprocMost->arySpecproc.c)
+					pPolyprocMost = &polyproc;
+			}
+		}
+
+		printf("  Polymorph cache:       %d lookups, %d hits (%.1f%%), %d call site repeats skipped\n",
+				pWork->cPolyLookup, pWork->cPolyHit, RPercent(pWork->cPolyHit, pWork->cPolyLookup), 
+				pWork->cPolyCallMemoHit);
+		if (pPolyprocMost)
+		{
+			printf("  Specializations:       %d across %d procedures, most %d (%s)\n", cSpecproc, cPolyproc,
+					pPolyprocMost->arySpecproc.c, pPolyprocMost->pAstdeclProcOrig->pChzName);
 		}
-		LLVMDisposeMessage(pChzError);
 	}
 }
 
@@ -11031,6 +16684,7 @@ void CompileAndCheckDeclaration(
 
 	ParseAll(&work);
 	TypeCheckAll(&work);
+	FoldConstants(&work);
 
 	SGenerateCtx genx = {};
 	Init(&genx, &work);
@@ -11077,6 +16731,76 @@ void CompileAndCheckDeclaration(
 	Destroy(&work);
 }
 
+void CompileAndCheckArgpass(
+	const char * pChzTestName, const char * pChzProc, const char * pChzCode, const char * pChzArgpass)
+{
+	// pChzArgpass is how each argument of pChzProc is passed when called directly, see ComputeAbiproc
+
+	SWorkspace work = {};
+	InitWorkspace(&work, GRFWINIT_None);
+
+	SModule * pModule = PtAppendNew(&work.aryModule);
+	pModule->pChzFile = PchzCopy(&work, pChzTestName, strlen(pChzTestName));
+	pModule->pChzContents = pChzCode;
+
+	ParseAll(&work);
+	TypeCheckAll(&work);
+	FoldConstants(&work);
+
+	SGenerateCtx genx = {};
+	Init(&genx, &work);
+	GenerateAll(&genx);
+
+	auto pResdecl = PresdeclLookup(&work.symtRoot, pChzProc, 0, {});
+	if (!pResdecl)
+	{
+		ShowErr(SErrorInfo{pChzTestName}, "Can't find declaration %s", pChzProc);
+	}
+
+	auto pAstproc = PastCast<SAstProcedure>(pResdecl->pDecl->pAstdecl->pAstValue);
+	auto pTypeproc = PtypeCast<STypeProcedure>(pAstproc->tid.pType);
+	SAbiProc abiproc = {};
+	ComputeAbiproc(&genx, pTypeproc, pTypeproc->aTidArg, pTypeproc->cTidArg, &abiproc, pAstproc);
+
+	SStringBuilder strb;
+	for (const SAbiValue & abival : abiproc.aryAbivalArg)
+	{
+		const char * pChz = "byval";
+		if (abival.abik == ABIK_Direct)
+		{
+			LLVMTypeKind ltypek = LLVMGetTypeKind(abival.pLtype);
+			pChz = (ltypek == LLVMStructTypeKind || ltypek == LLVMArrayTypeKind) ? "value" : "direct";
+		}
+		else if (abival.abik == ABIK_Coerce)
+		{
+			pChz = "coerce";
+		}
+		else if (abival.fCopiedByCallee)
+		{
+			pChz = "copied-reference";
+		}
+		else if (abival.fByReference)
+		{
+			pChz = "reference";
+		}
+
+		Print(&strb, (strb.cCh) ? " %s" : "%s", pChz);
+	}
+
+	if (strcmp(strb.aChz, pChzArgpass) != 0)
+	{
+		ShowErr(SErrorInfo{pChzTestName},
+				"Procedure %s arguments aren't passed as expected:\n"
+				" Expected \"%s\"\n"
+				" Found    \"%s\"",
+				pChzProc, pChzArgpass, strb.aChz);
+	}
+
+	Destroy(&abiproc);
+	Destroy(&genx);
+	Destroy(&work);
+}
+
 void RunUnitTests()
 {
 	// DWORD :: int; // int = type int
@@ -11131,6 +16855,12 @@ void RunUnitTests()
 		"(DeclareSingle var a infer-type (< 5 6.5))", 
 		"(DeclareSingle bool infer-type (< bool FloatLit FloatLit))");
 
+	CompileAndCheckDeclaration("cast-same", "a",
+		"b : int : 5;"
+		"a := cast(int) b;",
+		"(DeclareSingle var a infer-type (Cast 'int 'b))",
+		"(DeclareSingle s32 infer-type (Cast s32 (Type s32) s32))");
+
 	CompileAndCheckDeclaration("operator-struct", "a",
 		"S :: struct { a :: \"6.0\"; }"
 		"a :: S.a;",
@@ -11144,6 +16874,12 @@ void RunUnitTests()
 		"(DeclareSingle (Proc s32 -> s32) infer-type (Procedure (Proc s32 -> s32) (args (DeclareSingle s32 (Type s32))) "
 			"(returns (Type s32)) (Block void (+= void s32 IntLit) (Return s32 s32))))");
 	
+	CompileAndCheckDeclaration("operator-fold", "F",
+		"F :: () -> int { if 2 > 3 { return 1; } return 5 + 1028; }",
+		"(DeclareSingle const F infer-type (Procedure (returns 'int) (Block (EmptyStatement) (Return 0x409))))",
+		"(DeclareSingle (Proc -> s32) infer-type (Procedure (Proc -> s32) (returns (Type s32)) "
+			"(Block void (EmptyStatement void) (Return s32 IntLit))))");
+
 	CompileAndCheckDeclaration("operator-logand-precidence", "a",
 		"a := 5 != 10 && true;",
 		"(DeclareSingle var a infer-type (and (!= 0x5 0xa) true))", 
@@ -11161,6 +16897,243 @@ void RunUnitTests()
 		"(DeclareSingle var str infer-type \"hello string\")",
 		"(DeclareSingle string infer-type StringLit)");
 
+	CompileAndCheckDeclaration("builtin-shadow-array", "a",
+		"array_pop :: (n : int) -> int { return n; }"
+		"a := array_pop(5);",
+		"(DeclareSingle var a infer-type (Call 'array_pop 0x5))",
+		"(DeclareSingle s32 infer-type (Call s32 (Proc s32 -> s32) IntLit))");
+
+	CompileAndCheckDeclaration("builtin-shadow-vector", "a",
+		"vector_reduce_add :: (n : int) -> int { return n; }"
+		"a := vector_reduce_add(5);",
+		"(DeclareSingle var a infer-type (Call 'vector_reduce_add 0x5))",
+		"(DeclareSingle s32 infer-type (Call s32 (Proc s32 -> s32) IntLit))");
+
+	CompileAndCheckDeclaration("shift-literal-int", "a",
+		"a : int = 1 << 4;",
+		"(DeclareSingle var a 'int 0x10)",
+		"(DeclareSingle s32 (Type s32) IntLit)");
+
+	CompileAndCheckDeclaration("shift-literal-u8", "a",
+		"a : u8 = 1 << 3;",
+		"(DeclareSingle var a 'u8 0x8)",
+		"(DeclareSingle u8 (Type u8) IntLit)");
+
+	CompileAndCheckDeclaration("shift-literal-const", "a",
+		"FLAG :: 1 << 4;"
+		"x : int = 1;"
+		"a := x | FLAG;",
+		"(DeclareSingle var a infer-type (| 'x (Cast implicit 'FLAG)))",
+		"(DeclareSingle s32 infer-type (| s32 s32 (Cast s32 implicit s8)))");
+
+	CompileAndCheckDeclaration("shift-literal-u64", "E",
+		"E : u64 : 1 << 63;",
+		"(DeclareSingle const E 'u64 0x8000000000000000)",
+		"(DeclareSingle u64 (Type u64) IntLit)");
+
+	CompileAndCheckDeclaration("shift-typed-amount", "a",
+		"n : u8 = 3;"
+		"a := 1 << n;",
+		"(DeclareSingle var a infer-type (<< 0x1 (Cast implicit 'n)))",
+		"(DeclareSingle s64 infer-type (<< s64 IntLit (Cast s64 implicit u8)))");
+
+	CompileAndCheckDeclaration("operator-bitwise", "a",
+		"b : u8 = 0xf0;"
+		"a := (b & 0x3c) ^ ~b;",
+		"(DeclareSingle var a infer-type (^ (& 'b 0x3c) (~ 'b)))",
+		"(DeclareSingle u8 infer-type (^ u8 (& u8 u8 IntLit) (~ u8 u8)))");
+
+	CompileAndCheckDeclaration("context-user-declared", "F",
+		"Context :: struct { n : int; }"
+		"context : Context;"
+		"F :: () -> * int { context.n = 1; return new int; }",
+		"(DeclareSingle const F infer-type (Procedure (returns (TypePointer 'int)) "
+			"(Block (= (. 'context 'n) 0x1) (Return (New 'int)))))",
+		"(DeclareSingle (Proc -> (* s32)) infer-type (Procedure (Proc -> (* s32)) (returns (TypePointer (Type (* s32)) (Type s32))) "
+			"(Block void (= void (. s32 Context s32) IntLit) (Return (* s32) (New (* s32) (Type s32))))))");
+
+	CompileAndCheckDeclaration("context-import", "F",
+		"#import \"Context\"\n"
+		"F :: (pArena : * Arena) -> Allocator { return arena_allocator(pArena); }",
+		"(DeclareSingle const F infer-type (Procedure (args (DeclareSingle var pArena (TypePointer 'Arena))) "
+			"(returns 'Allocator) (Block (Return (Call 'arena_allocator 'pArena)))))",
+		"(DeclareSingle (Proc (* Arena) -> Allocator) infer-type (Procedure (Proc (* Arena) -> Allocator) "
+			"(args (DeclareSingle (* Arena) (TypePointer (Type (* Arena)) (Type Arena)))) (returns (Type Allocator)) "
+			"(Block void (Return Allocator (Call Allocator (Proc (* Arena) -> Allocator) (* Arena))))))");
+
+	// Memory arguments of procedures only called directly skip the byval copy, see ArgpassCompute
+
+	const char * pChzCodeArgpass = 
+		"Small :: struct { a : [8] int; }"
+		"Large :: struct { a : [32] int; }"
+		"Read :: (l : Large, n : int) -> int { return l.a[n]; }"
+		"Bump :: (l : Large) -> int { l.a[1] += 1; return l.a[1]; }"
+		"Offset :: (s : Small) -> Small { s.a[1] = 2; return s; }"
+		"Through :: (l : Large) -> int { return l.a[2]; }"
+		"F :: (l : Large, s : Small) -> int { "
+			"pfn := Through; s = Offset(s); return Read(l, 1) + Bump(l) + pfn(l) + s.a[1]; }";
+	CompileAndCheckArgpass("argpass-reference", "Read", pChzCodeArgpass, "reference direct");
+	CompileAndCheckArgpass("argpass-copied-reference", "Bump", pChzCodeArgpass, "copied-reference");
+	CompileAndCheckArgpass("argpass-value", "Offset", pChzCodeArgpass, "value");
+	CompileAndCheckArgpass("argpass-procedure-value", "Through", pChzCodeArgpass, "byval");
+
+	// References to something the callee can also change another way (a global or an addressed local) go through a
+	//  temporary unless the callee copies them anyway
+
+	const char * pChzCodeArgpassAlias = 
+		"Large :: struct { a : [32] int; }"
+		"g : Large;"
+		"Read :: (l : Large, pL : * Large) -> int { pL.a[0] = 1; g.a[0] = 2; return l.a[0]; }"
+		"Bump :: (l : Large, pL : * Large) -> int { pL.a[0] = 1; l.a[0] += 1; return l.a[0]; }"
+		"F :: () -> int { l : Large; return Read(g, *g) + Read(l, *l) + Bump(g, *g) + Bump(l, *l); }";
+	CompileAndCheckArgpass("argpass-alias-reference", "Read", pChzCodeArgpassAlias, "reference direct");
+	CompileAndCheckArgpass("argpass-alias-copied-reference", "Bump", pChzCodeArgpassAlias, "copied-reference direct");
+	CompileAndCheckDeclaration("argpass-alias", "F", pChzCodeArgpassAlias,
+		"(DeclareSingle const F infer-type (Procedure (returns 'int) (Block (DeclareSingle var l 'Large) "
+			"(Return (+ (+ (+ (Call 'Read 'g (* 'g)) (Call 'Read 'l (* 'l))) (Call 'Bump 'g (* 'g))) "
+			"(Call 'Bump 'l (* 'l)))))))",
+		"(DeclareSingle (Proc -> s32) infer-type (Procedure (Proc -> s32) (returns (Type s32)) "
+			"(Block void (DeclareSingle Large (Type Large)) (Return s32 (+ s32 (+ s32 (+ s32 "
+			"(Call s32 (Proc Large (* Large) -> s32) Large (* (* Large) Large)) "
+			"(Call s32 (Proc Large (* Large) -> s32) Large (* (* Large) Large))) "
+			"(Call s32 (Proc Large (* Large) -> s32) Large (* (* Large) Large))) "
+			"(Call s32 (Proc Large (* Large) -> s32) Large (* (* Large) Large)))))))");
+
+	// Overload sets bucket procedures by argument count and cache the best match for argument types
+
+	const char * pChzCodeOverload = 
+		"P :: (n : s8) -> s8 { return n; }"
+		"P :: (n : s64) -> s64 { return n; }"
+		"P :: (n : s64, m : s64) -> float { return 1.0; }"
+		"P :: (v : $T, m : s64, o : s64) -> T { return v; }"
+		"n8 : s8 = 1;"
+		"n64 : s64 = 2;"
+		"a := P(n8);"
+		"b := P(n64, n64);"
+		"c := P(n64) + P(n64);"
+		"d := P(n8, 3, 4);";
+	CompileAndCheckDeclaration("overload-arity-1", "a", pChzCodeOverload,
+		"(DeclareSingle var a infer-type (Call 'P 'n8))",
+		"(DeclareSingle s8 infer-type (Call s8 (Proc s8 -> s8) s8))");
+	CompileAndCheckDeclaration("overload-arity-2", "b", pChzCodeOverload,
+		"(DeclareSingle var b infer-type (Call 'P 'n64 'n64))",
+		"(DeclareSingle f32 infer-type (Call f32 (Proc s64 s64 -> f32) s64 s64))");
+	CompileAndCheckDeclaration("overload-cached", "c", pChzCodeOverload,
+		"(DeclareSingle var c infer-type (+ (Call 'P 'n64) (Call 'P 'n64)))",
+		"(DeclareSingle s64 infer-type (+ s64 (Call s64 (Proc s64 -> s64) s64) "
+			"(Call s64 (Proc s64 -> s64) s64)))");
+	CompileAndCheckDeclaration("overload-polymorphic", "d", pChzCodeOverload,
+		"(DeclareSingle var d infer-type (Call 'P 'n8 0x3 0x4))",
+		"(DeclareSingle s8 infer-type (Call s8 (Proc s8 s64 s64 -> s8) s8 IntLit IntLit))");
+
+	// No limit on candidates (there used to be 8)
+
+	CompileAndCheckDeclaration("overload-many", "a",
+		"A0 :: struct { n : int; }"
+		"A1 :: struct { n : int; }"
+		"A2 :: struct { n : int; }"
+		"A3 :: struct { n : int; }"
+		"A4 :: struct { n : int; }"
+		"A5 :: struct { n : int; }"
+		"A6 :: struct { n : int; }"
+		"A7 :: struct { n : int; }"
+		"A8 :: struct { n : int; }"
+		"A9 :: struct { n : int; }"
+		"Q :: (v : A0) -> int { return 0; }"
+		"Q :: (v : A1) -> int { return 1; }"
+		"Q :: (v : A2) -> int { return 2; }"
+		"Q :: (v : A3) -> int { return 3; }"
+		"Q :: (v : A4) -> int { return 4; }"
+		"Q :: (v : A5) -> int { return 5; }"
+		"Q :: (v : A6) -> int { return 6; }"
+		"Q :: (v : A7) -> int { return 7; }"
+		"Q :: (v : A8) -> int { return 8; }"
+		"Q :: (v : A9) -> int { return 9; }"
+		"x : A9;"
+		"a := Q(x);",
+		"(DeclareSingle var a infer-type (Call 'Q 'x))",
+		"(DeclareSingle s32 infer-type (Call s32 (Proc A9 -> s32) A9))");
+
+	// Declarations that need one declared later wait on it and resume when it finishes type checking, several may 
+	//  wait on the same one
+
+	const char * pChzCodeWaiters = 
+		"a := b + c;"
+		"b := c * 2;"
+		"c : s64 = D;"
+		"D :: E + 1;"
+		"E :: 5;"
+		"F :: (s : S) -> T { return s.t; }"
+		"S :: struct { t : T; u : T; }"
+		"T :: struct { n : s16; }"
+		"g := F(h).n;"
+		"h : S;";
+	CompileAndCheckDeclaration("waiters-chain", "a", pChzCodeWaiters,
+		"(DeclareSingle var a infer-type (+ 'b 'c))",
+		"(DeclareSingle s64 infer-type (+ s64 s64 s64))");
+	CompileAndCheckDeclaration("waiters-struct", "g", pChzCodeWaiters,
+		"(DeclareSingle var g infer-type (. (Call 'F 'h) 'n))",
+		"(DeclareSingle s16 infer-type (. s16 (Call T (Proc S -> T) S) s16))");
+
+	// Using imports members into a scope, lookups after a new using (in any scope) walk the parent scopes again
+
+	const char * pChzCodeUsing = 
+		"V :: struct { x : float; y : float; }"
+		"W :: struct { z : float; }"
+		"S :: struct { using v : V; w : W; }"
+		"O :: struct { using s : S; }"
+		"o : O;"
+		"a := o.x + o.y;"
+		"F :: () -> float { using v : V; n := x; using w : W; return n + y + z; }";
+	CompileAndCheckDeclaration("using-nested", "a", pChzCodeUsing,
+		"(DeclareSingle var a infer-type (+ (. 'o 'x) (. 'o 'y)))",
+		"(DeclareSingle f32 infer-type (+ f32 (. f32 O f32) (. f32 O f32)))");
+	CompileAndCheckDeclaration("using-local", "F", pChzCodeUsing,
+		"(DeclareSingle const F infer-type (Procedure (returns 'float) (Block (DeclareSingle var using v 'V) "
+			"(DeclareSingle var n infer-type 'x) (DeclareSingle var using w 'W) (Return (+ (+ 'n 'y) 'z)))))",
+		"(DeclareSingle (Proc -> f32) infer-type (Procedure (Proc -> f32) (returns (Type f32)) "
+			"(Block void (DeclareSingle V (Type V)) (DeclareSingle f32 infer-type f32) (DeclareSingle W (Type W)) "
+			"(Return f32 (+ f32 (+ f32 f32 f32) f32)))))");
+
+	// Vectors work elementwise with scalars splatting, comparisons give lane masks
+
+	const char * pChzCodeVector = 
+		"K : s32x4 : 3;"
+		"v : float4 = 1;"
+		"w : float4 = 2;"
+		"n : s32x4 = K * 2 + 1;"
+		"a := v * 2.0 + w;"
+		"b := v < w;"
+		"c := w.wzyx;"
+		"d := vector_select(b, v, w);"
+		"e := vector_shuffle(v, w, 0, 4, 1, 5);"
+		"f := vector_reduce_max(n);";
+	CompileAndCheckDeclaration("vector-arithmetic", "a", pChzCodeVector,
+		"(DeclareSingle var a infer-type (+ (* 'v (Cast implicit 2)) 'w))",
+		"(DeclareSingle (Vector 4 f32) infer-type (+ (Vector 4 f32) "
+			"(* (Vector 4 f32) (Vector 4 f32) (Cast (Vector 4 f32) implicit FloatLit)) (Vector 4 f32)))");
+	CompileAndCheckDeclaration("vector-compare", "b", pChzCodeVector,
+		"(DeclareSingle var b infer-type (< 'v 'w))",
+		"(DeclareSingle (Vector 4 s32) infer-type (< (Vector 4 s32) (Vector 4 f32) (Vector 4 f32)))");
+	CompileAndCheckDeclaration("vector-swizzle", "c", pChzCodeVector,
+		"(DeclareSingle var c infer-type (. 'w 'wzyx))",
+		"(DeclareSingle (Vector 4 f32) infer-type (. (Vector 4 f32) (Vector 4 f32) (Vector 4 f32)))");
+	CompileAndCheckDeclaration("vector-select", "d", pChzCodeVector,
+		"(DeclareSingle var d infer-type (Call 'vector_select 'b 'v 'w))",
+		"(DeclareSingle (Vector 4 f32) infer-type "
+			"(Call (Vector 4 f32) <no-type> (Vector 4 s32) (Vector 4 f32) (Vector 4 f32)))");
+	CompileAndCheckDeclaration("vector-shuffle", "e", pChzCodeVector,
+		"(DeclareSingle var e infer-type (Call 'vector_shuffle 'v 'w 0x0 0x4 0x1 0x5))",
+		"(DeclareSingle (Vector 4 f32) infer-type "
+			"(Call (Vector 4 f32) <no-type> (Vector 4 f32) (Vector 4 f32) IntLit IntLit IntLit IntLit))");
+	CompileAndCheckDeclaration("vector-reduce", "f", pChzCodeVector,
+		"(DeclareSingle var f infer-type (Call 'vector_reduce_max 'n))",
+		"(DeclareSingle s32 infer-type (Call s32 <no-type> (Vector 4 s32)))");
+	CompileAndCheckDeclaration("vector-splat", "n", pChzCodeVector,
+		"(DeclareSingle var n 's32x4 (+ (* 'K (Cast implicit 0x2)) (Cast implicit 0x1)))",
+		"(DeclareSingle (Vector 4 s32) (Type (Vector 4 s32)) (+ (Vector 4 s32) "
+			"(* (Vector 4 s32) (Vector 4 s32) (Cast (Vector 4 s32) implicit IntLit)) (Cast (Vector 4 s32) implicit IntLit)))");
+
 	// Add support:
 	// - Value result JIT
 
@@ -11174,6 +17147,51 @@ void RunUnitTests()
 	//  from workspace? E.g. page based arrays? Use global pointer for allocation?
 }
 
+void PrintJsonString(FILE * pFile, const char * pChz)
+{
+	fputc('"', pFile);
+	for (; *pChz; ++pChz)
+	{
+		char ch = *pChz;
+		if (ch == '"' || ch == '\\')
+			fprintf(pFile, "\\%c", ch);
+		else if (u8(ch) < 0x20)
+			fprintf(pFile, "\\u%04x", ch);
+		else
+			fputc(ch, pFile);
+	}
+	fputc('"', pFile);
+}
+
+void WriteTrace(const SWorkspace * pWork, const char * pChzFile)
+{
+	// Chrome trace event format (load with chrome://tracing or ui.perfetto.dev), one complete event per span with 
+	//  times in microseconds. Code generation threads get their own rows.
+
+	FILE * pFile = fopen(pChzFile, "w");
+	if (!pFile)
+	{
+		printf("Failed to write trace file %s\n", pChzFile);
+		return;
+	}
+
+	const STrace * pTrace = pWork->pTrace;
+	fprintf(pFile, "{\"traceEvents\":[\n");
+	for (int iTrspan : IterCount(pTrace->aryTrspan.c))
+	{
+		const STraceSpan & trspan = pTrace->aryTrspan[iTrspan];
+		fprintf(pFile, "{\"name\":");
+		PrintJsonString(pFile, trspan.pChzName);
+		fprintf(pFile, ",\"cat\":\"%s\",\"ph\":\"X\",\"ts\":%.3f,\"dur\":%.3f,\"pid\":1,\"tid\":%d}%s\n",
+				trspan.pChzCat, (trspan.nsStart - pTrace->nsStart) / 1e3, trspan.nsDuration / 1e3, trspan.iThread,
+				(iTrspan + 1 < pTrace->aryTrspan.c) ? "," : "");
+	}
+	fprintf(pFile, "],\"displayTimeUnit\":\"ms\"}\n");
+	fclose(pFile);
+
+	printf("Wrote trace %s\n", pChzFile);
+}
+
 void CrashHandler(int nSignal) 
 {
 	fprintf(stderr, "Crash: signal %d:\n", nSignal);
@@ -11195,6 +17213,11 @@ int main(int cpChzArg, const char * apChzArg[])
 	bool fTraceAst = false;
 	bool fTraceTypes = false;
 	bool fWriteBitcode = false;
+	bool fPrintStats = false;
+	const char * pChzFileTrace = nullptr;
+	int cJob = 1;
+	int nOptLevel = 2;
+	const char * pChzDirCache = nullptr;
 	int ipChz = 1;
 	for (; ipChz < cpChzArg; ++ipChz)
 	{
@@ -11219,6 +17242,39 @@ int main(int cpChzArg, const char * apChzArg[])
 		{
 			fWriteBitcode = true;
 		}
+		else if (strcmp(pChzArg, "--stats") == 0)
+		{
+			fPrintStats = true;
+		}
+		else if (pChzArg[1] == 'O' && pChzArg[2] >= '0' && pChzArg[2] <= '3' && pChzArg[3] == '\0')
+		{
+			nOptLevel = pChzArg[2] - '0';
+		}
+		else if (strcmp(pChzArg, "-j") == 0 || strcmp(pChzArg, "--jobs") == 0)
+		{
+			if (ipChz + 1 < cpChzArg)
+				cJob = atoi(apChzArg[++ipChz]);
+
+			if (cJob < 1)
+			{
+				printf("Invalid job count for %s, using 1.\n", pChzArg);
+				cJob = 1;
+			}
+		}
+		else if (strcmp(pChzArg, "--cache") == 0)
+		{
+			if (ipChz + 1 < cpChzArg)
+				pChzDirCache = apChzArg[++ipChz];
+			else
+				printf("Missing directory for %s, ignoring.\n", pChzArg);
+		}
+		else if (strcmp(pChzArg, "--trace") == 0)
+		{
+			if (ipChz + 1 < cpChzArg)
+				pChzFileTrace = apChzArg[++ipChz];
+			else
+				printf("Missing file for %s, ignoring.\n", pChzArg);
+		}
 		else
 		{
 			printf("Unknown option \"%s\", ignoring.\n", pChzArg);
@@ -11242,19 +17298,91 @@ int main(int cpChzArg, const char * apChzArg[])
 	SWorkspace work = {};
 	InitWorkspace(&work, FWINIT_IncludeBuiltinModule);
 	defer { Destroy(&work); };
+	work.nOptLevel = nOptLevel;
 
+	STrace trace = {};
+	trace.nsStart = NsNow();
+	defer { Destroy(&trace.aryTrspan); };
+	if (pChzFileTrace)
+		work.pTrace = &trace;
+
+	u64 nsPhase = NsNow();
 	AddModuleFile(&work, pChzFile);
 	ParseAll(&work);
+	EndPhase(&work, PHASE_Parse, nsPhase);
+
+	nsPhase = NsNow();
 	TypeCheckAll(&work);
+	EndPhase(&work, PHASE_TypeCheck, nsPhase);
 
-	SGenerateCtx genx = {};
-	Init(&genx, &work);
-	defer { Destroy(&genx); };
+	nsPhase = NsNow();
+	FoldConstants(&work);
+	EndPhase(&work, PHASE_Fold, nsPhase);
 
-	GenerateAll(&genx);
+	SArray<SGenerateCtx> aryGenx = {};
+	defer 
+	{ 
+		for (auto pGenx : IterPointer(aryGenx))
+			Destroy(pGenx);
+		Destroy(&aryGenx); 
+	};
+
+	// With a cache one module holds the globals and every procedure comes from its own cached object file
+
+	SArray<const char *> arypChzObjCached = {};
+	defer { Destroy(&arypChzObjCached); };
+
+	nsPhase = NsNow();
+	if (pChzDirCache)
+	{
+		Init(PtAppendNew(&aryGenx), &work);
+		GenerateCached(&aryGenx[0], pChzDirCache, cJob, &arypChzObjCached);
+	}
+	else
+	{
+		for (int iGenx : IterCount(cJob))
+		{
+			Init(PtAppendNew(&aryGenx), &work, iGenx, cJob);
+		}
+
+		GenerateAllParallel(aryGenx.a, aryGenx.c);
+	}
+	EndPhase(&work, PHASE_Generate, nsPhase);
+
+	nsPhase = NsNow();
+	ForEachGenxParallel(aryGenx.a, aryGenx.c, OptimizeModule);
+	EndPhase(&work, PHASE_Optimize, nsPhase);
+
+	// Write llvm assembly before emitting objects, which changes the module
+
+	if (fWriteBitcode)
+	{
+		// BB (adrianb) Full path management. Write to output directory?
+
+		for (auto pGenx : IterPointer(aryGenx))
+		{
+			SStringBuilder strbLl = SStringBuilder("%s", PchzBaseName(PchzBuild(&work)));
+			PatchExt(&strbLl, "");
+			if (aryGenx.c > 1)
+				Print(&strbLl, ".%d", pGenx->iPartition);
+			Print(&strbLl, ".ll");
+
+			char * pChzError = nullptr;
+			if (LLVMPrintModuleToFile(pGenx->pLmod, strbLl.aChz, &pChzError) == 0)
+			{
+				printf("Write out file %s\n", strbLl.aChz);
+			}
+			else	
+			{
+				printf("Failed writing out file %s\n  %s\n", strbLl.aChz, pChzError);
+			}
+			if (pChzError)
+				LLVMDisposeMessage(pChzError);
+		}
+	}
 
 	// Link result into an executable
-	//  Emit bitcode and link that into an exe with clang
+	//  Emit objects and link them into an exe with clang
 	// BB (adrianb) This is pretty bizarre. I wish there were a library linker to use to avoid file IO.
 	// BB (adrianb) Build actual path management.
 
@@ -11262,21 +17390,49 @@ int main(int cpChzArg, const char * apChzArg[])
 		// BB (adrianb) Less verbose way of building these using dtors? Also avoid stack craziness?
 		//  E.g. string builder class that can destruct itself?
 
-		SStringBuilder strbBc = SStringBuilder("%s", PchzBaseName(PchzBuild(&work))); //"output/";
-		PatchExt(&strbBc, ".bc");
+		SStringBuilder strbExe = SStringBuilder("%s", PchzBaseName(PchzBuild(&work))); //"output/";
+		PatchExt(&strbExe, "");
+
+		SStringBuilder strbCmd;
+		Print(&strbCmd, "clang -o %s", strbExe.aChz);
+
+		// One object file per partition when generating in parallel
+
+		auto PrintObjectFile = [&](SStringBuilder * pStrb, int iPartition)
+		{
+			Print(pStrb, "%s", strbExe.aChz);
+			if (aryGenx.c > 1)
+				Print(pStrb, ".%d", iPartition);
+			Print(pStrb, ".o");
+		};
+
+		nsPhase = NsNow();
+		auto afEmitted = static_cast<bool *>(alloca(sizeof(bool) * aryGenx.c));
+		ForEachGenxParallel(aryGenx.a, aryGenx.c, [&](SGenerateCtx * pGenx)
+		{
+			SStringBuilder strbObj;
+			PrintObjectFile(&strbObj, pGenx->iPartition);
+			afEmitted[pGenx->iPartition] = FEmitObject(pGenx, strbObj.aChz);
+		});
+		EndPhase(&work, PHASE_EmitObject, nsPhase);
 
-		ASSERT(genx.pLmod);
-		if (LLVMWriteBitcodeToFile(genx.pLmod, strbBc.aChz) != 0)
+		bool fEmittedAll = true;
+		for (int iGenx : IterCount(aryGenx.c))
 		{
-			printf("Failed to write bitcode file %s\n", strbBc.aChz);
+			SStringBuilder strbObj;
+			PrintObjectFile(&strbObj, iGenx);
+			Print(&strbCmd, " %s", strbObj.aChz);
+			fEmittedAll &= afEmitted[iGenx];
 		}
-		else
+
+		for (auto pChzObj : arypChzObjCached)
 		{
-			SStringBuilder strbExe = SStringBuilder("%s", strbBc.aChz);
-			PatchExt(&strbExe, "");
+			Print(&strbCmd, " %s", pChzObj);
+		}
 
-			SStringBuilder strbCmd;
-			Print(&strbCmd, "clang -o %s %s", strbExe.aChz, strbBc.aChz);
+		if (fEmittedAll)
+		{
+			nsPhase = NsNow();
 
 			printf("Running command: %s\n", strbCmd.aChz);
 
@@ -11284,7 +17440,7 @@ int main(int cpChzArg, const char * apChzArg[])
 
 			if (pFileCmdOut == nullptr)
 			{
-				printf("Couldn't link bitcode file %s into executable %s\n", strbBc.aChz, strbExe.aChz);
+				printf("Couldn't link bitcode into executable %s\n", strbExe.aChz);
 			}
 			else
 			{
@@ -11310,6 +17466,7 @@ int main(int cpChzArg, const char * apChzArg[])
 					printf("Compiled %s\n", strbExe.aChz);
 				}
 			}
+			EndPhase(&work, PHASE_Link, nsPhase);
 		}
 	}
 
@@ -11340,24 +17497,14 @@ int main(int cpChzArg, const char * apChzArg[])
 		}
 	}
 
-	if (fWriteBitcode && genx.pLmod)
+	if (fPrintStats)
 	{
-		// BB (adrianb) Full path management. Write to output directory?
-
-		SStringBuilder strbLl = SStringBuilder("%s", PchzBaseName(PchzBuild(&work)));
-		PatchExt(&strbLl, ".ll");
+		PrintStats(&work);
+	}
 
-		char * pChzError = nullptr;
-		if (LLVMPrintModuleToFile(genx.pLmod, strbLl.aChz, &pChzError) == 0)
-		{
-			printf("Write out file %s\n", strbLl.aChz);
-		}
-		else	
-		{
-			printf("Failed writing out file %s\n  %s\n", strbLl.aChz, pChzError);
-		}
-		if (pChzError)
-			LLVMDisposeMessage(pChzError);
+	if (pChzFileTrace)
+	{
+		WriteTrace(&work, pChzFileTrace);
 	}
 
 #if 0
@@ -11436,18 +17583,13 @@ int main(int cpChzArg, const char * apChzArg[])
 	- Add enums.
 	- General #run. Using tree evaluator and global memory allocations. Or byte code evaluation?
 	- Named parameters? Default values?
-	- Flesh out operators - bitwise operators
-	- Solve 1 << 9 giving bogus value? Could default int literals to s64? Or unsized s65?
 	- using with procedures, pointers, implicit this parameter.
-	- SOA support.
-	- Inlining.  In generation.
 	- Modify proc for polymorphic procedures.
 	- #bake, #bake_values with procedures?
 	- Polymorphic structs. With modify?
 	- Stuff from D: mixins, static if (esp mixins), lazy arguments (e.g. assert implementation)
 	- Stuff from Nim: inline iterator (for loop)
 	- Closures?
-	- implicit context
 	- Debugger GUI?
 	- Conditional compilation.
 
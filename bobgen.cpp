@@ -0,0 +1,441 @@
+/* Copyright (C) 2015 Adrian Bentley
+|
+| Permission is hereby granted, free of charge, to any person obtaining a copy of this software and associated
+| documentation files (the "Software"), to deal in the Software without restriction, including without limitation the
+| rights to use, copy, modify, merge, publish, distribute, sublicense, and sell copies of the Software, and to permit
+| persons to whom the Software is furnished to do so, subject to the following conditions:
+|
+| The above copyright notice and this permission notice shall be included in all copies or substantial portions of the
+| Software.
+|
+| THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE
+| WARRANTIES OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+| COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR
+| OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE. */
+
+// Generates synthetic .bob programs for measuring how compile time scales (see bench_compile.sh). Each workload
+//  stresses one part of the compiler and grows linearly with the count passed in, so anything worse than linear in
+//  the timings is the compiler's fault. Output is deterministic for a given seed.
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+
+typedef uint32_t u32;
+
+#define DIM(a) (int(sizeof(a)/sizeof(a[0])))
+
+struct SGen // tag = gen
+{
+	FILE * pFile;
+	const char * pChzFile;		// Root file, imported modules are written next to it
+	int c;						// Workload size
+	int cDepth;					// Nesting depth for expressions
+	u32 nRand;
+};
+
+int NRand(SGen * pGen, int nMax)
+{
+	// xorshift, good enough to vary operators and constants
+
+	pGen->nRand ^= pGen->nRand << 13;
+	pGen->nRand ^= pGen->nRand >> 17;
+	pGen->nRand ^= pGen->nRand << 5;
+	return int(pGen->nRand % u32(nMax));
+}
+
+void PrintHeader(SGen * pGen, const char * pChzWorkload)
+{
+	fprintf(pGen->pFile, "// Generated by bobgen: %s %d\n\n", pChzWorkload, pGen->c);
+	fprintf(pGen->pFile, "printf :: (format : * char, ..) -> int #foreign\n\n");
+}
+
+// procs: procedures calling the next one declared, so each call is a forward reference that suspends type checking
+
+void GenerateProcs(SGen * pGen)
+{
+	FILE * pFile = pGen->pFile;
+	PrintHeader(pGen, "procs");
+
+	for (int i = 0; i < pGen->c; ++i)
+	{
+		fprintf(pFile, "P%d :: (n : int) -> int {\n", i);
+		fprintf(pFile, "\tx := n * %d + %d\n", NRand(pGen, 9) + 1, i);
+		fprintf(pFile, "\tfor 0..%d { x = x ^ (cast(int) it << %d) }\n", NRand(pGen, 8) + 1, NRand(pGen, 4));
+		if (i + 1 < pGen->c)
+			fprintf(pFile, "\tif x < 0 { return P%d(x + 1) }\n", i + 1);
+		fprintf(pFile, "\treturn x\n}\n\n");
+	}
+
+	fprintf(pFile, "main :: () -> int {\n\tprintf(\"%%d\\n\", P0(1))\n\treturn 0\n}\n");
+}
+
+// expr: statements with expressions nested cDepth deep, 64 statements per procedure
+
+void PrintExpr(SGen * pGen, int cDepth)
+{
+	static const char * s_apChzOp[] = { "+", "-", "*", "&", "|", "^" };
+	static const char * s_apChzLeaf[] = { "a", "b", "x" };
+
+	if (cDepth == 0)
+	{
+		if (NRand(pGen, 4) == 0)
+			fprintf(pGen->pFile, "%d", NRand(pGen, 100) + 1);
+		else
+			fprintf(pGen->pFile, "%s", s_apChzLeaf[NRand(pGen, DIM(s_apChzLeaf))]);
+		return;
+	}
+
+	// Alternate which side nests so both left and right recursion get exercised
+
+	const char * pChzOp = s_apChzOp[NRand(pGen, DIM(s_apChzOp))];
+	fprintf(pGen->pFile, "(");
+	if (cDepth & 1)
+	{
+		PrintExpr(pGen, cDepth - 1);
+		fprintf(pGen->pFile, " %s ", pChzOp);
+		PrintExpr(pGen, 0);
+	}
+	else
+	{
+		PrintExpr(pGen, 0);
+		fprintf(pGen->pFile, " %s ", pChzOp);
+		PrintExpr(pGen, cDepth - 1);
+	}
+	fprintf(pGen->pFile, ")");
+}
+
+void GenerateExpr(SGen * pGen)
+{
+	FILE * pFile = pGen->pFile;
+	PrintHeader(pGen, "expr");
+
+	const int cStmtPerProc = 64;
+	int cProc = (pGen->c + cStmtPerProc - 1) / cStmtPerProc;
+	for (int iProc = 0; iProc < cProc; ++iProc)
+	{
+		fprintf(pFile, "E%d :: (a : s64, b : s64) -> s64 {\n\tx : s64 = a\n", iProc);
+		for (int iStmt = iProc * cStmtPerProc; iStmt < pGen->c && iStmt < (iProc + 1) * cStmtPerProc; ++iStmt)
+		{
+			fprintf(pFile, "\tx += ");
+			PrintExpr(pGen, pGen->cDepth);
+			fprintf(pFile, "\n");
+		}
+		fprintf(pFile, "\treturn x\n}\n\n");
+	}
+
+	fprintf(pFile, "main :: () -> int {\n\tx : s64 = 0\n");
+	for (int iProc = 0; iProc < cProc; ++iProc)
+	{
+		fprintf(pFile, "\tx += E%d(x, %d)\n", iProc, iProc);
+	}
+	fprintf(pFile, "\tprintf(\"%%lld\\n\", x)\n\treturn 0\n}\n");
+}
+
+// promote: arithmetic mixing every integer width with literals, 24 statements per procedure, so type checking is mostly
+//  operator promotion and coercion (bench_typecheck.bob is "promote 48")
+
+void PrintPromoteLeaf(SGen * pGen, bool fNarrow)
+{
+	// Narrow leaves skip f, since s32 with u32 promotes to s64
+
+	static const char * s_apChzLeaf[] = { "a", "b", "c", "d", "e", "y", "f" };
+
+	if (NRand(pGen, 4) == 0)
+		fprintf(pGen->pFile, "%d", NRand(pGen, 110) + 1);
+	else
+		fprintf(pGen->pFile, "%s", s_apChzLeaf[NRand(pGen, DIM(s_apChzLeaf) - fNarrow)]);
+}
+
+void GeneratePromote(SGen * pGen)
+{
+	static const char * s_apChzOp[] = { "+", "-", "*", "&", "|", "^" };
+
+	FILE * pFile = pGen->pFile;
+	PrintHeader(pGen, "promote");
+
+	const int cStmtPerProc = 24;
+	const int cLeafPerStmt = 6;
+	for (int i = 0; i < pGen->c; ++i)
+	{
+		fprintf(pFile, "Mix%d :: (a : s8, b : u8, c : s16, d : u16, e : s32, f : u32, g : s64) -> s64 {\n", i);
+		fprintf(pFile, "\tx : s64 = g\n\ty : s32 = e\n");
+		for (int iStmt = 0; iStmt < cStmtPerProc; ++iStmt)
+		{
+			// Every third statement narrows back to s32 so both directions get checked
+
+			if (iStmt % 3 == 2)
+			{
+				fprintf(pFile, "\ty = y ^ (");
+				PrintPromoteLeaf(pGen, true);
+				fprintf(pFile, " %s ", (NRand(pGen, 2)) ? "|" : "+");
+				PrintPromoteLeaf(pGen, true);
+				fprintf(pFile, ")\n");
+				continue;
+			}
+
+			fprintf(pFile, "\tx += ");
+			for (int iLeaf = 0; iLeaf < cLeafPerStmt; ++iLeaf)
+			{
+				if (iLeaf > 0)
+					fprintf(pFile, " %s ", s_apChzOp[NRand(pGen, DIM(s_apChzOp))]);
+				PrintPromoteLeaf(pGen, false);
+			}
+			fprintf(pFile, "\n");
+		}
+		fprintf(pFile, "\treturn x + y\n}\n\n");
+	}
+
+	// Arguments are literals, so keep each one in range of its parameter or the call won't match
+
+	fprintf(pFile, "main :: () -> int {\n\tx : s64 = 0\n");
+	for (int i = 0; i < pGen->c; ++i)
+	{
+		fprintf(pFile, "\tx += Mix%d(%d, %d, %d, %d, %d, %d, x)\n", i, i % 100, i % 200, i * 3 % 30000, i * 5 % 60000, 
+				i * 7 % 1000000, i * 11 % 1000000);
+	}
+	fprintf(pFile, "\tprintf(\"%%lld\\n\", x)\n\treturn 0\n}\n");
+}
+
+// structs: wide structs in chains of 8 linked by using, with procedures reading members through the whole chain
+
+void GenerateStructs(SGen * pGen)
+{
+	FILE * pFile = pGen->pFile;
+	PrintHeader(pGen, "structs");
+
+	const int cMember = 16;
+	const int cChain = 8;
+	for (int i = 0; i < pGen->c; ++i)
+	{
+		fprintf(pFile, "S%d :: struct {\n", i);
+		if (i % cChain != 0)
+			fprintf(pFile, "\tusing base%d : S%d\n", i, i - 1);
+		for (int iMember = 0; iMember < cMember; ++iMember)
+		{
+			fprintf(pFile, "\tf%d_%d : int = %d\n", i, iMember, iMember);
+		}
+		fprintf(pFile, "}\n\n");
+
+		int iRoot = i - i % cChain;
+		fprintf(pFile, "Sum%d :: (s : S%d) -> int {\n", i, i);
+		fprintf(pFile, "\treturn s.f%d_%d + s.f%d_%d + s.f%d_%d\n",
+				i, NRand(pGen, cMember), iRoot, NRand(pGen, cMember), (i + iRoot) / 2, NRand(pGen, cMember));
+		fprintf(pFile, "}\n\n");
+	}
+
+	fprintf(pFile, "main :: () -> int {\n\tn : int = 0\n");
+	for (int i = 0; i < pGen->c; ++i)
+	{
+		fprintf(pFile, "\tv%d : S%d\n\tn += Sum%d(v%d)\n", i, i, i, i);
+	}
+	fprintf(pFile, "\tprintf(\"%%d\\n\", n)\n\treturn 0\n}\n");
+}
+
+// overloads: one name overloaded on argument type and count, called once per overload
+
+void GenerateOverloads(SGen * pGen)
+{
+	FILE * pFile = pGen->pFile;
+	PrintHeader(pGen, "overloads");
+
+	for (int i = 0; i < pGen->c; ++i)
+	{
+		fprintf(pFile, "O%d :: struct { n : int = %d }\n", i, i);
+	}
+	fprintf(pFile, "\n");
+
+	for (int i = 0; i < pGen->c; ++i)
+	{
+		int cArgExtra = i % 3;
+		fprintf(pFile, "Over :: (o : O%d", i);
+		for (int iArg = 0; iArg < cArgExtra; ++iArg)
+		{
+			fprintf(pFile, ", n%d : int", iArg);
+		}
+		fprintf(pFile, ") -> int { return o.n + %d }\n", cArgExtra);
+	}
+
+	fprintf(pFile, "\nmain :: () -> int {\n\tn : int = 0\n");
+	for (int i = 0; i < pGen->c; ++i)
+	{
+		fprintf(pFile, "\to%d : O%d\n\tn += Over(o%d", i, i, i);
+		for (int iArg = 0; iArg < i % 3; ++iArg)
+		{
+			fprintf(pFile, ", %d", iArg);
+		}
+		fprintf(pFile, ")\n");
+	}
+	fprintf(pFile, "\tprintf(\"%%d\\n\", n)\n\treturn 0\n}\n");
+}
+
+// poly: a polymorphic procedure specialized once per struct type, each specialization called from two places
+
+void GeneratePoly(SGen * pGen)
+{
+	FILE * pFile = pGen->pFile;
+	PrintHeader(pGen, "poly");
+
+	fprintf(pFile, "Pick :: (a : $T, b : T, f : bool) -> T {\n\tif f { return a }\n\treturn b\n}\n\n");
+	for (int i = 0; i < pGen->c; ++i)
+	{
+		fprintf(pFile, "T%d :: struct { n : int = %d }\n", i, i);
+	}
+
+	fprintf(pFile, "\nmain :: () -> int {\n\tn : int = 0\n");
+	for (int i = 0; i < pGen->c; ++i)
+	{
+		fprintf(pFile, "\ta%d : T%d\n\tb%d : T%d\n", i, i, i, i);
+		fprintf(pFile, "\tn += Pick(a%d, b%d, true).n + Pick(b%d, a%d, false).n\n", i, i, i, i);
+	}
+	fprintf(pFile, "\tprintf(\"%%d\\n\", n)\n\treturn 0\n}\n");
+}
+
+// imports: one module per count with a struct and a few procedures, all imported by the root file
+
+void GenerateImports(SGen * pGen)
+{
+	// Modules are named after the root file (minus .bob) so several workloads can share a directory
+
+	const char * pChzBase = strrchr(pGen->pChzFile, '/');
+	pChzBase = (pChzBase) ? pChzBase + 1 : pGen->pChzFile;
+	int cChBase = int(strlen(pGen->pChzFile));
+	if (cChBase > 4 && strcmp(pGen->pChzFile + cChBase - 4, ".bob") == 0)
+		cChBase -= 4;
+	int cChDir = int(pChzBase - pGen->pChzFile);
+	int cChName = cChBase - cChDir;
+
+	FILE * pFile = pGen->pFile;
+	PrintHeader(pGen, "imports");
+
+	for (int i = 0; i < pGen->c; ++i)
+	{
+		char aChzModule[1024];
+		snprintf(aChzModule, DIM(aChzModule), "%.*s_m%d.bob", cChBase, pGen->pChzFile, i);
+		FILE * pFileModule = fopen(aChzModule, "w");
+		if (!pFileModule)
+		{
+			fprintf(stderr, "Can't write %s\n", aChzModule);
+			exit(1);
+		}
+
+		fprintf(pFileModule, "// Generated by bobgen: imports %d, module %d\n\n", pGen->c, i);
+		fprintf(pFileModule, "M%d :: struct { a : int = %d\n\tb : float = %d }\n\n", i, i, NRand(pGen, 100));
+		fprintf(pFileModule, "Init%d :: (m : * M%d) { m.a = %d }\n", i, i, NRand(pGen, 100));
+		fprintf(pFileModule, "Get%d :: (m : M%d) -> int { return m.a + cast(int) m.b }\n", i, i);
+		fprintf(pFileModule, "Run%d :: (n : int) -> int {\n\tm : M%d\n\tInit%d(*m)\n\treturn Get%d(m) + n\n}\n",
+				i, i, i, i);
+		fclose(pFileModule);
+
+		fprintf(pFile, "#import \"%.*s_m%d.bob\"\n", cChName, pChzBase, i);
+	}
+
+	fprintf(pFile, "\nmain :: () -> int {\n\tn : int = 0\n");
+	for (int i = 0; i < pGen->c; ++i)
+	{
+		fprintf(pFile, "\tn = Run%d(n)\n", i);
+	}
+	fprintf(pFile, "\tprintf(\"%%d\\n\", n)\n\treturn 0\n}\n");
+}
+
+struct SWorkload
+{
+	const char * pChzName;
+	void (*pfnGenerate)(SGen * pGen);
+	const char * pChzDesc;
+};
+
+static const SWorkload s_aWorkload[] =
+{
+	{ "procs", GenerateProcs, "N procedures, each calling the next (forward references)" },
+	{ "expr", GenerateExpr, "N statements with expressions nested -d deep" },
+	{ "promote", GeneratePromote, "N procedures of mixed width integer arithmetic" },
+	{ "structs", GenerateStructs, "N structs of 16 members chained 8 deep with using" },
+	{ "overloads", GenerateOverloads, "N overloads of one procedure" },
+	{ "poly", GeneratePoly, "N specializations of one polymorphic procedure" },
+	{ "imports", GenerateImports, "N imported modules" },
+};
+
+void ShowHelp()
+{
+	printf(
+		"Syntax:\n"
+		"bobgen [options] workload count output.bob\n"
+		"\n"
+		"Options:\n"
+		"  --depth,-d N            Expression nesting depth for expr (default 32)\n"
+		"  --seed N                Random seed (default 1)\n"
+		"\n"
+		"Workloads:\n");
+
+	for (const SWorkload & workload : s_aWorkload)
+	{
+		printf("  %-23s %s\n", workload.pChzName, workload.pChzDesc);
+	}
+}
+
+int main(int cpChzArg, const char * apChzArg[])
+{
+	SGen gen = {};
+	gen.cDepth = 32;
+	gen.nRand = 1;
+
+	int ipChz = 1;
+	for (; ipChz < cpChzArg; ++ipChz)
+	{
+		const char * pChzArg = apChzArg[ipChz];
+		if (pChzArg[0] != '-')
+			break;
+
+		if ((strcmp(pChzArg, "-d") == 0 || strcmp(pChzArg, "--depth") == 0) && ipChz + 1 < cpChzArg)
+		{
+			gen.cDepth = atoi(apChzArg[++ipChz]);
+		}
+		else if (strcmp(pChzArg, "--seed") == 0 && ipChz + 1 < cpChzArg)
+		{
+			gen.nRand = u32(atoi(apChzArg[++ipChz]));
+			if (gen.nRand == 0)
+				gen.nRand = 1;
+		}
+		else
+		{
+			printf("Unknown option \"%s\", ignoring.\n", pChzArg);
+		}
+	}
+
+	if (cpChzArg - ipChz != 3)
+	{
+		ShowHelp();
+		return -1;
+	}
+
+	const char * pChzWorkload = apChzArg[ipChz];
+	gen.c = atoi(apChzArg[ipChz + 1]);
+	gen.pChzFile = apChzArg[ipChz + 2];
+
+	const SWorkload * pWorkload = nullptr;
+	for (const SWorkload & workload : s_aWorkload)
+	{
+		if (strcmp(workload.pChzName, pChzWorkload) == 0)
+			pWorkload = &workload;
+	}
+
+	if (!pWorkload || gen.c < 1 || gen.cDepth < 0)
+	{
+		printf("Unknown workload \"%s\" or bad count.\n", pChzWorkload);
+		ShowHelp();
+		return -1;
+	}
+
+	gen.pFile = fopen(gen.pChzFile, "w");
+	if (!gen.pFile)
+	{
+		printf("Can't write %s\n", gen.pChzFile);
+		return -1;
+	}
+
+	pWorkload->pfnGenerate(&gen);
+	fclose(gen.pFile);
+	return 0;
+}
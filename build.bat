@@ -7,5 +7,6 @@ if not exist build mkdir -p build
 pushd build
 
 cl %COMPILER_OPTIONS% -Fmmain.map %BASE_DIR%\bob.cpp ..\..\extern\llvm\MinSizeRel\lib\LLVMAnalysis.lib /link -opt:ref
+cl %COMPILER_OPTIONS% -D_CRT_SECURE_NO_WARNINGS %BASE_DIR%\bobgen.cpp
 
 popd
\ No newline at end of file